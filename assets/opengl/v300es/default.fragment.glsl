@@ -4,6 +4,14 @@ varying vec2 TexCoord;
 // texture sampler
 uniform sampler2D glbuffer;
 
+// indexed mode: glbuffer holds palette indexes
+uniform sampler2D glpalette;
+uniform bool indexed;
+
 void main() {
-	gl_FragColor = texture2D(glbuffer, TexCoord);
+	if (indexed) {
+		float index = texture2D(glbuffer, TexCoord).r * 255.0;
+		gl_FragColor = texture2D(glpalette, vec2((index + 0.5) / 256.0, 0.5));
+	} else
+		gl_FragColor = texture2D(glbuffer, TexCoord);
 }
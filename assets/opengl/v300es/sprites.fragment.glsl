@@ -1,8 +1,8 @@
 varying vec2 TexCoords;
 
 uniform sampler2D sampler;
-uniform vec4 iSpriteDef;		// sprite info: index,
-uniform vec4 iSpriteFx;			// fx: tint_rgb, tintMode
+varying vec4 iSpriteDef;		// sprite info: index, height, numx, numy
+varying vec4 iSpriteFx;			// fx: tint_rgb, tintMode
 uniform vec4 iSpriteSheet;		// spritesheet metrics: w,h,numx,numy
 uniform vec4 iColorKey;			// chroma key
 
@@ -1,12 +1,35 @@
 attribute vec4 vertex; // <vec2 position, vec2 texCoords>
 
+// per sprite (SpriteMeta_t): x, y, scale, rotation / index, height, numx, numy / tint / raw
+attribute vec4 spritePos;
+attribute vec4 spriteDef;
+attribute vec4 spriteFx;
+attribute vec4 spriteRaw;
+
 varying vec2 TexCoords;
+varying vec4 iSpriteDef;
+varying vec4 iSpriteFx;
 
-uniform mat4 model;
 uniform mat4 projection;
+uniform vec2 iSpriteSize;		// base sprite size in pixels
 
 void main()
 {
 	TexCoords = vertex.zw;
-	gl_Position = projection * model * vec4(vertex.xy, 0.0, 1.0);
+	iSpriteDef = spriteDef;
+	iSpriteFx = spriteFx;
+
+	// hidden sprites fall outside the clip volume
+	if (spriteDef.x == -1.) {
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		return;
+	}
+
+	vec2 size = iSpriteSize * spritePos.z * spriteDef.zw;
+
+	// rotates around the center
+	float c = cos(spritePos.w), s = sin(spritePos.w);
+	vec2 position = spritePos.xy + mat2(c, s, -s, c) * ((vertex.xy - 0.5) * size);
+
+	gl_Position = projection * vec4(position, 0.0, 1.0);
 }
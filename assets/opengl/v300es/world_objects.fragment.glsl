@@ -2,6 +2,7 @@ varying vec2 TexCoords;
 varying vec3 surfaceNormal;
 varying vec3 toLightVector;
 varying vec3 toCameraVector;
+varying vec4 tintMode;
 
 
 // out vec4 color;
@@ -45,6 +46,9 @@ void main()
 	gl_FragColor =  vec4(diffuse,1.0) * fincolor + vec4(finalSpecular,1.0);
 	gl_FragColor =  fincolor; // vec4(diffuse,1.0) * fincolor + vec4(finalSpecular,1.0);
 
+	// tinted objects (ie. selected)
+	if (tintMode.w == 1.) gl_FragColor *= tintMode;
+
 	
 	
 //	color = fincolor;
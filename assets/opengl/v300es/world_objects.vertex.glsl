@@ -2,13 +2,17 @@ attribute vec3 aPos;
 attribute vec3 normal;
 attribute vec2 aTexCoord;
 
+// per instance (ObjectCluster)
+attribute mat4 instanceTransform;
+attribute vec4 instanceTint;
+
 varying vec2 TexCoords;
 
 varying vec3 surfaceNormal;
 varying vec3 toLightVector;
 varying vec3 toCameraVector;
+varying vec4 tintMode;
 
-uniform mat4 transformationMatrix;
 uniform mat4 projectionMatrix;
 uniform mat4 viewMatrix;
 uniform mat4 invViewMatrix;
@@ -18,16 +22,18 @@ uniform vec3 lightPosition;
 void main()
 {
 	
-	vec4 worldPosition = transformationMatrix * vec4(aPos,1.0);
+	vec4 worldPosition = instanceTransform * vec4(aPos,1.0);
 //	worldPosition = vec4(worldPosition.x, -worldPosition.z, worldPosition.y, 1.0);
-//	vec3 surfaceNormal = (transformationMatrix * vec4(normal,0.0)).xyz;
+//	vec3 surfaceNormal = (instanceTransform * vec4(normal,0.0)).xyz;
 
-	vec3 anormal = (transformationMatrix * vec4(normal,0.0)).xyz;
+	vec3 anormal = (instanceTransform * vec4(normal,0.0)).xyz;
     surfaceNormal = 0.5 * ( anormal + vec3( 1. ) );
 
 	toLightVector = lightPosition - worldPosition.xyz;
 	toCameraVector = (invViewMatrix * vec4(0.0,0.0,0.0,1.0)).xyz - worldPosition.xyz;
 
+	tintMode = instanceTint;
+
 	TexCoords = vec2(aTexCoord.x, 1.-aTexCoord.y);
 	
 	gl_Position = projectionMatrix * viewMatrix * worldPosition;
@@ -8,6 +8,14 @@ in vec2 TexCoord;
 // texture sampler
 uniform sampler2D glbuffer;
 
+// indexed mode: glbuffer holds palette indexes
+uniform sampler2D glpalette;
+uniform bool indexed;
+
 void main() {
-	FragColor = texture(glbuffer, TexCoord);
+	if (indexed) {
+		float index = texture(glbuffer, TexCoord).r * 255.0;
+		FragColor = texture(glpalette, vec2((index + 0.5) / 256.0, 0.5));
+	} else
+		FragColor = texture(glbuffer, TexCoord);
 }
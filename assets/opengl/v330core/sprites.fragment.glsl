@@ -4,8 +4,8 @@ out vec4 color;
 
 uniform sampler2D sampler;
 uniform vec4 iMapSize;
-uniform vec4 iSpriteDef;		// sprite info: index,
-uniform vec4 iSpriteFx;			// fx: tint_rgb, tintMode
+flat in vec4 iSpriteDef;		// sprite info: index, height, numx, numy
+flat in vec4 iSpriteFx;			// fx: tint_rgb, tintMode
 uniform vec4 iSpriteSheet;		// spritesheet metrics: w,h,numx,numy
 uniform vec4 iColorKey;			// chroma key
 
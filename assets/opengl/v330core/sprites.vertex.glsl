@@ -1,13 +1,36 @@
 #version 330 core
 layout (location = 0) in vec4 vertex; // <vec2 position, vec2 texCoords>
 
+// per sprite (SpriteMeta_t): x, y, scale, rotation / index, height, numx, numy / tint / raw
+layout (location = 1) in vec4 spritePos;
+layout (location = 2) in vec4 spriteDef;
+layout (location = 3) in vec4 spriteFx;
+layout (location = 4) in vec4 spriteRaw;
+
 out vec2 TexCoords;
+flat out vec4 iSpriteDef;
+flat out vec4 iSpriteFx;
 
-uniform mat4 model;
 uniform mat4 projection;
+uniform vec2 iSpriteSize;		// base sprite size in pixels
 
 void main()
 {
 	TexCoords = vertex.zw;
-	gl_Position = projection * model * vec4(vertex.xy, 0.0, 1.0);
+	iSpriteDef = spriteDef;
+	iSpriteFx = spriteFx;
+
+	// hidden sprites fall outside the clip volume
+	if (spriteDef.x == -1.) {
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		return;
+	}
+
+	vec2 size = iSpriteSize * spritePos.z * spriteDef.zw;
+
+	// rotates around the center
+	float c = cos(spritePos.w), s = sin(spritePos.w);
+	vec2 position = spritePos.xy + mat2(c, s, -s, c) * ((vertex.xy - 0.5) * size);
+
+	gl_Position = projection * vec4(position, 0.0, 1.0);
 }
@@ -0,0 +1,45 @@
+#version 330 core
+in vec2 TexCoords;
+out vec4 color;
+
+uniform sampler2D sampler;
+flat in vec4 iSpriteFx;			// fx: tint_rgb, tintMode
+flat in vec4 iSpriteKey;		// chroma key of the sheet
+
+// cnvert YUV<>RGB
+vec4 yuv(vec4 rgb) {
+    float Y = 0.2989 * rgb.r + 0.5866 * rgb.g + 0.1145 * rgb.b;
+    float Cr = 0.492 * (rgb.r - Y);
+    float Cb = 0.877 * (rgb.b - Y);
+    return vec4(Y,Cb,Cr,rgb.w);
+}
+
+void main()
+{
+	// coords in the atlas
+	vec2 coords = TexCoords;
+
+	// sample the sprite pixel
+	vec4 fincolor = texture(sampler, coords);
+
+	if (fincolor.w > 0.) {
+
+		// non-transparent point in the sprite
+		if (iSpriteFx.w == 1.) {
+			// tinting is enabled in chroma mode
+			vec4 yuvColorKey = yuv(iSpriteKey);
+			vec2 ckey=vec2(yuvColorKey.y, yuvColorKey.z);
+			vec4 co = yuv(fincolor);
+			if (distance(ckey, vec2(co.y, co.z)) < iSpriteKey.w) {
+				// tint the sprite to the new color computing the new shade
+				fincolor = vec4( (fincolor.xyz - iSpriteKey.xyz) + iSpriteFx.xyz * 0.8, fincolor.w);
+			}
+		} else if (iSpriteFx.w == 2.) {
+			// tinting is enabled, full mode
+			fincolor = vec4( fincolor.xyz + iSpriteFx.xyz * 0.8, fincolor.w);
+		} // else tinting is not enabled and the color read is the final color
+		
+	} else fincolor = vec4(0,0,0,0);
+
+	color = fincolor;
+}
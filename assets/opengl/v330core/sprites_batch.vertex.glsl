@@ -0,0 +1,30 @@
+#version 330 core
+layout (location = 0) in vec4 vertex; // <vec2 position, vec2 texCoords>
+
+// per sprite (BatchInstance_t): x, y, scale, rotation / size in px, sheet / tint / rectangle in the atlas
+layout (location = 1) in vec4 spritePos;
+layout (location = 2) in vec4 spriteSize;
+layout (location = 3) in vec4 spriteFx;
+layout (location = 4) in vec4 spriteCell;
+
+out vec2 TexCoords;
+flat out vec4 iSpriteFx;
+flat out vec4 iSpriteKey;		// chroma key of its sheet
+
+uniform mat4 projection;
+uniform vec4 iColorKeys[16];	// chroma key of each sheet (SpriteBatch::MAXSHEETS)
+
+void main()
+{
+	TexCoords = spriteCell.xy + vertex.zw * spriteCell.zw;
+	iSpriteFx = spriteFx;
+	iSpriteKey = iColorKeys[int(spriteSize.z)];
+
+	vec2 size = spriteSize.xy * spritePos.z;
+
+	// rotates around the center
+	float c = cos(spritePos.w), s = sin(spritePos.w);
+	vec2 position = spritePos.xy + mat2(c, s, -s, c) * ((vertex.xy - 0.5) * size);
+
+	gl_Position = projection * vec4(position, 0.0, 1.0);
+}
@@ -11,11 +11,15 @@ out vec3 toLightVector;
 out vec3 toCameraVector;
 
 uniform mat4 transformationMatrix;
-uniform mat4 projectionMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 invViewMatrix;
 
-uniform vec3 lightPosition;
+// per-frame data shared by the world shaders (WorldUniforms.hpp)
+layout (std140) uniform WorldFrame {
+	mat4 projectionMatrix;
+	mat4 viewMatrix;
+	mat4 invViewMatrix;
+	vec4 lightPosition;
+	vec4 lightColour;
+};
 
 void main()
 {
@@ -23,7 +27,7 @@ void main()
 	vec4 worldPosition = transformationMatrix * vec4(aPos,1.0);
 
 	surfaceNormal = (transformationMatrix * vec4(normal,0.0)).xyz;
-	toLightVector = lightPosition - worldPosition.xyz;
+	toLightVector = lightPosition.xyz - worldPosition.xyz;
 	toCameraVector = (inverse(viewMatrix) * vec4(0.0,0.0,0.0,1.0)).xyz - worldPosition.xyz;
 	toCameraVector = (invViewMatrix * vec4(0.0,0.0,0.0,1.0)).xyz - worldPosition.xyz;
 
@@ -3,15 +3,23 @@ in vec2 TexCoords;
 in vec3 surfaceNormal;
 in vec3 toLightVector;
 in vec3 toCameraVector;
+flat in vec4 tintMode;
 
 
 out vec4 color;
 
 uniform sampler2D modelTexture;
-uniform vec3 lightColour;
 uniform float shineDamper;
 uniform float reflectivity;
-uniform vec4 tintMode;
+
+// per-frame data shared by the world shaders (WorldUniforms.hpp)
+layout (std140) uniform WorldFrame {
+	mat4 projectionMatrix;
+	mat4 viewMatrix;
+	mat4 invViewMatrix;
+	vec4 lightPosition;
+	vec4 lightColour;
+};
 
 //vec3 lightColour=vec3(1,0,1);
 //float shineDamper = 1;
@@ -30,7 +38,7 @@ void main()
 	
 	float nDotl = dot(unitNormal,unitLightVector);
 	float brightness = max(nDotl,0.2);
-	vec3 diffuse = brightness * lightColour;
+	vec3 diffuse = brightness * lightColour.xyz;
 	
 	vec3 unitVectorToCamera = normalize(toCameraVector);
 	vec3 lightDirection = -unitLightVector;
@@ -39,7 +47,7 @@ void main()
 	float specularFactor = dot(reflectedLightDirection , unitVectorToCamera);
 	specularFactor = max(specularFactor,0.0);
 	float dampedFactor = pow(specularFactor,shineDamper);
-	vec3 finalSpecular = dampedFactor * reflectivity * lightColour;
+	vec3 finalSpecular = dampedFactor * reflectivity * lightColour.xyz;
 	
 	if (tintMode.w==1. || true) fincolor*=tintMode;
 	color =  vec4(diffuse,1.0) * fincolor + vec4(finalSpecular,1.0);
@@ -4,31 +4,40 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 aTexCoord;
 
+// per instance (ObjectCluster), the transform takes locations 3 to 6
+layout (location = 3) in mat4 instanceTransform;
+layout (location = 7) in vec4 instanceTint;
+
 out vec2 TexCoords;
 
 out vec3 surfaceNormal;
 out vec3 toLightVector;
 out vec3 toCameraVector;
+flat out vec4 tintMode;
 
-uniform mat4 transformationMatrix;
-uniform mat4 projectionMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 invViewMatrix;
-
-uniform vec3 lightPosition;
+// per-frame data shared by the world shaders (WorldUniforms.hpp)
+layout (std140) uniform WorldFrame {
+	mat4 projectionMatrix;
+	mat4 viewMatrix;
+	mat4 invViewMatrix;
+	vec4 lightPosition;
+	vec4 lightColour;
+};
 
 void main()
 {
 	
-	vec4 worldPosition = transformationMatrix * vec4(aPos,1.0);
+	vec4 worldPosition = instanceTransform * vec4(aPos,1.0);
 
-	vec3 anormal = (transformationMatrix * vec4(normal,0.0)).xyz;
+	vec3 anormal = (instanceTransform * vec4(normal,0.0)).xyz;
     surfaceNormal = 0.5 * ( anormal + vec3( 1 ) );
 
-	toLightVector = lightPosition - worldPosition.xyz;
+	toLightVector = lightPosition.xyz - worldPosition.xyz;
 //	toCameraVector = (inverse(viewMatrix) * vec4(0.0,0.0,0.0,1.0)).xyz - worldPosition.xyz;
 	toCameraVector = (invViewMatrix * vec4(0.0,0.0,0.0,1.0)).xyz - worldPosition.xyz;
 
+	tintMode = instanceTint;
+
 	TexCoords = vec2(aTexCoord.x, 1-aTexCoord.y);
 	
 	gl_Position = projectionMatrix * viewMatrix * worldPosition;
@@ -0,0 +1,159 @@
+/**
+ *  bench_canvas.cpp
+ *  PixFu engine
+ *
+ *  @author Rodolfo Lopez Pintor
+ *  @copyright  © 2020 Nebular Streams. All rights reserved.
+ *
+ *  Draws a heavy 2D overlay (debug grid, spline-like curves, circles, translucent panels,
+ *  triangles, sprites placed, scaled and rotated, and strings) with Canvas2D in immediate mode
+ *  and in deferred mode with a growing number of worker threads. Reports the frame time of each
+ *  and checks the output is identical.
+ *
+ *  Build (from the repo root, with the PixFu sources compiled in):
+ *
+ *    g++ -std=c++17 -O2 -pthread -DLINUX -Iinclude -Iinclude/core -Iinclude/items -Iinclude/input \
+ *        -Iinclude/support -Iinclude/arch/linux bench/bench_canvas.cpp <pixfu sources> -o bench_canvas
+ *
+ *  Usage: bench_canvas [width] [height] [frames] [assets root]
+ *
+ *  Strings need the default font, they are only drawn when the assets root is given.
+ *
+ */
+
+#include "Canvas2D.hpp"
+#include "Fu.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Drawable and Font are qualified, X11 (included by Fu.hpp on Linux) declares its own
+using namespace Pix;
+
+// a 32x32 sprite with a chroma keyed border and a translucent gradient
+static Pix::Drawable *makeSprite() {
+	Pix::Drawable *sprite = new Pix::Drawable(32, 32);
+	for (int y = 0; y < 32; y++)
+		for (int x = 0; x < 32; x++) {
+			bool border = x < 2 || y < 2 || x > 29 || y > 29;
+			sprite->setPixel(x, y, border ? Pixel(255, 0, 255) : Pixel(x * 8, y * 8, 160, 96 + x * 5));
+		}
+	return sprite;
+}
+
+static void scene(Canvas2D *canvas, int frame, Pix::Drawable *sprite, bool text) {
+
+	int w = canvas->width(), h = canvas->height();
+
+	canvas->clear(Pixel(16, 24, 32));
+
+	// debug grid
+	for (int x = 0; x < w; x += 16) canvas->drawLine(x, 0, x, h - 1, Pixel(40, 60, 80), x % 128 ? 0xF0F0F0F0 : 0xFFFFFFFF);
+	for (int y = 0; y < h; y += 16) canvas->drawLine(0, y, w - 1, y, Pixel(40, 60, 80), y % 128 ? 0xF0F0F0F0 : 0xFFFFFFFF);
+
+	// spline overlays, plotted point by point as Spline::DrawSelf does
+	for (int s = 0; s < 24; s++) {
+		float phase = frame * 0.02f + s;
+		for (float t = 0; t < 6.28f; t += 0.0005f)
+			canvas->setPixel((int32_t) (w / 2 + cosf(t * 3 + phase) * w * 0.45f * sinf(t + s)),
+							 (int32_t) (h / 2 + sinf(t * 2 + phase) * h * 0.45f),
+							 Pixel(255, 200, 50 + s * 8));
+	}
+
+	// waypoints and panels
+	for (int i = 0; i < 200; i++) {
+		int x = (i * 97 + frame * 3) % w, y = (i * 57) % h;
+		canvas->fillCircle(x, y, 6 + i % 10, Pixel(200, 60, 60, 160), BLEND_ALPHA);
+		canvas->drawCircle(x, y, 12 + i % 20, Pixel(255, 255, 255));
+	}
+
+	for (int i = 0; i < 40; i++) {
+		int x = (i * 131) % w, y = (i * 71) % h;
+		canvas->fillRect(x, y, 180, 90, Pixel(0, 0, 0, 128), BLEND_ALPHA);
+		canvas->fillTriangle(x, y, x + 200, y + 40, x + 60, y + 160, Pixel(60, 200, 90, 90), BLEND_ADDITIVE);
+		canvas->drawRect(x, y, 180, 90, Pixel(255, 255, 255));
+	}
+
+	// sprites: blitted, resampled, and placed with every filter and key
+	for (int i = 0; i < 60; i++) {
+		int x = (i * 89 + frame * 5) % w, y = (i * 43) % h;
+		canvas->drawSprite(x, y, sprite, 0, BLEND_ALPHA);
+		canvas->drawSprite(w - x, y, sprite, 48 + i % 32);
+
+		SpriteTransform_t transform = SpriteBlitter::place(x, h - y, frame * 0.05f + i, 0.5f + (i % 6) * 0.5f,
+														   i % 2 ? SPRITE_BILINEAR : SPRITE_NEAREST);
+		transform.key = i % 3 == 0 ? SPRITE_KEY_CHROMA : i % 3 == 1 ? SPRITE_KEY_ALPHA : SPRITE_KEY_NONE;
+		transform.keyValue = transform.key == SPRITE_KEY_CHROMA ? Pixel(255, 0, 255).n : 128;
+		canvas->drawSprite(sprite, transform, i % 4 ? BLEND_ALPHA : BLEND_ADDITIVE);
+	}
+
+	// debug strings, plain and blended, at several scales
+	if (text)
+		for (int i = 0; i < 40; i++)
+			canvas->drawString((i * 61 + frame) % w, (i * 29) % h, "frame time 16.6 ms / waypoint 12",
+							   Pixel(255, 255, 255, 200), 1 + i % 3, i % 2 ? BLEND_ALPHA : BLEND_NORMAL);
+}
+
+// average frame time in ms, and a copy of the last frame
+static double run(Pix::Drawable *target, Pix::Font *font, Pix::Drawable *sprite, int threads, int frames, std::vector<uint32_t> &out) {
+
+	JobSystem jobs;
+	Canvas2D canvas(target, font);
+	if (threads >= 0) {
+		jobs.start(threads);
+		canvas.setDeferred(true, &jobs);
+	}
+
+	auto t0 = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; f++) {
+		FrameArena::frame().reset();        // as the engine does every frame
+		scene(&canvas, f, sprite, font != nullptr);
+		target->resolve();
+	}
+	auto t1 = std::chrono::steady_clock::now();
+
+	out.assign(reinterpret_cast<uint32_t *>(target->getData()),
+			   reinterpret_cast<uint32_t *>(target->getData()) + target->width * target->height);
+
+	return std::chrono::duration<double, std::milli>(t1 - t0).count() / frames;
+}
+
+int main(int argc, const char *argv[]) {
+
+	int width = argc > 1 ? atoi(argv[1]) : 1920;
+	int height = argc > 2 ? atoi(argv[2]) : 1080;
+	int frames = argc > 3 ? atoi(argv[3]) : 30;
+
+	Pix::Font *font = nullptr;
+	if (argc > 4) {
+		FuPlatform::setPath(argv[4]);
+		font = new Pix::Font();
+	}
+
+	Pix::Drawable target(width, height);
+	Pix::Drawable *sprite = makeSprite();
+	std::vector<uint32_t> reference, frame;
+
+	double immediate = run(&target, font, sprite, -1, frames, reference);
+	printf("%dx%d, %d frames, %s\n", width, height, frames, font != nullptr ? "with strings" : "no strings (no assets)");
+	printf("  immediate              %8.2f ms\n", immediate);
+
+	int cores = (int) std::thread::hardware_concurrency();
+
+	for (int threads = 0; threads < std::max(cores, 2); threads = threads ? threads * 2 : 1) {
+		double deferred = run(&target, font, sprite, threads, frames, frame);
+		bool same = memcmp(frame.data(), reference.data(), frame.size() * sizeof(uint32_t)) == 0;
+		printf("  deferred, %2d workers   %8.2f ms   x%.2f  %s\n", threads, deferred, immediate / deferred,
+			   same ? "identical" : "MISMATCH");
+	}
+
+	delete sprite;
+	delete font;
+
+	return 0;
+}
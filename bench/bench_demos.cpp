@@ -0,0 +1,157 @@
+/**
+ *  bench_demos.cpp
+ *  PixFu engine
+ *
+ *  @author Rodolfo Lopez Pintor
+ *  @copyright  © 2020 Nebular Streams. All rights reserved.
+ *
+ *  Runs the template demos on the headless Linux platform with a fixed timestep and
+ *  reports frames/sec and frame time percentiles, and the heap allocations of a steady state
+ *  frame (transient data should go to the FrameArena) with the arena high water mark,
+ *  and the GL state calls of the last frame issued and elided by GlState.
+ *
+ *  Build (from the repo root, with the PixFu sources compiled in):
+ *
+ *    g++ -std=c++17 -O2 -DLINUX -Iinclude -Iinclude/core -Iinclude/items -Iinclude/input \
+ *        -Iinclude/support -Iinclude/arch/linux -Iinclude/ext/sprites -Iinclude/ext/world \
+ *        bench/bench_demos.cpp <pixfu sources> -lEGL -lGL -o bench_demos
+ *
+ *  Usage: bench_demos <assets root> [demo] [frames] [dumpEvery]
+ *
+ *    demo is one of: sprites, sprites_10k, sprites_batch, 3d, 3d_balls, all (default)
+ *
+ *  sprites_10k moves 10000 sprites of one sheet every frame (a single instanced draw).
+ *  sprites_batch moves 10000 sprites of two sheets in 4 layers (a SpriteBatch, a single draw).
+ *
+ */
+
+// count heap allocations (replaces the global new/delete)
+#define PIXFU_COUNT_HEAP_ALLOCATIONS
+#include "FrameArena.hpp"
+
+#include "PixFu.hpp"
+
+#include "../template/PixFuTemplate/PixFu.xctemplate/examples/demo_sprites.h"
+#include "../template/PixFuTemplate/PixFu.xctemplate/examples/demo_3d.h"
+#include "../template/PixFuTemplate/PixFu.xctemplate/examples/demo_3d_balls.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+static constexpr int WIDTH = 1024, HEIGHT = 576;
+
+// 10k sprites of one sheet, all moved every frame
+class DemoSpriteSwarm : public Pix::Fu {
+
+	static constexpr int COUNT = 10000;
+
+	Pix::SpriteSheet *pSprites = nullptr;
+
+public:
+
+	DemoSpriteSwarm() : Pix::Fu("Sprite Swarm") {}
+
+	bool onUserCreate(bool restarted) override {
+		if (restarted) return true;
+		pSprites = new Pix::SpriteSheet(this, {"sprites/mario-50.png", 16, 22});
+		addExtension(pSprites);
+		for (int i = 0; i < COUNT; i++)
+			pSprites->create(i % (16 * 22), 1, 1, glm::vec2(i % WIDTH, i * 7 % HEIGHT), 0.5f);
+		return true;
+	}
+
+	bool onUserUpdate(float fElapsedTime) override {
+		for (int i = 0; i < COUNT; i++)
+			pSprites->update(i, glm::vec2(i % WIDTH + 50 * sinf(METRONOME + i), i * 7 % HEIGHT + 50 * cosf(METRONOME + i)),
+							 -1, 0.5f, METRONOME * (i % 3));
+		return true;
+	}
+};
+
+// 10k sprites of two sheets packed in one atlas, interleaved in layers
+class DemoSpriteBatch : public Pix::Fu {
+
+	static constexpr int COUNT = 10000;
+
+	Pix::SpriteBatch *pBatch = nullptr;
+
+public:
+
+	DemoSpriteBatch() : Pix::Fu("Sprite Batch") {}
+
+	bool onUserCreate(bool restarted) override {
+		if (restarted) return true;
+		pBatch = new Pix::SpriteBatch(this, {{"sprites/mario-50.png", 16, 22}, {"sprites/items-spr.png", 10, 10}});
+		addExtension(pBatch);
+		for (int i = 0; i < COUNT; i++)
+			pBatch->sheet(i % 2)->create(i / 2 % (i % 2 ? 10 * 10 : 16 * 22), 1, 1,
+										 glm::vec2(i % WIDTH, i * 7 % HEIGHT), 0.5f, 0, 0, i % 4);
+		return true;
+	}
+
+	bool onUserUpdate(float fElapsedTime) override {
+		for (int i = 0; i < COUNT; i++)
+			pBatch->sheet(i % 2)->update(i / 2, glm::vec2(i % WIDTH + 50 * sinf(METRONOME + i),
+														  i * 7 % HEIGHT + 50 * cosf(METRONOME + i)),
+										 -1, 0.5f, METRONOME * (i % 3));
+		return true;
+	}
+};
+
+static void report(const std::string &name, const Pix::FrameStats_t &stats) {
+	Pix::FrameArena &arena = Pix::FrameArena::frame();
+	Pix::GlStats_t gl = Pix::GlState::stats();
+	printf("%-12s %6d frames %8.1f fps   mean %6.2f  p50 %6.2f  p90 %6.2f  p99 %6.2f  max %6.2f ms"
+		   "   heap allocs/frame %3llu  arena %5.1f KB   gl state calls %4u (%4u elided)\n",
+		   name.c_str(), stats.frames, stats.fps, stats.mean, stats.p50, stats.p90, stats.p99, stats.max,
+		   (unsigned long long) arena.heapAllocations(), arena.highWater() / 1024.0f, gl.issued, gl.elided);
+}
+
+static void bench(const std::string &name, std::function<Pix::Fu *()> factory, int frames, int dumpEvery) {
+
+	Pix::PixFuPlatformHeadless *platform = new Pix::PixFuPlatformHeadless(
+			{frames, 1.0f / 60, {}, dumpEvery, "frame_" + name + "_"});
+
+	Pix::FuPlatform::init(platform);
+
+	Pix::Fu *engine = factory();
+
+	if (engine->init(WIDTH, HEIGHT))
+		report(name, platform->run(engine));
+	else
+		printf("%-12s init failed\n", name.c_str());
+
+	delete engine;
+	delete platform;
+}
+
+int main(int argc, const char *argv[]) {
+
+	if (argc < 2) {
+		printf("usage: %s <assets root> [sprites|sprites_10k|sprites_batch|3d|3d_balls|all] [frames] [dumpEvery]\n", argv[0]);
+		return 1;
+	}
+
+	Pix::FuPlatform::setPath(argv[1]);
+
+	std::string which = argc > 2 ? argv[2] : "all";
+	int frames = argc > 3 ? atoi(argv[3]) : 600;
+	int dumpEvery = argc > 4 ? atoi(argv[4]) : 0;
+
+	std::vector<std::pair<std::string, std::function<Pix::Fu *()>>> demos = {
+			{"sprites",  [] { return new DemoSprites(); }},
+			{"sprites_10k", [] { return new DemoSpriteSwarm(); }},
+			{"sprites_batch", [] { return new DemoSpriteBatch(); }},
+			{"3d",       [] { return new Demo3d(); }},
+			{"3d_balls", [] { return new Demo3dBalls(); }}
+	};
+
+	for (auto &demo:demos)
+		if (which == "all" || which == demo.first)
+			bench(demo.first, demo.second, frames, dumpEvery);
+
+	return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ *  bench_jobs.cpp
+ *  PixFu engine
+ *
+ *  @author Rodolfo Lopez Pintor
+ *  @copyright  © 2020 Nebular Streams. All rights reserved.
+ *
+ *  Scaling benchmark of the JobSystem from 0 workers (calling thread only) to N: a parallel
+ *  loop with uneven cost per item (mandelbrot rows), many tiny jobs (scheduling overhead) and
+ *  a job graph (4 dependent stages of 16 jobs). Checks every run gets the same result.
+ *
+ *  Build (from the repo root, with the PixFu sources compiled in):
+ *
+ *    g++ -std=c++17 -O2 -pthread -Iinclude/core bench/bench_jobs.cpp <pixfu sources> -o bench_jobs
+ *
+ *  Usage: bench_jobs [max workers]
+ *
+ */
+
+#include "JobSystem.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using Pix::JobSystem;
+using Pix::JobGraph;
+using Pix::JobCounter_t;
+
+static constexpr int WIDTH = 1280, HEIGHT = 720, ITERATIONS = 256;
+
+// best of N runs, in ms
+template<typename Func>
+static double measure(Func fn, int runs = 5) {
+	double best = 1e9;
+	for (int i = 0; i < runs; i++) {
+		auto t0 = std::chrono::steady_clock::now();
+		fn();
+		auto t1 = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+	}
+	return best;
+}
+
+static void mandelbrotRow(int y, uint8_t *row) {
+	for (int x = 0; x < WIDTH; x++) {
+		float cr = -2.2f + 3.0f * x / WIDTH, ci = -1.2f + 2.4f * y / HEIGHT, zr = 0, zi = 0;
+		int i = 0;
+		while (i < ITERATIONS && zr * zr + zi * zi < 4) {
+			float t = zr * zr - zi * zi + cr;
+			zi = 2 * zr * zi + ci;
+			zr = t;
+			i++;
+		}
+		row[x] = (uint8_t) i;
+	}
+}
+
+static uint64_t checksum(const std::vector<uint8_t> &data) {
+	uint64_t sum = 0;
+	for (size_t i = 0; i < data.size(); i++) sum = sum * 31 + data[i];
+	return sum;
+}
+
+int main(int argc, const char *argv[]) {
+
+	int maxWorkers = argc > 1 ? atoi(argv[1]) : std::max(1, (int) std::thread::hardware_concurrency() - 1);
+
+	std::vector<uint8_t> image(WIDTH * HEIGHT);
+	uint64_t reference = 0;
+	double base[3] = {0, 0, 0};
+
+	printf("%d cores\n", (int) std::thread::hardware_concurrency());
+	printf("  workers   mandelbrot            100k tiny jobs        job graph\n");
+
+	for (int workers = 0; workers <= maxWorkers; workers++) {
+
+		JobSystem jobs;
+		jobs.start(workers);
+
+		double loop = measure([&] {
+			jobs.parallelFor(HEIGHT, [&](int begin, int end) {
+				for (int y = begin; y < end; y++) mandelbrotRow(y, &image[y * WIDTH]);
+			}, 4);
+		});
+
+		uint64_t sum = checksum(image);
+		if (workers == 0) reference = sum;
+
+		std::atomic<int> total{0};
+		double tiny = measure([&] {
+			JobCounter_t counter{0};
+			for (int i = 0; i < 100000; i++) jobs.push([&total] { total.fetch_add(1, std::memory_order_relaxed); }, &counter);
+			jobs.wait(counter);
+		});
+
+		// every band of a stage waits for the whole previous stage
+		JobGraph graph;
+		std::vector<int> previous;
+		for (int stage = 0; stage < 4; stage++) {
+			std::vector<int> current;
+			for (int band = 0; band < 16; band++) {
+				int first = band * HEIGHT / 16, last = (band + 1) * HEIGHT / 16;
+				current.push_back(graph.add([&image, first, last] {
+					for (int y = first; y < last; y++) mandelbrotRow(y, &image[y * WIDTH]);
+				}, previous));
+			}
+			previous = current;
+		}
+
+		double graphTime = measure([&] { jobs.run(graph); });
+
+		if (workers == 0) {
+			base[0] = loop;
+			base[1] = tiny;
+			base[2] = graphTime;
+		}
+
+		printf("  %7d   %8.2f ms  x%-5.2f   %8.2f ms  x%-5.2f   %8.2f ms  x%-5.2f  %s\n", workers,
+			   loop, base[0] / loop, tiny, base[1] / tiny, graphTime, base[2] / graphTime,
+			   sum == reference && checksum(image) == reference ? "ok" : "MISMATCH");
+
+		jobs.stop();
+	}
+
+	return 0;
+}
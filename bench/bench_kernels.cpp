@@ -0,0 +1,131 @@
+/**
+ *  bench_kernels.cpp
+ *  PixFu engine
+ *
+ *  @author Rodolfo Lopez Pintor
+ *  @copyright  © 2020 Nebular Streams. All rights reserved.
+ *
+ *  Micro-benchmark of the PixelOps span kernels against the per-pixel path (bounds check and
+ *  dirty flag on every pixel, as Drawable::setPixel used to do) at 720p and 4K.
+ *
+ *  Build (standalone):
+ *
+ *    g++ -std=c++17 -O2 [-mavx2] -Iinclude/core bench/bench_kernels.cpp -o bench_kernels
+ *
+ */
+
+#include "PixelOps.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+using Pix::PixelOps;
+
+// the old per-pixel write path
+struct ScalarTarget {
+	uint32_t *data;
+	int width, height;
+	bool dirty = false;
+
+	inline void setPixel(int x, int y, uint32_t pix) {
+		dirty = true;
+		if (x < width && y < height && x >= 0 && y >= 0)
+			data[y * width + x] = pix;
+	}
+};
+
+// best of N runs, in ms
+static double measure(std::function<void()> fn, int runs = 20) {
+	double best = 1e9;
+	for (int i = 0; i < runs; i++) {
+		auto t0 = std::chrono::steady_clock::now();
+		fn();
+		auto t1 = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+	}
+	return best;
+}
+
+static void row(const char *name, double scalar, double kernel) {
+	printf("  %-22s scalar %8.3f ms   %-6s %8.3f ms   x%.1f\n", name, scalar, PixelOps::isa(), kernel, scalar / kernel);
+}
+
+static void bench(const char *label, int w, int h) {
+
+	std::vector<uint32_t> buffer(w * h), sprite(w * h, 0x7f00ff00);
+	ScalarTarget target = {buffer.data(), w, h};
+	volatile uint32_t sink;
+
+	printf("%s (%dx%d)\n", label, w, h);
+
+	row("clear",
+		measure([&] {
+			for (int y = 0; y < h; y++)
+				for (int x = 0; x < w; x++)
+					target.setPixel(x, y, 0xff123456);
+		}),
+		measure([&] { PixelOps::fill(buffer.data(), 0xff123456, buffer.size()); }));
+
+	sink = buffer[w * h / 2];
+
+	// a half-screen rect, offset so rows are not aligned
+	int rx = w / 4 + 3, ry = h / 4, rw = w / 2, rh = h / 2;
+
+	row("fillRect 1/4 area",
+		measure([&] {
+			for (int y = ry; y < ry + rh; y++)
+				for (int x = rx; x < rx + rw; x++)
+					target.setPixel(x, y, 0xff654321);
+		}),
+		measure([&] { PixelOps::fillRect(buffer.data(), w, rx, ry, rw, rh, 0xff654321); }));
+
+	sink = buffer[ry * w + rx];
+
+	row("row copy (full frame)",
+		measure([&] {
+			for (int y = 0; y < h; y++)
+				for (int x = 0; x < w; x++)
+					target.setPixel(x, y, sprite[y * w + x]);
+		}),
+		measure([&] {
+			for (int y = 0; y < h; y++)
+				PixelOps::copy(buffer.data() + y * w, sprite.data() + y * w, w);
+		}));
+
+	sink = buffer[w * h - 1];
+
+	// translucent rect, the per-pixel path does the same integer blend the scalar kernel does
+	row("alpha fillRect 1/4",
+		measure([&] {
+			for (int y = ry; y < ry + rh; y++)
+				for (int x = rx; x < rx + rw; x++)
+					buffer[y * w + x] = PixelOps::blend(buffer[y * w + x], 0x80654321, Pix::BLEND_ALPHA);
+		}),
+		measure([&] {
+			for (int y = ry; y < ry + rh; y++)
+				PixelOps::blendFill(buffer.data() + y * w + rx, 0x80654321, rw, Pix::BLEND_ALPHA);
+		}));
+
+	sink = buffer[ry * w + rx];
+
+	row("alpha row copy",
+		measure([&] {
+			for (int i = 0; i < w * h; i++)
+				buffer[i] = PixelOps::blend(buffer[i], sprite[i], Pix::BLEND_ALPHA);
+		}),
+		measure([&] {
+			for (int y = 0; y < h; y++)
+				PixelOps::blendCopy(buffer.data() + y * w, sprite.data() + y * w, w, Pix::BLEND_ALPHA);
+		}));
+
+	sink = buffer[w * h - 1];
+	(void) sink;
+}
+
+int main() {
+	bench("720p", 1280, 720);
+	bench("4K", 3840, 2160);
+	return 0;
+}
@@ -0,0 +1,168 @@
+/**
+ *  bench_load.cpp
+ *  PixFu engine
+ *
+ *  World startup time: a terrain plus one object of every class in <assets>/objects, loaded
+ *  serially as World::add does (everything decoded in the world constructor, uploaded on the
+ *  first frame) and in the background with World::preload (decoded on the job system,
+ *  uploaded within the frame budget). Reports the time from creating the engine until the
+ *  first frame with everything loaded, how many frames the loop ran meanwhile and the longest
+ *  of them (decodes run on background jobs, so it is bounded by the upload budget).
+ *
+ *  Build (from the repo root, with the PixFu sources compiled in):
+ *
+ *    g++ -std=c++17 -O2 -DLINUX -Iinclude -Iinclude/core -Iinclude/items -Iinclude/input \
+ *        -Iinclude/support -Iinclude/arch/linux -Iinclude/ext/sprites -Iinclude/ext/world \
+ *        bench/bench_load.cpp <pixfu sources> -lEGL -lGL -o bench_load
+ *
+ *  Usage: bench_load <assets root> [terrain] [runs]
+ *
+ */
+
+#include "PixFu.hpp"
+#include "PixFuWorld.hpp"
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static constexpr int WIDTH = 1024, HEIGHT = 576;
+
+static const Pix::WorldConfig_t WORLDCONFIG = {
+		{0.4, 0.3, 0.9},
+		{20000, 20000, 2000},
+		{0.4, 0.4, 0.3},
+		Pix::DEBUG_NONE,
+		Pix::PERSP_FOV70,
+		Pix::World::TRANSFORM_NONE,
+		Pix::World::TRANSFORM_NONE,
+		true,
+		"default"
+};
+
+class LoadWorld : public Pix::World {
+
+	const bool PARALLEL;
+	const Pix::TerrainConfig_t TERRAIN;
+	const std::vector<std::string> CLASSES;
+
+	void addObjects() {
+		for (const std::string &name:CLASSES)
+			add(Pix::ObjectProperties_t{name}, Pix::ObjectLocation_t{{100, 0, 100}, {0, 0, 0}}, false);
+	}
+
+public:
+
+	LoadWorld(bool parallel, const std::string &terrain, const std::vector<std::string> &classes)
+			: World(WORLDCONFIG), PARALLEL(parallel), TERRAIN{terrain}, CLASSES(classes) {
+		if (!PARALLEL) {
+			add(TERRAIN);
+			addObjects();
+		}
+	}
+
+	bool init(Pix::Fu *engine) override {
+		if (PARALLEL) {
+			for (const std::string &name:CLASSES) preload(engine, name);
+			preload(engine, TERRAIN, [this](Pix::Terrain *) { addObjects(); });
+		}
+		return World::init(engine);
+	}
+};
+
+class LoadBench : public Pix::Fu {
+
+	const std::chrono::steady_clock::time_point T0;
+	bool bLoaded = false;
+
+public:
+
+	float fStartup = 0;     // ms
+	float fLongest = 0;     // ms, longest frame while loading
+	int nFrames = 0;
+
+	LoadBench(bool parallel, const std::string &terrain, const std::vector<std::string> &classes)
+			: Fu("bench_load"), T0(std::chrono::steady_clock::now()) {
+		addExtension(new LoadWorld(parallel, terrain, classes));
+	}
+
+	bool onUserCreate(bool restarted) override { return true; }
+
+	bool onUserUpdate(float fElapsedTime) override {
+		// the frame after everything arrived has drawn it all (serial uploads on the first render)
+		if (bLoaded) {
+			fStartup = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - T0).count();
+			return false;
+		}
+		bLoaded = assets()->done();
+		if (nFrames > 0) fLongest = std::max(fLongest, fElapsedTime * 1000);
+		nFrames++;
+		return true;
+	}
+};
+
+static std::vector<std::string> objectClasses(const std::string &root) {
+	std::vector<std::string> classes;
+	if (DIR *dir = opendir((root + "/objects").c_str())) {
+		while (dirent *entry = readdir(dir))
+			if (entry->d_name[0] != '.') classes.emplace_back(entry->d_name);
+		closedir(dir);
+	}
+	return classes;
+}
+
+static float measure(bool parallel, const std::string &terrain, const std::vector<std::string> &classes, int &frames,
+					 float &longest) {
+
+	Pix::PixFuPlatformHeadless *platform = new Pix::PixFuPlatformHeadless({100000});
+	Pix::FuPlatform::init(platform);
+
+	LoadBench *engine = new LoadBench(parallel, terrain, classes);
+
+	float startup = -1;
+	if (engine->init(WIDTH, HEIGHT)) {
+		platform->run(engine);
+		startup = engine->fStartup;
+		frames = engine->nFrames;
+		longest = engine->fLongest;
+	}
+
+	delete engine;
+	delete platform;
+	return startup;
+}
+
+int main(int argc, const char *argv[]) {
+
+	if (argc < 2) {
+		printf("usage: %s <assets root> [terrain] [runs]\n", argv[0]);
+		return 1;
+	}
+
+	Pix::FuPlatform::setPath(argv[1]);
+
+	std::string terrain = argc > 2 ? argv[2] : "cheeseland";
+	int runs = argc > 3 ? atoi(argv[3]) : 3;
+	std::vector<std::string> classes = objectClasses(argv[1]);
+
+	printf("terrain %s, %d object classes\n", terrain.c_str(), (int) classes.size());
+
+	// the first run writes the texture caches, not measured
+	int frames = 0;
+	float longest = 0;
+	measure(false, terrain, classes, frames, longest);
+
+	for (bool parallel:{false, true}) {
+		float best = 1e9;
+		for (int i = 0; i < runs; i++) best = std::min(best, measure(parallel, terrain, classes, frames, longest));
+		printf("  %-10s first full frame %8.1f ms   %4d frames while loading, longest %6.1f ms\n",
+			   parallel ? "preload" : "serial", best, frames, longest);
+	}
+
+	return 0;
+}
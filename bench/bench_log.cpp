@@ -0,0 +1,84 @@
+/**
+ *  bench_log.cpp
+ *  PixFu engine
+ *
+ *  @author Rodolfo Lopez Pintor
+ *  @copyright  © 2020 Nebular Streams. All rights reserved.
+ *
+ *  Cost of a log call on the calling thread: formatting in place with SF() (the old way),
+ *  the deferred Logger (formatted on its thread) and a level removed at compile time.
+ *  Messages go to /dev/null, so only the logging itself is measured.
+ *
+ *  Build (from the repo root, with the PixFu sources compiled in):
+ *
+ *    g++ -std=c++17 -O2 -pthread -Iinclude/core bench/bench_log.cpp <pixfu sources> -o bench_log
+ *
+ *  Usage: bench_log [messages]
+ *
+ */
+
+#include "Logger.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using Pix::Logger;
+using Pix::LogLevel_t;
+
+static const std::string TAG = "Bench";
+
+static FILE *output = nullptr;
+
+static void sink(LogLevel_t level, const char *tag, const char *text) {
+	fprintf(output, "%c %s: %s\n", level == Pix::LOGLEVEL_ERROR ? 'E' : 'V', tag, text);
+}
+
+// ns per message on the calling thread
+template<typename Func>
+static double measure(int messages, Func fn) {
+	auto t0 = std::chrono::steady_clock::now();
+	for (int i = 0; i < messages; i++) fn(i);
+	auto t1 = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(t1 - t0).count() / messages;
+}
+
+int main(int argc, const char *argv[]) {
+
+	int messages = argc > 1 ? atoi(argv[1]) : 100000;
+	std::string path = "assets/world/ball.obj";
+
+	output = fopen("/dev/null", "w");
+	Logger::setSink(sink);
+
+	double sync = measure(messages, [&](int i) {
+		sink(Pix::LOGLEVEL_ERROR, TAG.c_str(), Pix::SF("Collision %d with %s at %f", i, path.c_str(), i * 0.5f).c_str());
+	});
+
+	// batches below the ring size, so the background thread keeps up and nothing is dropped
+	double deferred = 0;
+	for (int done = 0; done < messages; done += 256) {
+		deferred += measure(256, [&](int i) {
+			PIXFU_LOGE(TAG, "Collision %d with %s at %f", i, path.c_str(), i * 0.5f);
+		}) * 256;
+		Logger::flush();
+	}
+	deferred /= messages;
+
+	volatile int evaluated = 0;
+	double disabled = measure(messages, [&](int) {
+		// removed at compile time without DBG, the arguments are not even evaluated
+		PIXFU_LOGV(TAG, "Collision %d", evaluated++);
+	});
+
+	Logger::stop();
+
+	printf("  SF() in place   %8.1f ns/message\n", sync);
+	printf("  deferred        %8.1f ns/message   dropped %llu\n", deferred, (unsigned long long) Logger::dropped());
+	printf("  compiled out    %8.1f ns/message   %s\n", disabled,
+		   PIXFU_LOG_LEVEL > Pix::LOGLEVEL_VERBOSE ? (evaluated == 0 ? "ok" : "EVALUATED") : "(verbose enabled)");
+
+	fclose(output);
+	return 0;
+}
@@ -0,0 +1,110 @@
+/**
+ *  bench_pack.cpp
+ *  PixFu engine
+ *
+ *  @author Rodolfo Lopez Pintor
+ *  @copyright  © 2020 Nebular Streams. All rights reserved.
+ *
+ *  Cost of opening and reading every asset: std::ifstream into a string (as the loaders did),
+ *  the loose files through AssetSource and a mounted pack (a lookup and a view).
+ *  Every byte is touched, so the reads are not optimized away. The files come from the
+ *  pack directory, build it first with tools/pxpack.
+ *
+ *  Build (from the repo root, with the PixFu sources compiled in):
+ *
+ *    g++ -std=c++17 -O2 -pthread -Iinclude/core bench/bench_pack.cpp <pixfu sources> -o bench_pack
+ *
+ *  Usage: bench_pack <assets root> [rounds]
+ *
+ */
+
+#include "AssetSource.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace Pix;
+
+static uint32_t touch(const char *data, size_t size) {
+	uint32_t sum = 0;
+	for (size_t i = 0; i < size; i++) sum += (uint8_t) data[i];
+	return sum;
+}
+
+// µs per round
+template<typename Func>
+static double measure(int rounds, Func fn) {
+	auto t0 = std::chrono::steady_clock::now();
+	for (int i = 0; i < rounds; i++) fn();
+	auto t1 = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::micro>(t1 - t0).count() / rounds;
+}
+
+int main(int argc, const char *argv[]) {
+
+	if (argc < 2) {
+		printf("usage: %s <assets root> [rounds]\n", argv[0]);
+		return 1;
+	}
+
+	std::string root = argv[1];
+	while (root.size() > 1 && root.back() == '/') root.pop_back();
+	int rounds = argc > 2 ? atoi(argv[2]) : 200;
+
+	std::string pack = root + AssetSource::EXTENSION;
+	AssetSource::setRoot(root);
+
+	// the asset names, from the pack directory
+	std::vector<std::string> names;
+	{
+		AssetData data = AssetSource::open(pack);
+		if (!data || data.size() < sizeof(AssetPackHeader_t)) {
+			printf("no pack at %s, build it with pxpack\n", pack.c_str());
+			return 1;
+		}
+		const auto *header = reinterpret_cast<const AssetPackHeader_t *>(data.data());
+		const auto *entries = reinterpret_cast<const AssetPackEntry_t *>(data.data() + sizeof(AssetPackHeader_t));
+		const char *block = reinterpret_cast<const char *>(data.data() + header->names);
+		for (uint32_t i = 0; i < header->entries; i++)
+			names.emplace_back(block + entries[i].name, entries[i].nameLength);
+	}
+
+	volatile uint32_t sink = 0;
+
+	double stream = measure(rounds, [&] {
+		for (const std::string &name:names) {
+			std::ifstream file(root + "/" + name, std::ios::in | std::ios::binary);
+			std::stringstream buffer;
+			buffer << file.rdbuf();
+			std::string text = buffer.str();
+			sink += touch(text.data(), text.size());
+		}
+	});
+
+	double loose = measure(rounds, [&] {
+		for (const std::string &name:names) {
+			AssetData data = AssetSource::open(name);
+			sink += touch(reinterpret_cast<const char *>(data.data()), data.size());
+		}
+	});
+
+	if (!AssetSource::mount(pack)) return 1;
+
+	double packed = measure(rounds, [&] {
+		for (const std::string &name:names) {
+			AssetData data = AssetSource::open(name);
+			sink += touch(reinterpret_cast<const char *>(data.data()), data.size());
+		}
+	});
+
+	printf("%d assets\n", (int) names.size());
+	printf("  ifstream         %10.1f us/round\n", stream);
+	printf("  loose files      %10.1f us/round\n", loose);
+	printf("  pack             %10.1f us/round\n", packed);
+	return 0;
+}
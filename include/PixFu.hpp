@@ -18,5 +18,6 @@
 #include "input/Mouse.hpp"
 #include "input/AxisController.hpp"
 #include "arch/apple/platform_apple.hpp"
+#include "arch/linux/platform_headless.hpp"
 
 
@@ -11,3 +11,5 @@
 #include "ext/sprites/SpriteSheet.hpp"
 #include "ext/sprites/SpriteSheets.hpp"
 
+#include "ext/sprites/SpriteAtlas.hpp"
+#include "ext/sprites/SpriteBatch.hpp"
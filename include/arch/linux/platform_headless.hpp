@@ -0,0 +1,328 @@
+#ifdef LINUX
+
+//
+//  platform_headless.hpp
+//  PixFu
+//
+//  A windowless platform to run the engine on Linux build machines. The GL context lives
+//  in an EGL pbuffer, frames are driven with a fixed (or scripted) elapsed time instead of
+//  the wall clock, and the primary surface can be dumped to disk as PPM files. Every frame
+//  is timed so the platform can be used to benchmark the engine (see FrameStats_t): frame
+//  times are the busy time of each frame, the fps is measured on the wall clock of the run.
+//
+//  Link with -lEGL -lGL
+//
+//  Created by rodo on 17/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "Logger.hpp"
+#include "OpenGL.h"
+#include "Fu.hpp"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace Pix {
+
+	/** Platform configuration, you can pass this object when initing the platform */
+	typedef struct sHeadlessConfig {
+		/** number of frames to run, then the loop ends */
+		int frames = 600;
+		/** fixed elapsed time passed to every frame */
+		float fixedElapsedTime = 1.0f / 60;
+		/** if not empty, elapsed times are taken from here (cycled) instead */
+		std::vector<float> timeline = {};
+		/** dump the primary surface every N frames (0 = never) */
+		int dumpEvery = 0;
+		/** path prefix for dumped frames, frame number and .ppm extension are appended */
+		std::string dumpPath = "frame";
+	} HeadlessConfig_t;
+
+	/** Frame timing report */
+	typedef struct sFrameStats {
+		int frames = 0;
+		float fps = 0;          // frames per wall clock second of the run
+		float mean = 0;         // busy ms per frame
+		float p50 = 0;          // ms
+		float p90 = 0;          // ms
+		float p99 = 0;          // ms
+		float max = 0;          // ms
+	} FrameStats_t;
+
+	class PixFuPlatformHeadless : public FuPlatform {
+
+		static std::string TAG;
+
+		// platform configuration
+		const HeadlessConfig_t CONFIG;
+
+		Fu *pEngine = nullptr;
+
+		EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+		EGLSurface eglSurface = EGL_NO_SURFACE;
+		EGLContext eglContext = EGL_NO_CONTEXT;
+
+		int nFrame = 0;
+		std::chrono::steady_clock::time_point tFrameStart;
+		std::vector<float> vFrameTimes;     // ms
+		float fRunTime = 0;                 // wall clock ms of the last run
+
+		/** elapsed time to pass to the frame */
+		float elapsed(int frame);
+
+		/** writes the primary surface as a binary PPM */
+		bool dump(const std::string &filename);
+
+	public:
+
+		PixFuPlatformHeadless(HeadlessConfig_t config = {});
+
+		/**
+		 * Creates the offscreen GL context
+		 */
+		bool init(Fu *engine) override;
+
+		/**
+		 * Loop runs until the configured number of frames, and is always focused
+		 */
+		std::pair<bool, bool> events() override;
+
+		/**
+		 * Finishes the GL frame, records frame time and dumps the surface if requested
+		 */
+		void commit() override;
+
+		/**
+		 * Releases the offscreen context
+		 */
+		void deinit() override;
+
+		/**
+		 * Runs the engine loop synchronously with the configured timing. Call instead of Fu::start()
+		 * @param engine An engine already inited with Fu::init()
+		 * @return Timing stats of the run
+		 */
+		FrameStats_t run(Fu *engine);
+
+		/**
+		 * Computes timing stats of the frames run so far
+		 */
+		FrameStats_t stats();
+
+	};
+
+	inline std::string PixFuPlatformHeadless::TAG = "PixFuPlatformHeadless";
+
+	inline PixFuPlatformHeadless::PixFuPlatformHeadless(HeadlessConfig_t config) : CONFIG(config) {}
+
+	inline bool PixFuPlatformHeadless::init(Fu *engine) {
+
+		pEngine = engine;
+
+		eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, nullptr, nullptr)) {
+			PIXFU_LOGE(TAG, "Cannot initialize EGL display");
+			return false;
+		}
+
+		const EGLint configAttribs[] = {
+				EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+				EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+				EGL_DEPTH_SIZE, 24,
+				EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+				EGL_NONE
+		};
+
+		EGLConfig config;
+		EGLint numConfigs = 0;
+		if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+			PIXFU_LOGE(TAG, "No suitable EGL config");
+			return false;
+		}
+
+		const EGLint surfaceAttribs[] = {
+				EGL_WIDTH, engine->screenWidth(),
+				EGL_HEIGHT, engine->screenHeight(),
+				EGL_NONE
+		};
+
+		eglSurface = eglCreatePbufferSurface(eglDisplay, config, surfaceAttribs);
+		eglBindAPI(EGL_OPENGL_API);
+
+		const EGLint contextAttribs[] = {
+				EGL_CONTEXT_MAJOR_VERSION, 3,
+				EGL_CONTEXT_MINOR_VERSION, 3,
+				EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+				EGL_NONE
+		};
+
+		eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+
+		if (eglSurface == EGL_NO_SURFACE || eglContext == EGL_NO_CONTEXT
+			|| !eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext)) {
+			PIXFU_LOGE(TAG, "Cannot create offscreen GL context");
+			return false;
+		}
+
+		// a new context, nothing is bound
+		GlState::newContext();
+		glViewport(0, 0, engine->screenWidth(), engine->screenHeight());
+
+		PIXFU_LOGV(TAG, "Headless context %dx%d", engine->screenWidth(), engine->screenHeight());
+
+		return true;
+	}
+
+	inline std::pair<bool, bool> PixFuPlatformHeadless::events() {
+		return {nFrame < CONFIG.frames, true};
+	}
+
+	inline void PixFuPlatformHeadless::commit() {
+
+		// make sure the GPU work is accounted in this frame
+		glFinish();
+
+		auto now = std::chrono::steady_clock::now();
+		vFrameTimes.push_back(std::chrono::duration<float, std::milli>(now - tFrameStart).count());
+
+		if (CONFIG.dumpEvery > 0 && nFrame % CONFIG.dumpEvery == 0)
+			dump(SF("%s%05d.ppm", CONFIG.dumpPath.c_str(), nFrame));
+
+		nFrame++;
+	}
+
+	inline void PixFuPlatformHeadless::deinit() {
+		if (eglDisplay != EGL_NO_DISPLAY) {
+			eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			if (eglContext != EGL_NO_CONTEXT) eglDestroyContext(eglDisplay, eglContext);
+			if (eglSurface != EGL_NO_SURFACE) eglDestroySurface(eglDisplay, eglSurface);
+			eglTerminate(eglDisplay);
+		}
+		eglDisplay = EGL_NO_DISPLAY;
+		eglSurface = EGL_NO_SURFACE;
+		eglContext = EGL_NO_CONTEXT;
+	}
+
+	inline float PixFuPlatformHeadless::elapsed(int frame) {
+		return CONFIG.timeline.empty()
+			   ? CONFIG.fixedElapsedTime
+			   : CONFIG.timeline[frame % CONFIG.timeline.size()];
+	}
+
+	inline FrameStats_t PixFuPlatformHeadless::run(Fu *engine) {
+
+		nFrame = 0;
+		fRunTime = 0;
+		vFrameTimes.clear();
+		vFrameTimes.reserve(CONFIG.frames);
+
+		if (!engine->loop_init()) {
+			PIXFU_LOGE(TAG, "Engine loop init failed");
+			return {};
+		}
+
+		float fSecond = 0;
+		int nFps = 0;
+
+		auto runStart = std::chrono::steady_clock::now();
+
+		while (events().first) {
+
+			float fElapsedTime = elapsed(nFrame);
+
+			tFrameStart = std::chrono::steady_clock::now();
+
+			// the engine commits the frame
+			if (!engine->loop_tick(fElapsedTime)) break;
+
+			// simulated second
+			nFps++;
+			if ((fSecond += fElapsedTime) >= 1.0f) {
+				onFps(engine, nFps);
+				fSecond -= 1.0f;
+				nFps = 0;
+			}
+		}
+
+		fRunTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - runStart).count();
+
+		engine->loop_deinit();
+		deinit();
+
+		return stats();
+	}
+
+	inline FrameStats_t PixFuPlatformHeadless::stats() {
+
+		FrameStats_t stats;
+		if (vFrameTimes.empty()) return stats;
+
+		std::vector<float> sorted = vFrameTimes;
+		std::sort(sorted.begin(), sorted.end());
+
+		float total = 0;
+		for (float t:sorted) total += t;
+
+		auto percentile = [&sorted](float p) {
+			return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+		};
+
+		stats.frames = static_cast<int>(sorted.size());
+		stats.mean = total / sorted.size();
+		stats.fps = fRunTime > 0 ? 1000.0f * sorted.size() / fRunTime : 0;
+		stats.p50 = percentile(0.50f);
+		stats.p90 = percentile(0.90f);
+		stats.p99 = percentile(0.99f);
+		stats.max = sorted.back();
+
+		return stats;
+	}
+
+	inline bool PixFuPlatformHeadless::dump(const std::string &filename) {
+
+		Drawable *buffer = pEngine->buffer();
+		if (buffer == nullptr) return false;
+
+		FILE *f = fopen(filename.c_str(), "wb");
+		if (f == nullptr) {
+			PIXFU_LOGE(TAG, "Cannot write frame %s", filename.c_str());
+			return false;
+		}
+
+		fprintf(f, "P6\n%d %d\n255\n", buffer->width, buffer->height);
+
+		std::vector<uint8_t> row(buffer->width * 3);
+		const Pixel *data = buffer->getData();
+
+		// indexed surface, resolve the palette first
+		std::vector<Pixel> resolved;
+		if (auto *indexed = dynamic_cast<IndexedDrawable *>(buffer)) {
+			resolved.resize((size_t) buffer->width * buffer->height);
+			indexed->toRGBA(resolved.data());
+			data = resolved.data();
+		}
+
+		for (int y = 0; y < buffer->height; y++) {
+			const Pixel *src = data + y * buffer->width;
+			for (int x = 0; x < buffer->width; x++) {
+				row[x * 3] = src[x].r;
+				row[x * 3 + 1] = src[x].g;
+				row[x * 3 + 2] = src[x].b;
+			}
+			fwrite(row.data(), 1, row.size(), f);
+		}
+
+		fclose(f);
+		return true;
+	}
+}
+
+#endif
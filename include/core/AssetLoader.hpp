@@ -0,0 +1,195 @@
+//
+//  AssetLoader.hpp
+//  PixFu
+//
+//  Background asset loading in two stages: the CPU part of every asset (file reads, model
+//  parsing, image decoding) runs on the job system workers, as background jobs the GL thread
+//  never picks up while it waits for other jobs, then the GL part (uploads) runs on the GL
+//  thread, a few every frame within a time budget so the loop keeps running (ie. to draw a
+//  loading screen). Uploads run in the order the assets were added, so an asset can rely on
+//  the ones added before it.
+//
+//  The engine owns one (Fu::assets) and steps it every frame with FuConfig_t::uploadBudget.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "JobSystem.hpp"
+#include "Logger.hpp"
+#include "Profiler.hpp"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <string>
+
+namespace Pix {
+
+	class AssetLoader {
+
+		inline static const std::string TAG = "AssetLoader";
+
+		typedef struct sAsset {
+			std::string name;
+			std::function<void()> decode;       // job system
+			std::function<void()> upload;       // GL thread
+			std::function<void()> discard;      // GL thread, if never uploaded
+			std::atomic<bool> decoded{false};
+		} Asset_t;
+
+		JobSystem *pJobs;
+
+		std::deque<Asset_t> vAssets;           // stable addresses, jobs point to them
+		size_t nUploaded = 0;                   // assets uploaded, the next one to upload
+		JobCounter_t nDecoding{0};
+		std::atomic<int> nDecoded{0};
+
+		uint64_t nStart = 0, nEnd = 0;          // Profiler::now()
+
+	public:
+
+		/**
+		 * Creates a loader
+		 * @param jobs Job system for the decoding stage
+		 */
+		explicit AssetLoader(JobSystem *jobs);
+
+		~AssetLoader();
+
+		/**
+		 * Adds an asset and starts decoding it. Call from the GL thread.
+		 * @param name Asset name, for progress reports
+		 * @param decode CPU stage, runs on any thread: must not use GL
+		 * @param upload GL stage, runs on the GL thread once decoded and the previous assets are uploaded
+		 * @param discard Optional, frees the decoded data if the loader is destroyed before the upload
+		 */
+		void add(const std::string &name, std::function<void()> decode, std::function<void()> upload,
+				 std::function<void()> discard = nullptr);
+
+		/**
+		 * Uploads decoded assets until the budget is spent, at least one if ready. Without worker
+		 * threads it also runs the decodes. Called every frame by the engine.
+		 * @param budget Time budget in seconds
+		 * @return whether all assets are loaded
+		 */
+		bool update(float budget);
+
+		/** Waits for all the assets and uploads them, blocking */
+		void finish();
+
+		/** Whether all assets added are loaded */
+		bool done();
+
+		/** Loading progress 0..1, decoding and uploading count the same */
+		float progress();
+
+		/** Assets added */
+		int total();
+
+		/** Assets loaded */
+		int loaded();
+
+		/** Name of the next asset to upload, empty when done */
+		std::string current();
+
+		/** Time since the first asset was added until the last was uploaded (or now), in ms */
+		float elapsed();
+
+	};
+
+	inline AssetLoader::AssetLoader(JobSystem *jobs) : pJobs(jobs) {}
+
+	inline AssetLoader::~AssetLoader() {
+		pJobs->wait(nDecoding);
+		for (; nUploaded < vAssets.size(); nUploaded++)
+			if (vAssets[nUploaded].discard) vAssets[nUploaded].discard();
+	}
+
+	inline void AssetLoader::add(const std::string &name, std::function<void()> decode,
+								 std::function<void()> upload, std::function<void()> discard) {
+
+		if (done()) {
+			// a new batch
+			vAssets.clear();
+			nUploaded = 0;
+			nDecoded = 0;
+			nStart = Profiler::now();
+		}
+
+		vAssets.emplace_back();
+		Asset_t *asset = &vAssets.back();
+		asset->name = name;
+		asset->decode = std::move(decode);
+		asset->upload = std::move(upload);
+		asset->discard = std::move(discard);
+
+		pJobs->pushBackground([this, asset] {
+			PIXFU_PROFILE("AssetLoader::decode");
+			if (asset->decode) asset->decode();
+			// counted first, once published the asset may be uploaded and a new batch started
+			nDecoded.fetch_add(1, std::memory_order_relaxed);
+			asset->decoded.store(true, std::memory_order_release);
+		}, &nDecoding);
+	}
+
+	inline bool AssetLoader::update(float budget) {
+
+		if (done()) return true;
+
+		PIXFU_PROFILE("AssetLoader::update");
+
+		uint64_t deadline = Profiler::now() + (uint64_t) (budget * 1e9f);
+		bool first = true;
+
+		while (nUploaded < vAssets.size() && (first || Profiler::now() < deadline)) {
+
+			Asset_t &asset = vAssets[nUploaded];
+
+			if (!asset.decoded.load(std::memory_order_acquire)) {
+				// a decode may take longer than the budget, only help when there are no workers to do it
+				if (pJobs->workers() > 0 || !pJobs->help()) break;
+				continue;
+			}
+
+			if (asset.upload) asset.upload();
+			asset.upload = nullptr;
+			asset.decode = nullptr;
+			nUploaded++;
+			first = false;
+		}
+
+		if (done()) {
+			nEnd = Profiler::now();
+			PIXFU_LOGV(TAG, "Loaded %d assets in %d ms", total(), (int) elapsed());
+		}
+
+		return done();
+	}
+
+	inline void AssetLoader::finish() {
+		pJobs->wait(nDecoding);
+		update(1e9f);
+	}
+
+	inline bool AssetLoader::done() { return nUploaded == vAssets.size(); }
+
+	inline float AssetLoader::progress() {
+		if (vAssets.empty()) return 1;
+		return (nDecoded.load(std::memory_order_relaxed) + nUploaded) / (2.0f * vAssets.size());
+	}
+
+	inline int AssetLoader::total() { return (int) vAssets.size(); }
+
+	inline int AssetLoader::loaded() { return (int) nUploaded; }
+
+	inline std::string AssetLoader::current() { return done() ? "" : vAssets[nUploaded].name; }
+
+	inline float AssetLoader::elapsed() {
+		if (vAssets.empty()) return 0;
+		return ((done() ? nEnd : Profiler::now()) - nStart) / 1e6f;
+	}
+
+}
@@ -0,0 +1,472 @@
+//
+//  AssetSource.hpp
+//  PixFu
+//
+//  Where assets are read from. Assets are served as read-only byte ranges (AssetData): from
+//  memory-mapped packs (a single file with all the assets, built by tools/pxpack) when
+//  mounted, or from the loose files otherwise, so development runs straight from the assets
+//  tree. Entries of a pack are views into its mapping: no open, no read and no copy.
+//
+//  The pack has a header, the directory sorted by name (binary searched), the names and
+//  the data. Every entry starts at the pack alignment (64 by default), so uploads can read
+//  straight from it. Entries can be LZ4 compressed, then they are decompressed on open
+//  (needs PIXFU_LZ4 and liblz4).
+//
+//  FuPlatform::setPath sets the root of the loose files and mounts <root>.pxpk if present.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef PIXFU_LZ4
+#include <lz4.h>
+#endif
+
+namespace Pix {
+
+	/** Pack header, followed by the directory, the names block and the data */
+	typedef struct sAssetPackHeader {
+		char magic[4];              // "PXPK"
+		uint32_t version;           // AssetSource::VERSION
+		uint32_t entries;           // directory entries, after the header
+		uint32_t alignment;         // of every entry data
+		uint64_t names;             // offset of the names block
+		uint64_t namesSize;
+	} AssetPackHeader_t;
+
+	constexpr uint32_t ASSETPACK_LZ4 = 1;
+
+	/** Directory entry. Names are relative to the assets root, without leading slash. */
+	typedef struct sAssetPackEntry {
+		uint64_t offset;            // data offset in the pack
+		uint64_t stored;            // bytes in the pack
+		uint64_t size;              // bytes once decompressed
+		uint32_t name;              // offset in the names block
+		uint32_t nameLength;
+		uint32_t flags;             // ASSETPACK_LZ4
+		uint32_t reserved;
+	} AssetPackEntry_t;
+
+	/**
+	 * The bytes of an asset. A view into a mounted pack (valid while it is mounted), or owns
+	 * them: a loose file (read, or mapped if big) or a decompressed entry. Movable, not copyable.
+	 */
+	class AssetData {
+
+		friend class AssetSource;
+
+		const uint8_t *pData = nullptr;
+		size_t nSize = 0;
+
+		void *pMap = nullptr;                   // big loose file mapping, owned
+		size_t nMapSize = 0;
+		std::unique_ptr<uint8_t[]> pBuffer;     // small loose file or decompressed entry
+
+		bool bPacked = false;
+		std::string sPack;                      // pack file and offset of a packed view
+		uint64_t nOffset = 0;
+
+	public:
+
+		AssetData() = default;
+
+		AssetData(AssetData &&other) noexcept;
+
+		AssetData &operator=(AssetData &&other) noexcept;
+
+		AssetData(const AssetData &) = delete;
+
+		AssetData &operator=(const AssetData &) = delete;
+
+		~AssetData();
+
+		const uint8_t *data() const;
+
+		size_t size() const;
+
+		std::string_view view() const;
+
+		/** Whether it is a view into a mounted pack, not a copy */
+		bool packed() const;
+
+		/** The pack file of a packed view, to map the entry on its own */
+		const std::string &pack() const;
+
+		/** Offset of a packed view in its pack file */
+		uint64_t offset() const;
+
+		/** Whether the asset was found */
+		explicit operator bool() const;
+
+	};
+
+	/**
+	 * An input stream over an asset, for parsers written for streams. Reads straight from
+	 * the asset bytes.
+	 */
+	class AssetStream : public std::istream {
+
+		class Buffer : public std::streambuf {
+		public:
+			void set(const AssetData &data);
+		};
+
+		AssetData mData;
+		Buffer mBuffer;
+
+	public:
+
+		/** @param path Asset path, as for AssetSource::open */
+		explicit AssetStream(const std::string &path);
+
+		bool is_open() const;
+
+		/** Releases the asset */
+		void close();
+
+	};
+
+	class AssetSource {
+
+		inline static const std::string TAG = "AssetSource";
+
+		typedef struct sPack {
+			std::string path;
+			uint8_t *map;
+			size_t size;
+			const AssetPackEntry_t *entries;
+			uint32_t count;
+			const char *names;
+		} Pack_t;
+
+		inline static std::mutex mPacks;
+		inline static std::vector<Pack_t> vPacks;      // mount order, the last wins
+		inline static std::string sRoot;
+
+		// name of a path in the packs, empty if outside the root
+		static std::string_view key(const std::string &path);
+
+		static const AssetPackEntry_t *find(const Pack_t &pack, std::string_view name);
+
+		// reads or maps a loose file
+		static AssetData load(const std::string &path);
+
+		// loose files from this size on are mapped
+		static constexpr size_t MAPTHRESHOLD = 64 * 1024;
+
+	public:
+
+		/** Current pack format version. Bump on any layout change. */
+		static constexpr uint32_t VERSION = 1;
+
+		static constexpr uint32_t ALIGNMENT = 64;
+
+		/** Pack file extension */
+		inline static const std::string EXTENSION = ".pxpk";
+
+		/**
+		 * Sets the root of the loose files and pack names. Called by FuPlatform::setPath.
+		 * @param root Absolute path of the assets folder
+		 */
+		static void setRoot(const std::string &root);
+
+		/**
+		 * Maps a pack. Its entries take priority over the loose files and the packs mounted
+		 * before it.
+		 * @param path Pack filename
+		 * @return whether it was mounted
+		 */
+		static bool mount(const std::string &path);
+
+		/** Unmaps a pack. Views of its entries become invalid. */
+		static void unmount(const std::string &path);
+
+		/**
+		 * Opens an asset
+		 * @param path Absolute (ie. from FuPlatform::getPath) or relative to the root
+		 * @param loose Whether to fall back to the loose file if it is not in a pack
+		 * @return its bytes, empty if not found
+		 */
+		static AssetData open(const std::string &path, bool loose = true);
+
+		/** Whether an asset is in a mounted pack */
+		static bool packed(const std::string &path);
+
+	};
+
+	//
+	///////// INLINE IMPLEMENTATION
+	//
+
+	inline AssetData::AssetData(AssetData &&other) noexcept { *this = std::move(other); }
+
+	inline AssetData &AssetData::operator=(AssetData &&other) noexcept {
+		if (this != &other) {
+			if (pMap != nullptr) munmap(pMap, nMapSize);
+			pData = other.pData;
+			nSize = other.nSize;
+			pMap = other.pMap;
+			nMapSize = other.nMapSize;
+			pBuffer = std::move(other.pBuffer);
+			bPacked = other.bPacked;
+			sPack = std::move(other.sPack);
+			nOffset = other.nOffset;
+			other.pData = nullptr;
+			other.nSize = 0;
+			other.pMap = nullptr;
+			other.bPacked = false;
+		}
+		return *this;
+	}
+
+	inline AssetData::~AssetData() {
+		if (pMap != nullptr) munmap(pMap, nMapSize);
+	}
+
+	inline const uint8_t *AssetData::data() const { return pData; }
+
+	inline size_t AssetData::size() const { return nSize; }
+
+	inline std::string_view AssetData::view() const {
+		return {reinterpret_cast<const char *>(pData), nSize};
+	}
+
+	inline bool AssetData::packed() const { return bPacked; }
+
+	inline const std::string &AssetData::pack() const { return sPack; }
+
+	inline uint64_t AssetData::offset() const { return nOffset; }
+
+	inline AssetData::operator bool() const { return pData != nullptr; }
+
+	inline void AssetStream::Buffer::set(const AssetData &data) {
+		// the get area is never written, streambuf just wants it non-const
+		char *begin = const_cast<char *>(reinterpret_cast<const char *>(data.data()));
+		setg(begin, begin, begin + data.size());
+	}
+
+	inline AssetStream::AssetStream(const std::string &path)
+			: std::istream(nullptr), mData(AssetSource::open(path)) {
+		mBuffer.set(mData);
+		rdbuf(&mBuffer);
+		if (!mData) setstate(std::ios::failbit);
+	}
+
+	inline bool AssetStream::is_open() const { return (bool) mData; }
+
+	inline void AssetStream::close() {
+		mData = AssetData();
+		mBuffer.set(mData);
+		setstate(std::ios::eofbit);
+	}
+
+	inline void AssetSource::setRoot(const std::string &root) {
+		std::lock_guard<std::mutex> lock(mPacks);
+		sRoot = root;
+		while (sRoot.size() > 1 && sRoot.back() == '/') sRoot.pop_back();
+	}
+
+	inline std::string_view AssetSource::key(const std::string &path) {
+		std::string_view name(path);
+		if (!name.empty() && name[0] == '/') {
+			// absolute: must be under the root
+			if (sRoot.empty() || name.compare(0, sRoot.size(), sRoot) != 0
+				|| (name.size() > sRoot.size() && name[sRoot.size()] != '/'))
+				return {};
+			name.remove_prefix(sRoot.size());
+		}
+		while (!name.empty() && name[0] == '/') name.remove_prefix(1);
+		return name;
+	}
+
+	inline const AssetPackEntry_t *AssetSource::find(const Pack_t &pack, std::string_view name) {
+		const AssetPackEntry_t *end = pack.entries + pack.count;
+		const AssetPackEntry_t *entry = std::lower_bound(pack.entries, end, name,
+				[&pack](const AssetPackEntry_t &e, std::string_view n) {
+					return std::string_view(pack.names + e.name, e.nameLength) < n;
+				});
+		if (entry == end || std::string_view(pack.names + entry->name, entry->nameLength) != name) return nullptr;
+		return entry;
+	}
+
+	inline bool AssetSource::mount(const std::string &path) {
+
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(AssetPackHeader_t)) {
+			close(fd);
+			PIXFU_LOGE(TAG, "Invalid pack %s", path.c_str());
+			return false;
+		}
+
+		// read only: entries are shared by every load, whoever modifies them makes a copy
+		void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (data == MAP_FAILED) {
+			PIXFU_LOGE(TAG, "Cannot map pack %s", path.c_str());
+			return false;
+		}
+
+		uint8_t *bytes = static_cast<uint8_t *>(data);
+		uint64_t size = (uint64_t) st.st_size;
+		const AssetPackHeader_t *header = reinterpret_cast<const AssetPackHeader_t *>(bytes);
+
+		bool valid = memcmp(header->magic, "PXPK", 4) == 0
+					 && header->version == VERSION
+					 && sizeof(AssetPackHeader_t) + (uint64_t) header->entries * sizeof(AssetPackEntry_t) <= header->names
+					 && header->names <= size && header->namesSize <= size - header->names;
+
+		const AssetPackEntry_t *entries = reinterpret_cast<const AssetPackEntry_t *>(bytes + sizeof(AssetPackHeader_t));
+		for (uint32_t i = 0; valid && i < header->entries; i++) {
+			const AssetPackEntry_t &entry = entries[i];
+			// subtracting, so huge offsets cannot wrap around
+			valid = entry.stored <= size && entry.offset <= size - entry.stored
+					&& entry.nameLength <= header->namesSize && entry.name <= header->namesSize - entry.nameLength
+					&& (entry.flags & ASSETPACK_LZ4 || entry.stored == entry.size);
+		}
+
+		if (!valid) {
+			munmap(data, st.st_size);
+			PIXFU_LOGE(TAG, "Invalid pack %s", path.c_str());
+			return false;
+		}
+
+		unmount(path);
+
+		std::lock_guard<std::mutex> lock(mPacks);
+		vPacks.push_back({path, bytes, (size_t) st.st_size, entries, header->entries,
+						  reinterpret_cast<const char *>(bytes + header->names)});
+
+		PIXFU_LOGV(TAG, "Mounted %s, %d assets", path.c_str(), (int) header->entries);
+		return true;
+	}
+
+	inline void AssetSource::unmount(const std::string &path) {
+		std::lock_guard<std::mutex> lock(mPacks);
+		for (auto pack = vPacks.begin(); pack != vPacks.end(); pack++) {
+			if (pack->path == path) {
+				munmap(pack->map, pack->size);
+				vPacks.erase(pack);
+				return;
+			}
+		}
+	}
+
+	inline AssetData AssetSource::load(const std::string &path) {
+
+		AssetData asset;
+
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return asset;
+
+		struct stat st;
+		if (fstat(fd, &st) == 0) {
+			size_t size = (size_t) st.st_size;
+			if (size < MAPTHRESHOLD) {
+				// small files: a read is cheaper than setting up a mapping
+				asset.pBuffer.reset(new uint8_t[std::max((size_t) 1, size)]);
+				size_t done = 0;
+				while (done < size) {
+					ssize_t got = read(fd, asset.pBuffer.get() + done, size - done);
+					if (got <= 0) break;
+					done += got;
+				}
+				if (done == size) {
+					asset.pData = asset.pBuffer.get();
+					asset.nSize = size;
+				} else asset.pBuffer.reset();
+			} else {
+				void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (data != MAP_FAILED) {
+					asset.pMap = data;
+					asset.nMapSize = size;
+					asset.pData = static_cast<const uint8_t *>(data);
+					asset.nSize = size;
+				}
+			}
+		}
+
+		close(fd);
+		return asset;
+	}
+
+	inline AssetData AssetSource::open(const std::string &path, bool loose) {
+
+		AssetData asset;
+		std::string file;
+
+		{
+			std::lock_guard<std::mutex> lock(mPacks);
+			std::string_view name = key(path);
+
+			for (auto pack = vPacks.rbegin(); !name.empty() && pack != vPacks.rend(); pack++) {
+
+				const AssetPackEntry_t *entry = find(*pack, name);
+				if (entry == nullptr) continue;
+
+				const uint8_t *stored = pack->map + entry->offset;
+
+				if (!(entry->flags & ASSETPACK_LZ4)) {
+					asset.pData = stored;
+					asset.nSize = entry->size;
+					asset.bPacked = true;
+					asset.sPack = pack->path;
+					asset.nOffset = entry->offset;
+					return asset;
+				}
+
+#ifdef PIXFU_LZ4
+				asset.pBuffer.reset(new uint8_t[std::max((uint64_t) 1, entry->size)]);
+				int decompressed = LZ4_decompress_safe(reinterpret_cast<const char *>(stored),
+													   reinterpret_cast<char *>(asset.pBuffer.get()),
+													   (int) entry->stored, (int) entry->size);
+				if (decompressed == (int) entry->size) {
+					asset.pData = asset.pBuffer.get();
+					asset.nSize = entry->size;
+					return asset;
+				}
+				asset.pBuffer.reset();
+				PIXFU_LOGE(TAG, "Corrupt entry %s in %s", path.c_str(), pack->path.c_str());
+#else
+				PIXFU_LOGE(TAG, "Entry %s is LZ4 compressed, build with PIXFU_LZ4", path.c_str());
+#endif
+				return asset;
+			}
+
+			if (!loose) return asset;
+			file = path[0] == '/' || sRoot.empty() ? path : sRoot + "/" + path;
+		}
+
+		return load(file);
+	}
+
+	inline bool AssetSource::packed(const std::string &path) {
+		std::lock_guard<std::mutex> lock(mPacks);
+		std::string_view name = key(path);
+		for (const Pack_t &pack:vPacks)
+			if (!name.empty() && find(pack, name) != nullptr) return true;
+		return false;
+	}
+
+}
@@ -0,0 +1,73 @@
+//
+//  Clock.hpp
+//  PixFu
+//
+//  The engine clock: monotonic nanoseconds since the engine started, on steady_clock
+//  (CLOCK_MONOTONIC on Linux and Android, mach_absolute_time on Apple), so it never jumps
+//  with NTP or wall clock changes. Frame times, the profiler, input events and the frame
+//  pacer all read it.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace Pix {
+
+	class Clock {
+
+		inline static const std::chrono::steady_clock::time_point EPOCH = std::chrono::steady_clock::now();
+
+	public:
+
+		/** ns since the engine started */
+		static uint64_t now();
+
+		/** seconds since the engine started */
+		static double seconds();
+
+		/** seconds between two now() readings */
+		static float elapsed(uint64_t from, uint64_t to);
+
+		/**
+		 * Blocks until a now() deadline: sleeps in the OS until margin ns before it, then
+		 * spins (yielding) the rest, as OS sleeps wake up late by a variable amount.
+		 * @param deadline now() to wake up at
+		 * @param margin ns to spin, 0 = only sleep
+		 * @return ns the OS sleep overshot the time it was asked for, 0 if it did not sleep
+		 */
+		static uint64_t sleepUntil(uint64_t deadline, uint64_t margin);
+
+	};
+
+	inline uint64_t Clock::now() {
+		return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - EPOCH).count();
+	}
+
+	inline double Clock::seconds() { return now() / 1e9; }
+
+	inline float Clock::elapsed(uint64_t from, uint64_t to) { return to > from ? (float) ((to - from) / 1e9) : 0; }
+
+	inline uint64_t Clock::sleepUntil(uint64_t deadline, uint64_t margin) {
+
+		uint64_t overshoot = 0;
+
+		if (deadline > margin && now() < deadline - margin) {
+			uint64_t wake = deadline - margin;
+			std::this_thread::sleep_until(EPOCH + std::chrono::nanoseconds(wake));
+			uint64_t woke = now();
+			overshoot = woke > wake ? woke - wake : 0;
+		}
+
+		while (now() < deadline) std::this_thread::yield();
+
+		return overshoot;
+	}
+
+}
@@ -13,8 +13,14 @@
 #pragma ide diagnostic ignored "OCUnusedGlobalDeclarationInspection"
 #pragma ide diagnostic ignored "err_uninitialized_member_in_ctor"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <string>
 
+#include "PixelOps.hpp"
+
 namespace Pix {
 
 	struct Pixel {
@@ -92,11 +98,55 @@ namespace Pix {
 	};
 
 
+	/** A dirty region, in pixels. x1,y1 are exclusive */
+	typedef struct sDirtyRect {
+		int x0, y0, x1, y1;
+
+		inline int area() const { return (x1 - x0) * (y1 - y0); }
+
+		inline bool contains(const sDirtyRect &r) const {
+			return r.x0 >= x0 && r.y0 >= y0 && r.x1 <= x1 && r.y1 <= y1;
+		}
+
+		inline sDirtyRect merged(const sDirtyRect &r) const {
+			return {std::min(x0, r.x0), std::min(y0, r.y0), std::max(x1, r.x1), std::max(y1, r.y1)};
+		}
+	} DirtyRect_t;
+
 	class Drawable {
 
 		static std::string TAG;
+
+		// maximum number of dirty rectangles tracked before they are forcibly merged
+		static constexpr int MAXDIRTY = 8;
+
+		// minimum wasted area allowed when merging two rectangles, so small ones coalesce
+		static constexpr int MERGESLACK = 256;
+
 		Pixel *pData;
-		bool dirty;
+
+		DirtyRect_t aDirty[MAXDIRTY];
+		int nDirty = 0;                     // number of dirty rects
+		int nLastDirty = 0;                 // last rect touched (fast path for consecutive pixels)
+
+		std::function<void()> fnResolver;   // completes deferred drawing (see Canvas2D::setDeferred)
+
+		// whether merging two rects wastes less area than they cover
+		static bool shouldMerge(const DirtyRect_t &a, const DirtyRect_t &b);
+
+		// merges rect i with any other rect it now qualifies to merge with
+		void coalesce(int i);
+
+	protected:
+
+		/**
+		 * Creates a drawable over pixels owned by a derived class (ie. a memory mapped file).
+		 * The derived class must detach() them before the drawable is destroyed.
+		 */
+		Drawable(int w, int h, Pixel *external);
+
+		/** Forgets the pixel buffer, so the destructor does not free it */
+		void detach();
 
 	public:
 
@@ -109,11 +159,11 @@ namespace Pix {
 		 */
 		Drawable(int w, int h);
 
-		~Drawable();
+		virtual ~Drawable();
 
 		/**
 		 * Gets supporting buffer
-		 * @return The raw pixel buffer
+		 * @return The raw pixel buffer, null if the pixels are not RGBA (IndexedDrawable)
 		 */
 
 		Pixel *getData();
@@ -123,8 +173,9 @@ namespace Pix {
 		 * @param x coord
 		 * @param y coord
 		 * @param pix color
+		 * @param mode how the color combines with the existing pixel
 		 */
-		void setPixel(int x, int y, Pixel pix);
+		virtual void setPixel(int x, int y, Pixel pix, BlendMode_t mode = BLEND_NORMAL);
 
 		/**
 		 * Gets pixel at position
@@ -133,7 +184,7 @@ namespace Pix {
 		 * @return Pixel
 		 */
 
-		Pixel getPixel(int x, int y);
+		virtual Pixel getPixel(int x, int y);
 
 		/**
 		 * Samples with normalized coordinates
@@ -149,7 +200,42 @@ namespace Pix {
 		 * @param color The color
 		 */
 
-		void clear(Pixel color);
+		virtual void clear(Pixel color);
+
+		/**
+		 * Fills a rectangle. The rectangle is clipped and marked dirty once, then filled with
+		 * the span kernels.
+		 * @param x left
+		 * @param y top
+		 * @param w width
+		 * @param h height
+		 * @param color The color
+		 * @param mode Blend mode
+		 */
+
+		virtual void fillRect(int x, int y, int w, int h, Pixel color, BlendMode_t mode = BLEND_NORMAL);
+
+		/**
+		 * Fills a horizontal span, clipped to the buffer
+		 * @param x left
+		 * @param y row
+		 * @param len length in pixels
+		 * @param color The color
+		 * @param mode Blend mode
+		 */
+
+		virtual void fillSpan(int x, int y, int len, Pixel color, BlendMode_t mode = BLEND_NORMAL);
+
+		/**
+		 * Copies a row of pixels into a horizontal span, clipped to the buffer
+		 * @param x left
+		 * @param y row
+		 * @param src source pixels
+		 * @param len length in pixels
+		 * @param mode Blend mode
+		 */
+
+		virtual void copySpan(int x, int y, const Pixel *src, int len, BlendMode_t mode = BLEND_NORMAL);
 
 		/**
 		 * Clears the buffer using a fast memset. So all components must be the same. Useful mainly to
@@ -157,16 +243,62 @@ namespace Pix {
 		 * @param colorbyte byte to fill the buffer with
 		 */
 
-		void blank(char colorbyte);
+		virtual void blank(char colorbyte);
+
+		/**
+		 * Marks a region as changed. The region is clipped to the drawable and merged into the
+		 * current set of dirty rectangles. Drawing primitives mark their bounding box once, so
+		 * the following per-pixel marks hit the fast path.
+		 * @param x left
+		 * @param y top
+		 * @param w width
+		 * @param h height
+		 */
+
+		void markDirty(int x, int y, int w, int h);
+
+		/**
+		 * Marks the whole drawable as changed
+		 */
+
+		void markDirty();
+
+		/**
+		 * Whether there are pending changes
+		 */
+
+		bool isDirty();
+
+		/**
+		 * Gets the dirty rectangles accumulated since the last clearDirty()
+		 * @param count receives the number of rectangles
+		 * @return the rectangles
+		 */
+
+		const DirtyRect_t *dirtyRects(int &count);
 
 		/**
-		 * Clears the dirty flag if set. Flag is set by setPixel(). Used by other classes to know
-		 * if a drawable has changed.
-		 * @return true if flag was cleared
+		 * Clears the dirty rectangles if any. They are set by setPixel() and all drawing functions.
+		 * Used by other classes to know if (and where) a drawable has changed.
+		 * @return true if there were dirty rectangles
 		 */
 
 		bool clearDirty();
 
+		/**
+		 * Sets a function that completes any drawing deferred on this drawable. It is called
+		 * by resolve() before the pixels are consumed, ie. uploaded to a texture.
+		 * @param resolver The function, or nullptr to remove it
+		 */
+
+		void setResolver(std::function<void()> resolver);
+
+		/**
+		 * Completes any deferred drawing, so the buffer holds the final pixels
+		 */
+
+		void resolve();
+
 
 		/**
 		 * Creates a drawable from a PNG file
@@ -178,21 +310,141 @@ namespace Pix {
 
 	};
 
+	inline Drawable::Drawable(int w, int h, Pixel *external) : pData(external), width(w), height(h) {}
+
+	inline void Drawable::detach() { pData = nullptr; }
+
 	inline Pixel *Drawable::getData() { return pData; }
 
-	inline void Drawable::setPixel(int x, int y, Pix::Pixel pix) {
-		dirty = true;
-		if (x < width && y < height && x >= 0 && y >= 0)
-			pData[y * width + x] = pix;
+	inline void Drawable::setPixel(int x, int y, Pix::Pixel pix, BlendMode_t mode) {
+		if (x < width && y < height && x >= 0 && y >= 0) {
+			uint32_t &dst = reinterpret_cast<uint32_t *>(pData)[y * width + x];
+			dst = mode == BLEND_NORMAL ? pix.n : PixelOps::blend(dst, pix.n, mode);
+			markDirty(x, y, 1, 1);
+		}
+	}
+
+	inline void Drawable::clear(Pixel color) {
+		PixelOps::fill(reinterpret_cast<uint32_t *>(pData), color.n, static_cast<size_t>(width) * height);
+		markDirty();
+	}
+
+	inline void Drawable::fillRect(int x, int y, int w, int h, Pixel color, BlendMode_t mode) {
+		int x1 = std::min(x + w, width), y1 = std::min(y + h, height);
+		x = std::max(x, 0);
+		y = std::max(y, 0);
+		if (x >= x1 || y >= y1) return;
+		uint32_t *data = reinterpret_cast<uint32_t *>(pData);
+		if (mode == BLEND_NORMAL)
+			PixelOps::fillRect(data, width, x, y, x1 - x, y1 - y, color.n);
+		else
+			for (int j = y; j < y1; j++)
+				PixelOps::blendFill(data + j * width + x, color.n, x1 - x, mode);
+		markDirty(x, y, x1 - x, y1 - y);
+	}
+
+	inline void Drawable::fillSpan(int x, int y, int len, Pixel color, BlendMode_t mode) {
+		if (y < 0 || y >= height) return;
+		int x1 = std::min(x + len, width);
+		x = std::max(x, 0);
+		if (x >= x1) return;
+		PixelOps::blendFill(reinterpret_cast<uint32_t *>(pData) + y * width + x, color.n, x1 - x, mode);
+		markDirty(x, y, x1 - x, 1);
+	}
+
+	inline void Drawable::copySpan(int x, int y, const Pixel *src, int len, BlendMode_t mode) {
+		if (y < 0 || y >= height) return;
+		int x1 = std::min(x + len, width);
+		int skip = x < 0 ? -x : 0;
+		x += skip;
+		if (x >= x1) return;
+		PixelOps::blendCopy(reinterpret_cast<uint32_t *>(pData) + y * width + x,
+							reinterpret_cast<const uint32_t *>(src) + skip, x1 - x, mode);
+		markDirty(x, y, x1 - x, 1);
+	}
+
+	inline void Drawable::blank(char colorbyte) {
+		memset(static_cast<void *>(pData), colorbyte, width * height * sizeof(Pixel));
+		markDirty();
+	}
+
+	inline bool Drawable::shouldMerge(const DirtyRect_t &a, const DirtyRect_t &b) {
+		int covered = a.area() + b.area();
+		return a.merged(b).area() - covered <= std::max(covered, MERGESLACK);
+	}
+
+	inline void Drawable::coalesce(int i) {
+		for (int j = 0; j < nDirty; j++) {
+			if (j != i && shouldMerge(aDirty[i], aDirty[j])) {
+				aDirty[i] = aDirty[i].merged(aDirty[j]);
+				aDirty[j] = aDirty[--nDirty];
+				if (i == nDirty) i = j;
+				j = -1;        // restart, rect i has grown
+			}
+		}
+		nLastDirty = i;
+	}
+
+	inline void Drawable::markDirty(int x, int y, int w, int h) {
+
+		DirtyRect_t rect = {std::max(x, 0), std::max(y, 0), std::min(x + w, width), std::min(y + h, height)};
+		if (rect.x1 <= rect.x0 || rect.y1 <= rect.y0) return;
+
+		// fast path: consecutive pixels of the same primitive
+		if (nDirty > 0 && aDirty[nLastDirty].contains(rect)) return;
+
+		for (int i = 0; i < nDirty; i++) {
+			if (shouldMerge(aDirty[i], rect)) {
+				aDirty[i] = aDirty[i].merged(rect);
+				coalesce(i);
+				return;
+			}
+		}
+
+		if (nDirty < MAXDIRTY) {
+			nLastDirty = nDirty;
+			aDirty[nDirty++] = rect;
+			return;
+		}
+
+		// full: merge into the rect that grows the least
+		int best = 0, bestGrowth = INT32_MAX;
+		for (int i = 0; i < nDirty; i++) {
+			int growth = aDirty[i].merged(rect).area() - aDirty[i].area();
+			if (growth < bestGrowth) {
+				bestGrowth = growth;
+				best = i;
+			}
+		}
+		aDirty[best] = aDirty[best].merged(rect);
+		coalesce(best);
+	}
+
+	inline void Drawable::markDirty() {
+		aDirty[0] = {0, 0, width, height};
+		nDirty = 1;
+		nLastDirty = 0;
+	}
+
+	inline bool Drawable::isDirty() { return nDirty > 0; }
+
+	inline const DirtyRect_t *Drawable::dirtyRects(int &count) {
+		count = nDirty;
+		return aDirty;
 	}
 
 	inline bool Drawable::clearDirty() {
-		if (dirty) {
-			dirty = false;
+		if (nDirty > 0) {
+			nDirty = 0;
+			nLastDirty = 0;
 			return true;
 		} else return false;
 	}
 
+	inline void Drawable::setResolver(std::function<void()> resolver) { fnResolver = std::move(resolver); }
+
+	inline void Drawable::resolve() { if (fnResolver) fnResolver(); }
+
 	inline Pixel Drawable::getPixel(int x, int y) {
 		if (x < 0 || y < 0 || x >= width || y >= height) return 0;
 		return pData[y * width + x];
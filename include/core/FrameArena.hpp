@@ -0,0 +1,297 @@
+//
+//  FrameArena.hpp
+//  PixFu
+//
+//  A linear allocator for data that only lives during a frame. Allocating is bumping an offset
+//  (thread safe, lock-free) and nothing is ever freed: the engine resets the whole arena at
+//  the start of every frame (Fu::loop_tick). If a frame needs more than the capacity, the
+//  excess goes to the heap and the arena grows to fit it on the next reset, so in steady state
+//  frames do not touch the heap at all.
+//
+//  FrameAllocator adapts it to STL containers (FrameVector), and SFF() formats strings into
+//  it, like SF() but without heap allocations.
+//
+//  To verify, define PIXFU_COUNT_HEAP_ALLOCATIONS in one source file of the application: it
+//  replaces the global new/delete (all forms, aligned and nothrow too) with counting ones, and
+//  heapAllocations() reports how many the last frame made. Allocations made straight with
+//  malloc are not seen.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace Pix {
+
+	class FrameArena {
+
+		inline static const std::string TAG = "FrameArena";
+
+		uint8_t *pBlock = nullptr;
+		size_t nCapacity;
+		std::atomic<size_t> nUsed{0};
+
+		// allocations that did not fit this frame
+		std::mutex mOverflow;
+		std::vector<std::pair<void *, size_t>> vOverflow;      // pointer, alignment
+		size_t nOverflowBytes = 0;
+
+		size_t nHighWater = 0;
+		uint64_t nHeapMark = 0, nHeapLastFrame = 0;
+
+		void *overflow(size_t size, size_t alignment);
+
+	public:
+
+		/** Heap allocations count, maintained by PIXFU_COUNT_HEAP_ALLOCATIONS */
+		inline static std::atomic<uint64_t> HEAPALLOCATIONS{0};
+
+		/** The engine frame arena, reset at the start of every frame */
+		static FrameArena &frame();
+
+		/**
+		 * Creates an arena
+		 * @param capacity Initial capacity in bytes
+		 */
+		explicit FrameArena(size_t capacity = 256 * 1024);
+
+		~FrameArena();
+
+		/**
+		 * Allocates memory valid until the next reset
+		 * @param size Bytes
+		 * @param alignment Alignment, a power of 2
+		 */
+		void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+		/**
+		 * Formats a string into the arena
+		 * @return the string, valid until the next reset
+		 */
+		template<typename ... Args>
+		const char *format(const char *format, Args ... args);
+
+		/**
+		 * Frees everything. Nothing allocated from the arena can be used anymore.
+		 */
+		void reset();
+
+		/** Bytes allocated since the last reset */
+		size_t used();
+
+		size_t capacity();
+
+		/** Most bytes a frame has needed */
+		size_t highWater();
+
+		/** Heap allocations during the last frame (see PIXFU_COUNT_HEAP_ALLOCATIONS) */
+		uint64_t heapAllocations();
+
+	};
+
+	/** STL allocator on a frame arena */
+	template<typename T>
+	class FrameAllocator {
+
+		FrameArena *pArena;
+
+	public:
+
+		typedef T value_type;
+
+		FrameAllocator(FrameArena *arena = &FrameArena::frame()) noexcept : pArena(arena) {}
+
+		template<typename U>
+		FrameAllocator(const FrameAllocator<U> &other) noexcept : pArena(other.arena()) {}
+
+		T *allocate(size_t count) { return static_cast<T *>(pArena->allocate(count * sizeof(T), alignof(T))); }
+
+		void deallocate(T *, size_t) noexcept {}
+
+		FrameArena *arena() const { return pArena; }
+
+		template<typename U>
+		bool operator==(const FrameAllocator<U> &other) const { return pArena == other.arena(); }
+
+		template<typename U>
+		bool operator!=(const FrameAllocator<U> &other) const { return pArena != other.arena(); }
+	};
+
+	/** A vector for the current frame, it must not outlive it */
+	template<typename T>
+	using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+	inline FrameArena &FrameArena::frame() {
+		static FrameArena arena;
+		return arena;
+	}
+
+	inline FrameArena::FrameArena(size_t capacity)
+			: pBlock(static_cast<uint8_t *>(::operator new(capacity, std::align_val_t(64)))), nCapacity(capacity) {}
+
+	inline FrameArena::~FrameArena() {
+		reset();
+		::operator delete(pBlock, std::align_val_t(64));
+	}
+
+	inline void *FrameArena::allocate(size_t size, size_t alignment) {
+
+		size_t offset = nUsed.load(std::memory_order_relaxed), aligned, end;
+
+		do {
+			aligned = (offset + alignment - 1) & ~(alignment - 1);
+			end = aligned + size;
+			if (end > nCapacity) return overflow(size, alignment);
+		} while (!nUsed.compare_exchange_weak(offset, end, std::memory_order_relaxed));
+
+		return pBlock + aligned;
+	}
+
+	inline void *FrameArena::overflow(size_t size, size_t alignment) {
+		std::lock_guard<std::mutex> lock(mOverflow);
+		alignment = std::max(alignment, alignof(std::max_align_t));
+		void *memory = ::operator new(size, std::align_val_t(alignment));
+		vOverflow.emplace_back(memory, alignment);
+		nOverflowBytes += size + alignment;
+		return memory;
+	}
+
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wformat-security"
+#endif
+
+	template<typename ... Args>
+	inline const char *FrameArena::format(const char *format, Args ... args) {
+		char buffer[256];
+		int size = snprintf(buffer, sizeof(buffer), format, args ...);
+		if (size < 0) return "";
+		char *text = static_cast<char *>(allocate(size + 1, 1));
+		if (size < (int) sizeof(buffer)) memcpy(text, buffer, size + 1);
+		else snprintf(text, size + 1, format, args ...);
+		return text;
+	}
+
+	/** Like SF() but formats into the frame arena: the string is only valid during this frame */
+	template<typename ... Args>
+	inline const char *SFF(const char *format, Args ... args) {
+		return FrameArena::frame().format(format, args ...);
+	}
+
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+	inline void FrameArena::reset() {
+
+		size_t used = std::min(nUsed.load(std::memory_order_relaxed), nCapacity) + nOverflowBytes;
+		nHighWater = std::max(nHighWater, used);
+
+		if (!vOverflow.empty()) {
+
+			for (auto &memory:vOverflow) ::operator delete(memory.first, std::align_val_t(memory.second));
+			vOverflow.clear();
+			nOverflowBytes = 0;
+
+			// grow so the next frames fit
+			size_t capacity = nCapacity;
+			while (capacity < nHighWater + nHighWater / 4) capacity *= 2;
+			::operator delete(pBlock, std::align_val_t(64));
+			pBlock = static_cast<uint8_t *>(::operator new(capacity, std::align_val_t(64)));
+			nCapacity = capacity;
+
+			PIXFU_LOGV(TAG, "Grown to %d KB", (int) (capacity / 1024));
+		}
+
+		nUsed.store(0, std::memory_order_relaxed);
+
+		uint64_t heap = HEAPALLOCATIONS.load(std::memory_order_relaxed);
+		nHeapLastFrame = heap - nHeapMark;
+		nHeapMark = heap;
+	}
+
+	inline size_t FrameArena::used() { return std::min(nUsed.load(std::memory_order_relaxed), nCapacity) + nOverflowBytes; }
+
+	inline size_t FrameArena::capacity() { return nCapacity; }
+
+	inline size_t FrameArena::highWater() { return nHighWater; }
+
+	inline uint64_t FrameArena::heapAllocations() { return nHeapLastFrame; }
+
+}
+
+// Counting global new/delete, all forms. Define PIXFU_COUNT_HEAP_ALLOCATIONS before including this header
+// in exactly one source file of the application.
+#ifdef PIXFU_COUNT_HEAP_ALLOCATIONS
+
+void *operator new(size_t size) {
+	Pix::FrameArena::HEAPALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+	if (void *memory = malloc(size > 0 ? size : 1)) return memory;
+	throw std::bad_alloc();
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+	Pix::FrameArena::HEAPALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+	void *memory = nullptr;
+	size_t align = std::max((size_t) alignment, sizeof(void *));
+	if (posix_memalign(&memory, align, size > 0 ? size : 1) == 0) return memory;
+	throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void *operator new[](size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+	Pix::FrameArena::HEAPALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+	return malloc(size > 0 ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &nothrow) noexcept { return operator new(size, nothrow); }
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+	Pix::FrameArena::HEAPALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+	void *memory = nullptr;
+	size_t align = std::max((size_t) alignment, sizeof(void *));
+	return posix_memalign(&memory, align, size > 0 ? size : 1) == 0 ? memory : nullptr;
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &nothrow) noexcept {
+	return operator new(size, alignment, nothrow);
+}
+
+// all of them come from malloc or posix_memalign, free releases any
+void operator delete(void *memory) noexcept { free(memory); }
+
+void operator delete[](void *memory) noexcept { free(memory); }
+
+void operator delete(void *memory, size_t) noexcept { free(memory); }
+
+void operator delete[](void *memory, size_t) noexcept { free(memory); }
+
+void operator delete(void *memory, std::align_val_t) noexcept { free(memory); }
+
+void operator delete[](void *memory, std::align_val_t) noexcept { free(memory); }
+
+void operator delete(void *memory, size_t, std::align_val_t) noexcept { free(memory); }
+
+void operator delete[](void *memory, size_t, std::align_val_t) noexcept { free(memory); }
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept { free(memory); }
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept { free(memory); }
+
+#endif
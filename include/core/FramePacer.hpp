@@ -0,0 +1,185 @@
+//
+//  FramePacer.hpp
+//  PixFu
+//
+//  Paces the loop to a target frame rate when the platform has no vsync (or it is off).
+//  At the end of every frame it waits for the next frame deadline on the engine Clock:
+//  it sleeps most of the time, so the CPU is not burnt in a busy loop, and spins the
+//  last stretch, so frames start on time despite the OS sleep granularity. The spin
+//  margin adapts to how late the sleeps wake up on the device.
+//
+//  Deadlines are a fixed grid (previous + period), so a late frame does not delay the
+//  next ones; if the loop falls more than a frame behind, the grid is restarted.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "Clock.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace Pix {
+
+	/** Pacing report over the last frames, in milliseconds */
+	typedef struct sPacingStats {
+		uint32_t frames = 0;
+		float target = 0;                // target frame time
+		float mean = 0;                  // mean frame time
+		float jitter = 0;                // standard deviation of the frame time
+		float p99 = 0;                   // 99th percentile of the wake up error (late, abs)
+		float max = 0;                   // worst wake up error
+		float spin = 0;                  // mean spin per frame, CPU burnt waiting
+		uint32_t missed = 0;             // frames that ended past their deadline
+	} PacingStats_t;
+
+	class FramePacer {
+
+		static constexpr int WINDOW = 256;                 // frames in the stats
+
+		static constexpr uint64_t MINMARGIN = 200000;      // ns
+		static constexpr uint64_t MAXMARGIN = 4000000;     // ns
+
+		uint64_t nPeriod = 0;                              // target frame time, ns, 0 = off
+		uint64_t nDeadline = 0;                            // last frame deadline, 0 = not started
+		uint64_t nMargin = 1000000;                        // spin before the deadline, ns
+		uint64_t nLastWake = 0;
+
+		float aIntervals[WINDOW] = {};                     // frame times, ms
+		float aErrors[WINDOW] = {};                        // wake up - deadline, ms
+		float aSpins[WINDOW] = {};                         // ms
+		uint32_t nSamples = 0;
+		uint32_t nMissed = 0;
+
+		void sample(uint64_t wake, uint64_t deadline, uint64_t spin);
+
+	public:
+
+		/** @param fps target frames per second, 0 = no pacing */
+		FramePacer(float fps = 0);
+
+		/** Sets the target frame rate, 0 disables pacing */
+		void setTarget(float fps);
+
+		/** target frames per second, 0 = no pacing */
+		float target();
+
+		bool enabled();
+
+		/**
+		 * Waits until the next frame deadline. The engine calls it at the end of every frame
+		 * (after committing it) when pacing is enabled.
+		 */
+		void wait();
+
+		/** Pacing stats of the last frames */
+		PacingStats_t stats();
+
+		/** Clears the stats and restarts the deadlines */
+		void reset();
+
+	};
+
+	///////// INLINE IMPLEMENTATION
+
+	inline FramePacer::FramePacer(float fps) { setTarget(fps); }
+
+	inline void FramePacer::setTarget(float fps) {
+		nPeriod = fps > 0 ? (uint64_t) (1e9 / fps) : 0;
+		reset();
+	}
+
+	inline float FramePacer::target() { return nPeriod > 0 ? (float) (1e9 / nPeriod) : 0; }
+
+	inline bool FramePacer::enabled() { return nPeriod > 0; }
+
+	inline void FramePacer::reset() {
+		nDeadline = nLastWake = 0;
+		nSamples = nMissed = 0;
+	}
+
+	inline void FramePacer::wait() {
+
+		if (nPeriod == 0) return;
+
+		PIXFU_PROFILE("FramePacer::wait");
+
+		uint64_t now = Clock::now();
+
+		if (nDeadline == 0) {
+			// first frame starts the grid
+			nDeadline = nLastWake = now;
+			return;
+		}
+
+		uint64_t deadline = nDeadline + nPeriod;
+
+		if (now >= deadline) {
+			// late: no wait, and if more than a frame behind do not try to catch up
+			nMissed++;
+			nDeadline = now - deadline > nPeriod ? now : deadline;
+			sample(now, deadline, 0);
+			return;
+		}
+
+		uint64_t margin = nMargin;
+		uint64_t overshoot = Clock::sleepUntil(deadline, margin);
+		uint64_t woke = Clock::now();
+
+		// spun the margin left after the sleep, or all of it if too close to sleep
+		uint64_t spin = deadline - now > margin ? (overshoot < margin ? margin - overshoot : 0) : deadline - now;
+
+		// the margin follows the worst recent overshoot: grows at once, shrinks slowly
+		if (overshoot > 0)
+			nMargin = std::min(MAXMARGIN, std::max({MINMARGIN, overshoot + overshoot / 4, margin - margin / 32}));
+
+		nDeadline = deadline;
+		sample(woke, deadline, spin);
+	}
+
+	inline void FramePacer::sample(uint64_t wake, uint64_t deadline, uint64_t spin) {
+		int slot = nSamples++ % WINDOW;
+		aIntervals[slot] = (wake - nLastWake) / 1e6f;
+		aErrors[slot] = (wake - deadline) / 1e6f;
+		aSpins[slot] = spin / 1e6f;
+		nLastWake = wake;
+	}
+
+	inline PacingStats_t FramePacer::stats() {
+
+		PacingStats_t stats;
+		stats.target = nPeriod / 1e6f;
+		stats.missed = nMissed;
+
+		int count = (int) std::min<uint32_t>(nSamples, WINDOW);
+		if (count == 0) return stats;
+
+		float errors[WINDOW];
+		float total = 0, spin = 0;
+		for (int i = 0; i < count; i++) {
+			total += aIntervals[i];
+			spin += aSpins[i];
+			errors[i] = aErrors[i];
+		}
+
+		stats.frames = (uint32_t) count;
+		stats.mean = total / count;
+		stats.spin = spin / count;
+
+		float variance = 0;
+		for (int i = 0; i < count; i++) variance += (aIntervals[i] - stats.mean) * (aIntervals[i] - stats.mean);
+		stats.jitter = sqrtf(variance / count);
+
+		std::sort(errors, errors + count);
+		stats.p99 = errors[std::min(count - 1, (int) (count * 0.99f))];
+		stats.max = errors[count - 1];
+
+		return stats;
+	}
+
+}
@@ -15,10 +15,21 @@
 #pragma ide diagnostic ignored "OCSimplifyInspection"
 #pragma ide diagnostic ignored "OCUnusedGlobalDeclarationInspection"
 
-#include "Utils.hpp"
+#include "Logger.hpp"
 #include "FuExtension.hpp"
 #include "Surface.hpp"
-
+#include "Profiler.hpp"
+#include "JobSystem.hpp"
+#include "AssetLoader.hpp"
+#include "AssetSource.hpp"
+#include "FrameArena.hpp"
+#include "FramePacer.hpp"
+#include "GlState.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -86,7 +97,7 @@ namespace Pix {
 		/** Get file path */
 		static std::string getPath(std::string relpath);
 
-		/** Set root path */
+		/** Set root path. Mounts the assets pack <rootpath>.pxpk if there is one. */
 		static void setPath(std::string rootpath);
 
 	};
@@ -98,8 +109,12 @@ namespace Pix {
 	}
 
 	inline void FuPlatform::setPath(std::string abspath) {
-		if (DBG) LogV(TAG, SF("Local Path Root is %s", abspath.c_str()));
+		PIXFU_LOGV(TAG, "Local Path Root is %s", abspath.c_str());
 		ROOTPATH = abspath;
+		AssetSource::setRoot(abspath);
+		std::string pack = abspath;
+		while (pack.size() > 1 && pack.back() == '/') pack.pop_back();
+		AssetSource::mount(pack + AssetSource::EXTENSION);
 	}
 
 	inline void FuPlatform::onFps(Fu *engine, int fps) {}
@@ -131,6 +146,12 @@ namespace Pix {
 	typedef struct sFuConfig {
 		const FontInfo_t fontInfo = {};
 		const std::string shaderName = "default";
+		const bool indexed = false;                    // indexed color primary surface
+		const float fixedTimestep = 0;                 // fixed simulation step in seconds, 0 = variable
+		const int maxFixedSteps = 5;                   // fixed steps per frame before dropping time
+		const int jobThreads = -1;                     // job system workers, -1 = one less than the cores
+		const float uploadBudget = 0.004f;             // GL time per frame for background loaded assets, seconds
+		const float targetFps = 0;                     // frame pacing without vsync, 0 = as fast as the platform
 	} FuConfig_t;
 
 	class Fu {
@@ -145,6 +166,8 @@ namespace Pix {
 
 		friend class PixFuPlatformApple;
 
+		friend class PixFuPlatformHeadless;
+
 		const FuConfig_t CONFIG;                       		// shader filename
 
 		FuPlatform *pPlatform = nullptr;                 	// platform layer
@@ -160,6 +183,19 @@ namespace Pix {
 		int nFrameCount = 0;                                // fps counter
 		float fFrameTimer = 1.0f;                           // frame timer
 
+		float fAccumulator = 0;                             // fixed step: unsimulated time
+		float fAlpha = 1.0f;                                // fixed step: interpolation alpha
+		int nFixedSteps = 0;                                // fixed step: steps run this frame
+
+		JobSystem mJobs;                                    // job system, runs with the loop
+		JobGraph mUpdates;                                  // update phase of the phased extensions
+		size_t nUpdatesExtensions = 0;                      // extensions when the graph was built
+		uint32_t nUpdatesDependencies = 0;                  // FuExtension::dependencyChanges() then
+		bool bUpdatesDirty = true;                          // graph has to be rebuilt
+		float fUpdateElapsedTime = 0;                       // frame time for the update phase
+		AssetLoader mAssets{&mJobs};                        // background asset loading
+		FramePacer mPacer{CONFIG.targetFps};                // waits for the next frame deadline
+
 		int nScreenWidth = 0, nScreenHeight = 0;            // screen dimensions
 
 		// loop control
@@ -179,6 +215,12 @@ namespace Pix {
 		/** reinit stopped loop */
 		bool loop_reinit(int newWidth, int newHeight);
 
+		/** builds the update graph of the phased extensions, dependencies first */
+		void buildUpdates();
+
+		/** runs the update phase of the phased extensions */
+		void runUpdates(float fElapsedTime);
+
 	protected:
 
 		/**
@@ -229,15 +271,70 @@ namespace Pix {
 
 		int screenHeight();                                  // get screen height
 
+		/**
+		 * Fixed simulation step
+		 * @return the step in seconds, 0 if the engine runs variable steps
+		 */
+
+		float fixedTimestep();
+
+		/**
+		 * How far the render time is between the last two fixed steps, to interpolate the
+		 * simulated state: previous + (current - previous) * alpha. Always 1 with variable steps.
+		 * @return alpha in 0..1
+		 */
+
+		float alpha();
+
+		/**
+		 * Fixed steps run in the current frame
+		 */
+
+		int fixedSteps();
+
 		virtual bool onUserCreate(bool restarted);
 
 		virtual bool onUserUpdate(float fElapsedTime);
 
+		/**
+		 * Called at a fixed rate when FuConfig_t::fixedTimestep is set, before onUserUpdate. Any
+		 * number of times per frame (zero included), always with the same step.
+		 * @param fStep The fixed step in seconds
+		 * @return whether to continue running. If not, no more steps run and the extensions do
+		 * not get this one.
+		 */
+
+		virtual bool onUserFixedUpdate(float fStep);
+
 		virtual bool onUserDestroy();
 
 		Shader *shader();
 		Canvas2D *canvas();
 
+		/**
+		 * The engine job system, to run work on all cores. It starts with the loop (or on first
+		 * use) and stops when the loop ends.
+		 * @return the job system
+		 */
+
+		JobSystem *jobs();
+
+		/**
+		 * The engine asset loader: assets are decoded on the job system and uploaded a few every
+		 * frame (FuConfig_t::uploadBudget). Its progress can drive a loading screen.
+		 * @return the asset loader
+		 */
+
+		AssetLoader *assets();
+
+		/**
+		 * The frame pacer: when it has a target (FuConfig_t::targetFps, FramePacer::setTarget) the
+		 * loop waits at the end of every frame for the next frame deadline.
+		 * @return the frame pacer
+		 */
+
+		FramePacer *pacer();
+
 		/**
 		 * Adds an extension to the engine. Added extensions are integrated into the loop
 		 * and can paint in OpenGL.
@@ -261,13 +358,75 @@ namespace Pix {
 
 	inline int Fu::screenHeight() { return nScreenHeight; }
 
+	inline float Fu::fixedTimestep() { return CONFIG.fixedTimestep; }
+
+	inline float Fu::alpha() { return fAlpha; }
+
+	inline int Fu::fixedSteps() { return nFixedSteps; }
+
+	inline bool Fu::onUserFixedUpdate(float fStep) { return true; }
+
+	inline JobSystem *Fu::jobs() {
+		if (!mJobs.running()) mJobs.start(CONFIG.jobThreads);
+		return &mJobs;
+	}
+
+	inline AssetLoader *Fu::assets() {
+		jobs();
+		return &mAssets;
+	}
+
+	inline FramePacer *Fu::pacer() { return &mPacer; }
+
+	// frame times come from the monotonic engine clock
+	inline void Fu::loop() {
+
+		if (!loop_init()) return;
+
+		uint64_t last = Clock::now();
+
+		while (bLoopActive) {
+
+			while (bLoopActive) {
+
+				uint64_t now = Clock::now();
+				float fElapsedTime = Clock::elapsed(last, now);
+				last = now;
+
+				bLoopActive = loop_tick(fElapsedTime);
+
+				fFrameTimer += fElapsedTime;
+				nFrameCount++;
+				if (fFrameTimer >= 1.0f) {
+					fFrameTimer -= 1.0f;
+					pPlatform->onFps(this, nFrameCount);
+					nFrameCount = 0;
+				}
+			}
+
+			// the app can cancel the exit
+			bLoopActive = !onUserDestroy();
+		}
+
+		loop_deinit();
+	}
+
+	// the platform has a new GL context: engine objects recreate the GL names they kept
+	inline bool Fu::loop_reinit(int newWidth, int newHeight) {
+		loop_deinit();
+		GlState::newContext();
+		glViewport(0, 0, newWidth, newHeight);
+		init(newWidth, newHeight);
+		return loop_init(true);
+	}
+
 	inline void Fu::addExtension(FuExtension *e) {
 	
 		if (e->ONCONSTRUCT && bLoopActive)
 			throw std::runtime_error("Extension has to be added on constructor");
 		
 		vExtensions.push_back(e);
-		
+		bUpdatesDirty = true;
 	}
 
 	inline void Fu::addInputDevice(InputDevice *inputDevice) {
@@ -275,6 +434,142 @@ namespace Pix {
 		inputDevice->init(this);
 	}
 
+	inline void Fu::buildUpdates() {
+
+		mUpdates.clear();
+		bUpdatesDirty = false;
+		nUpdatesExtensions = vExtensions.size();
+		nUpdatesDependencies = FuExtension::dependencyChanges();
+
+		// graph ids of the phased extensions, -1 while being visited (cycles)
+		std::map<FuExtension *, int> ids;
+
+		std::function<int(FuExtension *)> visit = [&](FuExtension *extension) {
+
+			auto found = ids.find(extension);
+			if (found != ids.end()) {
+				if (found->second < 0) PIXFU_LOGE(TAG, "Extension dependency cycle, dependency ignored");
+				return found->second;
+			}
+
+			ids[extension] = -1;
+
+			std::vector<int> after;
+			for (FuExtension *dependency:extension->dependencies()) {
+				if (!dependency->phased()) continue;
+				if (std::find(vExtensions.begin(), vExtensions.end(), dependency) == vExtensions.end()) continue;
+				int id = visit(dependency);
+				if (id >= 0) after.push_back(id);
+			}
+
+			return ids[extension] = mUpdates.add([this, extension] {
+				ProfileScope scope(Profiler::zone(typeid(*extension)));
+				extension->update(this, fUpdateElapsedTime);
+			}, after);
+		};
+
+		for (FuExtension *extension:vExtensions)
+			if (extension->phased()) visit(extension);
+	}
+
+	inline void Fu::runUpdates(float fElapsedTime) {
+
+		if (bUpdatesDirty || nUpdatesExtensions != vExtensions.size()
+			|| nUpdatesDependencies != FuExtension::dependencyChanges())
+			buildUpdates();
+		if (mUpdates.size() == 0) return;
+
+		PIXFU_PROFILE("Fu::update");
+
+		fUpdateElapsedTime = fElapsedTime;
+		mJobs.run(mUpdates);
+	}
+
+	// every stage of the frame is timed in its own profiler zone, extensions and input devices
+	// get a zone per type
+	inline bool Fu::loop_tick(float fElapsedTime) {
+
+		// last frame transient data is gone
+		FrameArena::frame().reset();
+
+		Profiler::frame();
+		GlState::frame();
+		PIXFU_PROFILE("Fu::loop_tick");
+
+		METRONOME += fElapsedTime;
+
+		auto status = pPlatform->events();
+		bLoopActive = status.first;
+		bIsFocused = status.second;
+
+		// draws leave their state set, the depth buffer is only cleared if it is writable
+		GlState::depthMask(true);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		if (bLoopActive) {
+
+			jobs()->runMainThread();
+			mAssets.update(CONFIG.uploadBudget);
+
+			for (InputDevice *device:vInputDevices) {
+				ProfileScope scope(Profiler::zone(typeid(*device)));
+				device->sync(fElapsedTime);
+			}
+
+			if (CONFIG.fixedTimestep > 0) {
+
+				PIXFU_PROFILE("Fu::fixedUpdate");
+
+				const float step = CONFIG.fixedTimestep;
+				fAccumulator += fElapsedTime;
+
+				for (nFixedSteps = 0; bLoopActive && fAccumulator >= step; nFixedSteps++) {
+					if (nFixedSteps == CONFIG.maxFixedSteps) {
+						// spiral of death: cannot keep up, drop the whole steps left, keep the phase
+						fAccumulator = fmodf(fAccumulator, step);
+						break;
+					}
+					bLoopActive = onUserFixedUpdate(step);
+					// stopped by the user, the extensions do not get this step
+					if (!bLoopActive) break;
+					for (FuExtension *extension:vExtensions) extension->fixedTick(this, step);
+					fAccumulator -= step;
+				}
+
+				fAlpha = fAccumulator / step;
+			}
+
+			{
+				PIXFU_PROFILE("Fu::onUserUpdate");
+				bLoopActive = onUserUpdate(fElapsedTime) && bLoopActive;
+			}
+
+			// phased extensions update in parallel, then all render in order on this thread
+			runUpdates(fElapsedTime);
+
+			for (FuExtension *extension:vExtensions) {
+				ProfileScope scope(Profiler::zone(typeid(*extension)));
+				if (extension->phased()) extension->render(this, fElapsedTime);
+				else extension->tick(this, fElapsedTime);
+			}
+
+			mJobs.runMainThread();
+
+			{
+				PIXFU_PROFILE("FuPlatform::commit");
+				pPlatform->commit();
+			}
+
+			for (InputDevice *device:vInputDevices) device->poll();
+
+			mPacer.wait();
+		}
+
+		if (!bLoopActive) mJobs.stop();
+
+		return bLoopActive;
+	}
+
 	inline Drawable *Fu::buffer() { return pSurface->buffer(); }
 
 	inline Canvas2D *Fu::canvas() { return pSurface->canvas(); }
@@ -8,16 +8,31 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
 namespace Pix {
 
 	class Fu;
 
 	/**
 	 * a PixEngine extension. Extensions are added with PixEngine::addExtension.
+	 *
+	 * Extensions are ticked every frame on the GL thread. Optionally, an extension can split its
+	 * frame in two phases (phased() returns true): update(), that must not call OpenGL and only
+	 * touch the extension own data, and render(), on the GL thread. The engine runs the updates
+	 * of all phased extensions concurrently on its job system, respecting dependsOn(), then
+	 * renders every extension in order.
 	 */
 
 	class FuExtension {
 
+		std::vector<FuExtension *> vDependencies;
+
+		// bumped by dependsOn(), so engines know to reorder their updates
+		inline static std::atomic<uint32_t> nDependencyChanges{0};
+
 	public:
 
 		const bool ONCONSTRUCT;
@@ -29,6 +44,44 @@ namespace Pix {
 		virtual bool init(Fu *engine);
 
 		virtual void tick(Fu *engine, float fElapsedTime) = 0;
+
+		/**
+		 * Fixed rate simulation step, only called when the engine runs a fixed timestep
+		 * (FuConfig_t::fixedTimestep), zero or more times per frame and before tick().
+		 * tick() is still called every frame, to render.
+		 * @param engine The engine
+		 * @param fStep The fixed step in seconds
+		 */
+		virtual void fixedTick(Fu *engine, float fStep);
+
+		/** Whether the engine calls update() and render() instead of tick() */
+		virtual bool phased();
+
+		/**
+		 * Update phase, on any thread and concurrently with other extensions updates. No OpenGL.
+		 * @param engine The engine
+		 * @param fElapsedTime The frame time
+		 */
+		virtual void update(Fu *engine, float fElapsedTime);
+
+		/**
+		 * Render phase, on the GL thread after all updates. Defaults to tick().
+		 * @param engine The engine
+		 * @param fElapsedTime The frame time
+		 */
+		virtual void render(Fu *engine, float fElapsedTime);
+
+		/**
+		 * Declares that the update of this extension uses data of another one, so it has to run
+		 * after that one's update. Only phased extensions are ordered.
+		 * @param extension The extension this one depends on
+		 */
+		void dependsOn(FuExtension *extension);
+
+		const std::vector<FuExtension *> &dependencies();
+
+		/** Changes whenever any extension declares a dependency */
+		static uint32_t dependencyChanges();
 	};
 
 	inline FuExtension::FuExtension(bool requireOnConstruct)
@@ -36,5 +89,22 @@ namespace Pix {
 
 	inline bool FuExtension::init(Fu *engine) { return true; }
 
+	inline void FuExtension::fixedTick(Fu *engine, float fStep) {}
+
+	inline bool FuExtension::phased() { return false; }
+
+	inline void FuExtension::update(Fu *engine, float fElapsedTime) {}
+
+	inline void FuExtension::render(Fu *engine, float fElapsedTime) { tick(engine, fElapsedTime); }
+
+	inline void FuExtension::dependsOn(FuExtension *extension) {
+		vDependencies.push_back(extension);
+		nDependencyChanges.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	inline const std::vector<FuExtension *> &FuExtension::dependencies() { return vDependencies; }
+
+	inline uint32_t FuExtension::dependencyChanges() { return nDependencyChanges.load(std::memory_order_relaxed); }
+
 }
 
@@ -0,0 +1,213 @@
+//
+//  GlState.hpp
+//  PixFu
+//
+//  Shadow of the GL state the engine touches on every draw: current program, vertex array,
+//  active texture unit and the texture bound on each unit, blending and depth. Engine classes
+//  change state through here, and calls that would set what is already set are not sent to the
+//  driver. Draws no longer unbind: the next draw binds what it needs, and usually it is what
+//  is already bound (every texture has its own hardwired unit, so its binding stays).
+//
+//  Code that changes these states with raw GL calls has to tell (invalidate()). When the GL
+//  context is (re)created, platforms and Fu::loop_reinit call newContext(): it invalidates and
+//  starts a new context generation (context()), so engine objects that keep GL names know
+//  theirs are gone and create them again.
+//
+//  The engine counts the state calls issued and elided in every frame (stats()).
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "OpenGL.h"
+
+#include <cstdint>
+
+namespace Pix {
+
+	/** GL state calls of a frame */
+	typedef struct sGlStats {
+		uint32_t issued = 0;             // sent to the driver
+		uint32_t elided = 0;             // redundant, skipped
+	} GlStats_t;
+
+	class GlState {
+
+		static constexpr int UNITS = 32;                 // tracked texture units
+		static constexpr GLuint UNKNOWN = (GLuint) -1;
+
+		// -1 unknown, 0 off, 1 on
+		typedef int8_t Flag_t;
+
+		inline static GLuint nProgram = UNKNOWN;
+		inline static GLuint nVertexArray = UNKNOWN;
+		inline static GLuint nActiveUnit = UNKNOWN;
+		inline static GLuint aTextures[UNITS];
+		inline static uint32_t nKnownUnits = 0;          // units with a known binding, bitmask
+
+		inline static Flag_t nBlend = -1;
+		inline static GLenum nBlendSrc = UNKNOWN, nBlendDst = UNKNOWN;
+		inline static Flag_t nDepthTest = -1;
+		inline static Flag_t nDepthMask = -1;
+
+		inline static GlStats_t mFrame, mLast;
+
+		inline static uint32_t nContext = 0;
+
+		/** counts a call, true if it has to be issued */
+		static bool change(bool changed);
+
+		static void capability(GLenum cap, Flag_t &current, bool enable);
+
+	public:
+
+		/** glUseProgram */
+		static void useProgram(GLuint program);
+
+		/** glBindVertexArray */
+		static void bindVertexArray(GLuint vao);
+
+		/** glActiveTexture, unit is the index (0 = GL_TEXTURE0) */
+		static void activeTexture(GLuint unit);
+
+		/**
+		 * Makes the unit active and binds a 2D texture to it, ready to be sampled
+		 * or modified (glTexSubImage2D ...)
+		 * @param unit  Texture unit index (0 = GL_TEXTURE0)
+		 * @param texture The texture id
+		 */
+		static void bindTexture(GLuint unit, GLuint texture);
+
+		/** glEnable / glDisable GL_BLEND */
+		static void blend(bool enable);
+
+		/** glBlendFunc */
+		static void blendFunc(GLenum src, GLenum dst);
+
+		/** glEnable / glDisable GL_DEPTH_TEST */
+		static void depthTest(bool enable);
+
+		/** glDepthMask */
+		static void depthMask(bool write);
+
+		/** Forgets all the state, next calls are issued. After raw GL calls. */
+		static void invalidate();
+
+		/**
+		 * A new GL context: forgets all the state, and the GL objects created before are gone.
+		 * Their names must not be deleted, the new context may have given them to new objects.
+		 */
+		static void newContext();
+
+		/** Generation of the GL context, objects keep the one they created their GL names in */
+		static uint32_t context();
+
+		/**
+		 * Records a texture binding done with raw GL calls (ie. OpenGlUtils::loadTexture),
+		 * the unit is now the active one.
+		 */
+		static void bound(GLuint unit, GLuint texture);
+
+		/** Closes the frame stats, the engine calls it at the start of every frame */
+		static void frame();
+
+		/** State calls of the last frame */
+		static GlStats_t stats();
+
+	};
+
+	///////// INLINE IMPLEMENTATION
+
+	inline bool GlState::change(bool changed) {
+		if (changed) mFrame.issued++;
+		else mFrame.elided++;
+		return changed;
+	}
+
+	inline void GlState::useProgram(GLuint program) {
+		if (!change(nProgram != program)) return;
+		glUseProgram(program);
+		nProgram = program;
+	}
+
+	inline void GlState::bindVertexArray(GLuint vao) {
+		if (!change(nVertexArray != vao)) return;
+		glBindVertexArray(vao);
+		nVertexArray = vao;
+	}
+
+	inline void GlState::activeTexture(GLuint unit) {
+		if (!change(nActiveUnit != unit)) return;
+		glActiveTexture(GL_TEXTURE0 + unit);
+		nActiveUnit = unit;
+	}
+
+	inline void GlState::bindTexture(GLuint unit, GLuint texture) {
+
+		activeTexture(unit);
+
+		bool tracked = unit < UNITS;
+		if (!change(!tracked || (nKnownUnits & (1u << unit)) == 0 || aTextures[unit] != texture)) return;
+
+		glBindTexture(GL_TEXTURE_2D, texture);
+		if (tracked) {
+			aTextures[unit] = texture;
+			nKnownUnits |= 1u << unit;
+		}
+	}
+
+	inline void GlState::bound(GLuint unit, GLuint texture) {
+		nActiveUnit = unit;
+		if (unit >= UNITS) return;
+		aTextures[unit] = texture;
+		nKnownUnits |= 1u << unit;
+	}
+
+	inline void GlState::capability(GLenum cap, Flag_t &current, bool enable) {
+		if (!change(current != (Flag_t) enable)) return;
+		if (enable) glEnable(cap);
+		else glDisable(cap);
+		current = enable;
+	}
+
+	inline void GlState::blend(bool enable) { capability(GL_BLEND, nBlend, enable); }
+
+	inline void GlState::blendFunc(GLenum src, GLenum dst) {
+		if (!change(nBlendSrc != src || nBlendDst != dst)) return;
+		glBlendFunc(src, dst);
+		nBlendSrc = src;
+		nBlendDst = dst;
+	}
+
+	inline void GlState::depthTest(bool enable) { capability(GL_DEPTH_TEST, nDepthTest, enable); }
+
+	inline void GlState::depthMask(bool write) {
+		if (!change(nDepthMask != (Flag_t) write)) return;
+		glDepthMask(write ? GL_TRUE : GL_FALSE);
+		nDepthMask = write;
+	}
+
+	inline void GlState::invalidate() {
+		nProgram = nVertexArray = nActiveUnit = UNKNOWN;
+		nKnownUnits = 0;
+		nBlend = nDepthTest = nDepthMask = -1;
+		nBlendSrc = nBlendDst = UNKNOWN;
+	}
+
+	inline void GlState::newContext() {
+		invalidate();
+		nContext++;
+	}
+
+	inline uint32_t GlState::context() { return nContext; }
+
+	inline void GlState::frame() {
+		mLast = mFrame;
+		mFrame = {};
+	}
+
+	inline GlStats_t GlState::stats() { return mLast; }
+
+}
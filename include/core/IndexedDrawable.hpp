@@ -0,0 +1,353 @@
+//
+//  IndexedDrawable.hpp
+//  PixFu
+//
+//  An 8-bit indexed-color drawable with a 256 entry palette, backing the indexed mode of the
+//  Surface. Pixels are palette indexes, colors are resolved by the GPU when drawing, so fills
+//  move a quarter of the bytes, uploads are 4x smaller and changing the palette (palette
+//  animation) does not touch the pixels at all.
+//
+//  Canvas2D draws into it transparently: colors are converted to indexes as they are written.
+//  Colors::COLOR_1 .. COLOR_16 select palette entries 1 to 16, fully transparent colors select
+//  entry 0 (transparent), any other color selects its nearest palette entry. There is no
+//  arithmetic blending: blended pixels are written when mostly opaque, and fully transparent
+//  sprite and string pixels are skipped.
+//
+//  The drawing methods of Drawable (setPixel, getPixel, fillSpan, copySpan, clear ...) work
+//  on the indexes and convert colors the same way. There are no RGBA pixels though: getData()
+//  is null and sample() is not available, toRGBA() resolves the pixels through the palette.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "Drawable.hpp"
+#include "PixelOps.hpp"
+
+#include <cstring>
+#include <vector>
+
+namespace Pix {
+
+	/**
+	 * Small direct-mapped cache of color to index conversions. Every Canvas2D keeps its own,
+	 * so tiles drawn in parallel never share one.
+	 */
+	typedef struct sPaletteLookup {
+		static constexpr int SIZE = 256;
+		uint32_t keys[SIZE];
+		uint8_t values[SIZE];
+		uint32_t version = 0;       // palette version the entries belong to, 0 = empty
+	} PaletteLookup_t;
+
+	class IndexedDrawable : public Drawable {
+
+		std::vector<uint8_t> vIndexes;
+		std::vector<uint32_t> vPalette;     // Pixel::n of every entry
+		uint32_t nVersion = 1;              // bumped on every palette change
+		bool bPaletteChanged = true;
+		PaletteLookup_t mLookup;            // for the Drawable methods, canvases keep their own
+
+		// nearest palette entry (1..255) of an opaque color
+		uint8_t nearest(uint32_t color) const;
+
+		// whether a source pixel is written with a blend mode
+		static bool covers(uint32_t color, BlendMode_t blend);
+
+	public:
+
+		static constexpr int PALETTESIZE = 256;
+
+		/**
+		 * Creates an indexed drawable, cleared to index 0 and with the default palette: 0 is
+		 * transparent, 1-15 the CGA colors, 16-231 a 6x6x6 color cube and 232-255 a gray ramp.
+		 * @param width Width
+		 * @param height Height
+		 */
+		IndexedDrawable(int width, int height);
+
+		~IndexedDrawable() override;
+
+		/** The pixel indexes, row major */
+		uint8_t *indexes();
+
+		/** The palette, PALETTESIZE entries */
+		const Pixel *palette();
+
+		/** Sets a palette entry. Pixels are not touched, they just show the new color */
+		void setPalette(uint8_t index, Pixel color);
+
+		/**
+		 * Sets several palette entries
+		 * @param colors The colors
+		 * @param count Number of colors
+		 * @param first First entry to set
+		 */
+		void setPalette(const Pixel *colors, int count, int first = 0);
+
+		/**
+		 * Rotates a range of palette entries (color cycling)
+		 * @param first First entry of the range
+		 * @param count Entries in the range
+		 * @param steps Entries to rotate by, negative rotates backwards
+		 */
+		void rotatePalette(int first, int count, int steps = 1);
+
+		/** Whether the palette changed since clearPaletteChanged() */
+		bool paletteChanged();
+
+		void clearPaletteChanged();
+
+		/** Gets a pixel index, 0 outside */
+		uint8_t getIndex(int x, int y);
+
+		/** Sets a pixel index */
+		void setIndex(int x, int y, uint8_t index);
+
+		/** Sets all pixels to an index */
+		void fillIndexes(uint8_t index);
+
+		/**
+		 * Resolves the pixels through the palette
+		 * @param out width * height pixels
+		 */
+		void toRGBA(Pixel *out) const;
+
+		void setPixel(int x, int y, Pixel pix, BlendMode_t mode = BLEND_NORMAL) override;
+
+		Pixel getPixel(int x, int y) override;
+
+		void clear(Pixel color) override;
+
+		void fillRect(int x, int y, int w, int h, Pixel color, BlendMode_t mode = BLEND_NORMAL) override;
+
+		void fillSpan(int x, int y, int len, Pixel color, BlendMode_t mode = BLEND_NORMAL) override;
+
+		void copySpan(int x, int y, const Pixel *src, int len, BlendMode_t mode = BLEND_NORMAL) override;
+
+		void blank(char colorbyte) override;
+
+		/**
+		 * Converts a color to a palette index
+		 * @param color The color
+		 * @param lookup Conversion cache
+		 * @return the index
+		 */
+		uint8_t indexOf(Pixel color, PaletteLookup_t &lookup) const;
+
+		/**
+		 * Writes a pixel. Coordinates must be already clipped.
+		 * @param x coord
+		 * @param y coord
+		 * @param color The color
+		 * @param blend Blend mode
+		 * @param lookup Conversion cache
+		 */
+		void plot(int32_t x, int32_t y, uint32_t color, BlendMode_t blend, PaletteLookup_t &lookup);
+
+		/**
+		 * Fills a span with a color. Span must be already clipped.
+		 */
+		void fillSpan(int32_t x, int32_t y, int32_t count, uint32_t color, BlendMode_t blend, PaletteLookup_t &lookup);
+
+		/**
+		 * Copies a span of RGBA pixels, skipping transparent ones. Span must be already clipped.
+		 */
+		void copySpan(int32_t x, int32_t y, const uint32_t *src, int32_t count, BlendMode_t blend,
+					  PaletteLookup_t &lookup);
+
+	};
+
+	inline IndexedDrawable::IndexedDrawable(int width, int height)
+			: Drawable(width, height, nullptr), vIndexes((size_t) width * height, 0), vPalette(PALETTESIZE) {
+
+		static const uint8_t cga[16][3] = {
+				{0, 0, 0}, {0, 0, 170}, {0, 170, 0}, {0, 170, 170}, {170, 0, 0}, {170, 0, 170}, {170, 85, 0},
+				{170, 170, 170}, {85, 85, 85}, {85, 85, 255}, {85, 255, 85}, {85, 255, 255}, {255, 85, 85},
+				{255, 85, 255}, {255, 255, 85}, {255, 255, 255}};
+		static const uint8_t cube[6] = {0, 95, 135, 175, 215, 255};
+
+		vPalette[0] = Pixel(0, 0, 0, 0).n;
+		for (int i = 1; i < 16; i++) vPalette[i] = Pixel(cga[i][0], cga[i][1], cga[i][2]).n;
+		for (int i = 0; i < 216; i++) vPalette[16 + i] = Pixel(cube[i / 36], cube[i / 6 % 6], cube[i % 6]).n;
+		for (int i = 0; i < 24; i++) vPalette[232 + i] = Pixel(8 + i * 10, 8 + i * 10, 8 + i * 10).n;
+	}
+
+	inline IndexedDrawable::~IndexedDrawable() { detach(); }
+
+	inline uint8_t *IndexedDrawable::indexes() { return vIndexes.data(); }
+
+	inline const Pixel *IndexedDrawable::palette() { return reinterpret_cast<const Pixel *>(vPalette.data()); }
+
+	inline void IndexedDrawable::setPalette(uint8_t index, Pixel color) {
+		vPalette[index] = color.n;
+		nVersion++;
+		bPaletteChanged = true;
+	}
+
+	inline void IndexedDrawable::setPalette(const Pixel *colors, int count, int first) {
+		count = std::min(count, PALETTESIZE - first);
+		if (first < 0 || count <= 0) return;
+		memcpy(vPalette.data() + first, reinterpret_cast<const uint32_t *>(colors), count * sizeof(uint32_t));
+		nVersion++;
+		bPaletteChanged = true;
+	}
+
+	inline void IndexedDrawable::rotatePalette(int first, int count, int steps) {
+		count = std::min(count, PALETTESIZE - first);
+		if (first < 0 || count <= 1) return;
+		steps = ((steps % count) + count) % count;
+		if (steps == 0) return;
+		uint32_t *entries = vPalette.data() + first;
+		std::rotate(entries, entries + count - steps, entries + count);
+		nVersion++;
+		bPaletteChanged = true;
+	}
+
+	inline bool IndexedDrawable::paletteChanged() { return bPaletteChanged; }
+
+	inline void IndexedDrawable::clearPaletteChanged() { bPaletteChanged = false; }
+
+	inline uint8_t IndexedDrawable::getIndex(int x, int y) {
+		if (x < 0 || y < 0 || x >= width || y >= height) return 0;
+		return vIndexes[y * width + x];
+	}
+
+	inline void IndexedDrawable::setIndex(int x, int y, uint8_t index) {
+		if (x < 0 || y < 0 || x >= width || y >= height) return;
+		vIndexes[y * width + x] = index;
+		markDirty(x, y, 1, 1);
+	}
+
+	inline void IndexedDrawable::fillIndexes(uint8_t index) {
+		memset(vIndexes.data(), index, vIndexes.size());
+		markDirty();
+	}
+
+	inline void IndexedDrawable::toRGBA(Pixel *out) const {
+		uint32_t *dst = reinterpret_cast<uint32_t *>(out);
+		for (size_t i = 0; i < vIndexes.size(); i++) dst[i] = vPalette[vIndexes[i]];
+	}
+
+	inline void IndexedDrawable::setPixel(int x, int y, Pixel pix, BlendMode_t mode) {
+		if (x < 0 || y < 0 || x >= width || y >= height) return;
+		plot(x, y, pix.n, mode, mLookup);
+		markDirty(x, y, 1, 1);
+	}
+
+	inline Pixel IndexedDrawable::getPixel(int x, int y) {
+		if (x < 0 || y < 0 || x >= width || y >= height) return 0;
+		return vPalette[vIndexes[y * width + x]];
+	}
+
+	inline void IndexedDrawable::clear(Pixel color) { fillIndexes(indexOf(color, mLookup)); }
+
+	inline void IndexedDrawable::fillRect(int x, int y, int w, int h, Pixel color, BlendMode_t mode) {
+		int x1 = std::min(x + w, width), y1 = std::min(y + h, height);
+		x = std::max(x, 0);
+		y = std::max(y, 0);
+		if (x >= x1 || y >= y1) return;
+		for (int j = y; j < y1; j++) fillSpan(x, j, x1 - x, color.n, mode, mLookup);
+		markDirty(x, y, x1 - x, y1 - y);
+	}
+
+	inline void IndexedDrawable::fillSpan(int x, int y, int len, Pixel color, BlendMode_t mode) {
+		if (y < 0 || y >= height) return;
+		int x1 = std::min(x + len, width);
+		x = std::max(x, 0);
+		if (x >= x1) return;
+		fillSpan(x, y, x1 - x, color.n, mode, mLookup);
+		markDirty(x, y, x1 - x, 1);
+	}
+
+	inline void IndexedDrawable::copySpan(int x, int y, const Pixel *src, int len, BlendMode_t mode) {
+		if (y < 0 || y >= height) return;
+		int x1 = std::min(x + len, width);
+		int skip = x < 0 ? -x : 0;
+		x += skip;
+		if (x >= x1) return;
+		copySpan(x, y, reinterpret_cast<const uint32_t *>(src) + skip, x1 - x, mode, mLookup);
+		markDirty(x, y, x1 - x, 1);
+	}
+
+	// the byte repeated in every channel, as Drawable::blank writes it
+	inline void IndexedDrawable::blank(char colorbyte) { clear((uint8_t) colorbyte * 0x01010101u); }
+
+	inline uint8_t IndexedDrawable::nearest(uint32_t color) const {
+		int r = color & 0xFF, g = (color >> 8) & 0xFF, b = (color >> 16) & 0xFF;
+		const uint32_t *entries = vPalette.data();
+		int best = 1, bestDistance = INT32_MAX;
+		for (int i = 1; i < PALETTESIZE && bestDistance > 0; i++) {
+			int dr = (int) (entries[i] & 0xFF) - r, dg = (int) ((entries[i] >> 8) & 0xFF) - g;
+			int db = (int) ((entries[i] >> 16) & 0xFF) - b;
+			int distance = dr * dr + dg * dg + db * db;
+			if (distance < bestDistance) {
+				bestDistance = distance;
+				best = i;
+			}
+		}
+		return (uint8_t) best;
+	}
+
+	inline uint8_t IndexedDrawable::indexOf(Pixel color, PaletteLookup_t &lookup) const {
+
+		uint32_t n = color.n, alpha = n >> 24;
+
+		if (alpha == 0) return 0;
+		if ((n & 0xFFFFFF) == 0 && alpha <= 16) return (uint8_t) alpha;      // Colors::COLOR_n
+
+		if (lookup.version != nVersion) {
+			memset(lookup.keys, 0, sizeof(lookup.keys));   // 0 is never stored, it has alpha 0
+			lookup.version = nVersion;
+		}
+
+		uint32_t slot = (n * 2654435761u) >> 24;
+		if (lookup.keys[slot] != n) {
+			lookup.keys[slot] = n;
+			lookup.values[slot] = nearest(n);
+		}
+		return lookup.values[slot];
+	}
+
+	inline bool IndexedDrawable::covers(uint32_t color, BlendMode_t blend) {
+		uint32_t alpha = color >> 24;
+		bool code = (color & 0xFFFFFF) == 0 && alpha > 0 && alpha <= 16;
+		switch (blend) {
+			case BLEND_NORMAL:
+				return true;
+			case BLEND_MASK:
+				return alpha == 255 || code;
+			default:
+				return alpha >= 128 || code;
+		}
+	}
+
+	inline void IndexedDrawable::plot(int32_t x, int32_t y, uint32_t color, BlendMode_t blend, PaletteLookup_t &lookup) {
+		if (covers(color, blend)) vIndexes[y * width + x] = indexOf(color, lookup);
+	}
+
+	inline void IndexedDrawable::fillSpan(int32_t x, int32_t y, int32_t count, uint32_t color, BlendMode_t blend,
+										  PaletteLookup_t &lookup) {
+		if (count > 0 && covers(color, blend))
+			memset(vIndexes.data() + y * width + x, indexOf(color, lookup), count);
+	}
+
+	inline void IndexedDrawable::copySpan(int32_t x, int32_t y, const uint32_t *src, int32_t count, BlendMode_t blend,
+										  PaletteLookup_t &lookup) {
+		uint8_t *dst = vIndexes.data() + y * width + x;
+		uint32_t last = 0;
+		uint8_t index = 0;
+		for (int32_t i = 0; i < count; i++) {
+			uint32_t color = src[i];
+			if ((color >> 24) == 0 || !covers(color, blend)) continue;
+			if (color != last) {
+				last = color;
+				index = indexOf(color, lookup);
+			}
+			dst[i] = index;
+		}
+	}
+
+}
@@ -0,0 +1,142 @@
+//
+//  IndexedTexture.hpp
+//  PixFu
+//
+//  OpenGL textures of an IndexedDrawable: the indexes as a single channel 8-bit texture and
+//  the palette as a 256x1 RGBA texture. A shader resolves the color of a pixel by looking its
+//  index up in the palette (see the default shader). Like Texture2D, every texture uses the
+//  texture unit hardwired to its id.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "OpenGL.h"
+#include "GlState.hpp"
+#include "IndexedDrawable.hpp"
+#include "Profiler.hpp"
+
+namespace Pix {
+
+	class IndexedTexture {
+
+		IndexedDrawable *pBuffer;
+		GLuint glIndexes = -1;
+		GLuint glPalette = -1;
+
+	public:
+
+		// New texture (buffer), the texture owns the buffer
+		IndexedTexture(IndexedDrawable *buffer);
+
+		// New texture (blank)
+		IndexedTexture(int width, int height);
+
+		~IndexedTexture();
+
+		bool upload();           // Upload both textures to graphics card
+		void update();           // re-uploads the changed regions, and the palette if changed
+		void bind();             // Binds and activates both textures
+
+		GLuint unit();           // Texture unit of the indexes
+		GLuint paletteUnit();    // Texture unit of the palette
+
+		IndexedDrawable *buffer();
+	};
+
+	inline IndexedTexture::IndexedTexture(IndexedDrawable *buffer) : pBuffer(buffer) {}
+
+	inline IndexedTexture::IndexedTexture(int width, int height) : pBuffer(new IndexedDrawable(width, height)) {}
+
+	inline IndexedTexture::~IndexedTexture() {
+		// GL unbinds deleted textures, GlState has to know
+		if (glIndexes != (GLuint) -1) {
+			GlState::bindTexture(unit(), 0);
+			glDeleteTextures(1, &glIndexes);
+		}
+		if (glPalette != (GLuint) -1) {
+			GlState::bindTexture(paletteUnit(), 0);
+			glDeleteTextures(1, &glPalette);
+		}
+		delete pBuffer;
+	}
+
+	inline IndexedDrawable *IndexedTexture::buffer() { return pBuffer; }
+
+	inline GLuint IndexedTexture::unit() { return glIndexes - 1; }
+
+	inline GLuint IndexedTexture::paletteUnit() { return glPalette - 1; }
+
+	inline bool IndexedTexture::upload() {
+
+		glGenTextures(1, &glIndexes);
+		glGenTextures(1, &glPalette);
+
+		GlState::bindTexture(unit(), glIndexes);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, pBuffer->width, pBuffer->height, 0, GL_RED, GL_UNSIGNED_BYTE,
+					 pBuffer->indexes());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		// indexes must never be interpolated
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		GlState::bindTexture(paletteUnit(), glPalette);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, IndexedDrawable::PALETTESIZE, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+					 pBuffer->palette());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		pBuffer->clearDirty();
+		pBuffer->clearPaletteChanged();
+
+		return glGetError() == GL_NO_ERROR;
+	}
+
+	inline void IndexedTexture::bind() {
+		GlState::bindTexture(unit(), glIndexes);
+		GlState::bindTexture(paletteUnit(), glPalette);
+	}
+
+	inline void IndexedTexture::update() {
+
+		pBuffer->resolve();
+
+		PIXFU_PROFILE("IndexedTexture::update");
+
+		if (pBuffer->paletteChanged()) {
+			GlState::bindTexture(paletteUnit(), glPalette);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, IndexedDrawable::PALETTESIZE, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+							pBuffer->palette());
+			pBuffer->clearPaletteChanged();
+		}
+
+		int count;
+		const DirtyRect_t *rects = pBuffer->dirtyRects(count);
+		if (count == 0) return;
+
+		GlState::bindTexture(unit(), glIndexes);
+
+		const uint8_t *data = pBuffer->indexes();
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, pBuffer->width);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		for (int i = 0; i < count; i++) {
+			const DirtyRect_t &r = rects[i];
+			glTexSubImage2D(GL_TEXTURE_2D, 0, r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0,
+							GL_RED, GL_UNSIGNED_BYTE, data + r.y0 * pBuffer->width + r.x0);
+		}
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		pBuffer->clearDirty();
+	}
+
+}
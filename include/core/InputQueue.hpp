@@ -0,0 +1,120 @@
+//
+//  InputQueue.hpp
+//  PixFu
+//
+//  Timestamped input events from the platform to an input device. The platform (or a thread
+//  sampling a device at a high rate) pushes events as they happen into a lock-free single
+//  producer, single consumer ring; the device drains it in sync() and applies the events in
+//  order, so presses shorter than a frame are not lost and the frame gets the full ordered
+//  event list besides the state snapshot.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "Profiler.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace Pix {
+
+	typedef enum eInputEventType : uint8_t {
+		INPUT_KEY,          // code = key, down
+		INPUT_BUTTON,       // code = button, down
+		INPUT_MOVE,         // x, y = position
+		INPUT_WHEEL,        // x, y = wheel
+		INPUT_AXIS          // code = axis mode, x, y = values
+	} InputEventType_t;
+
+	typedef struct sInputEvent {
+		uint64_t time;              // Profiler::now(), ns
+		InputEventType_t type;
+		bool down;
+		int16_t code;
+		float x, y;
+	} InputEvent_t;
+
+	class InputQueue {
+
+	public:
+
+		/** Events that fit between two drains, a power of two */
+		static constexpr uint32_t CAPACITY = 1024;
+
+	private:
+
+		// producer and consumer indices in their own cache lines
+		alignas(64) std::atomic<uint32_t> nHead{0};      // consumer
+		alignas(64) std::atomic<uint32_t> nTail{0};      // producer
+		alignas(64) std::atomic<uint32_t> nDropped{0};
+
+		InputEvent_t vRing[CAPACITY];
+
+		std::vector<InputEvent_t> vFrame;               // consumer: events of this frame
+
+	public:
+
+		InputQueue();
+
+		/**
+		 * Queues an event. Only one thread may push to a queue.
+		 * @param time Event time (Profiler::now()), 0 = now
+		 * @return false if the queue is full (the event is dropped)
+		 */
+		bool push(InputEventType_t type, int code, bool down, float x = 0, float y = 0, uint64_t time = 0);
+
+		/**
+		 * Consumer: replaces the frame events with the queued ones, in order
+		 * @return the frame events
+		 */
+		std::vector<InputEvent_t> &drain();
+
+		/** Consumer: adds an event to the frame (ie. found by polling), not queued */
+		void record(const InputEvent_t &event);
+
+		/** Consumer: the events of this frame, in order */
+		const std::vector<InputEvent_t> &events();
+
+		/** Events dropped because the queue was full */
+		uint32_t dropped();
+
+	};
+
+	inline InputQueue::InputQueue() { vFrame.reserve(CAPACITY); }
+
+	inline bool InputQueue::push(InputEventType_t type, int code, bool down, float x, float y, uint64_t time) {
+
+		uint32_t tail = nTail.load(std::memory_order_relaxed);
+		if (tail - nHead.load(std::memory_order_acquire) == CAPACITY) {
+			nDropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		vRing[tail & (CAPACITY - 1)] = {time != 0 ? time : Profiler::now(), type, down, (int16_t) code, x, y};
+		nTail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	inline std::vector<InputEvent_t> &InputQueue::drain() {
+
+		vFrame.clear();
+
+		uint32_t head = nHead.load(std::memory_order_relaxed);
+		uint32_t tail = nTail.load(std::memory_order_acquire);
+		for (; head != tail; head++) vFrame.push_back(vRing[head & (CAPACITY - 1)]);
+
+		nHead.store(head, std::memory_order_release);
+		return vFrame;
+	}
+
+	inline void InputQueue::record(const InputEvent_t &event) { vFrame.push_back(event); }
+
+	inline const std::vector<InputEvent_t> &InputQueue::events() { return vFrame; }
+
+	inline uint32_t InputQueue::dropped() { return nDropped.load(std::memory_order_relaxed); }
+
+}
@@ -0,0 +1,465 @@
+//
+//  JobSystem.hpp
+//  PixFu
+//
+//  A work-stealing job scheduler. Every worker thread owns a job queue: it runs its own jobs
+//  newest first and, when it runs out, steals the oldest jobs of the others. Threads waiting
+//  for jobs to finish run jobs meanwhile, so jobs can spawn and wait for other jobs.
+//
+//  Long jobs that nobody waits for within a frame (ie. asset decoding) go to a background
+//  queue (pushBackground) that only idle workers take: a thread in wait() or help(), like the
+//  GL thread waiting for a parallelFor, never picks one up and stalls for its whole length.
+//
+//  Besides single jobs it runs parallel loops (parallelFor) and graphs of jobs with
+//  dependencies (JobGraph). OpenGL calls are only valid on the GL thread, so workers can
+//  post them to the main thread queue (onMainThread), run by the engine loop.
+//
+//  The engine owns one (Fu::jobs), started with the loop and stopped when it ends. start() and
+//  stop() are called by the owner thread, while no other thread pushes jobs.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "Logger.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Pix {
+
+	class JobSystem;
+
+	/** Counts unfinished jobs, to wait for them */
+	typedef std::atomic<int> JobCounter_t;
+
+	/**
+	 * Jobs with dependencies. Build it once and run it every frame: a job starts when all the
+	 * jobs it depends on have finished.
+	 */
+	class JobGraph {
+
+		friend class JobSystem;
+
+		typedef struct sNode {
+			std::function<void()> fn;
+			std::vector<int> successors;
+			int dependencies = 0;
+			std::atomic<int> pending{0};
+		} Node_t;
+
+		std::deque<Node_t> vNodes;      // stable addresses
+
+		// while running
+		JobSystem *pSystem = nullptr;
+		JobCounter_t *pCounter = nullptr;
+
+		// queues a node, its successors are queued when it finishes
+		void launch(int id);
+
+	public:
+
+		/**
+		 * Adds a job
+		 * @param fn The job
+		 * @param after Jobs (as returned by add) that must finish first
+		 * @return the job id
+		 */
+		int add(std::function<void()> fn, std::initializer_list<int> after = {});
+
+		int add(std::function<void()> fn, const std::vector<int> &after);
+
+		/** Number of jobs */
+		int size();
+
+		void clear();
+	};
+
+	class JobSystem {
+
+		inline static const std::string TAG = "JobSystem";
+
+		typedef struct sJob {
+			std::function<void()> fn;
+			JobCounter_t *counter;
+		} Job_t;
+
+		// a growable ring, so steady state pushes and pops do not allocate
+		typedef struct sQueue {
+			std::mutex mutex;
+			std::vector<Job_t> ring;
+			size_t head = 0, count = 0;
+		} Queue_t;
+
+		// a queue per worker, one for jobs pushed from other threads and the background one (last)
+		std::vector<std::unique_ptr<Queue_t>> vQueues;
+		std::vector<std::thread> vThreads;
+
+		std::atomic<int> nQueued{0};
+		std::atomic<bool> bRunning{false}, bQuit{false};
+		std::mutex mSleep;
+		std::condition_variable cvWake;
+
+		std::mutex mMainThread;
+		std::vector<std::function<void()>> vMainThread, vMainThreadRunning;
+
+		// queue of the calling thread
+		int queueIndex();
+
+		bool pop(int queue, Job_t &job, bool own);
+
+		// queues a job in a queue
+		void enqueue(int queue, std::function<void()> fn, JobCounter_t *counter);
+
+		// runs one queued job, if any, then a background one if allowed
+		bool tryRun(int queue, bool background = false);
+
+		void run(Job_t &job);
+
+		void workerLoop(int index);
+
+	public:
+
+		JobSystem() = default;
+
+		~JobSystem();
+
+		/**
+		 * Starts the worker threads
+		 * @param threads Workers, besides the calling thread. -1 = one less than the cores.
+		 */
+		void start(int threads = -1);
+
+		/** Finishes the queued jobs, and the jobs they push, and stops the workers */
+		void stop();
+
+		bool running();
+
+		/** Number of worker threads */
+		int workers();
+
+		/**
+		 * Queues a job
+		 * @param fn The job
+		 * @param counter Optional, incremented now and decremented when the job finishes
+		 */
+		void push(std::function<void()> fn, JobCounter_t *counter = nullptr);
+
+		/**
+		 * Queues a long job that only idle workers run, never a thread waiting in wait() or
+		 * help(). Waiting for its counter waits for the workers. Without workers it is a job
+		 * like the others.
+		 * @param fn The job
+		 * @param counter Optional, incremented now and decremented when the job finishes
+		 */
+		void pushBackground(std::function<void()> fn, JobCounter_t *counter = nullptr);
+
+		/** Runs jobs (not background ones) until the counter gets to zero */
+		void wait(JobCounter_t &counter);
+
+		/**
+		 * Runs one queued job (not a background one) on the calling thread, if any. For threads
+		 * that wait for work in small steps, ie. the GL thread within a frame budget.
+		 * @return whether a job was run
+		 */
+		bool help();
+
+		/**
+		 * Runs fn(begin, end) over [0, count) split in chunks, on the workers and the calling
+		 * thread, and waits for all of them.
+		 * @param count Number of items
+		 * @param fn The job, receives a range of items
+		 * @param grain Items per chunk, 0 = a few chunks per thread
+		 */
+		void parallelFor(int count, const std::function<void(int, int)> &fn, int grain = 0);
+
+		/** Runs a job graph and waits for all its jobs */
+		void run(JobGraph &graph);
+
+		/**
+		 * Posts a job to the main (GL) thread. The engine runs them at the start of the frame
+		 * and before committing it.
+		 */
+		void onMainThread(std::function<void()> fn);
+
+		/**
+		 * Runs the jobs posted to the main thread. Called by the engine loop.
+		 * @return the number of jobs run
+		 */
+		int runMainThread();
+
+	};
+
+	inline int JobGraph::add(std::function<void()> fn, std::initializer_list<int> after) {
+		return add(std::move(fn), std::vector<int>(after));
+	}
+
+	inline int JobGraph::add(std::function<void()> fn, const std::vector<int> &after) {
+		int id = (int) vNodes.size();
+		vNodes.emplace_back();
+		vNodes.back().fn = std::move(fn);
+		for (int dependency:after) {
+			vNodes[dependency].successors.push_back(id);
+			vNodes.back().dependencies++;
+		}
+		return id;
+	}
+
+	inline int JobGraph::size() { return (int) vNodes.size(); }
+
+	inline void JobGraph::clear() { vNodes.clear(); }
+
+	// the job system and queue of every thread
+	namespace JobThread {
+		inline thread_local JobSystem *pOwner = nullptr;
+		inline thread_local int nQueue = -1;
+	}
+
+	inline JobSystem::~JobSystem() { stop(); }
+
+	inline bool JobSystem::running() { return bRunning.load(std::memory_order_acquire); }
+
+	inline int JobSystem::workers() { return (int) vThreads.size(); }
+
+	inline void JobSystem::start(int threads) {
+
+		if (running()) return;
+
+		if (threads < 0) threads = std::max(0, (int) std::thread::hardware_concurrency() - 1);
+
+		bQuit = false;
+		for (int i = 0; i <= threads + 1; i++) vQueues.emplace_back(new Queue_t());
+		bRunning.store(true, std::memory_order_release);
+		for (int i = 0; i < threads; i++) vThreads.emplace_back(&JobSystem::workerLoop, this, i);
+
+		PIXFU_LOGV(TAG, "Started with %d workers", threads);
+	}
+
+	inline void JobSystem::stop() {
+
+		if (!running()) return;
+
+		// from now on jobs pushed by the running ones run in place
+		bRunning.store(false, std::memory_order_release);
+
+		// nobody may wait for orphan jobs, but they may post main thread work or hold resources.
+		// Workers keep running jobs until the queues are empty.
+		while (tryRun(workers(), true)) {}
+
+		{
+			std::lock_guard<std::mutex> lock(mSleep);
+			bQuit = true;
+		}
+		cvWake.notify_all();
+		for (std::thread &thread:vThreads) thread.join();
+
+		// anything left by jobs that were running when the queues emptied
+		while (tryRun(workers(), true)) {}
+
+		vThreads.clear();
+		vQueues.clear();
+		runMainThread();
+	}
+
+	inline int JobSystem::queueIndex() {
+		return JobThread::pOwner == this ? JobThread::nQueue : workers();
+	}
+
+	inline void JobSystem::push(std::function<void()> fn, JobCounter_t *counter) {
+
+		if (counter != nullptr) counter->fetch_add(1, std::memory_order_relaxed);
+
+		if (!running()) {
+			// not started: run in place
+			Job_t job = {std::move(fn), counter};
+			run(job);
+			return;
+		}
+
+		enqueue(queueIndex(), std::move(fn), counter);
+	}
+
+	inline void JobSystem::pushBackground(std::function<void()> fn, JobCounter_t *counter) {
+
+		if (!running() || workers() == 0) {
+			push(std::move(fn), counter);
+			return;
+		}
+
+		if (counter != nullptr) counter->fetch_add(1, std::memory_order_relaxed);
+		enqueue(workers() + 1, std::move(fn), counter);
+	}
+
+	inline void JobSystem::enqueue(int index, std::function<void()> fn, JobCounter_t *counter) {
+
+		Queue_t &queue = *vQueues[index];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.count == queue.ring.size()) {
+				std::vector<Job_t> grown(std::max((size_t) 64, queue.ring.size() * 2));
+				for (size_t i = 0; i < queue.count; i++)
+					grown[i] = std::move(queue.ring[(queue.head + i) & (queue.ring.size() - 1)]);
+				queue.ring.swap(grown);
+				queue.head = 0;
+			}
+			queue.ring[(queue.head + queue.count++) & (queue.ring.size() - 1)] = {std::move(fn), counter};
+		}
+
+		nQueued.fetch_add(1, std::memory_order_release);
+		{
+			// the lock orders this with the sleep check of the workers
+			std::lock_guard<std::mutex> lock(mSleep);
+		}
+		cvWake.notify_one();
+	}
+
+	inline bool JobSystem::pop(int index, Job_t &job, bool own) {
+		Queue_t &queue = *vQueues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.count == 0) return false;
+		size_t mask = queue.ring.size() - 1;
+		if (own) {
+			// own jobs newest first, they are the hottest in cache
+			job = std::move(queue.ring[(queue.head + queue.count - 1) & mask]);
+		} else {
+			job = std::move(queue.ring[queue.head]);
+			queue.head = (queue.head + 1) & mask;
+		}
+		queue.count--;
+		return true;
+	}
+
+	inline bool JobSystem::tryRun(int index, bool background) {
+
+		if (nQueued.load(std::memory_order_acquire) == 0) return false;
+
+		// the background queue is not stolen from
+		int count = workers() + 1;
+		Job_t job;
+
+		bool found = pop(index, job, index < workers());
+		for (int i = 1; !found && i < count; i++)
+			found = pop((index + i) % count, job, false);
+		if (!found && background) found = pop(count, job, false);
+
+		if (!found) return false;
+
+		nQueued.fetch_sub(1, std::memory_order_relaxed);
+		run(job);
+		return true;
+	}
+
+	inline void JobSystem::run(Job_t &job) {
+		{
+			PIXFU_PROFILE("JobSystem::job");
+			job.fn();
+		}
+		if (job.counter != nullptr) job.counter->fetch_sub(1, std::memory_order_release);
+	}
+
+	inline void JobSystem::workerLoop(int index) {
+
+		JobThread::pOwner = this;
+		JobThread::nQueue = index;
+
+		while (true) {
+
+			// idle here, background jobs too
+			if (tryRun(index, true)) continue;
+
+			std::unique_lock<std::mutex> lock(mSleep);
+			cvWake.wait(lock, [this] { return bQuit || nQueued.load(std::memory_order_acquire) > 0; });
+			if (bQuit && nQueued.load(std::memory_order_acquire) == 0) return;
+		}
+	}
+
+	inline void JobSystem::wait(JobCounter_t &counter) {
+		// queued jobs are run while stopping too, the counter may depend on them
+		int index = queueIndex();
+		while (counter.load(std::memory_order_acquire) > 0) {
+			if (!tryRun(index)) std::this_thread::yield();
+		}
+	}
+
+	inline bool JobSystem::help() { return running() && tryRun(queueIndex()); }
+
+	inline void JobSystem::parallelFor(int count, const std::function<void(int, int)> &fn, int grain) {
+
+		if (count <= 0) return;
+
+		if (grain <= 0) grain = std::max(1, count / ((workers() + 1) * 4));
+
+		if (grain >= count || !running()) {
+			fn(0, count);
+			return;
+		}
+
+		JobCounter_t counter{0};
+
+		// queue all chunks but the first, run that one here
+		for (int begin = grain; begin < count; begin += grain) {
+			int end = std::min(count, begin + grain);
+			push([&fn, begin, end] { fn(begin, end); }, &counter);
+		}
+
+		fn(0, grain);
+		wait(counter);
+	}
+
+	inline void JobGraph::launch(int id) {
+		// small capture, std::function stores it without allocating
+		pSystem->push([this, id] {
+			Node_t &node = vNodes[id];
+			node.fn();
+			for (int next:node.successors)
+				if (vNodes[next].pending.fetch_sub(1, std::memory_order_acq_rel) == 1) launch(next);
+		}, pCounter);
+	}
+
+	inline void JobSystem::run(JobGraph &graph) {
+
+		if (graph.vNodes.empty()) return;
+
+		JobCounter_t counter{0};
+		graph.pSystem = this;
+		graph.pCounter = &counter;
+
+		for (JobGraph::Node_t &node:graph.vNodes)
+			node.pending.store(node.dependencies, std::memory_order_relaxed);
+
+		for (int id = 0; id < graph.size(); id++)
+			if (graph.vNodes[id].dependencies == 0) graph.launch(id);
+
+		wait(counter);
+		graph.pCounter = nullptr;
+	}
+
+	inline void JobSystem::onMainThread(std::function<void()> fn) {
+		std::lock_guard<std::mutex> lock(mMainThread);
+		vMainThread.push_back(std::move(fn));
+	}
+
+	inline int JobSystem::runMainThread() {
+		{
+			std::lock_guard<std::mutex> lock(mMainThread);
+			if (vMainThread.empty()) return 0;
+			vMainThread.swap(vMainThreadRunning);
+		}
+		// jobs may post more, they will run next time
+		for (std::function<void()> &fn:vMainThreadRunning) fn();
+		int count = (int) vMainThreadRunning.size();
+		vMainThreadRunning.clear();
+		return count;
+	}
+
+}
@@ -10,6 +10,9 @@
 //  This class does not know about shaders, derived classes are expected to take care
 //  of that as needed.
 //
+//  The vertex attributes are enabled once in the VAO, and draws leave it bound (GlState skips
+//  binding it again), so drawing a mesh is a bind and a glDrawElements at most.
+//
 //  Created by rodo on 11/02/2020.
 //  Copyright © 2020 rodo. All rights reserved.
 //
@@ -21,6 +24,7 @@
 #pragma once
 
 #include "FuExtension.hpp"
+#include "GlState.hpp"
 #include <string>
 #include <vector>
 #include "glm/vec2.hpp"
@@ -90,7 +94,8 @@ namespace Pix {
 		void bind(int index = 0);
 
 		/**
-		 * Unbinds bound mesh
+		 * Unbinds bound mesh. Not needed between draws, only before raw GL calls that
+		 * would modify the bound VAO.
 		 */
 
 		void unbind();
@@ -101,14 +106,62 @@ namespace Pix {
 
 		virtual ~LayerVao();
 
-		// called by the loop to update the surface
+		// called by the loop to update the surface, the mesh stays bound
 		void draw(int index = 0, bool bind = true);
 
+		// draws several instances of the mesh, their per-instance attributes set up by the derived class
+		void drawInstanced(int index, int instances, bool bind = true);
+
 		// called by the loop to finish the surface
 		void deinit();
 
 	};
 
+	///////// INLINE IMPLEMENTATION
+
+	inline void LayerVao::init(Mesh_t &mesh) {
+
+		glGenVertexArrays(1, &mesh.vao);
+		GlState::bindVertexArray(mesh.vao);
+
+		glGenBuffers(1, &mesh.vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+		glBufferData(GL_ARRAY_BUFFER, mesh.nVertices * 8 * sizeof(float), mesh.pVertices, GL_STATIC_DRAW);
+
+		glGenBuffers(1, &mesh.ebo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.nIndices * sizeof(unsigned), mesh.pIndices, GL_STATIC_DRAW);
+
+		// position, normal, texture coordinates. Enabled arrays are VAO state: enabled once here.
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) 0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) (3 * sizeof(float)));
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) (6 * sizeof(float)));
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		GlState::bindVertexArray(0);
+	}
+
+	inline void LayerVao::bind(int index) {
+		GlState::bindVertexArray(vMeshes[index].vao);
+	}
+
+	inline void LayerVao::unbind() {
+		GlState::bindVertexArray(0);
+	}
+
+	inline void LayerVao::draw(int index, bool bind) {
+		if (bind) this->bind(index);
+		glDrawElements(DRAWMODE, vMeshes[index].nIndices, GL_UNSIGNED_INT, 0);
+	}
+
+	inline void LayerVao::drawInstanced(int index, int instances, bool bind) {
+		if (bind) this->bind(index);
+		glDrawElementsInstanced(DRAWMODE, vMeshes[index].nIndices, GL_UNSIGNED_INT, 0, instances);
+	}
+
 }
 
 #pragma clang diagnostic pop
@@ -0,0 +1,411 @@
+//
+//  Logger.hpp
+//  PixFu
+//
+//  Asynchronous logging with deferred formatting. PIXFU_LOGV / PIXFU_LOGE do not format
+//  anything on the calling thread: they copy the format string pointer and the raw arguments
+//  (strings are copied, everything else by value) into a lock-free ring of the calling thread,
+//  and a background thread formats them and sends them to the platform LogV / LogE.
+//
+//  Levels below PIXFU_LOG_LEVEL are removed at compile time, arguments included, so disabled
+//  levels cost nothing. By default verbose messages are only kept with DBG.
+//
+//      PIXFU_LOGV(TAG, "Loaded %s in %d ms", path.c_str(), ms);
+//
+//  The format must be a string literal (it is read later). A full ring drops verbose messages
+//  (they are counted and reported) and makes errors wait. Messages of different threads are
+//  emitted in time order.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace Pix {
+
+	typedef enum eLogLevel {
+		LOGLEVEL_VERBOSE, LOGLEVEL_ERROR, LOGLEVEL_NONE
+	} LogLevel_t;
+
+}
+
+// minimum level compiled in
+#ifndef PIXFU_LOG_LEVEL
+#define PIXFU_LOG_LEVEL (Pix::DBG ? Pix::LOGLEVEL_VERBOSE : Pix::LOGLEVEL_ERROR)
+#endif
+
+#define PIXFU_LOG(level, tag, ...) \
+	do { if constexpr ((level) >= (PIXFU_LOG_LEVEL)) Pix::Logger::write(level, tag, __VA_ARGS__); } while (0)
+
+#define PIXFU_LOGV(tag, ...) PIXFU_LOG(Pix::LOGLEVEL_VERBOSE, tag, __VA_ARGS__)
+#define PIXFU_LOGE(tag, ...) PIXFU_LOG(Pix::LOGLEVEL_ERROR, tag, __VA_ARGS__)
+
+namespace Pix {
+
+	/** Encodes and decodes a log argument in a ring slot */
+	template<typename T, typename Enable = void>
+	struct LogArg {
+
+		static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+					  "Log arguments must be numbers, pointers or strings");
+
+		typedef T decoded_t;
+
+		static void encode(uint8_t *&data, uint8_t *end, const T &value) {
+			if (data + sizeof(T) > end) {
+				// no room, this and the next arguments are decoded as zeroes
+				data = end;
+				return;
+			}
+			memcpy(data, &value, sizeof(T));
+			data += sizeof(T);
+		}
+
+		static T decode(const uint8_t *&data, const uint8_t *end) {
+			T value{};
+			if (data + sizeof(T) > end) return value;
+			memcpy(&value, data, sizeof(T));
+			data += sizeof(T);
+			return value;
+		}
+	};
+
+	// strings are copied: the pointer may not be valid anymore when the message is formatted
+	template<typename T>
+	struct LogArg<T, typename std::enable_if<std::is_same<typename std::decay<T>::type, char *>::value ||
+											 std::is_same<typename std::decay<T>::type, const char *>::value ||
+											 std::is_same<T, std::string>::value>::type> {
+
+		typedef const char *decoded_t;
+
+		static const char *str(const char *value) { return value != nullptr ? value : "(null)"; }
+
+		static const char *str(const std::string &value) { return value.c_str(); }
+
+		// longer strings are truncated, so they leave room for the next arguments
+		static constexpr size_t MAXLENGTH = 160;
+
+		static void encode(uint8_t *&data, uint8_t *end, const T &value) {
+			if (data >= end) return;
+			const char *text = str(value);
+			size_t length = std::min({strlen(text), MAXLENGTH, (size_t) (end - data - 1)});
+			memcpy(data, text, length);
+			data[length] = 0;
+			data += length + 1;
+		}
+
+		static const char *decode(const uint8_t *&data, const uint8_t *end) {
+			if (data >= end) return "";
+			const char *text = reinterpret_cast<const char *>(data);
+			data += strlen(text) + 1;
+			return text;
+		}
+	};
+
+	class Logger {
+
+		static constexpr size_t SLOTSIZE = 256;
+		static constexpr uint32_t RINGSIZE = 512;        // slots per thread, a power of two
+		static constexpr int PERIODMS = 10;              // max delay of a message
+
+		typedef int (*Formatter_t)(const uint8_t *data, const uint8_t *end, const char *format, char *out, size_t size);
+
+		typedef struct sSlot {
+			uint64_t time;
+			const char *format;
+			Formatter_t formatter;
+			uint8_t level;
+			uint8_t data[SLOTSIZE - 3 * sizeof(uint64_t) - 8];      // tag then arguments
+		} Slot_t;
+
+		// single producer (the owner thread), single consumer (the logger thread)
+		typedef struct sRing {
+			Slot_t slots[RINGSIZE];
+			alignas(64) std::atomic<uint32_t> head{0};
+			alignas(64) std::atomic<uint32_t> tail{0};
+			std::atomic<bool> orphan{false};           // owner thread has finished
+		} Ring_t;
+
+		// registers the ring of a thread, and orphans it when the thread ends
+		typedef struct sRingOwner {
+			std::shared_ptr<Ring_t> ring;
+
+			~sRingOwner() { if (ring) ring->orphan.store(true, std::memory_order_release); }
+		} RingOwner_t;
+
+		typedef std::function<void(LogLevel_t level, const char *tag, const char *text)> Sink_t;
+
+		inline static std::mutex mRings;
+		inline static std::vector<std::shared_ptr<Ring_t>> vRings;
+
+		inline static std::mutex mWake;
+		inline static std::condition_variable cvWake;
+		inline static std::thread cThread;
+		inline static std::atomic<std::thread::id> nThreadId{};     // of cThread, readable anywhere
+		inline static std::atomic<bool> bRunning{false}, bQuit{false}, bAsync{true}, bSleeping{false};
+		inline static std::atomic<uint64_t> nDropped{0}, nDropReported{0}, nWritten{0}, nEmitted{0};
+		inline static std::once_flag fStart;
+		inline static Sink_t fSink;
+		inline static std::recursive_mutex mSink;      // emit vs setSink, a sink may log itself
+
+		static Ring_t *ring();
+
+		static void start();
+
+		static void threadLoop();
+
+		// formats and emits everything queued, returns the number of messages
+		static int drain();
+
+		static void emit(LogLevel_t level, const char *tag, const char *text);
+
+		template<typename ... Args>
+		static int formatter(const uint8_t *data, const uint8_t *end, const char *format, char *out, size_t size);
+
+		// stops the thread at exit, declared last so it is destroyed first
+		typedef struct sShutdown {
+			~sShutdown() { Logger::stop(); }
+		} Shutdown_t;
+
+		inline static Shutdown_t cShutdown;
+
+	public:
+
+		/**
+		 * Logs a message. Use the PIXFU_LOG macros, they filter levels at compile time.
+		 * @param level Level
+		 * @param tag Tag
+		 * @param format printf format, must stay valid (a literal)
+		 * @param args Numbers, pointers or strings
+		 */
+		template<typename Tag, typename ... Args>
+		static void write(LogLevel_t level, const Tag &tag, const char *format, const Args &... args);
+
+		/**
+		 * Formats on the background thread (default) or on the calling one. Synchronous mode
+		 * is handy when debugging a crash.
+		 */
+		static void setAsync(bool async);
+
+		/**
+		 * Replaces the output, by default the platform LogV / LogE. The old sink is not called
+		 * anymore once this returns.
+		 */
+		static void setSink(Sink_t sink);
+
+		/** Waits until every message logged so far has been emitted */
+		static void flush();
+
+		/** Flushes and stops the background thread, messages are then formatted in place */
+		static void stop();
+
+		/** Messages dropped because a ring was full */
+		static uint64_t dropped();
+
+	};
+
+	template<typename ... Args>
+	inline int Logger::formatter(const uint8_t *data, const uint8_t *end, const char *format, char *out, size_t size) {
+		// unused without arguments
+		(void) data;
+		(void) end;
+		// a braced list decodes in order
+		std::tuple<typename LogArg<Args>::decoded_t ...> values{LogArg<Args>::decode(data, end) ...};
+		return std::apply([&](auto ... arg) {
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wformat-security"
+#endif
+			return snprintf(out, size, format, arg ...);
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+		}, values);
+	}
+
+	template<typename Tag, typename ... Args>
+	inline void Logger::write(LogLevel_t level, const Tag &tag, const char *format, const Args &... args) {
+
+		if (!bAsync.load(std::memory_order_relaxed) || bQuit.load(std::memory_order_relaxed)) {
+			char text[1024];
+			Slot_t slot;
+			uint8_t *data = slot.data, *end = slot.data + sizeof(slot.data);
+			(LogArg<Args>::encode(data, end, args), ...);
+			(void) end;
+			formatter<Args ...>(slot.data, data, format, text, sizeof(text));
+			emit(level, LogArg<Tag>::str(tag), text);
+			return;
+		}
+
+		std::call_once(fStart, start);
+
+		Ring_t *ring = Logger::ring();
+		uint32_t head = ring->head.load(std::memory_order_relaxed);
+
+		while (head - ring->tail.load(std::memory_order_acquire) == RINGSIZE) {
+			if (level < LOGLEVEL_ERROR || std::this_thread::get_id() == nThreadId.load(std::memory_order_relaxed)) {
+				nDropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			// errors are not lost
+			cvWake.notify_one();
+			std::this_thread::yield();
+		}
+
+		Slot_t &slot = ring->slots[head & (RINGSIZE - 1)];
+		slot.time = (uint64_t) std::chrono::steady_clock::now().time_since_epoch().count();
+		slot.format = format;
+		slot.formatter = &formatter<Args ...>;
+		slot.level = (uint8_t) level;
+
+		uint8_t *data = slot.data, *end = slot.data + sizeof(slot.data);
+		LogArg<Tag>::encode(data, end, tag);
+		(LogArg<Args>::encode(data, end, args), ...);
+
+		ring->head.store(head + 1, std::memory_order_release);
+		nWritten.fetch_add(1, std::memory_order_relaxed);
+
+		// the thread wakes up every few ms by itself, waking it for every message would cost a
+		// context switch each. Only when the ring is getting full.
+		if (head - ring->tail.load(std::memory_order_relaxed) > RINGSIZE / 2 &&
+			bSleeping.exchange(false, std::memory_order_relaxed))
+			cvWake.notify_one();
+	}
+
+	inline Logger::Ring_t *Logger::ring() {
+		thread_local RingOwner_t owner;
+		if (!owner.ring) {
+			owner.ring = std::make_shared<Ring_t>();
+			std::lock_guard<std::mutex> lock(mRings);
+			vRings.push_back(owner.ring);
+		}
+		return owner.ring.get();
+	}
+
+	inline void Logger::start() {
+		cThread = std::thread(threadLoop);
+		bRunning.store(true, std::memory_order_release);
+	}
+
+	inline void Logger::threadLoop() {
+		nThreadId.store(std::this_thread::get_id(), std::memory_order_relaxed);
+		while (!bQuit.load(std::memory_order_acquire)) {
+			drain();
+			// writers wake it up when a ring fills up (a lost wake up only delays messages until
+			// the timeout)
+			std::unique_lock<std::mutex> lock(mWake);
+			bSleeping.store(true, std::memory_order_relaxed);
+			cvWake.wait_for(lock, std::chrono::milliseconds(PERIODMS));
+			bSleeping.store(false, std::memory_order_relaxed);
+		}
+		drain();
+	}
+
+	inline int Logger::drain() {
+
+		typedef struct sMessage {
+			uint64_t time;
+			LogLevel_t level;
+			std::string tag, text;
+		} Message_t;
+
+		std::vector<std::shared_ptr<Ring_t>> rings;
+		{
+			std::lock_guard<std::mutex> lock(mRings);
+			// finished threads that have nothing left
+			vRings.erase(std::remove_if(vRings.begin(), vRings.end(), [](const std::shared_ptr<Ring_t> &ring) {
+				return ring->orphan.load(std::memory_order_acquire) &&
+					   ring->head.load(std::memory_order_acquire) == ring->tail.load(std::memory_order_relaxed);
+			}), vRings.end());
+			rings = vRings;
+		}
+
+		std::vector<Message_t> messages;
+		char text[1024];
+
+		for (auto &ring:rings) {
+			uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+			uint32_t head = ring->head.load(std::memory_order_acquire);
+			for (; tail != head; tail++) {
+				Slot_t &slot = ring->slots[tail & (RINGSIZE - 1)];
+				const uint8_t *data = slot.data, *end = slot.data + sizeof(slot.data);
+				const char *tag = LogArg<const char *>::decode(data, end);
+				slot.formatter(data, end, slot.format, text, sizeof(text));
+				messages.push_back({slot.time, (LogLevel_t) slot.level, tag, text});
+			}
+			ring->tail.store(tail, std::memory_order_release);
+		}
+
+		std::stable_sort(messages.begin(), messages.end(), [](const Message_t &a, const Message_t &b) {
+			return a.time < b.time;
+		});
+
+		for (Message_t &message:messages) emit(message.level, message.tag.c_str(), message.text.c_str());
+
+		uint64_t dropped = nDropped.load(std::memory_order_relaxed) - nDropReported.load(std::memory_order_relaxed);
+		if (dropped > 0) {
+			nDropReported.fetch_add(dropped, std::memory_order_relaxed);
+			snprintf(text, sizeof(text), "%llu messages dropped, log ring full", (unsigned long long) dropped);
+			emit(LOGLEVEL_ERROR, "Logger", text);
+		}
+
+		nEmitted.fetch_add(messages.size(), std::memory_order_release);
+		return (int) messages.size();
+	}
+
+	inline void Logger::emit(LogLevel_t level, const char *tag, const char *text) {
+		std::lock_guard<std::recursive_mutex> lock(mSink);
+		if (fSink) fSink(level, tag, text);
+		else if (level >= LOGLEVEL_ERROR) LogE(tag, text);
+		else LogV(tag, text);
+	}
+
+	inline void Logger::setAsync(bool async) {
+		if (!async) flush();
+		bAsync.store(async, std::memory_order_relaxed);
+	}
+
+	inline void Logger::setSink(Sink_t sink) {
+		flush();
+		std::lock_guard<std::recursive_mutex> lock(mSink);
+		fSink = std::move(sink);
+	}
+
+	inline void Logger::flush() {
+		if (!bRunning.load(std::memory_order_acquire)
+			|| std::this_thread::get_id() == nThreadId.load(std::memory_order_relaxed))
+			return;
+		uint64_t written = nWritten.load(std::memory_order_relaxed);
+		while (nEmitted.load(std::memory_order_acquire) < written && !bQuit.load(std::memory_order_relaxed)) {
+			cvWake.notify_one();
+			std::this_thread::yield();
+		}
+	}
+
+	inline void Logger::stop() {
+		if (!bRunning.load(std::memory_order_acquire) || bQuit.exchange(true)) return;
+		cvWake.notify_one();
+		if (cThread.joinable()) cThread.join();
+	}
+
+	inline uint64_t Logger::dropped() { return nDropped.load(std::memory_order_relaxed); }
+
+}
@@ -0,0 +1,435 @@
+//
+//  PixelOps.hpp
+//  PixFu
+//
+//  Span kernels used by Drawable and Canvas2D to fill, copy and blend runs of 32-bit pixels.
+//  The widest instruction set enabled at compile time is used: AVX2 (-mavx2), SSE2 (any
+//  x86_64 build) or NEON (arm64), with a portable scalar fallback.
+//
+//  Blending uses integer math with exact rounded division by 255, so the SIMD kernels give
+//  the very same result as the scalar blend() used for span tails and single pixels.
+//
+//  Created by rodo on 17/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace Pix {
+
+	/** How drawn pixels combine with the destination */
+	typedef enum eBlendMode {
+		/** overwrite destination */
+		BLEND_NORMAL = 0,
+		/** source over destination, weighted by source alpha */
+		BLEND_ALPHA = 1,
+		/** add source weighted by its alpha, saturating */
+		BLEND_ADDITIVE = 2,
+		/** only opaque source pixels (alpha 255) are written */
+		BLEND_MASK = 3
+	} BlendMode_t;
+
+	class PixelOps {
+
+#if defined(__AVX2__)
+		static __m256i blend8(__m256i d, __m256i s, BlendMode_t mode);
+#elif defined(__SSE2__)
+		static __m128i blend4(__m128i d, __m128i s, BlendMode_t mode);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+		static uint8x8x4_t blend8(uint8x8x4_t d, uint8x8x4_t s, BlendMode_t mode);
+#endif
+
+		// rounded x / 255 for x <= 255 * 255
+		static uint32_t div255(uint32_t x);
+
+	public:
+
+		/**
+		 * Fills a span of pixels with a color
+		 * @param dst Destination
+		 * @param color The color (Pixel::n)
+		 * @param count Number of pixels
+		 */
+		static void fill(uint32_t *dst, uint32_t color, size_t count);
+
+		/**
+		 * Scalar reference of fill(), for benchmarks
+		 */
+		static void fillScalar(uint32_t *dst, uint32_t color, size_t count);
+
+		/**
+		 * Copies a span of pixels. Spans must not overlap.
+		 * @param dst Destination
+		 * @param src Source
+		 * @param count Number of pixels
+		 */
+		static void copy(uint32_t *dst, const uint32_t *src, size_t count);
+
+		/**
+		 * Fills a rectangle of a buffer. Rectangle must be already clipped.
+		 * @param dst Buffer
+		 * @param stride Buffer width in pixels
+		 * @param x left
+		 * @param y top
+		 * @param w width
+		 * @param h height
+		 * @param color The color
+		 */
+		static void fillRect(uint32_t *dst, int stride, int x, int y, int w, int h, uint32_t color);
+
+		/**
+		 * Blends a single pixel
+		 * @param dst Destination pixel
+		 * @param src Source pixel
+		 * @param mode Blend mode
+		 * @return The resulting pixel
+		 */
+		static uint32_t blend(uint32_t dst, uint32_t src, BlendMode_t mode);
+
+		/**
+		 * Blends a color over a span of pixels
+		 * @param dst Destination
+		 * @param color The color
+		 * @param count Number of pixels
+		 * @param mode Blend mode
+		 */
+		static void blendFill(uint32_t *dst, uint32_t color, size_t count, BlendMode_t mode);
+
+		/**
+		 * Blends a span of pixels over another. Spans must not overlap.
+		 * @param dst Destination
+		 * @param src Source
+		 * @param count Number of pixels
+		 * @param mode Blend mode
+		 */
+		static void blendCopy(uint32_t *dst, const uint32_t *src, size_t count, BlendMode_t mode);
+
+		/** Name of the instruction set in use */
+		static const char *isa();
+
+	};
+
+	inline void PixelOps::fillScalar(uint32_t *dst, uint32_t color, size_t count) {
+		for (size_t i = 0; i < count; i++) dst[i] = color;
+	}
+
+	inline void PixelOps::fill(uint32_t *dst, uint32_t color, size_t count) {
+
+#if defined(__AVX2__)
+
+		// align destination so the main loop does aligned stores
+		while (count > 0 && (reinterpret_cast<uintptr_t>(dst) & 31)) {
+			*dst++ = color;
+			count--;
+		}
+
+		const __m256i c = _mm256_set1_epi32(static_cast<int>(color));
+
+		for (; count >= 32; count -= 32, dst += 32) {
+			_mm256_store_si256(reinterpret_cast<__m256i *>(dst), c);
+			_mm256_store_si256(reinterpret_cast<__m256i *>(dst + 8), c);
+			_mm256_store_si256(reinterpret_cast<__m256i *>(dst + 16), c);
+			_mm256_store_si256(reinterpret_cast<__m256i *>(dst + 24), c);
+		}
+
+		for (; count >= 8; count -= 8, dst += 8)
+			_mm256_store_si256(reinterpret_cast<__m256i *>(dst), c);
+
+#elif defined(__SSE2__)
+
+		while (count > 0 && (reinterpret_cast<uintptr_t>(dst) & 15)) {
+			*dst++ = color;
+			count--;
+		}
+
+		const __m128i c = _mm_set1_epi32(static_cast<int>(color));
+
+		for (; count >= 16; count -= 16, dst += 16) {
+			_mm_store_si128(reinterpret_cast<__m128i *>(dst), c);
+			_mm_store_si128(reinterpret_cast<__m128i *>(dst + 4), c);
+			_mm_store_si128(reinterpret_cast<__m128i *>(dst + 8), c);
+			_mm_store_si128(reinterpret_cast<__m128i *>(dst + 12), c);
+		}
+
+		for (; count >= 4; count -= 4, dst += 4)
+			_mm_store_si128(reinterpret_cast<__m128i *>(dst), c);
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+		const uint32x4_t c = vdupq_n_u32(color);
+
+		for (; count >= 16; count -= 16, dst += 16) {
+			vst1q_u32(dst, c);
+			vst1q_u32(dst + 4, c);
+			vst1q_u32(dst + 8, c);
+			vst1q_u32(dst + 12, c);
+		}
+
+		for (; count >= 4; count -= 4, dst += 4)
+			vst1q_u32(dst, c);
+
+#endif
+
+		// tail (or everything without SIMD)
+		for (size_t i = 0; i < count; i++) dst[i] = color;
+	}
+
+	inline void PixelOps::copy(uint32_t *dst, const uint32_t *src, size_t count) {
+		// libc memcpy is already vectorized and picks non-temporal stores for large sizes
+		memcpy(dst, src, count * sizeof(uint32_t));
+	}
+
+	inline void PixelOps::fillRect(uint32_t *dst, int stride, int x, int y, int w, int h, uint32_t color) {
+		if (w == stride) {
+			// contiguous rows, single span
+			fill(dst + y * stride, color, static_cast<size_t>(w) * h);
+			return;
+		}
+		uint32_t *row = dst + y * stride + x;
+		for (int j = 0; j < h; j++, row += stride)
+			fill(row, color, w);
+	}
+
+	inline uint32_t PixelOps::div255(uint32_t x) {
+		x += 128;
+		return (x + (x >> 8)) >> 8;
+	}
+
+	inline uint32_t PixelOps::blend(uint32_t d, uint32_t s, BlendMode_t mode) {
+
+		uint32_t a = s >> 24;
+
+		switch (mode) {
+
+			case BLEND_NORMAL:
+				return s;
+
+			case BLEND_MASK:
+				return a == 255 ? s : d;
+
+			case BLEND_ALPHA: {
+				// source alpha channel is taken as 255, so out alpha = a + dA * (1 - a)
+				uint32_t out = 0;
+				for (int shift = 0; shift < 32; shift += 8) {
+					uint32_t sc = shift == 24 ? 255 : (s >> shift) & 0xff;
+					uint32_t dc = (d >> shift) & 0xff;
+					out |= div255(sc * a + dc * (255 - a)) << shift;
+				}
+				return out;
+			}
+
+			case BLEND_ADDITIVE: {
+				uint32_t out = 0;
+				for (int shift = 0; shift < 32; shift += 8) {
+					uint32_t sc = shift == 24 ? 255 : (s >> shift) & 0xff;
+					uint32_t dc = (d >> shift) & 0xff;
+					out |= std::min<uint32_t>(255, dc + div255(sc * a)) << shift;
+				}
+				return out;
+			}
+		}
+
+		return s;
+	}
+
+#if defined(__AVX2__)
+
+	inline __m256i PixelOps::blend8(__m256i d, __m256i s, BlendMode_t mode) {
+
+		if (mode == BLEND_MASK) {
+			__m256i opaque = _mm256_cmpeq_epi32(_mm256_srli_epi32(s, 24), _mm256_set1_epi32(255));
+			return _mm256_blendv_epi8(d, s, opaque);
+		}
+
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i c128 = _mm256_set1_epi16(128);
+
+		// alpha of each pixel replicated on its 4 channels, as 16 bit lanes
+		__m256i a32 = _mm256_srli_epi32(s, 24);
+		a32 = _mm256_or_si256(a32, _mm256_slli_epi32(a32, 16));
+		__m256i aLo = _mm256_unpacklo_epi32(a32, a32), aHi = _mm256_unpackhi_epi32(a32, a32);
+
+		// source alpha channel counts as 255
+		__m256i so = _mm256_or_si256(s, _mm256_set1_epi32(static_cast<int>(0xFF000000)));
+		__m256i sLo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(so, zero), aLo);
+		__m256i sHi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(so, zero), aHi);
+
+		if (mode == BLEND_ALPHA) {
+			const __m256i c255 = _mm256_set1_epi16(255);
+			sLo = _mm256_add_epi16(sLo, _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), _mm256_sub_epi16(c255, aLo)));
+			sHi = _mm256_add_epi16(sHi, _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), _mm256_sub_epi16(c255, aHi)));
+		}
+
+		// rounded division by 255
+		sLo = _mm256_add_epi16(sLo, c128);
+		sHi = _mm256_add_epi16(sHi, c128);
+		sLo = _mm256_srli_epi16(_mm256_add_epi16(sLo, _mm256_srli_epi16(sLo, 8)), 8);
+		sHi = _mm256_srli_epi16(_mm256_add_epi16(sHi, _mm256_srli_epi16(sHi, 8)), 8);
+
+		__m256i r = _mm256_packus_epi16(sLo, sHi);
+		return mode == BLEND_ADDITIVE ? _mm256_adds_epu8(d, r) : r;
+	}
+
+#elif defined(__SSE2__)
+
+	inline __m128i PixelOps::blend4(__m128i d, __m128i s, BlendMode_t mode) {
+
+		if (mode == BLEND_MASK) {
+			__m128i opaque = _mm_cmpeq_epi32(_mm_srli_epi32(s, 24), _mm_set1_epi32(255));
+			return _mm_or_si128(_mm_and_si128(opaque, s), _mm_andnot_si128(opaque, d));
+		}
+
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i c128 = _mm_set1_epi16(128);
+
+		// alpha of each pixel replicated on its 4 channels, as 16 bit lanes
+		__m128i a32 = _mm_srli_epi32(s, 24);
+		a32 = _mm_or_si128(a32, _mm_slli_epi32(a32, 16));
+		__m128i aLo = _mm_unpacklo_epi32(a32, a32), aHi = _mm_unpackhi_epi32(a32, a32);
+
+		// source alpha channel counts as 255
+		__m128i so = _mm_or_si128(s, _mm_set1_epi32(static_cast<int>(0xFF000000)));
+		__m128i sLo = _mm_mullo_epi16(_mm_unpacklo_epi8(so, zero), aLo);
+		__m128i sHi = _mm_mullo_epi16(_mm_unpackhi_epi8(so, zero), aHi);
+
+		if (mode == BLEND_ALPHA) {
+			const __m128i c255 = _mm_set1_epi16(255);
+			sLo = _mm_add_epi16(sLo, _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(c255, aLo)));
+			sHi = _mm_add_epi16(sHi, _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(c255, aHi)));
+		}
+
+		// rounded division by 255
+		sLo = _mm_add_epi16(sLo, c128);
+		sHi = _mm_add_epi16(sHi, c128);
+		sLo = _mm_srli_epi16(_mm_add_epi16(sLo, _mm_srli_epi16(sLo, 8)), 8);
+		sHi = _mm_srli_epi16(_mm_add_epi16(sHi, _mm_srli_epi16(sHi, 8)), 8);
+
+		__m128i r = _mm_packus_epi16(sLo, sHi);
+		return mode == BLEND_ADDITIVE ? _mm_adds_epu8(d, r) : r;
+	}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+	// operates on deinterleaved channels (vld4), 8 pixels
+	inline uint8x8x4_t PixelOps::blend8(uint8x8x4_t d, uint8x8x4_t s, BlendMode_t mode) {
+
+		uint8x8_t a = s.val[3];
+		uint8x8x4_t r;
+
+		if (mode == BLEND_MASK) {
+			uint8x8_t opaque = vceq_u8(a, vdup_n_u8(255));
+			for (int c = 0; c < 4; c++) r.val[c] = vbsl_u8(opaque, s.val[c], d.val[c]);
+			return r;
+		}
+
+		// source alpha channel counts as 255
+		s.val[3] = vdup_n_u8(255);
+		uint8x8_t ia = vsub_u8(vdup_n_u8(255), a);
+
+		for (int c = 0; c < 4; c++) {
+			uint16x8_t t = vmull_u8(s.val[c], a);
+			if (mode == BLEND_ALPHA) t = vmlal_u8(t, d.val[c], ia);
+			// rounded division by 255: (t + 128 + ((t + 128) >> 8)) >> 8
+			uint8x8_t v = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+			r.val[c] = mode == BLEND_ADDITIVE ? vqadd_u8(d.val[c], v) : v;
+		}
+
+		return r;
+	}
+
+#endif
+
+	inline void PixelOps::blendFill(uint32_t *dst, uint32_t color, size_t count, BlendMode_t mode) {
+
+		uint32_t a = color >> 24;
+
+		// trivial cases
+		if (mode == BLEND_NORMAL || (a == 255 && mode != BLEND_ADDITIVE)) {
+			fill(dst, color, count);
+			return;
+		}
+		if (a == 0 || mode == BLEND_MASK) return;
+
+		size_t i = 0;
+
+#if defined(__AVX2__)
+		const __m256i s = _mm256_set1_epi32(static_cast<int>(color));
+		for (; i + 8 <= count; i += 8) {
+			__m256i *p = reinterpret_cast<__m256i *>(dst + i);
+			_mm256_storeu_si256(p, blend8(_mm256_loadu_si256(p), s, mode));
+		}
+#elif defined(__SSE2__)
+		const __m128i s = _mm_set1_epi32(static_cast<int>(color));
+		for (; i + 4 <= count; i += 4) {
+			__m128i *p = reinterpret_cast<__m128i *>(dst + i);
+			_mm_storeu_si128(p, blend4(_mm_loadu_si128(p), s, mode));
+		}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+		uint8x8x4_t s;
+		for (int c = 0; c < 4; c++) s.val[c] = vdup_n_u8((color >> (c * 8)) & 0xff);
+		for (; i + 8 <= count; i += 8) {
+			uint8_t *p = reinterpret_cast<uint8_t *>(dst + i);
+			vst4_u8(p, blend8(vld4_u8(p), s, mode));
+		}
+#endif
+
+		for (; i < count; i++) dst[i] = blend(dst[i], color, mode);
+	}
+
+	inline void PixelOps::blendCopy(uint32_t *dst, const uint32_t *src, size_t count, BlendMode_t mode) {
+
+		if (mode == BLEND_NORMAL) {
+			copy(dst, src, count);
+			return;
+		}
+
+		size_t i = 0;
+
+#if defined(__AVX2__)
+		for (; i + 8 <= count; i += 8) {
+			__m256i *p = reinterpret_cast<__m256i *>(dst + i);
+			__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+			_mm256_storeu_si256(p, blend8(_mm256_loadu_si256(p), s, mode));
+		}
+#elif defined(__SSE2__)
+		for (; i + 4 <= count; i += 4) {
+			__m128i *p = reinterpret_cast<__m128i *>(dst + i);
+			__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+			_mm_storeu_si128(p, blend4(_mm_loadu_si128(p), s, mode));
+		}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+		for (; i + 8 <= count; i += 8) {
+			uint8_t *p = reinterpret_cast<uint8_t *>(dst + i);
+			vst4_u8(p, blend8(vld4_u8(p), vld4_u8(reinterpret_cast<const uint8_t *>(src + i)), mode));
+		}
+#endif
+
+		for (; i < count; i++) dst[i] = blend(dst[i], src[i], mode);
+	}
+
+	inline const char *PixelOps::isa() {
+#if defined(__AVX2__)
+		return "AVX2";
+#elif defined(__SSE2__)
+		return "SSE2";
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+		return "NEON";
+#else
+		return "scalar";
+#endif
+	}
+
+}
@@ -0,0 +1,348 @@
+//
+//  Profiler.hpp
+//  PixFu
+//
+//  Frame profiler. Hot paths are wrapped in scoped timers (PIXFU_PROFILE) that write a sample
+//  to a fixed lock-free ring buffer: recording never allocates nor locks, so it can stay on in
+//  production builds and be switched on when a frame spike has to be attributed. The engine
+//  loop times every extension tick, input device sync, onUserUpdate and the platform commit,
+//  and textures time their uploads.
+//
+//  Rolling statistics (percentiles) are computed from the samples in the ring, and the ring
+//  can be dumped as Chrome trace_event JSON (chrome://tracing, Perfetto).
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "Clock.hpp"
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#if defined(__GNUG__) || defined(__clang__)
+#include <cxxabi.h>
+#endif
+
+// scoped timer of a named zone, the zone is registered once
+#define PIXFU_PROFILE_CAT2(a, b) a##b
+#define PIXFU_PROFILE_CAT(a, b) PIXFU_PROFILE_CAT2(a, b)
+#define PIXFU_PROFILE(name) \
+	static const uint16_t PIXFU_PROFILE_CAT(_pixfuZone, __LINE__) = Pix::Profiler::zone(name); \
+	Pix::ProfileScope PIXFU_PROFILE_CAT(_pixfuScope, __LINE__)(PIXFU_PROFILE_CAT(_pixfuZone, __LINE__))
+
+namespace Pix {
+
+	/** A timed sample */
+	typedef struct sProfileSample {
+		uint64_t start;                  // ns since the profiler epoch
+		uint32_t duration;               // ns
+		uint32_t frame;
+		uint16_t zone;
+		uint16_t thread;
+	} ProfileSample_t;
+
+	/** Rolling statistics of a zone, in milliseconds */
+	typedef struct sProfileStats {
+		uint32_t count = 0;
+		float mean = 0, p50 = 0, p95 = 0, p99 = 0, max = 0;
+		float perFrame = 0;              // mean total time per frame
+	} ProfileStats_t;
+
+	class Profiler {
+
+		static constexpr int NAMELENGTH = 64;
+
+		typedef struct sZone {
+			char name[NAMELENGTH];
+			const void *key;             // name pointer or type_info, for fast lookups
+		} Zone_t;
+
+		// a ring entry: the sample is valid while sequence is its write index + 1
+		typedef struct sSlot {
+			std::atomic<uint64_t> sequence;
+			ProfileSample_t sample;
+		} Slot_t;
+
+		inline static Slot_t aRing[1 << 16];
+		inline static Zone_t aZones[256];
+		inline static std::atomic<uint32_t> nZones{0};
+		inline static std::atomic<uint64_t> nWrite{0};
+		inline static std::atomic<uint32_t> nFrame{0};
+		inline static std::atomic<bool> bEnabled{true};
+		inline static std::atomic<uint16_t> nThreads{0};
+		inline static std::mutex mRegister;
+		inline static bool bOverflowLogged = false;
+
+		static uint16_t registerZone(const char *name, const void *key);
+
+		// copies the valid samples of the ring, oldest first. Samples overwritten while being
+		// copied are dropped.
+		static std::vector<ProfileSample_t> snapshot();
+
+	public:
+
+		/** Ring capacity in samples, a power of two */
+		static constexpr uint32_t RINGSIZE = 1 << 16;
+
+		/** Zones that can be registered, later ones are all counted in the last one */
+		static constexpr int MAXZONES = 256;
+
+		/** Enables or disables recording */
+		static void enable(bool enabled);
+
+		static bool enabled();
+
+		/** Current time in ns (Clock::now() + 1, never 0) */
+		static uint64_t now();
+
+		/**
+		 * Gets the zone of a name, registering it the first time
+		 * @param name Zone name. Pointers are compared first, so prefer string literals.
+		 * @return the zone id
+		 */
+		static uint16_t zone(const char *name);
+
+		/** Gets the zone of a type (demangled name), registering it the first time */
+		static uint16_t zone(const std::type_info &type);
+
+		/** Name of a zone */
+		static const char *name(uint16_t zone);
+
+		/** Marks the start of a frame */
+		static void frame();
+
+		/**
+		 * Records a sample. Lock-free, never allocates.
+		 * @param zone The zone
+		 * @param start Start time (now())
+		 * @param end End time (now())
+		 */
+		static void record(uint16_t zone, uint64_t start, uint64_t end);
+
+		/**
+		 * Statistics of a zone over the samples still in the ring
+		 * @param zone The zone
+		 * @param frames Only consider the last frames, 0 = all
+		 */
+		static ProfileStats_t stats(uint16_t zone, uint32_t frames = 0);
+
+		static ProfileStats_t stats(const char *name, uint32_t frames = 0);
+
+		/**
+		 * Writes the samples in the ring as Chrome trace_event JSON
+		 * @param path File to write
+		 * @return success
+		 */
+		static bool dumpTrace(const std::string &path);
+
+		/** Drops all samples */
+		static void clear();
+
+	};
+
+	/** Times a scope into a zone */
+	class ProfileScope {
+
+		const uint16_t nZone;
+		const uint64_t nStart;
+
+	public:
+
+		explicit ProfileScope(uint16_t zone);
+
+		~ProfileScope();
+
+	};
+
+	inline ProfileScope::ProfileScope(uint16_t zone)
+			: nZone(zone), nStart(Profiler::enabled() ? Profiler::now() : 0) {}
+
+	inline ProfileScope::~ProfileScope() {
+		if (nStart != 0) Profiler::record(nZone, nStart, Profiler::now());
+	}
+
+	inline void Profiler::enable(bool enabled) { bEnabled.store(enabled, std::memory_order_relaxed); }
+
+	inline bool Profiler::enabled() { return bEnabled.load(std::memory_order_relaxed); }
+
+	inline uint64_t Profiler::now() {
+		// +1 so a valid start is never 0
+		return Clock::now() + 1;
+	}
+
+	inline uint16_t Profiler::registerZone(const char *name, const void *key) {
+
+		std::lock_guard<std::mutex> lock(mRegister);
+
+		uint32_t count = nZones.load(std::memory_order_acquire);
+		for (uint32_t i = 0; i < count; i++)
+			if (aZones[i].key == key || strncmp(aZones[i].name, name, NAMELENGTH - 1) == 0) return (uint16_t) i;
+
+		if (count == MAXZONES) {
+			if (!bOverflowLogged) {
+				PIXFU_LOGE("Profiler", "More than %d zones, %s and later ones are counted as %s", MAXZONES, name,
+						   aZones[MAXZONES - 1].name);
+				bOverflowLogged = true;
+			}
+			return MAXZONES - 1;
+		}
+
+		strncpy(aZones[count].name, name, NAMELENGTH - 1);
+		aZones[count].name[NAMELENGTH - 1] = 0;
+		aZones[count].key = key;
+		nZones.store(count + 1, std::memory_order_release);
+		return (uint16_t) count;
+	}
+
+	inline uint16_t Profiler::zone(const char *name) {
+		uint32_t count = nZones.load(std::memory_order_acquire);
+		for (uint32_t i = 0; i < count; i++)
+			if (aZones[i].key == name) return (uint16_t) i;
+		return registerZone(name, name);
+	}
+
+	inline uint16_t Profiler::zone(const std::type_info &type) {
+
+		uint32_t count = nZones.load(std::memory_order_acquire);
+		for (uint32_t i = 0; i < count; i++)
+			if (aZones[i].key == &type) return (uint16_t) i;
+
+		std::string name = type.name();
+#if defined(__GNUG__) || defined(__clang__)
+		int status = 0;
+		char *demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+		if (status == 0 && demangled != nullptr) name = demangled;
+		free(demangled);
+#endif
+		return registerZone(name.c_str(), &type);
+	}
+
+	inline const char *Profiler::name(uint16_t zone) {
+		return zone < nZones.load(std::memory_order_acquire) ? aZones[zone].name : "?";
+	}
+
+	inline void Profiler::frame() { nFrame.fetch_add(1, std::memory_order_relaxed); }
+
+	inline void Profiler::record(uint16_t zone, uint64_t start, uint64_t end) {
+
+		if (!enabled()) return;
+
+		thread_local uint16_t thread = nThreads.fetch_add(1, std::memory_order_relaxed);
+
+		uint64_t index = nWrite.fetch_add(1, std::memory_order_relaxed);
+		Slot_t &slot = aRing[index & (RINGSIZE - 1)];
+
+		// invalidate while writing, publish with the sequence
+		slot.sequence.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.sample.start = start;
+		slot.sample.duration = (uint32_t) std::min<uint64_t>(end - start, UINT32_MAX);
+		slot.sample.frame = nFrame.load(std::memory_order_relaxed);
+		slot.sample.zone = zone;
+		slot.sample.thread = thread;
+		slot.sequence.store(index + 1, std::memory_order_release);
+	}
+
+	inline std::vector<ProfileSample_t> Profiler::snapshot() {
+
+		uint64_t end = nWrite.load(std::memory_order_acquire);
+		uint64_t begin = end > RINGSIZE ? end - RINGSIZE : 0;
+
+		std::vector<ProfileSample_t> samples;
+		samples.reserve(end - begin);
+
+		for (uint64_t i = begin; i < end; i++) {
+			Slot_t &slot = aRing[i & (RINGSIZE - 1)];
+			if (slot.sequence.load(std::memory_order_acquire) != i + 1) continue;
+			ProfileSample_t sample = slot.sample;
+			// a writer that wrapped around meanwhile has changed the sequence
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) == i + 1) samples.push_back(sample);
+		}
+
+		return samples;
+	}
+
+	inline ProfileStats_t Profiler::stats(uint16_t zone, uint32_t frames) {
+
+		uint32_t current = nFrame.load(std::memory_order_relaxed);
+		std::vector<float> durations;
+		uint32_t firstFrame = UINT32_MAX, lastFrame = 0;
+
+		for (const ProfileSample_t &sample:snapshot()) {
+			if (sample.zone != zone || (frames > 0 && current - sample.frame >= frames)) continue;
+			durations.push_back(sample.duration / 1e6f);
+			firstFrame = std::min(firstFrame, sample.frame);
+			lastFrame = std::max(lastFrame, sample.frame);
+		}
+
+		ProfileStats_t stats;
+		if (durations.empty()) return stats;
+
+		std::sort(durations.begin(), durations.end());
+
+		float total = 0;
+		for (float d:durations) total += d;
+
+		auto percentile = [&durations](float p) {
+			return durations[std::min(durations.size() - 1, (size_t) (p * durations.size()))];
+		};
+
+		stats.count = (uint32_t) durations.size();
+		stats.mean = total / durations.size();
+		stats.p50 = percentile(0.50f);
+		stats.p95 = percentile(0.95f);
+		stats.p99 = percentile(0.99f);
+		stats.max = durations.back();
+		stats.perFrame = total / (lastFrame - firstFrame + 1);
+		return stats;
+	}
+
+	inline ProfileStats_t Profiler::stats(const char *name, uint32_t frames) {
+		return stats(zone(name), frames);
+	}
+
+	inline bool Profiler::dumpTrace(const std::string &path) {
+
+		FILE *file = fopen(path.c_str(), "w");
+		if (file == nullptr) {
+			PIXFU_LOGE("Profiler", "Cannot write %s", path.c_str());
+			return false;
+		}
+
+		fprintf(file, "{\"traceEvents\":[\n");
+
+		bool first = true;
+		for (const ProfileSample_t &sample:snapshot()) {
+			// names are identifiers or demangled types, only quotes and backslashes need escaping
+			std::string name;
+			for (const char *c = Profiler::name(sample.zone); *c; c++) {
+				if (*c == '"' || *c == '\\') name += '\\';
+				name += *c;
+			}
+			fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,"
+						  "\"args\":{\"frame\":%u}}",
+					first ? "" : ",\n", name.c_str(), sample.start / 1e3, sample.duration / 1e3,
+					(unsigned) sample.thread, (unsigned) sample.frame);
+			first = false;
+		}
+
+		fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+		return fclose(file) == 0;
+	}
+
+	inline void Profiler::clear() {
+		for (Slot_t &slot:aRing) slot.sequence.store(0, std::memory_order_relaxed);
+	}
+
+}
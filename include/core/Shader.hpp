@@ -5,6 +5,14 @@
 //  The shader class abstracts communication with the shader providing methods to set the
 //  uniforms, and to start and stop the shader.
 //
+//  Uniform locations are queried once when the shader is created and cached by name hash, so
+//  setting a uniform does not ask the driver. Names are hashed at compile time when they are
+//  literals or constexpr UniformName_t constants, and compared on a hash match. Every element
+//  of array uniforms is cached (name, name[0], name[1]...).
+//
+//  use() and stop() go through GlState: using the shader that is already in use costs nothing,
+//  so draws do not need to stop() their shader.
+//
 //  Created by rodo on 11/02/2020.
 //  Copyright © 2020 rodo. All rights reserved.
 //
@@ -13,52 +21,128 @@
 
 #include "OpenGL.h"
 #include "OpenGlUtils.h"
+#include "GlState.hpp"
 #include "Texture2D.hpp"
+#include "AssetSource.hpp"
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 namespace Pix {
 
+	/**
+	 * A uniform name, FNV-1a hashed (at compile time for literals) to find its cached location.
+	 * It points to the name, which has to outlive it (literals, or the string it is built from
+	 * for the call).
+	 */
+	typedef struct sUniformName {
+
+		uint32_t hash;
+		const char *name;
+		size_t length;
+
+		constexpr sUniformName(const char *name) : hash(fnv(name, ~(size_t) 0)), name(name), length(count(name)) {}
+
+		sUniformName(const std::string &name) : hash(fnv(name.c_str(), name.size())), name(name.c_str()),
+												length(name.size()) {}
+
+		static constexpr uint32_t fnv(const char *name, size_t length) {
+			uint32_t hash = 2166136261u;
+			for (size_t i = 0; i < length && name[i] != 0; i++) hash = (hash ^ (uint8_t) name[i]) * 16777619u;
+			return hash;
+		}
+
+		static constexpr size_t count(const char *name) {
+			size_t length = 0;
+			while (name[length] != 0) length++;
+			return length;
+		}
+
+	} UniformName_t;
+
+	/** A cached uniform location */
+	typedef struct sUniformLocation {
+		uint32_t hash;
+		GLint location;
+		std::string name;
+	} UniformLocation_t;
+
 	class Shader {
 
+		inline static const std::string TAG = "Shader";
+
 		GLuint ID;
 
+		// active uniforms, sorted by hash
+		std::vector<UniformLocation_t> vUniforms;
+
+		/** queries the active uniforms of the linked program */
+		void cacheUniforms();
+
+		// caches the location of a uniform name, if it has one
+		void cacheUniform(const std::string &name);
+
 	public:
 
 		Shader(const std::string &name);
 
+		/** The GL program */
+		GLuint id();
+
+		/**
+		 * Location of a uniform, from the cache. As every active uniform (and array element) is
+		 * cached, a name that is not there is not in the program.
+		 * @return the location, -1 if the shader has no such uniform (setting it is ignored)
+		 */
+		GLint location(UniformName_t name) const;
+
+		/**
+		 * Attaches a uniform block of the shader to a binding point (see UniformBlock)
+		 * @return false if the shader does not declare the block
+		 */
+		bool bindBlock(const std::string &block, GLuint binding);
+
 		// activates the shader
 		void use();
 
+		// no shader in use
 		void stop();
 
 		void cleanup();
 
-		void textureUnit(std::string sampler2d, Texture2D *texture);
+		void textureUnit(UniformName_t sampler2d, Texture2D *texture);
 
 		// utility uniform functions
 
-		void setBool(const std::string &name, bool value) const;
+		void setBool(UniformName_t name, bool value) const;
 
-		void setInt(const std::string &name, int value) const;
+		void setInt(UniformName_t name, int value) const;
 
-		void setFloat(const std::string &name, float value) const;
+		void setFloat(UniformName_t name, float value) const;
 
-		void setVec2(const std::string &name, float x, float y) const;
+		void setVec2(UniformName_t name, float x, float y) const;
 
-		void setVec3(const std::string &name, float x, float y, float z) const;
+		void setVec3(UniformName_t name, float x, float y, float z) const;
 
-		void setVec4(const std::string &name, float x, float y, float z, float w) const;
+		void setVec4(UniformName_t name, float x, float y, float z, float w) const;
 
-		void setMat2(const std::string &name, const float *mat2) const;
+		void setMat2(UniformName_t name, const float *mat2) const;
 
-		void setMat3(const std::string &name, const float *mat3) const;
+		void setMat3(UniformName_t name, const float *mat3) const;
 
-		void setMat4(const std::string &name, const float *mat4) const;
+		void setMat4(UniformName_t name, const float *mat4) const;
 
 		void bindAttribute(GLuint attribute, std::string variableName);
 
+		/** Links the program again, ie. to apply bindAttribute(). Uniform blocks have to be bound again. */
+		void relink();
+
 	};
 
-	inline void Shader::textureUnit(std::string sampler2d, Texture2D *texture) {
+	inline void Shader::textureUnit(UniformName_t sampler2d, Texture2D *texture) {
 		setInt(sampler2d, texture->unit());
 	}
 
@@ -66,17 +150,83 @@ namespace Pix {
 		glBindAttribLocation(ID, attribute, variableName.c_str());
 	}
 
+	inline void Shader::relink() {
+		glLinkProgram(ID);
+		cacheUniforms();
+	}
+
 	inline Shader::Shader(const std::string &name) {
-		ID = OpenGlUtils::loadShader(name);
+		// sources in a mounted pack are compiled from it, otherwise read from assets/opengl/<version>
+		std::string base = "opengl/" + OpenGlUtils::VERSION + "/" + name;
+		AssetData vertex = AssetSource::open(base + ".vertex.glsl", false);
+		AssetData fragment = AssetSource::open(base + ".fragment.glsl", false);
+		ID = vertex && fragment
+			 ? OpenGlUtils::loadShader(std::string(vertex.view()), std::string(fragment.view()))
+			 : OpenGlUtils::loadShader(name);
+		cacheUniforms();
 	}
 
-	inline void Shader::use() {
-		glUseProgram(ID);
+	inline void Shader::cacheUniforms() {
+
+		GLint count = 0, length = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &length);
+
+		vUniforms.clear();
+		std::string name(std::max(length, 1), 0);
+
+		for (GLint i = 0; i < count; i++) {
+			GLsizei size = 0;
+			GLint elements = 0;
+			GLenum type = 0;
+			glGetActiveUniform(ID, (GLuint) i, (GLsizei) name.size(), &size, &elements, &type, &name[0]);
+			std::string uniform = name.substr(0, size);
+
+			// arrays are reported as name[0], they are also set by their name and every element
+			if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0) {
+				std::string array = uniform.substr(0, uniform.size() - 3);
+				cacheUniform(array);
+				for (GLint element = 0; element < elements; element++)
+					cacheUniform(array + "[" + std::to_string(element) + "]");
+			} else {
+				cacheUniform(uniform);
+			}
+		}
+
+		std::sort(vUniforms.begin(), vUniforms.end(),
+				  [](const UniformLocation_t &a, const UniformLocation_t &b) { return a.hash < b.hash; });
+	}
+
+	inline void Shader::cacheUniform(const std::string &name) {
+		GLint location = glGetUniformLocation(ID, name.c_str());
+		// block members have no location
+		if (location >= 0) vUniforms.push_back({UniformName_t(name).hash, location, name});
 	}
 
+	inline GLuint Shader::id() { return ID; }
+
+	inline GLint Shader::location(UniformName_t name) const {
+		auto found = std::lower_bound(vUniforms.begin(), vUniforms.end(), name.hash,
+									  [](const UniformLocation_t &uniform, uint32_t hash) { return uniform.hash < hash; });
+		// names that collide are told apart by the name
+		for (; found != vUniforms.end() && found->hash == name.hash; found++)
+			if (found->name.compare(0, std::string::npos, name.name, name.length) == 0) return found->location;
+		return -1;
+	}
+
+	inline bool Shader::bindBlock(const std::string &block, GLuint binding) {
+		GLuint index = glGetUniformBlockIndex(ID, block.c_str());
+		if (index == GL_INVALID_INDEX) return false;
+		glUniformBlockBinding(ID, index, binding);
+		return true;
+	}
+
+	inline void Shader::use() {
+		GlState::useProgram(ID);
+	}
 
 	inline void Shader::stop() {
-		glUseProgram(0);
+		GlState::useProgram(0);
 	}
 
 	inline void Shader::cleanup() {
@@ -89,40 +239,40 @@ namespace Pix {
 	}
 
 
-	inline void Shader::setBool(const std::string &name, bool value) const {
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int) value);
+	inline void Shader::setBool(UniformName_t name, bool value) const {
+		glUniform1i(location(name), (int) value);
 	}
 
-	inline void Shader::setInt(const std::string &name, int value) const {
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	inline void Shader::setInt(UniformName_t name, int value) const {
+		glUniform1i(location(name), value);
 	}
 
-	inline void Shader::setFloat(const std::string &name, float value) const {
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	inline void Shader::setFloat(UniformName_t name, float value) const {
+		glUniform1f(location(name), value);
 	}
 
-	inline void Shader::setVec2(const std::string &name, float x, float y) const {
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+	inline void Shader::setVec2(UniformName_t name, float x, float y) const {
+		glUniform2f(location(name), x, y);
 	}
 
-	inline void Shader::setVec3(const std::string &name, float x, float y, float z) const {
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+	inline void Shader::setVec3(UniformName_t name, float x, float y, float z) const {
+		glUniform3f(location(name), x, y, z);
 	}
 
-	inline void Shader::setVec4(const std::string &name, float x, float y, float z, float w) const {
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+	inline void Shader::setVec4(UniformName_t name, float x, float y, float z, float w) const {
+		glUniform4f(location(name), x, y, z, w);
 	}
 
-	inline void Shader::setMat2(const std::string &name, const float *mat) const {
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, mat);
+	inline void Shader::setMat2(UniformName_t name, const float *mat) const {
+		glUniformMatrix2fv(location(name), 1, GL_FALSE, mat);
 	}
 
-	inline void Shader::setMat3(const std::string &name, const float *mat) const {
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, mat);
+	inline void Shader::setMat3(UniformName_t name, const float *mat) const {
+		glUniformMatrix3fv(location(name), 1, GL_FALSE, mat);
 	}
 
-	inline void Shader::setMat4(const std::string &name, const float *mat) const {
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, mat);
+	inline void Shader::setMat4(UniformName_t name, const float *mat) const {
+		glUniformMatrix4fv(location(name), 1, GL_FALSE, mat);
 	}
 
 };
@@ -0,0 +1,146 @@
+//
+//  StreamBuffer.hpp
+//  PixFu
+//
+//  A vertex buffer for data that is written again every frame (ie. per-instance data). The
+//  buffer is split in segments used in turn, so the frame being written never touches the
+//  storage the GPU may still be reading from the previous frames, and writes map their segment
+//  unsynchronized. Each segment gets a fence at the next write, once the draws that read it
+//  have been issued, and a write waits on the fence of its segment before reusing it; with the
+//  GPU less than SEGMENTS frames behind it has signalled already. The segments grow (and the
+//  ring restarts) when a frame needs more room. A new GL context (GlState::newContext) gets a
+//  new buffer.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "OpenGL.h"
+#include "GlState.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace Pix {
+
+	class StreamBuffer {
+
+		GLuint nBuffer = 0;
+		size_t nSegment = 0;             // bytes per segment
+		int nCurrent = 0;                // segment to write next
+		int nWritten = -1;               // segment written last, fenced at the next write
+		uint32_t nContext = 0;           // GlState::context() the buffer was created in
+		std::vector<GLsync> vFences;     // of each segment, until it is reused
+
+		// deletes the fences, or just forgets them with a lost context
+		void dropFences(bool deleteThem);
+
+	public:
+
+		/** Segments in the ring, frames the GPU can be behind */
+		const int SEGMENTS;
+
+		StreamBuffer(int segments = 3);
+
+		/** The GL buffer */
+		GLuint id() const;
+
+		/**
+		 * Writes the data of this frame to the next segment. The buffer is left bound to
+		 * GL_ARRAY_BUFFER, so attribute pointers can be set right after.
+		 * @param data The data
+		 * @param size Size in bytes
+		 * @return The offset of the data in the buffer
+		 */
+		size_t write(const void *data, size_t size);
+
+		/** Deletes the buffer (with the GL context) */
+		void cleanup();
+
+	};
+
+	///////// INLINE IMPLEMENTATION
+
+	inline StreamBuffer::StreamBuffer(int segments) : vFences(segments, nullptr), SEGMENTS(segments) {}
+
+	inline GLuint StreamBuffer::id() const { return nBuffer; }
+
+	inline size_t StreamBuffer::write(const void *data, size_t size) {
+
+		if (nBuffer != 0 && nContext != GlState::context()) {
+			// gone with its context, the names are not ours to delete
+			dropFences(false);
+			nBuffer = 0;
+			nSegment = 0;
+			nCurrent = 0;
+		}
+
+		// the draws reading the last segment have been issued by now
+		if (nWritten >= 0) {
+			vFences[nWritten] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			nWritten = -1;
+		}
+
+		if (nBuffer == 0) {
+			glGenBuffers(1, &nBuffer);
+			nContext = GlState::context();
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, nBuffer);
+
+		if (size > nSegment) {
+			// a new store, nothing in flight uses it
+			dropFences(true);
+			nSegment = std::max(size, nSegment * 2);
+			glBufferData(GL_ARRAY_BUFFER, nSegment * SEGMENTS, nullptr, GL_STREAM_DRAW);
+			nCurrent = 0;
+		}
+
+		int segment = nCurrent;
+		size_t offset = segment * nSegment;
+		nCurrent = (nCurrent + 1) % SEGMENTS;
+
+		if (size == 0) return offset;
+
+		if (vFences[segment] != nullptr) {
+			// the GPU is SEGMENTS frames behind, wait for it to be done with the segment
+			GLenum status;
+			do {
+				status = glClientWaitSync(vFences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			} while (status == GL_TIMEOUT_EXPIRED);
+			glDeleteSync(vFences[segment]);
+			vFences[segment] = nullptr;
+		}
+		nWritten = segment;
+
+		void *target = glMapBufferRange(GL_ARRAY_BUFFER, offset, size,
+										GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+		if (target != nullptr) {
+			memcpy(target, data, size);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		} else glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+
+		return offset;
+	}
+
+	inline void StreamBuffer::dropFences(bool deleteThem) {
+		for (GLsync &fence:vFences) {
+			if (fence != nullptr && deleteThem) glDeleteSync(fence);
+			fence = nullptr;
+		}
+		nWritten = -1;
+	}
+
+	inline void StreamBuffer::cleanup() {
+		bool live = nBuffer != 0 && nContext == GlState::context();
+		if (live) glDeleteBuffers(1, &nBuffer);
+		dropFences(live);
+		nBuffer = 0;
+		nSegment = 0;
+		nCurrent = 0;
+	}
+
+}
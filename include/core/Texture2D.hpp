@@ -3,6 +3,8 @@
 //  PixFu
 //
 //  A Texture to be used in OpenGL. Contains a drawable that you can get and manipulate.
+//  Every texture uses the texture unit hardwired to its id, binds go through GlState so binding
+//  a texture again is free.
 //
 //  Created by rodo on 11/02/2020.
 //  Copyright © 2020 rodo. All rights reserved.
@@ -11,7 +13,11 @@
 #pragma once
 
 #include "OpenGL.h"
+#include "OpenGlUtils.h"
+#include "GlState.hpp"
 #include "Drawable.hpp"
+#include "TextureCache.hpp"
+#include "Profiler.hpp"
 
 namespace Pix {
 
@@ -32,8 +38,8 @@ namespace Pix {
 		// New Texture (blank)
 		Texture2D(int width, int height);
 
-		// New Texture (from file)
-		Texture2D(std::string filename);
+		// New Texture (from file, through the texture cache)
+		Texture2D(std::string filename, bool mipmaps = false);
 
 		bool upload();    // Upload texture to graphics card
 		GLuint id();    // Get texture id
@@ -43,19 +49,67 @@ namespace Pix {
 
 
 		void bind();    // Binds and activates texture
-		void update();    // re-uploads changed buffer
+		void update();    // re-uploads the changed regions of the buffer
+		void uploadMipmaps();    // uploads the cached mip levels, if the buffer has them
 
 		Drawable *buffer();
 	};
 
+	inline Texture2D::Texture2D(std::string filename, bool mipmaps)
+			: Texture2D(TextureCache::load(filename, mipmaps)) {}
+
 	inline Drawable *Texture2D::buffer() { return pBuffer; }
 
 	inline GLuint Texture2D::id() { return glChannel; }
 
 	inline GLuint Texture2D::unit() { return glChannel - 1; }
 
+	inline bool Texture2D::upload() {
+		if (pBuffer == nullptr) return false;
+		glChannel = OpenGlUtils::loadTexture(pBuffer);
+		// loadTexture leaves the new texture bound on its unit
+		GlState::bound(unit(), glChannel);
+		return true;
+	}
+
+	inline void Texture2D::bind() { GlState::bindTexture(unit(), glChannel); }
+
 	inline int Texture2D::width() { return pBuffer->width; }
 
 	inline int Texture2D::height() { return pBuffer->height; }
 
+	// resolves deferred drawing, then uploads only the dirty rectangles accumulated since last update
+	inline void Texture2D::update() {
+
+		pBuffer->resolve();
+
+		int count;
+		const DirtyRect_t *rects = pBuffer->dirtyRects(count);
+		if (count == 0) return;
+
+		PIXFU_PROFILE("Texture2D::update");
+
+		bind();
+
+		const Pixel *data = pBuffer->getData();
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, pBuffer->width);
+
+		for (int i = 0; i < count; i++) {
+			const DirtyRect_t &r = rects[i];
+			glTexSubImage2D(GL_TEXTURE_2D, 0, r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0,
+							GL_RGBA, GL_UNSIGNED_BYTE, data + r.y0 * pBuffer->width + r.x0);
+		}
+
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		pBuffer->clearDirty();
+	}
+
+	inline void Texture2D::uploadMipmaps() {
+		MappedDrawable *mapped = dynamic_cast<MappedDrawable *>(pBuffer);
+		if (mapped == nullptr || mapped->levels() < 2) return;
+		PIXFU_PROFILE("Texture2D::uploadMipmaps");
+		bind();
+		mapped->uploadMipmaps();
+	}
+
 }
@@ -0,0 +1,490 @@
+//
+//  TextureCache.hpp
+//  PixFu
+//
+//  GPU-ready cache of decoded images. The first time an image is loaded (or offline, with
+//  tools/texcache) its decoded pixels are written to a versioned binary file next to it,
+//  optionally with precomputed mip levels. Next loads memory-map that file: the drawable
+//  pixels are the mapping itself (copy-on-write), so there is no decode and no copy before
+//  the texture upload.
+//
+//  A cache file is valid while its source keeps the recorded size and modification time.
+//  If only the time changed (ie. the file was touched or checked out again) the source hash
+//  is compared, and the stamp refreshed when it matches. Cache files without their source
+//  (shipped alone) are always valid, and so are the cache files in a mounted asset pack:
+//  those are mapped privately from the pack file at their entry, so every load gets its own
+//  copy-on-write pixels, with no copy either.
+//
+//  When the source folder is not writable (ie. a read-only app bundle) the cache file goes to
+//  a cache directory instead (setCacheDir, $XDG_CACHE_HOME/pixfu by default), named after the
+//  source path. A missing or stale cache file next to the source falls back to that one. Cache files are written to a unique temporary and renamed, so concurrent
+//  loads of the same image do not step on each other.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "OpenGL.h"
+#include "Drawable.hpp"
+#include "AssetSource.hpp"
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Pix {
+
+	/** Cache file header. Level 0 starts at a page boundary, levels are RGBA8 and tightly packed */
+	typedef struct sTextureCacheHeader {
+		char magic[4];              // "PXTC"
+		uint32_t version;           // TextureCache::VERSION
+		uint32_t width, height;
+		uint32_t levels;            // 1 + mip levels
+		uint32_t reserved;
+		int64_t sourceMtime;        // source modification time, seconds
+		uint64_t sourceSize;        // source size, bytes
+		uint64_t sourceHash;        // FNV-1a of the source bytes
+		uint64_t offsets[16];       // file offset of every level
+	} TextureCacheHeader_t;
+
+	/**
+	 * A drawable whose pixels live in a memory-mapped cache file
+	 */
+	class MappedDrawable : public Drawable {
+
+		void *pMap;
+		size_t nSize;               // of the mapping
+		TextureCacheHeader_t *pHeader;
+
+	public:
+
+		/**
+		 * @param map The mapping, owned
+		 * @param size Size of the mapping
+		 * @param header Offset of the cache file in the mapping (ie. an entry in a pack)
+		 */
+		MappedDrawable(int w, int h, void *map, size_t size, size_t header = 0);
+
+		~MappedDrawable() override;
+
+		/** Number of levels, including the base image */
+		int levels();
+
+		/**
+		 * Gets a mip level
+		 * @param level Level, 0 is the base image
+		 * @param w receives its width
+		 * @param h receives its height
+		 * @return its pixels
+		 */
+		const Pixel *level(int level, int &w, int &h);
+
+		/**
+		 * Uploads the mip levels to the texture bound to GL_TEXTURE_2D, and enables
+		 * trilinear filtering. Level 0 is uploaded as usual, from the drawable data.
+		 */
+		void uploadMipmaps();
+	};
+
+	class TextureCache {
+
+		inline static const std::string TAG = "TextureCache";
+
+		inline static std::string sCacheDir;
+
+		// cache file of a source
+		static std::string cachePath(const std::string &source);
+
+		// cache file of a source in the cache directory
+		static std::string fallbackPath(const std::string &source);
+
+		// creates a unique temporary next to a path, open for writing
+		static FILE *createTemp(const std::string &path, std::string &temp);
+
+		// creates a directory and its parents
+		static void makeDirs(const std::string &dir);
+
+		// hashes a whole file, 0 if it cannot be read
+		static uint64_t hashFile(const std::string &path);
+
+		// whether a header and the file size describe a usable cache
+		static bool validHeader(const TextureCacheHeader_t *header, uint64_t size, bool mipmaps);
+
+		// whether a level is inside the file
+		static bool validLevel(uint64_t offset, uint64_t bytes, uint64_t size);
+
+		// maps a cache file, if valid for the source
+		static MappedDrawable *mapFile(const std::string &path, const std::string &source, bool mipmaps);
+
+		// maps the cache of a source: packed, next to it or in the cache directory
+		static MappedDrawable *map(const std::string &source, bool mipmaps);
+
+	public:
+
+		/** Current cache format version. Bump on any layout change. */
+		static constexpr uint32_t VERSION = 1;
+
+		static constexpr int MAXLEVELS = 16;
+
+		/** Widest and tallest image cached */
+		static constexpr uint32_t MAXSIZE = 65536;
+
+		/** Cache file extension, appended to the source name */
+		inline static const std::string EXTENSION = ".pxtc";
+
+		/**
+		 * Loads an image, from its cache file if valid. Otherwise the source is decoded with
+		 * Drawable::fromFile and the cache file is written for the next time.
+		 * @param source The image filename, as passed to Drawable::fromFile
+		 * @param mipmaps Whether the cache must contain mip levels
+		 * @return The drawable, nullptr if it could not be loaded
+		 */
+		static Drawable *load(const std::string &source, bool mipmaps = false);
+
+		/**
+		 * Writes the cache file of an image
+		 * @param source The image filename
+		 * @param mipmaps Whether to precompute mip levels
+		 * @return whether the cache file was written
+		 */
+		static bool convert(const std::string &source, bool mipmaps = false);
+
+		/**
+		 * Writes the cache file of an already decoded image
+		 * @param source The image filename (the cache is stamped with it)
+		 * @param image The decoded image
+		 * @param mipmaps Whether to precompute mip levels
+		 * @return whether the cache file was written
+		 */
+		static bool write(const std::string &source, Drawable *image, bool mipmaps);
+
+		/** Whether an image has a valid cache file (with mip levels, if asked) */
+		static bool isValid(const std::string &source, bool mipmaps = false);
+
+		/**
+		 * Sets the writable directory for cache files that cannot be written next to their
+		 * source. Set it before loading (ie. the app cache directory on mobile).
+		 * @param dir The directory, created if needed
+		 */
+		static void setCacheDir(const std::string &dir);
+
+		/** The cache directory */
+		static std::string cacheDir();
+	};
+
+	//
+	///////// INLINE IMPLEMENTATION
+	//
+
+	inline MappedDrawable::MappedDrawable(int w, int h, void *map, size_t size, size_t header)
+			: Drawable(w, h, reinterpret_cast<Pixel *>(static_cast<uint8_t *>(map) + header +
+													   reinterpret_cast<TextureCacheHeader_t *>(
+															   static_cast<uint8_t *>(map) + header)->offsets[0])),
+			  pMap(map), nSize(size),
+			  pHeader(reinterpret_cast<TextureCacheHeader_t *>(static_cast<uint8_t *>(map) + header)) {}
+
+	inline MappedDrawable::~MappedDrawable() {
+		detach();
+		munmap(pMap, nSize);
+	}
+
+	inline int MappedDrawable::levels() { return (int) pHeader->levels; }
+
+	inline const Pixel *MappedDrawable::level(int level, int &w, int &h) {
+		w = std::max(1, (int) pHeader->width >> level);
+		h = std::max(1, (int) pHeader->height >> level);
+		return reinterpret_cast<const Pixel *>(reinterpret_cast<uint8_t *>(pHeader) + pHeader->offsets[level]);
+	}
+
+	inline void MappedDrawable::uploadMipmaps() {
+		int w, h;
+		for (int i = 1; i < levels(); i++) {
+			const Pixel *pixels = level(i, w, h);
+			glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		}
+		if (levels() > 1) {
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels() - 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		}
+	}
+
+	inline std::string TextureCache::cachePath(const std::string &source) { return source + EXTENSION; }
+
+	inline void TextureCache::setCacheDir(const std::string &dir) { sCacheDir = dir; }
+
+	inline std::string TextureCache::cacheDir() {
+		if (!sCacheDir.empty()) return sCacheDir;
+		static const std::string fallback = [] {
+			const char *xdg = getenv("XDG_CACHE_HOME"), *home = getenv("HOME"), *tmp = getenv("TMPDIR");
+			if (xdg != nullptr && *xdg != 0) return std::string(xdg) + "/pixfu";
+			if (home != nullptr && *home != 0) return std::string(home) + "/.cache/pixfu";
+			return std::string(tmp != nullptr && *tmp != 0 ? tmp : "/tmp") + "/pixfu";
+		}();
+		return fallback;
+	}
+
+	inline std::string TextureCache::fallbackPath(const std::string &source) {
+		// named after the whole source path, so same named images in different folders differ
+		uint64_t hash = 0xcbf29ce484222325ULL;
+		for (char c:source) hash = (hash ^ (uint8_t) c) * 0x100000001b3ULL;
+		size_t slash = source.find_last_of('/');
+		std::string name = slash == std::string::npos ? source : source.substr(slash + 1);
+		char prefix[24];
+		snprintf(prefix, sizeof(prefix), "%016llx-", (unsigned long long) hash);
+		return cacheDir() + "/" + prefix + name + EXTENSION;
+	}
+
+	inline FILE *TextureCache::createTemp(const std::string &path, std::string &temp) {
+		temp = path + ".XXXXXX";
+		int fd = mkstemp(&temp[0]);
+		if (fd < 0) return nullptr;
+		fchmod(fd, 0644);
+		FILE *file = fdopen(fd, "wb");
+		if (file == nullptr) {
+			close(fd);
+			remove(temp.c_str());
+		}
+		return file;
+	}
+
+	inline void TextureCache::makeDirs(const std::string &dir) {
+		for (size_t slash = dir.find('/', 1);; slash = dir.find('/', slash + 1)) {
+			mkdir(dir.substr(0, slash).c_str(), 0755);
+			if (slash == std::string::npos) break;
+		}
+	}
+
+	inline uint64_t TextureCache::hashFile(const std::string &path) {
+
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) return 0;
+
+		struct stat st;
+		uint64_t hash = 0xcbf29ce484222325ULL;
+
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data != MAP_FAILED) {
+				const uint8_t *bytes = static_cast<const uint8_t *>(data);
+				for (off_t i = 0; i < st.st_size; i++) hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+				munmap(data, st.st_size);
+			}
+		}
+
+		close(fd);
+		return hash;
+	}
+
+	inline bool TextureCache::validLevel(uint64_t offset, uint64_t bytes, uint64_t size) {
+		// by subtraction, so a corrupt offset cannot wrap around
+		return offset % sizeof(Pixel) == 0 && offset <= size && bytes <= size - offset;
+	}
+
+	inline bool TextureCache::validHeader(const TextureCacheHeader_t *header, uint64_t size, bool mipmaps) {
+
+		if (size < sizeof(TextureCacheHeader_t)
+			|| memcmp(header->magic, "PXTC", 4) != 0
+			|| header->version != VERSION
+			|| header->width == 0 || header->height == 0
+			|| header->width > MAXSIZE || header->height > MAXSIZE
+			|| header->levels < 1 || header->levels > MAXLEVELS
+			|| (mipmaps && header->levels == 1 && (header->width > 1 || header->height > 1)))
+			return false;
+
+		// every level has to be inside the file
+		for (uint32_t i = 0; i < header->levels; i++) {
+			uint64_t bytes = (uint64_t) std::max(1u, header->width >> i) * std::max(1u, header->height >> i) * sizeof(Pixel);
+			if (!validLevel(header->offsets[i], bytes, size)) return false;
+		}
+
+		return true;
+	}
+
+	inline MappedDrawable *TextureCache::map(const std::string &source, bool mipmaps) {
+
+		std::string path = cachePath(source);
+
+		// shipped in a pack: the entry is mapped from the pack file, privately as drawables are
+		// modified, so there is no copy and the shared pack mapping is never written
+		AssetData packed = AssetSource::open(path, false);
+		if (packed.packed()) {
+			if (validHeader(reinterpret_cast<const TextureCacheHeader_t *>(packed.data()), packed.size(), mipmaps)) {
+				int fd = open(packed.pack().c_str(), O_RDONLY);
+				if (fd < 0) return nullptr;
+				uint64_t start = packed.offset() - packed.offset() % (uint64_t) sysconf(_SC_PAGESIZE);
+				size_t size = (size_t) (packed.offset() - start) + packed.size();
+				void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t) start);
+				close(fd);
+				if (data == MAP_FAILED) return nullptr;
+				const TextureCacheHeader_t *header = reinterpret_cast<const TextureCacheHeader_t *>(packed.data());
+				return new MappedDrawable((int) header->width, (int) header->height, data, size,
+										  (size_t) (packed.offset() - start));
+			}
+			PIXFU_LOGE(TAG, "Invalid texture cache %s in pack", path.c_str());
+		}
+
+		// next to the source, or in the cache directory if it could not be written there (or
+		// is stale and read-only)
+		MappedDrawable *mapped = mapFile(path, source, mipmaps);
+		return mapped != nullptr ? mapped : mapFile(fallbackPath(source), source, mipmaps);
+	}
+
+	inline MappedDrawable *TextureCache::mapFile(const std::string &path, const std::string &source, bool mipmaps) {
+
+		int fd = open(path.c_str(), O_RDWR);
+		if (fd < 0) fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) return nullptr;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(TextureCacheHeader_t)) {
+			close(fd);
+			return nullptr;
+		}
+
+		// private writable mapping: the drawable can be modified, changes never reach the file
+		void *data = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			close(fd);
+			return nullptr;
+		}
+
+		TextureCacheHeader_t *header = static_cast<TextureCacheHeader_t *>(data);
+		bool valid = validHeader(header, (uint64_t) st.st_size, mipmaps);
+
+		struct stat src;
+		if (valid && stat(source.c_str(), &src) == 0) {
+			if ((uint64_t) src.st_size != header->sourceSize) valid = false;
+			else if ((int64_t) src.st_mtime != header->sourceMtime) {
+				// touched: same contents?
+				valid = hashFile(source) == header->sourceHash;
+				if (valid) {
+					TextureCacheHeader_t stamped = *header;
+					stamped.sourceMtime = (int64_t) src.st_mtime;
+					if (pwrite(fd, &stamped, sizeof(stamped), 0) != sizeof(stamped))
+						PIXFU_LOGE(TAG, "Cannot refresh stamp of %s", path.c_str());
+				}
+			}
+		}
+
+		close(fd);
+
+		if (!valid) {
+			munmap(data, st.st_size);
+			return nullptr;
+		}
+
+		return new MappedDrawable((int) header->width, (int) header->height, data, st.st_size);
+	}
+
+	inline bool TextureCache::write(const std::string &source, Drawable *image, bool mipmaps) {
+
+		struct stat src;
+		if (stat(source.c_str(), &src) != 0) return false;
+
+		TextureCacheHeader_t header = {{'P', 'X', 'T', 'C'}, VERSION, (uint32_t) image->width, (uint32_t) image->height,
+									   1, 0, (int64_t) src.st_mtime, (uint64_t) src.st_size, hashFile(source), {}};
+
+		// levels: 2x2 box filter of the previous one
+		std::vector<std::vector<uint32_t>> mips;
+		int w = image->width, h = image->height;
+		const uint32_t *prev = reinterpret_cast<const uint32_t *>(image->getData());
+
+		while (mipmaps && (w > 1 || h > 1) && header.levels < MAXLEVELS) {
+			int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+			std::vector<uint32_t> level((size_t) nw * nh);
+			for (int y = 0; y < nh; y++) {
+				for (int x = 0; x < nw; x++) {
+					int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+					int y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+					uint32_t a = prev[y0 * w + x0], b = prev[y0 * w + x1], c = prev[y1 * w + x0], d = prev[y1 * w + x1];
+					uint32_t out = 0;
+					for (int shift = 0; shift < 32; shift += 8)
+						out |= ((((a >> shift) & 0xFF) + ((b >> shift) & 0xFF) + ((c >> shift) & 0xFF) +
+								 ((d >> shift) & 0xFF) + 2) / 4) << shift;
+					level[y * nw + x] = out;
+				}
+			}
+			mips.push_back(std::move(level));
+			prev = mips.back().data();
+			w = nw;
+			h = nh;
+			header.levels++;
+		}
+
+		// level 0 page aligned, so the mapped pixels are aligned too
+		uint64_t offset = std::max((uint64_t) sysconf(_SC_PAGESIZE), (uint64_t) sizeof(header));
+		header.offsets[0] = offset;
+		offset += (uint64_t) image->width * image->height * sizeof(Pixel);
+		for (size_t i = 0; i < mips.size(); i++) {
+			header.offsets[i + 1] = offset;
+			offset += mips[i].size() * sizeof(uint32_t);
+		}
+
+		// write to a unique temporary and rename, so readers never see a partial file. Next to
+		// the source or, if that is not writable, in the cache directory.
+		std::string path = cachePath(source), temp;
+		FILE *file = createTemp(path, temp);
+		if (file == nullptr) {
+			path = fallbackPath(source);
+			makeDirs(cacheDir());
+			file = createTemp(path, temp);
+		}
+		if (file == nullptr) {
+			PIXFU_LOGE(TAG, "Cannot write texture cache of %s", source.c_str());
+			return false;
+		}
+
+		std::vector<uint8_t> padding(header.offsets[0] - sizeof(header), 0);
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+				  && fwrite(padding.data(), 1, padding.size(), file) == padding.size()
+				  && fwrite(image->getData(), sizeof(Pixel), (size_t) image->width * image->height, file) ==
+					 (size_t) image->width * image->height;
+		for (std::vector<uint32_t> &level:mips)
+			ok = ok && fwrite(level.data(), sizeof(uint32_t), level.size(), file) == level.size();
+
+		ok = fclose(file) == 0 && ok;
+		if (ok) ok = rename(temp.c_str(), path.c_str()) == 0;
+		if (!ok) {
+			PIXFU_LOGE(TAG, "Cannot write texture cache %s", path.c_str());
+			remove(temp.c_str());
+		}
+		return ok;
+	}
+
+	inline bool TextureCache::convert(const std::string &source, bool mipmaps) {
+		Drawable *image = Drawable::fromFile(source);
+		if (image == nullptr) return false;
+		bool ok = write(source, image, mipmaps);
+		delete image;
+		return ok;
+	}
+
+	inline bool TextureCache::isValid(const std::string &source, bool mipmaps) {
+		MappedDrawable *mapped = map(source, mipmaps);
+		delete mapped;
+		return mapped != nullptr;
+	}
+
+	inline Drawable *TextureCache::load(const std::string &source, bool mipmaps) {
+
+		MappedDrawable *mapped = map(source, mipmaps);
+		if (mapped != nullptr) return mapped;
+
+		// first run: decode and cache. The decoded image is returned, the mapping is used next time.
+		Drawable *image = Drawable::fromFile(source);
+		if (image != nullptr) write(source, image, mipmaps);
+		return image;
+	}
+
+}
@@ -0,0 +1,119 @@
+//
+//  UniformBlock.hpp
+//  PixFu
+//
+//  A uniform buffer shared by several shaders. The data is a std140 struct that lives in a
+//  GL uniform buffer bound to a fixed binding point; shaders that declare the block are
+//  attached to the binding point once (Shader::bindBlock), so per-frame values like the camera
+//  and the light are uploaded once and seen by all of them. Writes are compared with the
+//  current contents and only changed members are uploaded, so several shaders loading the
+//  same camera in a frame cost a single upload. The data is kept, so the buffer is created again
+//  with all of it in a new GL context (GlState::newContext) or after cleanup().
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "OpenGL.h"
+#include "GlState.hpp"
+
+#include <cstring>
+#include <string>
+#include <utility>
+
+namespace Pix {
+
+	template<typename T>
+	class UniformBlock {
+
+		T mData{};
+		GLuint nBuffer = 0;
+		uint32_t nContext = 0;          // GlState::context() the buffer was created in
+
+		/** whether the buffer exists in the current context */
+		bool live() const;
+
+		/** uploads a range of the data, creates the buffer on first use */
+		void upload(size_t offset, size_t size);
+
+	public:
+
+		/** Block name in the shaders */
+		const std::string NAME;
+
+		/** Binding point of the block */
+		const GLuint BINDING;
+
+		UniformBlock(std::string name, GLuint binding);
+
+		/** The current contents */
+		const T &data() const;
+
+		/**
+		 * Sets a member of the block, uploaded only if it changed
+		 * @param member The member, ie. &WorldUniforms_t::view
+		 * @param value  The value
+		 */
+		template<typename V>
+		void set(V T::*member, const V &value);
+
+		/** Uploads all the block */
+		void set(const T &data);
+
+		/** Deletes the buffer (with the GL context), the next set() creates it again */
+		void cleanup();
+
+	};
+
+	///////// INLINE IMPLEMENTATION
+
+	template<typename T>
+	inline UniformBlock<T>::UniformBlock(std::string name, GLuint binding) : NAME(std::move(name)), BINDING(binding) {}
+
+	template<typename T>
+	inline const T &UniformBlock<T>::data() const { return mData; }
+
+	template<typename T>
+	inline bool UniformBlock<T>::live() const { return nBuffer != 0 && nContext == GlState::context(); }
+
+	template<typename T>
+	template<typename V>
+	inline void UniformBlock<T>::set(V T::*member, const V &value) {
+		V &slot = mData.*member;
+		if (live() && memcmp(&slot, &value, sizeof(V)) == 0) return;
+		slot = value;
+		upload(reinterpret_cast<const char *>(&slot) - reinterpret_cast<const char *>(&mData), sizeof(V));
+	}
+
+	template<typename T>
+	inline void UniformBlock<T>::set(const T &data) {
+		mData = data;
+		upload(0, sizeof(T));
+	}
+
+	template<typename T>
+	inline void UniformBlock<T>::upload(size_t offset, size_t size) {
+
+		if (!live()) {
+			// first use, or the buffer went with its context: the name is not ours to delete
+			glGenBuffers(1, &nBuffer);
+			nContext = GlState::context();
+			glBindBuffer(GL_UNIFORM_BUFFER, nBuffer);
+			glBufferData(GL_UNIFORM_BUFFER, sizeof(T), &mData, GL_DYNAMIC_DRAW);
+			glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, nBuffer);
+			return;
+		}
+
+		glBindBuffer(GL_UNIFORM_BUFFER, nBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, size, reinterpret_cast<const char *>(&mData) + offset);
+	}
+
+	template<typename T>
+	inline void UniformBlock<T>::cleanup() {
+		if (live()) glDeleteBuffers(1, &nBuffer);
+		nBuffer = 0;
+	}
+
+}
@@ -8,7 +8,11 @@
 
 #pragma once
 
+#include "Clock.hpp"
+
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <memory>
 #include <string>
 #include <stdexcept>
@@ -18,32 +22,40 @@ namespace Pix {
 	// global debug info flag
 	static constexpr bool DBG = false;
 
-	// ms now
+	// ms now, wall clock (since the epoch). For intervals use Clock (Clock.hpp), it is monotonic.
 	inline long nowms() {
 		return static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(
 				std::chrono::system_clock::now().time_since_epoch()).count());
 	}
 
-	// ns now
-	inline long nowns() {
-		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	// ns now, monotonic (Clock.hpp), for intervals only: not a wall clock time
+	inline int64_t nowns() {
+		return static_cast<int64_t>(Clock::now());
 	}
 
+#ifdef __clang__
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wformat-security"
+#endif
 
+	// formats into a std::string. For logging use PIXFU_LOGV / PIXFU_LOGE (Logger.hpp), they
+	// format later on a background thread.
 	template<typename ... Args>
 	std::string SF(const std::string &format, Args ... args) {
-		size_t size = static_cast<size_t>(snprintf(nullptr, 0, format.c_str(), args ...) +
-										  1); // Extra space for '\0'
-		if (size <= 0) { throw std::runtime_error("Error during formatting."); }
+		// most strings are short: format once on the stack, only long ones twice
+		char buffer[256];
+		int size = snprintf(buffer, sizeof(buffer), format.c_str(), args ...);
+		if (size < 0) { throw std::runtime_error("Error during formatting."); }
+		if (size < (int) sizeof(buffer)) return std::string(buffer, size);
 
-		std::unique_ptr<char[]> buf(new char[size]);
-		snprintf(buf.get(), size, format.c_str(), args ...);
-		return std::string(buf.get(), buf.get() + size - 1); // We don't want the '\0' inside
+		std::string text(size, 0);
+		snprintf(&text[0], size + 1, format.c_str(), args ...);
+		return text;
 	}
 
+#ifdef __clang__
 #pragma clang diagnostic pop
+#endif
 
 	void LogV(const std::string &tag, std::string text);
 
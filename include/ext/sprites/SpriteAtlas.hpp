@@ -0,0 +1,144 @@
+//
+//  SpriteAtlas.hpp
+//  PixFu
+//
+//  Packs the images of several sprite sheets into one, so they can share a texture. Images are
+//  placed in shelves (rows), tallest first, with a gap between them so filtering does not bleed
+//  from one sheet into its neighbours. The atlas has to fit in a texture: build() takes the
+//  largest size (GL_MAX_TEXTURE_SIZE) and throws when the images do not fit in it.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "Drawable.hpp"
+#include "PixelOps.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace Pix {
+
+	/** Where an image is in the atlas, in pixels */
+	typedef struct sAtlasRegion {
+		int x, y, width, height;
+	} AtlasRegion_t;
+
+	class SpriteAtlas {
+
+		static constexpr int PADDING = 2;               // pixels between images
+
+		std::vector<Drawable *> vImages;
+		std::vector<AtlasRegion_t> vRegions;
+
+		// places the images in shelves of a width, returns the height used
+		int pack(int width);
+
+	public:
+
+		~SpriteAtlas();
+
+		/**
+		 * Adds an image to pack, the atlas owns it
+		 * @param image The image
+		 * @return Index of its region
+		 */
+		int add(Drawable *image);
+
+		/**
+		 * Packs the images added into a new drawable and frees them. Their regions are known after.
+		 * Throws std::runtime_error if they do not fit in maxSize x maxSize.
+		 * @param maxSize Largest width and height of the atlas, ie. GL_MAX_TEXTURE_SIZE
+		 * @return The atlas image, for the caller to own
+		 */
+		Drawable *build(int maxSize = 4096);
+
+		/** The region of an image, after build() */
+		const AtlasRegion_t &region(int index) const;
+
+		/** Images in the atlas */
+		int size() const;
+
+	};
+
+	///////// INLINE IMPLEMENTATION
+
+	inline SpriteAtlas::~SpriteAtlas() {
+		for (Drawable *image:vImages) delete image;
+	}
+
+	inline int SpriteAtlas::add(Drawable *image) {
+		vImages.push_back(image);
+		vRegions.push_back({0, 0, image->width, image->height});
+		return (int) vImages.size() - 1;
+	}
+
+	inline int SpriteAtlas::pack(int width) {
+
+		std::vector<int> order(vRegions.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(),
+						 [this](int a, int b) { return vRegions[a].height > vRegions[b].height; });
+
+		int x = 0, y = 0, shelf = 0;
+		for (int index:order) {
+			AtlasRegion_t &region = vRegions[index];
+			if (x > 0 && x + region.width > width) {
+				// next shelf
+				y += shelf + PADDING;
+				x = 0;
+				shelf = 0;
+			}
+			region.x = x;
+			region.y = y;
+			x += region.width + PADDING;
+			shelf = std::max(shelf, region.height);
+		}
+
+		return std::max(1, y + shelf);
+	}
+
+	inline Drawable *SpriteAtlas::build(int maxSize) {
+
+		// about square, but never narrower than the widest image
+		int widest = 0;
+		long area = 0;
+		for (AtlasRegion_t &region:vRegions) {
+			widest = std::max(widest, region.width);
+			area += (long) (region.width + PADDING) * (region.height + PADDING);
+		}
+		int width = std::max(widest, std::min(maxSize, (int) std::ceil(std::sqrt((double) area))));
+		int height = width <= maxSize ? pack(width) : 0;
+
+		// too tall, as wide as it can be
+		if (height > maxSize && width < maxSize) height = pack(width = maxSize);
+
+		if (width > maxSize || height > maxSize)
+			throw std::runtime_error("Sprite atlas does not fit in " + std::to_string(maxSize) + " pixels");
+
+		Drawable *atlas = new Drawable(width, height);
+		atlas->clear(Colors::BLANK);
+
+		for (int i = 0; i < (int) vImages.size(); i++) {
+			AtlasRegion_t &region = vRegions[i];
+			uint32_t *source = reinterpret_cast<uint32_t *>(vImages[i]->getData());
+			uint32_t *target = reinterpret_cast<uint32_t *>(atlas->getData());
+			for (int row = 0; row < region.height; row++)
+				PixelOps::copy(target + (region.y + row) * width + region.x, source + row * region.width, region.width);
+			delete vImages[i];
+		}
+
+		vImages.clear();
+		return atlas;
+	}
+
+	inline const AtlasRegion_t &SpriteAtlas::region(int index) const { return vRegions.at(index); }
+
+	inline int SpriteAtlas::size() const { return (int) vRegions.size(); }
+
+}
@@ -0,0 +1,266 @@
+//
+//  SpriteBatch.hpp
+//  PixFu
+//
+//  Draws the sprites of several sheets with one texture and one draw call. The sheet images are
+//  packed in an atlas (SpriteAtlas) when the batch is created, and every frame the visible sprites
+//  of all its sheets are gathered in layer order (then sheet and array order) into the instance
+//  data. Each instance carries the rectangle of its sprite in the atlas, so the shader does not
+//  care which sheet it comes from, and the index of its sheet to pick its chroma key.
+//
+//  The batch owns its sheets: they are not registered in SpriteSheets (which deletes its sheets
+//  on unload), and are deleted with the batch.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "SpriteSheet.hpp"
+#include "SpriteAtlas.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+namespace Pix {
+
+	// per-instance data: pos = x, y, scale, rotation / size = width, height in px, sheet index
+	// fx = tint rgb, tint mode / cell = sprite rectangle in the atlas (u, v, width, height)
+	typedef struct sBatchInstance {
+		glm::vec4 pos, size, fx, cell;
+	} BatchInstance_t;
+
+	class SpriteBatch : public FuExtension {
+
+		inline static const std::string TAG = "SpriteBatch";
+
+		// chroma keys in the shader (iColorKeys)
+		static constexpr int MAXSHEETS = 16;
+
+		std::vector<SpriteSheet *> vSheets;     // owned
+		std::vector<AtlasRegion_t> vRegions;    // of each sheet
+
+		Shader *pShader;
+		Texture2D *pTexture;
+		GLuint quadVAO = 0, quadVBO = 0;
+		glm::mat4 mProjection;
+
+		long lStartTime = 0;
+
+		// instances of the frame, gathered and in layer order, and the sort keys
+		std::vector<BatchInstance_t> vGathered, vInstances;
+		std::vector<uint64_t> vOrder;
+		StreamBuffer mInstances;
+
+		// gathers the visible sprites of all sheets in draw order, into vInstances
+		void gather();
+
+	public:
+
+		/**
+		 * Loads the sheets and packs them in one texture. Throws std::runtime_error if a sheet
+		 * cannot be loaded, there are more than MAXSHEETS or they do not fit in a texture.
+		 * @param engine The engine
+		 * @param sheets The sheets, as for a SpriteSheet
+		 * @param shader Shader that takes the per-instance BatchInstance_t
+		 */
+		SpriteBatch(Fu *engine, std::vector<SpriteSheetInfo_t> sheets, std::string shader = "sprites_batch");
+
+		~SpriteBatch();
+
+		bool init(Fu *engine);
+
+		void tick(Fu *engine, float fElapsedTime);
+
+		/**
+		 * Gets a sheet of the batch, to create and update its sprites. It belongs to the batch
+		 * and is not in SpriteSheets.
+		 * @param index The sheet index, in the order they were passed
+		 * @return The sheet
+		 */
+		SpriteSheet *sheet(int index);
+
+		/** Number of sheets */
+		int size();
+
+	};
+
+	///////// INLINE IMPLEMENTATION
+
+	inline SpriteBatch::SpriteBatch(Fu *engine, std::vector<SpriteSheetInfo_t> sheets, std::string shader) {
+
+		if (sheets.size() > MAXSHEETS)
+			throw std::runtime_error("A sprite batch takes " + std::to_string(MAXSHEETS) + " sheets");
+
+		SpriteAtlas atlas;
+
+		for (SpriteSheetInfo_t &info:sheets) {
+			Drawable *image = TextureCache::load(info.filename);
+			if (image == nullptr) throw std::runtime_error("Cannot load sprite sheet " + info.filename);
+			atlas.add(image);
+		}
+
+		GLint maxSize;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+		pTexture = new Texture2D(atlas.build(maxSize));
+
+		for (int i = 0; i < (int) sheets.size(); i++) {
+			const AtlasRegion_t &region = atlas.region(i);
+			vSheets.push_back(new SpriteSheet(sheets[i], region.width, region.height));
+			vRegions.push_back(region);
+		}
+
+		pShader = new Shader(shader);
+		mProjection = glm::ortho(0.0f, (float) engine->screenWidth(), (float) engine->screenHeight(), 0.0f, -1.0f, 1.0f);
+	}
+
+	inline SpriteBatch::~SpriteBatch() {
+		for (SpriteSheet *sheet:vSheets) delete sheet;
+		// GL unbinds a deleted VAO, GlState has to know
+		GlState::bindVertexArray(0);
+		glDeleteVertexArrays(1, &quadVAO);
+		glDeleteBuffers(1, &quadVBO);
+		mInstances.cleanup();
+		delete pShader;
+		delete pTexture;
+	}
+
+	inline SpriteSheet *SpriteBatch::sheet(int index) { return vSheets.at(index); }
+
+	inline int SpriteBatch::size() { return (int) vSheets.size(); }
+
+	inline bool SpriteBatch::init(Fu *engine) {
+
+		// GLSL ES 1.0 has no layout qualifiers
+		pShader->bindAttribute(0, "vertex");
+		pShader->bindAttribute(1, "spritePos");
+		pShader->bindAttribute(2, "spriteSize");
+		pShader->bindAttribute(3, "spriteFx");
+		pShader->bindAttribute(4, "spriteCell");
+		pShader->relink();
+
+		float vertices[] = {
+				0.0f, 1.0f, 0.0f, 1.0f,
+				1.0f, 0.0f, 1.0f, 0.0f,
+				0.0f, 0.0f, 0.0f, 0.0f,
+
+				0.0f, 1.0f, 0.0f, 1.0f,
+				1.0f, 1.0f, 1.0f, 1.0f,
+				1.0f, 0.0f, 1.0f, 0.0f
+		};
+
+		glGenVertexArrays(1, &quadVAO);
+		glGenBuffers(1, &quadVBO);
+
+		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+		GlState::bindVertexArray(quadVAO);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *) 0);
+		for (GLuint attribute = 1; attribute <= 4; attribute++) {
+			glVertexAttribDivisor(attribute, 1);
+			glEnableVertexAttribArray(attribute);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		GlState::bindVertexArray(0);
+
+		lStartTime = nowms();
+		pTexture->upload();
+
+		pShader->use();
+		pShader->setMat4("projection", &mProjection[0][0]);
+
+		// the chroma key of each sheet, picked by the sheet index of the instance
+		for (int s = 0; s < (int) vSheets.size(); s++) {
+			Pixel key = vSheets[s]->oChromaKey;
+			pShader->setVec4("iColorKeys[" + std::to_string(s) + "]",
+							 key.r / 255.0f, key.g / 255.0f, key.b / 255.0f, key.a / 255.0f);
+		}
+
+		return true;
+	}
+
+	inline void SpriteBatch::gather() {
+
+		vGathered.clear();
+		vOrder.clear();
+
+		glm::vec2 atlas(pTexture->width(), pTexture->height());
+		int lowest = 0, highest = 0;
+
+		for (int s = 0; s < (int) vSheets.size(); s++) {
+
+			SpriteSheet *sheet = vSheets[s];
+			sheet->compact();
+			const AtlasRegion_t &region = vRegions[s];
+			glm::vec2 cell(region.width / (float) sheet->sInfo.numX, region.height / (float) sheet->sInfo.numY);
+
+			for (int i = 0; i < (int) sheet->vSprites.size(); i++) {
+
+				SpriteMeta_t &meta = sheet->vSprites[i];
+
+				// hidden
+				if (meta.def.x == -1) continue;
+
+				int index = (int) meta.def.x;
+				glm::vec2 origin(region.x + (index % sheet->sInfo.numX) * cell.x,
+								 region.y + (index / sheet->sInfo.numX) * cell.y);
+				glm::vec2 span(cell.x * meta.def.z, cell.y * meta.def.w);
+
+				int layer = sheet->vLayers[i];
+				lowest = vGathered.empty() ? layer : std::min(lowest, layer);
+				highest = vGathered.empty() ? layer : std::max(highest, layer);
+
+				// layer, biased so the unsigned key keeps the order, then gather order
+				vOrder.push_back((uint64_t) ((uint32_t) layer + 0x80000000u) << 32 | vGathered.size());
+				vGathered.push_back({
+						meta.pos,
+						{sheet->SPRSIZE.x * meta.def.z, sheet->SPRSIZE.y * meta.def.w, (float) s, 0},
+						meta.fx,
+						{origin / atlas, span / atlas}
+				});
+			}
+		}
+
+		// a single layer is already in order
+		if (lowest == highest) {
+			vInstances.swap(vGathered);
+			return;
+		}
+
+		std::sort(vOrder.begin(), vOrder.end());
+		vInstances.resize(vGathered.size());
+		for (size_t i = 0; i < vOrder.size(); i++)
+			vInstances[i] = vGathered[vOrder[i] & 0xffffffffu];
+	}
+
+	// one texture, one instanced draw for all the sheets
+	inline void SpriteBatch::tick(Fu *engine, float fElapsedTime) {
+
+		gather();
+		if (vInstances.empty()) return;
+
+		long now = nowms();
+
+		pShader->use();
+		pShader->setFloat("iTime", (now - lStartTime) / 1000.0f);
+		pShader->setInt("sampler", pTexture->unit());
+		pTexture->bind();
+
+		GlState::depthTest(false);
+		GlState::blend(true);
+		GlState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		GlState::bindVertexArray(quadVAO);
+
+		size_t offset = mInstances.write(vInstances.data(), vInstances.size() * sizeof(BatchInstance_t));
+		for (GLuint attribute = 1; attribute <= 4; attribute++)
+			glVertexAttribPointer(attribute, 4, GL_FLOAT, GL_FALSE, sizeof(BatchInstance_t),
+								  (void *) (offset + (attribute - 1) * sizeof(glm::vec4)));
+
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei) vInstances.size());
+	}
+
+}
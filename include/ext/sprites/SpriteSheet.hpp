@@ -2,6 +2,19 @@
 //  SpriteRenderer.hpp
 //  LoneKart
 //
+//  Sprites are kept in a dense array in draw order, the order they were created in. The id
+//  returned by create() is a stable handle to a slot that points into the array. Removing a
+//  sprite leaves a hole that is closed before the next draw, keeping the order of the others,
+//  and frees the handle for the next create(). Handles carry a generation, so the id of a
+//  removed sprite stays invalid (std::out_of_range) when its slot is reused. Every frame the
+//  array is streamed as is to a ring-buffered instance buffer (StreamBuffer), and the whole
+//  sheet is one instanced draw of the quad. Sprite shaders without the per-instance attributes
+//  get a draw per sprite.
+//
+//  Sheets created by a SpriteBatch have no texture of their own: their image is packed in the
+//  batch atlas and the batch draws their sprites, ordered by layer with those of its other sheets.
+//  The batch owns them, they are not in SpriteSheets.
+//
 //  Created by rodo on 10/02/2020.
 //  Copyright © 2020 rodo. All rights reserved.
 //
@@ -13,15 +26,18 @@
 
 #include <vector>
 #include <map>
+#include <stdexcept>
 
 #include "Shader.hpp"
 #include "Drawable.hpp"
 #include "Texture2D.hpp"
+#include "StreamBuffer.hpp"
 #include "Fu.hpp"
 
 #include "glm/vec4.hpp"
 #include "glm/vec2.hpp"
 #include "glm/mat4x4.hpp"
+#include "glm/gtc/matrix_transform.hpp"
 
 namespace Pix {
 
@@ -49,17 +65,22 @@ namespace Pix {
 		NO_TINT = 0, TINT_CHROMA = 1, TINT_FULL = 2
 	} TintMode_t;
 
+	// also the per-instance data: pos = x, y, scale, rotation / def = index, height, numx, numy
+	// fx = tint rgb, tint mode / raw = user data
 	typedef struct sSpriteMeta {
 		glm::vec4 pos, def, fx, raw;
 	} SpriteMeta_t;
 
 	class Fu;
 
+	class SpriteBatch;
+
 	class SpriteSheet : public FuExtension {
 
+		friend class SpriteBatch;
+
 		static std::string TAG;
 
-		int nIdCounter = 0;
 		int nId;
 
 		SpriteSheetInfo_t sInfo;
@@ -89,10 +110,15 @@ namespace Pix {
 				glm::vec2 position = {0, 0},        // position in screen coords
 				float scale = 1.0,        // scale
 				float rotation = 0.0,    // rotation
-				float height = 0.0        // height
+				float height = 0.0,        // height
+				int layer = 0            // draw order in a SpriteBatch, lower first
 		);
 
 
+		/**
+		 * Removes a sprite, the others keep their order
+		 * @return false if there is no such sprite (ie. removed already)
+		 */
 		bool remove(int spriteId);
 
 		/**
@@ -114,6 +140,11 @@ namespace Pix {
 		 */
 		void hide(int spriteId);
 
+		/**
+		 * Moves existing sprite to another layer, the draw order in a SpriteBatch
+		 */
+		void layer(int spriteId, int layer);
+
 		/**
 		 * Updates existing sprite properties
 		 */
@@ -149,16 +180,46 @@ namespace Pix {
 
 		Shader *pShader;
 		GLuint quadVAO;
+		GLuint quadVBO = 0;
+		uint32_t nContext = 0;                  // GlState::context() the quad was created in
 		Texture2D *pTexture;
 		glm::uvec2 SPRSIZE;
 		glm::mat4 mProjection;
 
 		long lStartTime;
 
-		std::map<int, SpriteMeta_t> mSprites;
+		// sprite ids: handle index in the low bits, generation of the handle in the high ones
+		static constexpr int HANDLEBITS = 22, HANDLEMASK = (1 << HANDLEBITS) - 1, GENERATIONS = 1 << 9;
+
+		// sprites in draw order, the handle of each one (-1 removed, closed by compact()), and
+		// the index and generation of each handle (index -1 free)
+		std::vector<SpriteMeta_t> vSprites;
+		std::vector<int> vHandles;
+		std::vector<int> vSlots;
+		std::vector<int> vGenerations;
+		std::vector<int> vFreeHandles;
+		std::vector<int> vLayers;               // layer of each sprite, same order
+		int nRemoved = 0;                       // holes in the array
+
+		// per-instance data, if the shader takes it
+		StreamBuffer mInstances;
+		bool bInstanced = false;
+
+		// a sheet packed in the atlas of a SpriteBatch, that draws it
+		SpriteSheet(SpriteSheetInfo_t info, int width, int height);
 
 		void init();
 
+		// releases the quad and the stream buffer, the names are just forgotten if the context was lost
+		void deinit();
+
+		int slot(int spriteId);
+
+		// closes the holes of removed sprites, keeping the order
+		void compact();
+
+		SpriteMeta_t &sprite(int spriteId);
+
 		void drawSprite(SpriteMeta_t &spriteMeta);
 
 		// getters
@@ -182,6 +243,261 @@ namespace Pix {
 	inline int SpriteSheet::getSpriteHeight() { return SPRSIZE.y; }
 
 	inline float SpriteSheet::getSpriteRadius() { return sInfo.spriteRadiusConstant * SPRSIZE.x / 2; }
+
+	inline SpriteSheet::SpriteSheet(SpriteSheetInfo_t info, int width, int height)
+			: sInfo(info), pShader(nullptr), quadVAO(0), pTexture(nullptr), mProjection(1.0f), lStartTime(0) {
+		sInfo.width = width;
+		sInfo.height = height;
+		SPRSIZE = {width / info.numX, height / info.numY};
+		sInfo.spriteWidth = SPRSIZE.x;
+		sInfo.spriteHeight = SPRSIZE.y;
+		nId = -1;                        // owned by the batch, not in SpriteSheets
+	}
+
+	inline SpriteSheet::~SpriteSheet() {
+		deinit();
+		if (pShader != nullptr) delete pShader;
+		if (pTexture != nullptr) delete pTexture;
+		pShader = nullptr;
+		pTexture = nullptr;
+	}
+
+	// the unit quad all sprites are drawn with, position and texture coordinates, and the
+	// per-instance attributes that point to the stream buffer every frame
+	inline void SpriteSheet::init() {
+
+		// GLSL ES 1.0 has no layout qualifiers
+		pShader->bindAttribute(0, "vertex");
+		pShader->bindAttribute(1, "spritePos");
+		pShader->bindAttribute(2, "spriteDef");
+		pShader->bindAttribute(3, "spriteFx");
+		pShader->bindAttribute(4, "spriteRaw");
+		pShader->relink();
+		bInstanced = glGetAttribLocation(pShader->id(), "spritePos") >= 0;
+
+		float vertices[] = {
+				0.0f, 1.0f, 0.0f, 1.0f,
+				1.0f, 0.0f, 1.0f, 0.0f,
+				0.0f, 0.0f, 0.0f, 0.0f,
+
+				0.0f, 1.0f, 0.0f, 1.0f,
+				1.0f, 1.0f, 1.0f, 1.0f,
+				1.0f, 0.0f, 1.0f, 0.0f
+		};
+
+		deinit();
+		glGenVertexArrays(1, &quadVAO);
+		glGenBuffers(1, &quadVBO);
+		nContext = GlState::context();
+
+		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+		GlState::bindVertexArray(quadVAO);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *) 0);
+		for (GLuint attribute = 1; attribute <= 4; attribute++) {
+			glVertexAttribDivisor(attribute, 1);
+			if (bInstanced) glEnableVertexAttribArray(attribute);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		GlState::bindVertexArray(0);
+	}
+
+	inline void SpriteSheet::deinit() {
+		if (quadVAO != 0 && nContext == GlState::context()) {
+			// GL unbinds a deleted VAO, GlState has to know
+			GlState::bindVertexArray(0);
+			glDeleteVertexArrays(1, &quadVAO);
+			glDeleteBuffers(1, &quadVBO);
+		}
+		quadVAO = 0;
+		quadVBO = 0;
+		mInstances.cleanup();
+	}
+
+	inline int SpriteSheet::slot(int spriteId) {
+		int handle = spriteId & HANDLEMASK;
+		bool valid = spriteId >= 0 && handle < (int) vSlots.size() && vGenerations[handle] == spriteId >> HANDLEBITS;
+		int index = valid ? vSlots[handle] : -1;
+		if (index < 0) throw std::out_of_range("No sprite " + std::to_string(spriteId));
+		return index;
+	}
+
+	inline void SpriteSheet::compact() {
+
+		if (nRemoved == 0) return;
+
+		int kept = 0;
+		for (int i = 0; i < (int) vSprites.size(); i++) {
+			if (vHandles[i] < 0) continue;
+			if (kept != i) {
+				vSprites[kept] = vSprites[i];
+				vHandles[kept] = vHandles[i];
+				vLayers[kept] = vLayers[i];
+				vSlots[vHandles[kept]] = kept;
+			}
+			kept++;
+		}
+
+		vSprites.resize(kept);
+		vHandles.resize(kept);
+		vLayers.resize(kept);
+		nRemoved = 0;
+	}
+
+	inline SpriteMeta_t &SpriteSheet::sprite(int spriteId) { return vSprites[slot(spriteId)]; }
+
+	inline int SpriteSheet::create(int sheetIndex, int totalx, int totaly, glm::vec2 position, float scale, float rotation,
+								   float height, int layer) {
+
+		int handle;
+		if (vFreeHandles.empty()) {
+			if (vSlots.size() > HANDLEMASK) throw std::length_error("Too many sprites");
+			handle = (int) vSlots.size();
+			vSlots.push_back(-1);
+			vGenerations.push_back(0);
+		} else {
+			handle = vFreeHandles.back();
+			vFreeHandles.pop_back();
+		}
+
+		vSlots[handle] = (int) vSprites.size();
+		vHandles.push_back(handle);
+		vSprites.push_back({
+				{position.x, position.y, scale, rotation},
+				{sheetIndex, height, totalx, totaly},
+				getTinter(NO_TINT, Pixel(0, 0, 0, 0)),
+				{0, 0, 0, 0}
+		});
+		vLayers.push_back(layer);
+
+		return vGenerations[handle] << HANDLEBITS | handle;
+	}
+
+	inline bool SpriteSheet::remove(int spriteId) {
+
+		int index;
+		try {
+			index = slot(spriteId);
+		} catch (std::out_of_range &) {
+			return false;
+		}
+
+		// a hole, closed before the next draw so the order of the others is kept
+		int handle = vHandles[index];
+		vHandles[index] = -1;
+		nRemoved++;
+
+		vSlots[handle] = -1;
+		vGenerations[handle] = (vGenerations[handle] + 1) % GENERATIONS;
+		vFreeHandles.push_back(handle);
+		return true;
+	}
+
+	inline void SpriteSheet::tint(int spriteId, TintMode_t tintMode, Pixel color) {
+		sprite(spriteId).fx = getTinter(tintMode, color);
+	}
+
+	inline void SpriteSheet::tint(int spriteId, TintMode_t tintMode) {
+		sprite(spriteId).fx.w = tintMode;
+	}
+
+	inline void SpriteSheet::hide(int spriteId) {
+		sprite(spriteId).def.x = -1;
+	}
+
+	inline void SpriteSheet::layer(int spriteId, int layer) {
+		vLayers[slot(spriteId)] = layer;
+	}
+
+	inline void SpriteSheet::update(int spriteId, glm::vec2 position, int spriteIndex, float scale, float rotation,
+									glm::vec4 raw) {
+		SpriteMeta_t &meta = sprite(spriteId);
+		if (spriteIndex >= 0) meta.def.x = spriteIndex;
+		meta.pos = {position.x, position.y, scale, rotation};
+		meta.def.y = raw.z;
+		meta.raw.x = raw.x;
+		meta.raw.y = raw.y;
+		meta.raw.z = raw.z;
+	}
+
+	// the handles are kept, with a new generation, so the ids of before stay invalid
+	inline void SpriteSheet::clear() {
+		for (int handle = 0; handle < (int) vSlots.size(); handle++) {
+			if (vSlots[handle] < 0) continue;
+			vSlots[handle] = -1;
+			vGenerations[handle] = (vGenerations[handle] + 1) % GENERATIONS;
+			vFreeHandles.push_back(handle);
+		}
+		vSprites.clear();
+		vHandles.clear();
+		vLayers.clear();
+		nRemoved = 0;
+	}
+
+	// all sprites share the quad and are drawn at once, the sprite array is the instance data
+	inline void SpriteSheet::tick(Fu *engine, float fElapsedTime) {
+
+		compact();
+		if (vSprites.empty()) return;
+
+		long now = nowms();
+
+		pShader->use();
+		pShader->setFloat("iTime", (now - lStartTime) / 1000.0f);
+		pShader->setInt("sampler", pTexture->unit());
+		pTexture->bind();
+
+		GlState::depthTest(false);
+		GlState::blend(true);
+		GlState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		GlState::bindVertexArray(quadVAO);
+
+		if (!bInstanced) {
+			for (SpriteMeta_t &sprite:vSprites) drawSprite(sprite);
+			return;
+		}
+
+		pShader->setVec2("iSpriteSize", SPRSIZE.x, SPRSIZE.y);
+
+		size_t offset = mInstances.write(vSprites.data(), vSprites.size() * sizeof(SpriteMeta_t));
+		for (GLuint attribute = 1; attribute <= 4; attribute++)
+			glVertexAttribPointer(attribute, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteMeta_t),
+								  (void *) (offset + (attribute - 1) * sizeof(glm::vec4)));
+
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei) vSprites.size());
+	}
+
+	inline void SpriteSheet::drawSprite(SpriteMeta_t &spriteMeta) {
+
+		// hidden
+		if (spriteMeta.def.x == -1) return;
+
+		float scale = spriteMeta.pos.z;
+		float rotation = spriteMeta.pos.w;
+
+		glm::vec2 size(SPRSIZE.x * scale, SPRSIZE.y * scale);
+		size.x *= spriteMeta.def.z;
+		size.y *= spriteMeta.def.w;
+
+		glm::mat4 model(1.0f);
+		model = glm::translate(model, glm::vec3(spriteMeta.pos.x - size.x / 2, spriteMeta.pos.y - size.y / 2, 0.0f));
+
+		// rotates around the center
+		model = glm::translate(model, glm::vec3(0.5f * size.x, 0.5f * size.y, 0.0f));
+		model = glm::rotate(model, rotation, glm::vec3(0.0f, 0.0f, 1.0f));
+		model = glm::translate(model, glm::vec3(-0.5f * size.x, -0.5f * size.y, 0.0f));
+
+		model = glm::scale(model, glm::vec3(size, 1.0));
+
+		pShader->setMat4("model", &model[0][0]);
+		pShader->setVec4("iSpriteRaw", spriteMeta.raw.x, spriteMeta.raw.y, spriteMeta.raw.z, spriteMeta.pos.w);
+		pShader->setVec4("iSpriteDef", spriteMeta.def.x, spriteMeta.def.y, spriteMeta.def.z, spriteMeta.def.w);
+		pShader->setVec4("iSpriteFx", spriteMeta.fx.x, spriteMeta.fx.y, spriteMeta.fx.z, spriteMeta.fx.w);
+
+		glDrawArrays(GL_TRIANGLES, 0, 6);
+	}
 };
 
 #pragma clang diagnostic pop
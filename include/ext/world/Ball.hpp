@@ -23,8 +23,12 @@
 
 #include "glm/vec2.hpp"
 #include "glm/vec3.hpp"
+#include "glm/common.hpp"
 #include "glm/gtx/fast_square_root.hpp"
 
+#include <mutex>
+#include <vector>
+
 namespace Pix {
 
 
@@ -60,6 +64,18 @@ namespace Pix {
 
 		static constexpr int MAXSIMULATIONSTEPS = 3; // 15
 
+		// released Ball blocks, see operator new. They go back to the heap at exit.
+		static constexpr size_t MAXRECYCLED = 256;
+
+		typedef struct sRecycled {
+			std::vector<void *> blocks;
+			bool freed;                     // balls deleted later go to the heap (static, starts false)
+			~sRecycled();
+		} Recycled_t;
+
+		inline static std::mutex mRecycle;
+		inline static Recycled_t mRecycled;
+
 	public:
 
 		/** whether this is a static object (so wont collide with another static object) */
@@ -105,6 +121,20 @@ namespace Pix {
 		// simulation time remaining for current iteration
 		float fSimTimeRemaining;
 
+		// fixed step render interpolation: state after the previous step, and the simulated
+		// state put aside while the interpolated one is rendered
+		glm::vec3 mPrevPosition = {0, 0, 0}, mPrevRotation = {0, 0, 0};
+		glm::vec3 mSimPosition = {0, 0, 0}, mSimRotation = {0, 0, 0};
+		bool bHasPrevious = false;
+
+		// keeps the current state as the previous one, before a fixed step
+		void saveState();
+
+		// replaces position and rotation with the interpolated ones until restoreState()
+		void interpolateState(float alpha);
+
+		void restoreState();
+
 		Ball(const WorldConfig_t &planetConfig, float radi, float mass, glm::vec3 position, glm::vec3 speed);
 
 		// internal loop function to commit simulation steps
@@ -263,6 +293,14 @@ namespace Pix {
 
 		glm::vec3 calculateOverlapDisplacement(Ball *target, bool outer = false);
 
+		/**
+		 * Balls are recycled: collision balls are made and deleted many times per frame, so
+		 * released Ball blocks are kept and reused instead of going back to the heap.
+		 */
+		static void *operator new(size_t size);
+
+		static void operator delete(void *memory, size_t size);
+
 		/**
 		 * Make a collision ball using this one as reference
 		 * @param radi The new ball radius
@@ -363,6 +401,101 @@ namespace Pix {
 
 	inline void Ball::setHeightScale(float scale) { stfHeightScale = scale; }
 
+	inline void Ball::saveState() {
+		mPrevPosition = mPosition;
+		mPrevRotation = mRotation;
+		bHasPrevious = true;
+	}
+
+	inline void Ball::interpolateState(float alpha) {
+		mSimPosition = mPosition;
+		mSimRotation = mRotation;
+		if (!bHasPrevious) return;
+		mPosition = mPrevPosition + (mPosition - mPrevPosition) * alpha;
+		// shortest way around
+		glm::vec3 delta = mRotation - mPrevRotation;
+		delta -= glm::round(delta / (float) (2 * M_PI)) * (float) (2 * M_PI);
+		mRotation = mPrevRotation + delta * alpha;
+	}
+
+	inline void Ball::restoreState() {
+		mPosition = mSimPosition;
+		mRotation = mSimRotation;
+	}
+
+	inline Ball::sRecycled::~sRecycled() {
+		std::lock_guard<std::mutex> lock(mRecycle);
+		for (void *memory:blocks) ::operator delete(memory);
+		blocks.clear();
+		freed = true;
+	}
+
+	inline void *Ball::operator new(size_t size) {
+		// derived classes are bigger, they use the heap
+		if (size == sizeof(Ball)) {
+			std::lock_guard<std::mutex> lock(mRecycle);
+			std::vector<void *> &blocks = mRecycled.blocks;
+			if (!mRecycled.freed && !blocks.empty()) {
+				void *memory = blocks.back();
+				blocks.pop_back();
+				return memory;
+			}
+			if (!mRecycled.freed && blocks.capacity() == 0) blocks.reserve(MAXRECYCLED);
+		}
+		return ::operator new(size);
+	}
+
+	inline void Ball::operator delete(void *memory, size_t size) {
+		if (size == sizeof(Ball)) {
+			std::lock_guard<std::mutex> lock(mRecycle);
+			std::vector<void *> &blocks = mRecycled.blocks;
+			if (!mRecycled.freed && blocks.size() < MAXRECYCLED) {
+				blocks.push_back(memory);
+				return;
+			}
+		}
+		::operator delete(memory);
+	}
+
+	// BallWorld inline implementation that requires the Ball definition
+
+	template<typename Func>
+	inline void BallWorld::iterateBalls(Func callback) {
+		iterateObjects([&callback](WorldObject *object) {
+			Ball *ball = dynamic_cast<Ball *>(object);
+			if (ball != nullptr && !ball->ISSTATIC) callback(ball);
+		});
+	}
+
+	inline void BallWorld::tick(Fu *engine, float fElapsedTime) {
+		update(engine, fElapsedTime);
+		render(engine, fElapsedTime);
+	}
+
+	inline bool BallWorld::phased() { return true; }
+
+	inline void BallWorld::update(Fu *engine, float fElapsedTime) {
+		if (engine->fixedTimestep() <= 0) processCollisions(fElapsedTime);
+	}
+
+	inline void BallWorld::render(Fu *engine, float fElapsedTime) {
+
+		if (engine->fixedTimestep() <= 0) {
+			World::tick(engine, fElapsedTime);
+			return;
+		}
+
+		const float alpha = engine->alpha();
+		iterateBalls([alpha](Ball *ball) { ball->interpolateState(alpha); });
+		World::tick(engine, fElapsedTime);
+		iterateBalls([](Ball *ball) { ball->restoreState(); });
+	}
+
+	inline void BallWorld::fixedTick(Fu *engine, float fStep) {
+		iterateBalls([](Ball *ball) { ball->saveState(); });
+		processCollisions(fStep);
+	}
+
 	class LinearDelayer {
 
 		float fTarget;
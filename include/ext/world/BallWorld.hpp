@@ -11,6 +11,7 @@
 #pragma ide diagnostic ignored "OCUnusedGlobalDeclarationInspection"
 #pragma once
 
+#include "Fu.hpp"
 #include "World.hpp"
 #include "BallWorldMap.hpp"
 #include "LineSegment.hpp"
@@ -61,6 +62,7 @@ namespace Pix {
 		
 		/**
 		 * Processes ball updates and collisions.
+		 * @return ns spent
 		 */
 
 		long processCollisions(float fElapsedTime);
@@ -71,12 +73,43 @@ namespace Pix {
 		// process dynamic collisions
 		void processDynamicCollision(Ball *b1, Ball *b2, float fElapsedTime);
 
+		// calls back every non-static ball
+		template<typename Func>
+		void iterateBalls(Func callback);
+
 	public:
 
 		BallWorld(const std::string& levelName, WorldConfig_t& config);
 
+		/**
+		 * Runs the simulation and renders the world (update, then render)
+		 */
+
 		virtual void tick(Pix::Fu *engine, float fElapsedTime) override;
 
+		/** The world is phased: simulation in update, OpenGL in render */
+		bool phased() override;
+
+		/**
+		 * With a variable timestep, runs the simulation with the frame time. With a fixed
+		 * timestep (FuConfig_t::fixedTimestep) the simulation runs in fixedTick instead.
+		 */
+
+		void update(Pix::Fu *engine, float fElapsedTime) override;
+
+		/**
+		 * Renders the world. With a fixed timestep balls are drawn interpolated between their
+		 * last two steps (Fu::alpha).
+		 */
+
+		void render(Pix::Fu *engine, float fElapsedTime) override;
+
+		/**
+		 * Runs a simulation step: ball updates and collisions
+		 */
+
+		void fixedTick(Pix::Fu *engine, float fStep) override;
+
 		void load(const std::string& levelName);
 		
 		BallWorldMap_t *map();
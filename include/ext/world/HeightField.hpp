@@ -0,0 +1,291 @@
+//
+//  HeightField.hpp
+//  PixFu Engine
+//
+//  A compact terrain height map. Heights are stored as 8-bit, 16-bit or float values in a
+//  single channel (instead of a full RGBA Drawable) and sampled with nearest or bilinear
+//  filtering. Batch lookups process positions in chunks, first computing the texel indexes
+//  and then gathering, so the loops vectorize.
+//
+//  16-bit height maps are read from PNG files with the high byte in red and the low byte in
+//  green. An 8-bit grayscale map has equal red and green, so it reads as the same height.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "Drawable.hpp"
+#include "TextureCache.hpp"
+#include "glm/vec2.hpp"
+#include "glm/vec3.hpp"
+
+#include <cmath>
+#include <vector>
+
+namespace Pix {
+
+	/** Storage of a height field */
+	typedef enum eHeightFormat {
+		HEIGHT_8,        // 0..255
+		HEIGHT_16,       // 0..65535
+		HEIGHT_FLOAT     // any, normally 0..1
+	} HeightFormat_t;
+
+	/** Sampling of a height field */
+	typedef enum eHeightSampling {
+		HEIGHT_NEAREST,
+		HEIGHT_BILINEAR
+	} HeightSampling_t;
+
+	class HeightField {
+
+		// positions processed per chunk in batch lookups
+		static constexpr int CHUNK = 64;
+
+		std::vector<uint8_t> vData;
+		float fNormalize;                // converts stored values to 0..1
+
+		template<typename T>
+		void gatherNearest(const T *data, const glm::vec3 *positions, int count, float *heights, glm::vec2 origin, float scale);
+
+		template<typename T>
+		void gatherBilinear(const T *data, const glm::vec3 *positions, int count, float *heights, glm::vec2 origin, float scale);
+
+		template<typename T>
+		float sampleBilinear(const T *data, float x, float z);
+
+	public:
+
+		const int width, height;
+		const HeightFormat_t FORMAT;
+		HeightSampling_t sampling;
+
+		/**
+		 * Creates a flat height field
+		 * @param width Width in texels
+		 * @param height Height in texels
+		 * @param format Storage format
+		 * @param sampling Sampling mode
+		 */
+		HeightField(int width, int height, HeightFormat_t format = HEIGHT_8, HeightSampling_t sampling = HEIGHT_NEAREST);
+
+		/**
+		 * Creates a height field from a height map drawable
+		 * @param map The height map (red channel, or red and green for 16 bits)
+		 * @param format Storage format
+		 * @param sampling Sampling mode
+		 * @return The height field
+		 */
+		static HeightField *fromDrawable(Drawable *map, HeightFormat_t format = HEIGHT_8,
+										 HeightSampling_t sampling = HEIGHT_NEAREST);
+
+		/**
+		 * Creates a height field from a PNG height map, decoded through the texture cache
+		 * @param name The filename
+		 * @param format Storage format
+		 * @param sampling Sampling mode
+		 * @return The height field, or nullptr if the file could not be loaded
+		 */
+		static HeightField *fromFile(std::string name, HeightFormat_t format = HEIGHT_8,
+									 HeightSampling_t sampling = HEIGHT_NEAREST);
+
+		/**
+		 * Gets a texel height
+		 * @param x coord
+		 * @param z coord
+		 * @return normalized height, 0 outside the field
+		 */
+		float get(int x, int z);
+
+		/**
+		 * Sets a texel height
+		 * @param x coord
+		 * @param z coord
+		 * @param h normalized height (clamped to 0..1 unless stored as float)
+		 */
+		void set(int x, int z, float h);
+
+		/**
+		 * Samples the field with its sampling mode. Texel x covers [x, x+1).
+		 * @param x coord
+		 * @param z coord
+		 * @return normalized height, 0 outside the field
+		 */
+		float sample(float x, float z);
+
+		/**
+		 * Samples many positions at once
+		 * @param positions World positions, x and z are used
+		 * @param count Number of positions
+		 * @param heights Receives the normalized heights
+		 * @param origin World position of texel 0,0
+		 * @param scale Multiplies every height
+		 */
+		void getHeights(const glm::vec3 *positions, size_t count, float *heights,
+						glm::vec2 origin = {0, 0}, float scale = 1);
+
+		/** Memory used by the heights, in bytes */
+		size_t bytes();
+
+	};
+
+	inline HeightField::HeightField(int w, int h, HeightFormat_t format, HeightSampling_t sampling)
+			: width(w), height(h), FORMAT(format), sampling(sampling) {
+		size_t texel = format == HEIGHT_8 ? 1 : format == HEIGHT_16 ? 2 : sizeof(float);
+		vData.resize((size_t) w * h * texel);
+		fNormalize = format == HEIGHT_8 ? 1 / 255.0f : format == HEIGHT_16 ? 1 / 65535.0f : 1;
+	}
+
+	inline HeightField *HeightField::fromDrawable(Drawable *map, HeightFormat_t format, HeightSampling_t sampling) {
+
+		HeightField *field = new HeightField(map->width, map->height, format, sampling);
+		const Pixel *src = map->getData();
+		size_t count = (size_t) map->width * map->height;
+
+		switch (format) {
+			case HEIGHT_8:
+				for (size_t i = 0; i < count; i++) field->vData[i] = src[i].r;
+				break;
+			case HEIGHT_16: {
+				uint16_t *dst = reinterpret_cast<uint16_t *>(field->vData.data());
+				for (size_t i = 0; i < count; i++) dst[i] = (uint16_t) (src[i].r << 8 | src[i].g);
+				break;
+			}
+			case HEIGHT_FLOAT: {
+				float *dst = reinterpret_cast<float *>(field->vData.data());
+				for (size_t i = 0; i < count; i++) dst[i] = (src[i].r << 8 | src[i].g) / 65535.0f;
+				break;
+			}
+		}
+
+		return field;
+	}
+
+	inline HeightField *HeightField::fromFile(std::string name, HeightFormat_t format, HeightSampling_t sampling) {
+		Drawable *map = TextureCache::load(name);
+		if (map == nullptr) return nullptr;
+		HeightField *field = fromDrawable(map, format, sampling);
+		delete map;
+		return field;
+	}
+
+	inline float HeightField::get(int x, int z) {
+		if (x < 0 || z < 0 || x >= width || z >= height) return 0;
+		size_t i = (size_t) z * width + x;
+		switch (FORMAT) {
+			case HEIGHT_8:
+				return vData[i] * fNormalize;
+			case HEIGHT_16:
+				return reinterpret_cast<const uint16_t *>(vData.data())[i] * fNormalize;
+			default:
+				return reinterpret_cast<const float *>(vData.data())[i];
+		}
+	}
+
+	inline void HeightField::set(int x, int z, float h) {
+		if (x < 0 || z < 0 || x >= width || z >= height) return;
+		size_t i = (size_t) z * width + x;
+		switch (FORMAT) {
+			case HEIGHT_8:
+				vData[i] = (uint8_t) lroundf(std::fmin(std::fmax(h, 0.0f), 1.0f) * 255);
+				break;
+			case HEIGHT_16:
+				reinterpret_cast<uint16_t *>(vData.data())[i] = (uint16_t) lroundf(std::fmin(std::fmax(h, 0.0f), 1.0f) * 65535);
+				break;
+			default:
+				reinterpret_cast<float *>(vData.data())[i] = h;
+		}
+	}
+
+	template<typename T>
+	inline float HeightField::sampleBilinear(const T *data, float x, float z) {
+
+		if (x < 0 || z < 0 || x >= width || z >= height) return 0;
+
+		// texel centers are at +0.5, clamp at the borders
+		float fx = std::fmax(x - 0.5f, 0.0f), fz = std::fmax(z - 0.5f, 0.0f);
+		int x0 = std::min((int) fx, width - 1), z0 = std::min((int) fz, height - 1);
+		int x1 = std::min(x0 + 1, width - 1), z1 = std::min(z0 + 1, height - 1);
+		float tx = std::fmin(fx - x0, 1.0f), tz = std::fmin(fz - z0, 1.0f);
+
+		float h00 = data[z0 * width + x0], h10 = data[z0 * width + x1];
+		float h01 = data[z1 * width + x0], h11 = data[z1 * width + x1];
+
+		float top = h00 + (h10 - h00) * tx, bottom = h01 + (h11 - h01) * tx;
+		return (top + (bottom - top) * tz) * fNormalize;
+	}
+
+	inline float HeightField::sample(float x, float z) {
+
+		if (sampling == HEIGHT_NEAREST) return get((int) x, (int) z);
+
+		switch (FORMAT) {
+			case HEIGHT_8:
+				return sampleBilinear(vData.data(), x, z);
+			case HEIGHT_16:
+				return sampleBilinear(reinterpret_cast<const uint16_t *>(vData.data()), x, z);
+			default:
+				return sampleBilinear(reinterpret_cast<const float *>(vData.data()), x, z);
+		}
+	}
+
+	template<typename T>
+	inline void HeightField::gatherNearest(const T *data, const glm::vec3 *positions, int count, float *heights,
+										   glm::vec2 origin, float scale) {
+
+		int index[CHUNK];
+
+		// indexes first (vectorizes), -1 outside the field
+		for (int i = 0; i < count; i++) {
+			int x = (int) (positions[i].x - origin.x), z = (int) (positions[i].z - origin.y);
+			bool inside = x >= 0 && z >= 0 && x < width && z < height;
+			index[i] = inside ? z * width + x : -1;
+		}
+
+		float k = fNormalize * scale;
+		for (int i = 0; i < count; i++)
+			heights[i] = index[i] >= 0 ? data[index[i]] * k : 0;
+	}
+
+	template<typename T>
+	inline void HeightField::gatherBilinear(const T *data, const glm::vec3 *positions, int count, float *heights,
+											glm::vec2 origin, float scale) {
+		for (int i = 0; i < count; i++)
+			heights[i] = sampleBilinear(data, positions[i].x - origin.x, positions[i].z - origin.y) * scale;
+	}
+
+	inline void HeightField::getHeights(const glm::vec3 *positions, size_t count, float *heights,
+										glm::vec2 origin, float scale) {
+
+		for (size_t done = 0; done < count; done += CHUNK) {
+
+			int n = (int) std::min((size_t) CHUNK, count - done);
+			const glm::vec3 *pos = positions + done;
+			float *out = heights + done;
+
+			switch (FORMAT) {
+				case HEIGHT_8:
+					if (sampling == HEIGHT_NEAREST) gatherNearest(vData.data(), pos, n, out, origin, scale);
+					else gatherBilinear(vData.data(), pos, n, out, origin, scale);
+					break;
+				case HEIGHT_16: {
+					const uint16_t *data = reinterpret_cast<const uint16_t *>(vData.data());
+					if (sampling == HEIGHT_NEAREST) gatherNearest(data, pos, n, out, origin, scale);
+					else gatherBilinear(data, pos, n, out, origin, scale);
+					break;
+				}
+				case HEIGHT_FLOAT: {
+					const float *data = reinterpret_cast<const float *>(vData.data());
+					if (sampling == HEIGHT_NEAREST) gatherNearest(data, pos, n, out, origin, scale);
+					else gatherBilinear(data, pos, n, out, origin, scale);
+					break;
+				}
+			}
+		}
+	}
+
+	inline size_t HeightField::bytes() { return vData.size(); }
+
+}
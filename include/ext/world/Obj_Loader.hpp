@@ -19,6 +19,9 @@
 
 #include <cmath>
 
+// AssetStream - PixFu assets, from a mounted pack or the loose files
+#include "AssetSource.hpp"
+
 // Print progress to console while loading (large models)
 #define OBJL_CONSOLE_OUTPUT
 
@@ -402,7 +405,7 @@ namespace objl {
 				return false;
 
 
-			std::ifstream file(Path);
+			Pix::AssetStream file(Path);
 
 			if (!file.is_open())
 				return false;
@@ -908,7 +911,7 @@ namespace objl {
 			if (path.substr(path.size() - 4, path.size()) != ".mtl")
 				return false;
 
-			std::ifstream file(path);
+			Pix::AssetStream file(path);
 
 			// If the file is not found return false
 			if (!file.is_open())
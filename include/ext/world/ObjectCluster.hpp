@@ -2,14 +2,26 @@
 //  ObjectCluster.hpp
 //  PixEngine
 //
+//  All the objects of a class (same meshes and textures). Every frame the cluster culls its
+//  objects against the frustum. With a shader that takes the instance attributes, it writes the
+//  transform and tint of the visible ones into an instance buffer and draws each mesh once for
+//  all of them (glDrawElementsInstanced). Object shaders without them get one draw per visible
+//  object and mesh, with the transform and tint in uniforms.
+//
+//  In a new GL context (GlState::newContext) the meshes, textures and instance buffer are
+//  created again on the next render.
+//
 //  Created by rodo on 25/02/2020.
 //  Copyright © 2020 rodo. All rights reserved.
 //
 
 #pragma once
 
+#include "FrameArena.hpp"
 #include "LayerVao.hpp"
 #include "WorldMeta.hpp"
+#include "WorldObject.hpp"
+#include "ObjLoader.hpp"
 #include "ObjectShader.hpp"
 
 
@@ -19,10 +31,11 @@ namespace Pix {
 
 	class WorldObject;
 
-	typedef struct sVisible {
-		WorldObject *object;
-		glm::mat4 transformMatrix;
-	} Visible_t;
+	/** Per-instance data of a visible object, streamed to the instance buffer */
+	typedef struct sObjectInstance {
+		glm::mat4 transform;
+		glm::vec4 tint;
+	} ObjectInstance_t;
 
 	class ObjectCluster : public LayerVao {
 
@@ -35,11 +48,33 @@ namespace Pix {
 		bool bInited = false;
 		ObjLoader *pLoader;
 
-		std::vector<Visible_t> vVisibles;
 		std::vector<Texture2D *> vTextures;
 		glm::mat4 mPlacer;
 // todo		std::vector<WorldObject *> vInstances;
 
+		// instance buffer, its capacity in instances, and the program the mesh VAOs are laid out for
+		// (0 none) with its attribute locations
+		GLuint nInstanceBuffer = 0;
+		size_t nInstanceCapacity = 0;
+		GLuint nLayoutProgram = 0;
+		GLint nLayoutTransform = -1, nLayoutTint = -1;
+		uint32_t nContext = 0;              // GlState::context() of the GL objects
+
+		/** forgets the GL objects of a lost context, they are created again by init() */
+		void lost();
+
+		/** points the instance attributes of the shader to the instance buffer in all the meshes */
+		void layoutInstances(ObjectShader *shader);
+
+		/**
+		 * disables the instance attributes of the last layout in all the meshes, so a shader that
+		 * does not take them (or takes them elsewhere) does not read the instance buffer
+		 */
+		void clearInstances();
+
+		/** uploads the visible instances, orphaning the buffer of the last frame */
+		void uploadInstances(const FrameVector<ObjectInstance_t> &visibles);
+
 	public:
 		std::vector<WorldObject *> vInstances;
 
@@ -59,4 +94,148 @@ namespace Pix {
 		void render(ObjectShader *shader);
 	};
 
+	///////// INLINE IMPLEMENTATION
+
+	inline ObjectCluster::~ObjectCluster() {
+		if (pTexture != nullptr) delete pTexture;
+		pTexture = nullptr;
+		if (nInstanceBuffer != 0 && nContext == GlState::context()) glDeleteBuffers(1, &nInstanceBuffer);
+	}
+
+	inline void ObjectCluster::init() {
+		for (unsigned i = 0; i < pLoader->meshCount(); i++) {
+			LayerVao::add(pLoader->vertices(i), pLoader->verticesCount(i), pLoader->indices(i), pLoader->indicesCount(i));
+			vTextures[i]->upload();
+		}
+		glGenBuffers(1, &nInstanceBuffer);
+		nContext = GlState::context();
+		bInited = true;
+	}
+
+	inline void ObjectCluster::lost() {
+		// the names are not deleted, the new context may have given them to other objects
+		vMeshes.clear();
+		nInstanceBuffer = 0;
+		nInstanceCapacity = 0;
+		nLayoutProgram = 0;
+		nLayoutTransform = nLayoutTint = -1;
+		bInited = false;
+	}
+
+	inline void ObjectCluster::layoutInstances(ObjectShader *shader) {
+
+		clearInstances();
+
+		GLint transform = shader->transformAttribute();
+		GLint tint = shader->tintAttribute();
+
+		glBindBuffer(GL_ARRAY_BUFFER, nInstanceBuffer);
+
+		for (int i = 0; i < (int) vMeshes.size(); i++) {
+			bind(i);
+			// a mat4 attribute takes 4 locations, one per column
+			for (int column = 0; column < 4; column++) {
+				glVertexAttribPointer(transform + column, 4, GL_FLOAT, GL_FALSE, sizeof(ObjectInstance_t),
+									  (void *) (offsetof(ObjectInstance_t, transform) + column * sizeof(glm::vec4)));
+				glVertexAttribDivisor(transform + column, 1);
+				glEnableVertexAttribArray(transform + column);
+			}
+			if (tint >= 0) {
+				glVertexAttribPointer(tint, 4, GL_FLOAT, GL_FALSE, sizeof(ObjectInstance_t),
+									  (void *) offsetof(ObjectInstance_t, tint));
+				glVertexAttribDivisor(tint, 1);
+				glEnableVertexAttribArray(tint);
+			}
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		nLayoutProgram = shader->id();
+		nLayoutTransform = transform;
+		nLayoutTint = tint;
+	}
+
+	inline void ObjectCluster::clearInstances() {
+
+		if (nLayoutProgram == 0) return;
+
+		for (int i = 0; i < (int) vMeshes.size(); i++) {
+			bind(i);
+			for (int column = 0; column < 4; column++) {
+				glVertexAttribDivisor(nLayoutTransform + column, 0);
+				glDisableVertexAttribArray(nLayoutTransform + column);
+			}
+			if (nLayoutTint >= 0) {
+				glVertexAttribDivisor(nLayoutTint, 0);
+				glDisableVertexAttribArray(nLayoutTint);
+			}
+		}
+
+		nLayoutProgram = 0;
+		nLayoutTransform = nLayoutTint = -1;
+	}
+
+	inline void ObjectCluster::uploadInstances(const FrameVector<ObjectInstance_t> &visibles) {
+
+		glBindBuffer(GL_ARRAY_BUFFER, nInstanceBuffer);
+
+		// a new store every frame, so the driver does not wait for last frame's draws
+		nInstanceCapacity = std::max(nInstanceCapacity, visibles.size());
+		glBufferData(GL_ARRAY_BUFFER, nInstanceCapacity * sizeof(ObjectInstance_t), nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, visibles.size() * sizeof(ObjectInstance_t), visibles.data());
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	inline void ObjectCluster::render(ObjectShader *shader) {
+
+		if (bInited && nContext != GlState::context()) lost();
+		if (!bInited) init();
+
+		Frustum *frustum = shader->frustum();
+
+		// visible objects of this frame, in the frame arena
+		FrameVector<ObjectInstance_t> visibles;
+		visibles.reserve(vInstances.size());
+
+		for (WorldObject *object : vInstances) {
+
+			glm::vec3 rot = object->rot();
+			glm::vec3 pos = object->pos() / 1000.0f;
+			float radius = object->drawRadius();
+
+			if (frustum != nullptr && !frustum->IsBoxVisible(pos - radius, pos + radius)) continue;
+
+			glm::mat4 transform = createTransformationMatrix(pos, rot.x, rot.y, rot.z, radius, false, false, false);
+			visibles.push_back({transform * mPlacer, object->isSelected() ? WorldObject::TINT_SELECT : object->tintCode()});
+		}
+
+		if (visibles.empty()) return;
+
+		bool instanced = shader->instanced();
+
+		if (instanced) {
+			if (nLayoutProgram != shader->id()) layoutInstances(shader);
+			uploadInstances(visibles);
+		} else clearInstances();
+
+		for (int i = 0; i < (int) vMeshes.size(); i++) {
+
+			shader->textureUnit("modelTexture", vTextures[i]);
+			shader->loadShineVariables(1, 0.7f);
+			vTextures[i]->bind();
+			bind(i);
+
+			if (instanced) {
+				drawInstanced(i, (int) visibles.size(), false);
+				continue;
+			}
+
+			for (ObjectInstance_t &visible : visibles) {
+				shader->loadTransformationMatrix(visible.transform);
+				shader->setTint(visible.tint);
+				draw(i, false);
+			}
+		}
+	}
+
 }
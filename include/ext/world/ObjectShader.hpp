@@ -1,7 +1,12 @@
 //
-//  TerrainShader.hpp
+//  ObjectShader.hpp
 //  PixEngine
 //
+//  The world objects shader. Projection, camera and light go to the shared WorldFrame uniform
+//  block when the shader declares it (see WorldUniforms.hpp), otherwise to plain uniforms.
+//  Shaders that take the object transform and tint as per-instance attributes (instanceTransform,
+//  instanceTint) draw all the objects of a cluster at once, see ObjectCluster.
+//
 //  Created by rodo on 16/02/2020.
 //  Copyright © 2020 rodo. All rights reserved.
 //
@@ -9,21 +14,43 @@
 #pragma once
 
 #include "Camera.hpp"
+#include "Frustum.hpp"
 #include "Shader.hpp"
+#include "WorldUniforms.hpp"
 #include "glm/mat4x4.hpp"
 #include "glm/vec4.hpp"
+#include "glm/gtc/type_ptr.hpp"
 
 namespace Pix {
 
-	class Frustum;
-
 	class ObjectShader : public Shader {
 
+		static constexpr UniformName_t SHINEDAMPER = "shineDamper";
+		static constexpr UniformName_t REFLECTIVITY = "reflectivity";
+		static constexpr UniformName_t TRANSFORMATION = "transformationMatrix";
+		static constexpr UniformName_t PROJECTION = "projectionMatrix";
+		static constexpr UniformName_t VIEW = "viewMatrix";
+		static constexpr UniformName_t INVVIEW = "invViewMatrix";
+		static constexpr UniformName_t LIGHTPOSITION = "lightPosition";
+		static constexpr UniformName_t LIGHTCOLOUR = "lightColour";
+		static constexpr UniformName_t TINT = "tintMode";
+
+		static constexpr const char *INSTANCETRANSFORM = "instanceTransform";
+		static constexpr const char *INSTANCETINT = "instanceTint";
+
 		// keey this for frustum calculations
 		glm::mat4 mProjectionMatrix;
 
 		// we wil evaluate each draw() to check if inside the frustum
-		Frustum *mFrustum;
+		Frustum mFrustumPlanes;
+		Frustum *mFrustum = nullptr;
+
+		// whether the shader reads the frame data from the WorldFrame block
+		bool bFrameBlock = false;
+
+		// locations of the per-instance attributes, -1 if the shader does not have them
+		GLint nTransformAttribute = -1;
+		GLint nTintAttribute = -1;
 
 	public:
 
@@ -44,5 +71,83 @@ namespace Pix {
 		void setTint(glm::vec4 tint);
 
 		Frustum *frustum() { return mFrustum; }
+
+		/** Whether the shader takes the transform per instance */
+		bool instanced() { return nTransformAttribute >= 0; }
+
+		/** First location of the per-instance transform (a mat4 takes 4) */
+		GLint transformAttribute() { return nTransformAttribute; }
+
+		/** Location of the per-instance tint, -1 if the shader does not use it */
+		GLint tintAttribute() { return nTintAttribute; }
 	};
+
+	///////// INLINE IMPLEMENTATION
+
+	inline ObjectShader::ObjectShader(const std::string &name) : Shader(name) {
+		// GLSL ES 1.0 has no layout qualifiers, fix the locations the meshes and instances are laid out at
+		bindAttributes();
+		relink();
+		bFrameBlock = bindBlock(WorldUniforms::frame().NAME, WorldUniforms::BINDING);
+		nTransformAttribute = glGetAttribLocation(id(), INSTANCETRANSFORM);
+		nTintAttribute = glGetAttribLocation(id(), INSTANCETINT);
+	}
+
+	inline void ObjectShader::bindAttributes() {
+		bindAttribute(0, "aPos");
+		bindAttribute(1, "normal");
+		bindAttribute(2, "aTexCoord");
+		// the transform takes 3 to 6
+		bindAttribute(3, INSTANCETRANSFORM);
+		bindAttribute(7, INSTANCETINT);
+	}
+
+	inline void ObjectShader::loadShineVariables(float damper, float reflectivity) {
+		setFloat(SHINEDAMPER, damper);
+		setFloat(REFLECTIVITY, reflectivity);
+	}
+
+	inline void ObjectShader::loadTransformationMatrix(glm::mat4 &matrix) {
+		setMat4(TRANSFORMATION, glm::value_ptr(matrix));
+	}
+
+	inline void ObjectShader::loadLight(Light *light) {
+		glm::vec3 position = light->position();
+		glm::vec3 colour = light->getColour();
+		if (bFrameBlock) {
+			WorldUniforms::frame().set(&WorldUniforms_t::lightPosition, glm::vec4(position, 1));
+			WorldUniforms::frame().set(&WorldUniforms_t::lightColour, glm::vec4(colour, 1));
+		} else {
+			setVec3(LIGHTPOSITION, position.x, position.y, position.z);
+			setVec3(LIGHTCOLOUR, colour.x, colour.y, colour.z);
+		}
+	}
+
+	inline void ObjectShader::loadViewMatrix(Camera *camera) {
+
+		glm::mat4 &view = camera->getViewMatrix();
+
+		if (bFrameBlock) {
+			WorldUniforms::frame().set(&WorldUniforms_t::view, view);
+			WorldUniforms::frame().set(&WorldUniforms_t::invView, camera->getInvViewMatrix());
+		} else {
+			setMat4(VIEW, glm::value_ptr(view));
+			setMat4(INVVIEW, glm::value_ptr(camera->getInvViewMatrix()));
+		}
+
+		mFrustumPlanes = Frustum(mProjectionMatrix * view);
+		mFrustum = &mFrustumPlanes;
+	}
+
+	inline void ObjectShader::loadProjectionMatrix(glm::mat4 &projection) {
+		if (bFrameBlock) WorldUniforms::frame().set(&WorldUniforms_t::projection, projection);
+		else setMat4(PROJECTION, glm::value_ptr(projection));
+		mProjectionMatrix = projection;
+		// valid again with the next view
+		mFrustum = nullptr;
+	}
+
+	inline void ObjectShader::setTint(glm::vec4 tint) {
+		setVec4(TINT, tint.x, tint.y, tint.z, tint.w);
+	}
 }
@@ -13,17 +13,24 @@
 #include "LayerVao.hpp"
 #include "ObjLoader.hpp"
 #include "TerrainShader.hpp"
+#include "HeightField.hpp"
+
+#include <memory>
 
 namespace Pix {
 
 	class Terrain : public LayerVao {
 
+		// uploads preloaded terrains
+		friend class World;
+
 		static std::string TAG;
 
 		Texture2D *pTexture = nullptr;        // Terrain texture
 		Texture2D *pDirtTexture = nullptr;    // 3D canvas texture
 		Canvas2D *pDirtCanvas = nullptr;    // 3D canvas over the texture
-		Drawable *pHeightMap = nullptr;        // Height Map
+		Drawable *pHeightMap = nullptr;        // Height Map as loaded, converted to pHeightField by the constructor
+		std::unique_ptr<HeightField> pHeightField;    // Compact height map
 		ObjLoader *pLoader = nullptr;        // 3D model loader
 
 		/** Terrain Size */
@@ -35,6 +42,9 @@ namespace Pix {
 		/** Inits the terrain */
 		void init(TerrainShader *shader);
 
+		/** Converts the loaded height map to the height field. Called by the constructor once the map is loaded */
+		void buildHeightField();
+
 	public:
 
 		const TerrainConfig_t CONFIG;
@@ -51,6 +61,17 @@ namespace Pix {
 		/** Queries heightmap */
 		float getHeight(glm::vec3 &posWorld);
 
+		/**
+		 * Queries the heightmap for many positions at once
+		 * @param posWorld World positions
+		 * @param count Number of positions
+		 * @param heights Receives the heights in world coordinates
+		 */
+		void getHeights(const glm::vec3 *posWorld, size_t count, float *heights);
+
+		/** Gets the height field, nullptr if the terrain has no height map */
+		HeightField *heightField();
+
 		/** Whether the absolute coordinates belong to this terrain (mult-terrain world) */
 		bool contains(glm::vec3 &posWorld);
 
@@ -70,13 +91,29 @@ namespace Pix {
 
 	inline int Terrain::zPixels() { return pTexture->height(); }
 
+	inline void Terrain::buildHeightField() {
+		if (pHeightMap == nullptr) return;
+		// the RGBA map is only needed to build the field
+		pHeightField.reset(HeightField::fromDrawable(pHeightMap, CONFIG.heightFormat, CONFIG.heightSampling));
+		delete pHeightMap;
+		pHeightMap = nullptr;
+	}
+
+	inline HeightField *Terrain::heightField() { return pHeightField.get(); }
+
 	inline float Terrain::getHeight(glm::vec3 &posWorld3d) {
-		return (pHeightMap != nullptr)
-			   ? CONFIG.scaleHeight * 1000 * pHeightMap->getPixel(posWorld3d.x - CONFIG.origin.x, (posWorld3d.z) - CONFIG.origin.y).r /
-				 (float) 255
+		HeightField *field = pHeightField.get();
+		return field != nullptr
+			   ? CONFIG.scaleHeight * 1000 * field->sample(posWorld3d.x - CONFIG.origin.x, posWorld3d.z - CONFIG.origin.y)
 			   : 0;
 	}
 
+	inline void Terrain::getHeights(const glm::vec3 *posWorld, size_t count, float *heights) {
+		HeightField *field = pHeightField.get();
+		if (field != nullptr) field->getHeights(posWorld, count, heights, CONFIG.origin, CONFIG.scaleHeight * 1000);
+		else std::fill(heights, heights + count, 0.0f);
+	}
+
 	inline bool Terrain::contains(glm::vec3 &posWorld) {
 		return posWorld.x >= CONFIG.origin.x
 			   && posWorld.z >= CONFIG.origin.y
@@ -2,22 +2,36 @@
 //  TerrainShader.hpp
 //  PixEngine
 //
+//  The terrain shader. Projection, camera and light go to the shared WorldFrame uniform
+//  block when the shader declares it (see WorldUniforms.hpp), otherwise to plain uniforms.
+//
 //  Created by rodo on 16/02/2020.
 //  Copyright © 2020 rodo. All rights reserved.
 //
 
 #pragma once
 
+#include "Camera.hpp"
 #include "Shader.hpp"
+#include "WorldUniforms.hpp"
 #include "glm/mat4x4.hpp"
+#include "glm/gtc/type_ptr.hpp"
 
 namespace Pix {
 
-	class Camera;
+	class TerrainShader : public Shader {
 
-	class Light;
+		static constexpr UniformName_t SHINEDAMPER = "shineDamper";
+		static constexpr UniformName_t REFLECTIVITY = "reflectivity";
+		static constexpr UniformName_t TRANSFORMATION = "transformationMatrix";
+		static constexpr UniformName_t PROJECTION = "projectionMatrix";
+		static constexpr UniformName_t VIEW = "viewMatrix";
+		static constexpr UniformName_t INVVIEW = "invViewMatrix";
+		static constexpr UniformName_t LIGHTPOSITION = "lightPosition";
+		static constexpr UniformName_t LIGHTCOLOUR = "lightColour";
 
-	class TerrainShader : public Shader {
+		// whether the shader reads the frame data from the WorldFrame block
+		bool bFrameBlock = false;
 
 	public:
 		
@@ -35,4 +49,52 @@ namespace Pix {
 
 		void loadProjectionMatrix(glm::mat4 &projection);
 	};
+
+	///////// INLINE IMPLEMENTATION
+
+	inline TerrainShader::TerrainShader(std::string name) : Shader(name) {
+		bFrameBlock = bindBlock(WorldUniforms::frame().NAME, WorldUniforms::BINDING);
+	}
+
+	inline void TerrainShader::bindAttributes() {
+		bindAttribute(0, "position");
+		bindAttribute(1, "normal");
+		bindAttribute(2, "textureCoordinates");
+	}
+
+	inline void TerrainShader::loadShineVariables(float damper, float reflectivity) {
+		setFloat(SHINEDAMPER, damper);
+		setFloat(REFLECTIVITY, reflectivity);
+	}
+
+	inline void TerrainShader::loadTransformationMatrix(glm::mat4 &matrix) {
+		setMat4(TRANSFORMATION, glm::value_ptr(matrix));
+	}
+
+	inline void TerrainShader::loadLight(Light *light) {
+		glm::vec3 position = light->position();
+		glm::vec3 colour = light->getColour();
+		if (bFrameBlock) {
+			WorldUniforms::frame().set(&WorldUniforms_t::lightPosition, glm::vec4(position, 1));
+			WorldUniforms::frame().set(&WorldUniforms_t::lightColour, glm::vec4(colour, 1));
+		} else {
+			setVec3(LIGHTPOSITION, position.x, position.y, position.z);
+			setVec3(LIGHTCOLOUR, colour.x, colour.y, colour.z);
+		}
+	}
+
+	inline void TerrainShader::loadViewMatrix(Camera *camera) {
+		if (bFrameBlock) {
+			WorldUniforms::frame().set(&WorldUniforms_t::view, camera->getViewMatrix());
+			WorldUniforms::frame().set(&WorldUniforms_t::invView, camera->getInvViewMatrix());
+		} else {
+			setMat4(VIEW, glm::value_ptr(camera->getViewMatrix()));
+			setMat4(INVVIEW, glm::value_ptr(camera->getInvViewMatrix()));
+		}
+	}
+
+	inline void TerrainShader::loadProjectionMatrix(glm::mat4 &projection) {
+		if (bFrameBlock) WorldUniforms::frame().set(&WorldUniforms_t::projection, projection);
+		else setMat4(PROJECTION, glm::value_ptr(projection));
+	}
 }
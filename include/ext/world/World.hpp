@@ -11,10 +11,12 @@
 #pragma ide diagnostic ignored "OCUnusedGlobalDeclarationInspection"
 #pragma once
 
+#include "Fu.hpp"
 #include "WorldMeta.hpp"
 #include "Terrain.hpp"
 #include "ObjectCluster.hpp"
 
+#include <functional>
 #include <vector>
 #include <map>
 #include <cmath>
@@ -114,6 +116,29 @@ namespace Pix {
 		 */
 
 		virtual WorldObject *add(int oid, bool setHeight);
+
+		/**
+		 * Loads a terrain in the background (Fu::assets): the model, texture and height map are
+		 * decoded on the job system, then the terrain is uploaded on the GL thread within the frame
+		 * budget and added to the world. The Terrain is constructed on a worker: its constructor
+		 * only loads files and builds CPU side data, the GL objects are made by init().
+		 * @param engine The FU engine
+		 * @param terrainConfig The terrain configuration object
+		 * @param onLoaded Optional, called on the GL thread when the terrain is in the world
+		 */
+
+		void preload(Fu *engine, TerrainConfig_t terrainConfig, std::function<void(Terrain *)> onLoaded = nullptr);
+
+		/**
+		 * Loads the model and textures of an object class in the background, so adding objects
+		 * of that class does not load anything. Add the objects once loaded, or after preloading
+		 * a terrain (assets are uploaded in order, so its onLoaded callback is fine). As with
+		 * terrains, the cluster is constructed on a worker and init() makes its GL objects.
+		 * @param engine The FU engine
+		 * @param objectClass The object class, maps to /assets/objects/<name>/
+		 */
+
+		void preload(Fu *engine, const std::string &objectClass);
 		
 		/**
 		 * Iterates all world objects
@@ -200,6 +225,16 @@ namespace Pix {
 		 */
 
 		float getHeight(glm::vec3& posWorld);
+
+		/**
+		 * Looks up the terrain heights of many positions at once, ie. of all objects in a cluster.
+		 * Positions out of any terrain get height 0.
+		 * @param posWorld Positions to check
+		 * @param count Number of positions
+		 * @param heights Receives the heights in world coordinates
+		 */
+
+		void getHeights(const glm::vec3 *posWorld, size_t count, float *heights);
 		
 		/**
 		 * Whether there is a terrain at that world coords.
@@ -236,7 +271,7 @@ namespace Pix {
 
 		/**
 		 * Convenience function to return the 3D canvas of the first terrain.
-		 * @return The 3D canvas
+		 * @return The 3D canvas, nullptr if there are no terrains yet
 		 */
 		Canvas2D *canvas();
 
@@ -246,8 +281,40 @@ namespace Pix {
 	///////// INLINE IMPLEMENTATION
 	//
 
+	inline World::~World() {
+		for (Terrain *terrain:vTerrains) delete terrain;
+		vTerrains.clear();
+		// the frame block is shared by the world shaders, another world creates it again
+		WorldUniforms::frame().cleanup();
+	}
+
 	inline Camera *World::camera() { return pCamera; }
 
+	// terrains then objects, with depth test and no blending. Shaders are left in use.
+	inline void World::tick(Fu *engine, float fElapsedTime) {
+
+		pCamera->update(fElapsedTime);
+
+		glClearColor(CONFIG.backgroundColor.r, CONFIG.backgroundColor.g, CONFIG.backgroundColor.b, 1.0f);
+		GlState::depthTest(true);
+		GlState::blend(false);
+
+		pShader->use();
+		pShader->loadViewMatrix(pCamera);
+		pShader->loadLight(pLight);
+		for (Terrain *terrain:vTerrains) terrain->render(pShader);
+
+		if (!vObjects.empty()) {
+			pShaderObjects->use();
+			pShaderObjects->loadViewMatrix(pCamera);
+			pShaderObjects->loadLight(pLight);
+			for (ObjectCluster *cluster:vObjects) cluster->render(pShaderObjects);
+		}
+
+		// no canvas until a terrain is loaded
+		if (CONFIG.debugMode == DEBUG_COLLISIONS && canvas() != nullptr) canvas()->blank();
+	}
+
 	inline float World::getHeight(glm::vec3 &posWorld) {
 
 		if (vTerrains.size() == 1)
@@ -261,6 +328,19 @@ namespace Pix {
 		return 0;
 	}
 
+	inline void World::getHeights(const glm::vec3 *posWorld, size_t count, float *heights) {
+
+		if (vTerrains.size() == 1) {
+			vTerrains[0]->getHeights(posWorld, count, heights);
+			return;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			glm::vec3 pos = posWorld[i];
+			heights[i] = getHeight(pos);
+		}
+	}
+
 	inline glm::mat4 World::getProjectionMatrix() {
 		return projectionMatrix;
 	}
@@ -291,7 +371,8 @@ namespace Pix {
 	}
 
 	inline Canvas2D *World::canvas() {
-		return vTerrains[0]->canvas();
+		// none until a preloaded terrain arrives
+		return vTerrains.empty() ? nullptr : vTerrains[0]->canvas();
 	}
 
 	inline WorldObject *World::add(int oid, ObjectLocation_t location, bool setHeight) {
@@ -304,6 +385,51 @@ namespace Pix {
 		return add(entry->first, entry->second, setHeight);
 	}
 
+	inline void World::preload(Fu *engine, TerrainConfig_t terrainConfig, std::function<void(Terrain *)> onLoaded) {
+
+		// the loader keeps the stages until uploaded, they share the terrain
+		auto terrain = std::make_shared<Terrain *>(nullptr);
+
+		engine->assets()->add(
+				"terrain " + terrainConfig.name,
+				[this, terrain, terrainConfig] {
+					// no GL here: the constructor loads the model and images, init() uploads them
+					*terrain = new Terrain(CONFIG, terrainConfig);
+				},
+				[this, terrain, onLoaded] {
+					vTerrains.push_back(*terrain);
+					if (pShader != nullptr) {
+						pShader->use();
+						(*terrain)->init(pShader);
+					}
+					if (onLoaded) onLoaded(*terrain);
+				},
+				[terrain] { delete *terrain; });
+	}
+
+	inline void World::preload(Fu *engine, const std::string &objectClass) {
+
+		auto cluster = std::make_shared<ObjectCluster *>(nullptr);
+
+		engine->assets()->add(
+				"object " + objectClass,
+				[this, cluster, objectClass] {
+					// no GL here either, see above
+					*cluster = new ObjectCluster(this, objectClass, CONFIG.worldTransform);
+				},
+				[this, cluster, objectClass] {
+					if (mClusters.count(objectClass) > 0) {
+						// objects of this class were added meanwhile and loaded it
+						delete *cluster;
+						return;
+					}
+					mClusters[objectClass] = *cluster;
+					vObjects.push_back(*cluster);
+					(*cluster)->init();
+				},
+				[cluster] { delete *cluster; });
+	}
+
 }
 
 #pragma clang diagnostic pop
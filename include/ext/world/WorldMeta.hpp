@@ -14,6 +14,7 @@
 #include <map>
 #include "StaticObject.hpp"
 #include "Font.hpp"
+#include "HeightField.hpp"
 #include "glm/mat4x4.hpp"
 #include "glm/vec3.hpp"
 #include "glm/vec4.hpp"
@@ -273,6 +274,12 @@ namespace Pix {
 		/** use a provided mesh instead of loading one */
 		const Static3DObject_t *staticMesh = nullptr;
 
+		/** heightmap storage (16 bits reads red as high and green as low byte) */
+		const HeightFormat_t heightFormat = HEIGHT_8;
+
+		/** heightmap sampling */
+		const HeightSampling_t heightSampling = HEIGHT_NEAREST;
+
 	} TerrainConfig_t;
 
 
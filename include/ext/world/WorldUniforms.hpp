@@ -0,0 +1,48 @@
+//
+//  WorldUniforms.hpp
+//  PixFu World Extension
+//
+//  Per-frame data of the world shaders (projection, camera and light) in the uniform
+//  block "WorldFrame", shared by the terrain and object shaders (std140 layout). Shaders
+//  without the block (GLSL ES 1.0) get the same data as plain uniforms.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "UniformBlock.hpp"
+#include "glm/mat4x4.hpp"
+#include "glm/vec4.hpp"
+
+namespace Pix {
+
+	typedef struct sWorldUniforms {
+		glm::mat4 projection;
+		glm::mat4 view;
+		glm::mat4 invView;
+		glm::vec4 lightPosition;        // xyz
+		glm::vec4 lightColour;          // xyz
+	} WorldUniforms_t;
+
+	class WorldUniforms {
+
+	public:
+
+		static constexpr GLuint BINDING = 0;
+
+		/**
+		 * The block shared by the world shaders. Its buffer is created again in a new GL context,
+		 * and deleted with the worlds (World::~World).
+		 */
+		static UniformBlock<WorldUniforms_t> &frame();
+
+	};
+
+	inline UniformBlock<WorldUniforms_t> &WorldUniforms::frame() {
+		static UniformBlock<WorldUniforms_t> block("WorldFrame", BINDING);
+		return block;
+	}
+
+}
@@ -1,6 +1,9 @@
 //
 // Created by rodo on 2020-02-10.
 //
+// Input (normalized, incremental or gyroscope) is queued with its time and applied in order
+// in sync(), so it can be sampled from another thread at any rate.
+//
 
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "OCUnusedStructInspection"
@@ -10,6 +13,7 @@
 
 #include "Fu.hpp"
 #include "Canvas2D.hpp"
+#include "InputQueue.hpp"
 
 namespace Pix {
 
@@ -22,7 +26,18 @@ namespace Pix {
 	class AxisController : public InputDevice {
 
 		inline static const std::string TAG="AxisController";
-		
+
+		// event codes
+		static constexpr int AXIS_NORMALIZED = 0, AXIS_INCREMENTAL = 1;
+
+		// interpolation speed (per second), and distance at which the interpolated value snaps
+		// to the raw one. The values of AxisController.cpp, unchanged.
+		static constexpr float INTERPSPEED = 4, INTERPSNAP = 0.001F;
+
+		// each incremental input holds the axis two more syncs, up to INPUTHOLD, then it decays
+		// by CONFIG.AUTOX / AUTOY every sync. As in AxisController.cpp.
+		static constexpr int INPUTHOLD = 6;
+
 		const AxisControllerConfig_t CONFIG;
 		
 		float fAxisX, fAxisY, fNextAxisX, fNextAxisY;    // raw
@@ -30,7 +45,12 @@ namespace Pix {
 		int nInputCounterX = 0;
 		int nInputCounterY = 0;
 
-	
+		InputQueue mQueue;
+
+		void applyNormalized(float xAxis, float yAxis);
+
+		void applyIncremental(float xdelta, float ydelta);
+
 	public:
 
 		/**
@@ -101,6 +121,12 @@ namespace Pix {
 		 */
 		float yInterp();
 
+		/**
+		 * The axis events of this frame, in order
+		 * @return the events (INPUT_AXIS)
+		 */
+		const std::vector<InputEvent_t> &events();
+
 		/**
 		 * Updates inputdevice values
 		 * @param fElapsedTime  frame time
@@ -118,6 +144,56 @@ namespace Pix {
 
 	inline float AxisController::yInterp() { return fCurrentY; }
 
+	inline const std::vector<InputEvent_t> &AxisController::events() { return mQueue.events(); }
+
+	inline void AxisController::inputGyroscope(float radAzimuth, float radPitch) {
+		inputNormalized(sinf(radAzimuth), sinf(-radPitch));
+	}
+
+	inline void AxisController::inputNormalized(float xAxis, float yAxis) {
+		mQueue.push(INPUT_AXIS, AXIS_NORMALIZED, false, xAxis, yAxis);
+	}
+
+	inline void AxisController::inputIncremental(float xdelta, float ydelta) {
+		mQueue.push(INPUT_AXIS, AXIS_INCREMENTAL, false, xdelta, ydelta);
+	}
+
+	inline void AxisController::applyNormalized(float xAxis, float yAxis) {
+		fNextAxisX = std::fmin(std::fmax(xAxis, CONFIG.XMIN), CONFIG.XMAX);
+		fNextAxisY = std::fmin(std::fmax(yAxis, CONFIG.YMIN), CONFIG.YMAX);
+	}
+
+	inline void AxisController::applyIncremental(float xdelta, float ydelta) {
+		// recent input holds the axis, it recenters when the counter runs out
+		if (xdelta != 0) nInputCounterX = std::min(nInputCounterX + 2, INPUTHOLD);
+		if (ydelta != 0) nInputCounterY = std::min(nInputCounterY + 2, INPUTHOLD);
+		applyNormalized(fNextAxisX + xdelta, fNextAxisY + ydelta);
+	}
+
+	inline void AxisController::sync(float fElapsedTime) {
+
+		for (const InputEvent_t &event:mQueue.drain()) {
+			if (event.code == AXIS_INCREMENTAL) applyIncremental(event.x, event.y);
+			else applyNormalized(event.x, event.y);
+		}
+
+		fAxisX = fNextAxisX;
+		fAxisY = fNextAxisY;
+
+		if (nInputCounterX > 0) nInputCounterX--;
+		if (nInputCounterY > 0) nInputCounterY--;
+		if (nInputCounterX == 0) fAxisX *= CONFIG.AUTOX;
+		if (nInputCounterY == 0) fAxisY *= CONFIG.AUTOY;
+
+		fCurrentX += (fAxisX - fCurrentX) * INTERPSPEED * fElapsedTime;
+		fCurrentY += (fAxisY - fCurrentY) * INTERPSPEED * fElapsedTime;
+		if (fabsf(fCurrentX - fAxisX) < INTERPSNAP) fCurrentX = fAxisX;
+		if (fabsf(fCurrentY - fAxisY) < INTERPSNAP) fCurrentY = fAxisY;
+
+		fNextAxisX = fAxisX;
+		fNextAxisY = fAxisY;
+	}
+
 
 	/**
 	 * A generic axis controller (AxisController is abstract). This class is a singleton that
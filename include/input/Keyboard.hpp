@@ -2,6 +2,10 @@
 //  Keyboard.hpp
 //  PixFu
 //
+//  Platforms report keys with Keyboard::input as they happen (from any one thread), or
+//  write the state buffer when polled. sync() applies them in order, so a key pressed and
+//  released within a frame is both pressed and released in it, and keeps the frame events.
+//
 //  Created by rodo on 12/02/2020.
 //  Copyright © 2020 rodo. All rights reserved.
 //
@@ -9,6 +13,7 @@
 #pragma once
 
 #include "Fu.hpp"
+#include "InputQueue.hpp"
 
 namespace Pix {
 
@@ -39,10 +44,15 @@ namespace Pix {
 		static bool *pStateReleased;
 		static bool *pStateHeld;
 
+		InputQueue mQueue;
+
 		Keyboard(int numkeys);
 
 		static bool *getBuffer();
 
+		// applies a key change to this frame state
+		void apply(int key, bool down);
+
 	public:
 
 		const int NUMKEYS;
@@ -85,6 +95,20 @@ namespace Pix {
 
 		static bool isReleased(Keys key);
 
+		/**
+		 * Reports a key change, from the platform. Lock-free, from a single thread.
+		 * @param key key code
+		 * @param down Whether it went down or up
+		 * @param time When (Profiler::now()), 0 = now
+		 */
+		static void input(Keys key, bool down, uint64_t time = 0);
+
+		/**
+		 * The key events of this frame, in order
+		 * @return the events (INPUT_KEY)
+		 */
+		static const std::vector<InputEvent_t> &events();
+
 		static Keyboard *instance();
 		
 		~Keyboard();
@@ -106,4 +130,36 @@ namespace Pix {
 
 	inline bool Keyboard::isHeld(Keys key) { return pStateHeld[key]; }
 
+	inline void Keyboard::input(Keys key, bool down, uint64_t time) {
+		if (pInstance != nullptr) pInstance->mQueue.push(INPUT_KEY, key, down, 0, 0, time);
+	}
+
+	inline const std::vector<InputEvent_t> &Keyboard::events() { return pInstance->mQueue.events(); }
+
+	inline void Keyboard::apply(int key, bool down) {
+		if (down && !pStateHeld[key]) pStatePressed[key] = true;
+		if (!down && pStateHeld[key]) pStateReleased[key] = true;
+		pStateHeld[key] = down;
+		pThisState[key] = pNextState[key] = down;
+	}
+
+	inline void Keyboard::sync(float fElapsedTime) {
+
+		if (pInstance == nullptr) return;
+
+		for (int i = 0; i < NUMKEYS; i++) pStatePressed[i] = pStateReleased[i] = false;
+
+		for (const InputEvent_t &event:mQueue.drain())
+			if (event.code >= 0 && event.code < NUMKEYS) apply(event.code, event.down);
+
+		// changes written to the buffer by polling platforms, at the end of the frame events
+		uint64_t now = Profiler::now();
+		for (int i = 0; i < NUMKEYS; i++) {
+			if (pNextState[i] != pThisState[i]) {
+				mQueue.record({now, INPUT_KEY, pNextState[i], (int16_t) i, 0, 0});
+				apply(i, pNextState[i]);
+			}
+		}
+	}
+
 }
@@ -2,6 +2,12 @@
 //  Mouse.hpp
 //  PixFu
 //
+//  Platform input (input, inputWheel, inputButton) is queued with its time and applied in
+//  order in sync(), so clicks shorter than a frame are not lost. It can come from any one
+//  thread, ie. one sampling the device at a high rate; that thread only touches the queue and
+//  its own last-sent values. Platforms that write the position, wheel or button buffer directly
+//  (on the main thread) still work, their changes since the last sync are recorded in sync().
+//
 //  Created by rodo on 12/02/2020.
 //  Copyright © 2020 rodo. All rights reserved.
 //
@@ -12,6 +18,7 @@
 #pragma once
 
 #include "Fu.hpp"
+#include "InputQueue.hpp"
 #include "Utils.hpp"
 
 namespace Pix {
@@ -25,7 +32,8 @@ namespace Pix {
 		static std::string TAG;
 
 		int nX = 0, nY = 0, nWheelX = 0, nWheelY = 0;
-		int nNewX = 0, nNewY = 0, nNewWheelX = 0, nNewWheelY = 0;
+		int nNewX = 0, nNewY = 0, nNewWheelX = 0, nNewWheelY = 0;     // written directly by a platform
+		int nSeenX = 0, nSeenY = 0, nSeenWheelX = 0, nSeenWheelY = 0; // main: direct values of the last sync
 		int nScreenWidth, nScreenHeight;
 		bool *pNextButtonState = nullptr;
 		bool *pButtonState = nullptr;
@@ -33,8 +41,15 @@ namespace Pix {
 		bool *pStateReleased;
 		bool *pStateHeld;
 
+		InputQueue mQueue;
+		uint32_t nInputButtons = 0;     // producer: buttons down as reported, to queue only changes
+		int nSentX = 0, nSentY = 0, nSentWheelX = 0, nSentWheelY = 0; // producer: last queued
+
 		bool *getBuffer();
 
+		// applies a button change to this frame state
+		void apply(int button, bool down);
+
 		void input(int px, int py);
 
 		void inputWheel(int sx, int sy);
@@ -47,7 +62,7 @@ namespace Pix {
 
 		const int BUTTONS;
 
-		// singleton: enable mouse
+		// singleton: enable mouse, up to 32 buttons
 		static void enable(int buttons = 2);
 
 		// singleton: disable mouse
@@ -70,6 +85,12 @@ namespace Pix {
 
 		static bool isReleased(int button);
 
+		/**
+		 * The mouse events of this frame, in order
+		 * @return the events (INPUT_MOVE, INPUT_WHEEL, INPUT_BUTTON)
+		 */
+		static const std::vector<InputEvent_t> &events();
+
 		~Mouse();
 
 		void init(Fu *engine);
@@ -94,18 +115,80 @@ namespace Pix {
 	inline float Mouse::xNdc() { return 2.0f*((float)pInstance->nX / pInstance->nScreenWidth - 0.5f); }
 	inline float Mouse::yNdc() { return  -2.0f*((float)pInstance->nY / pInstance->nScreenHeight - 0.5f); }
 
-	// input coordinates from platform layer
+	// input from platform layer, queued until sync
+	// the producer only touches its own fields, the direct ones are the platform's
 	inline void Mouse::input(int px, int py) {
-		nNewX = px;
-		nNewY = py;
+		if (px != nSentX || py != nSentY) mQueue.push(INPUT_MOVE, 0, false, (float) px, (float) py);
+		nSentX = px;
+		nSentY = py;
 	}
 
 	inline void Mouse::inputWheel(int px, int py) {
-		nNewWheelX = px;
-		nNewWheelY = py;
+		if (px != nSentWheelX || py != nSentWheelY) mQueue.push(INPUT_WHEEL, 0, false, (float) px, (float) py);
+		nSentWheelX = px;
+		nSentWheelY = py;
+	}
+
+	inline void Mouse::inputButton(int b, bool stat) {
+		// nInputButtons holds 32 buttons
+		if (b < 0 || b >= BUTTONS || b >= 32) return;
+		uint32_t bit = 1u << b;
+		if (((nInputButtons & bit) != 0) == stat) return;
+		mQueue.push(INPUT_BUTTON, b, stat);
+		nInputButtons ^= bit;
 	}
 
-	inline void Mouse::inputButton(int b, bool stat) { pNextButtonState[b] = stat; }
+	inline const std::vector<InputEvent_t> &Mouse::events() { return pInstance->mQueue.events(); }
+
+	inline void Mouse::apply(int button, bool down) {
+		if (down && !pStateHeld[button]) pStatePressed[button] = true;
+		if (!down && pStateHeld[button]) pStateReleased[button] = true;
+		pStateHeld[button] = down;
+		pButtonState[button] = pNextButtonState[button] = down;
+	}
+
+	inline void Mouse::sync(float fElapsedTime) {
+
+		for (int i = 0; i < BUTTONS; i++) pStatePressed[i] = pStateReleased[i] = false;
+
+		for (const InputEvent_t &event:mQueue.drain()) {
+			switch (event.type) {
+				case INPUT_MOVE:
+					nX = (int) event.x;
+					nY = (int) event.y;
+					break;
+				case INPUT_WHEEL:
+					nWheelX = (int) event.x;
+					nWheelY = (int) event.y;
+					break;
+				case INPUT_BUTTON:
+					if (event.code >= 0 && event.code < BUTTONS) apply(event.code, event.down);
+					break;
+				default:
+					break;
+			}
+		}
+
+		// changes written directly by the platform (position, wheel and button buffer) since the
+		// last sync, at the end of the frame events. Queued input never shows here.
+		uint64_t now = Profiler::now();
+		if (nNewX != nSeenX || nNewY != nSeenY) {
+			mQueue.record({now, INPUT_MOVE, false, 0, (float) nNewX, (float) nNewY});
+			nX = nSeenX = nNewX;
+			nY = nSeenY = nNewY;
+		}
+		if (nNewWheelX != nSeenWheelX || nNewWheelY != nSeenWheelY) {
+			mQueue.record({now, INPUT_WHEEL, false, 0, (float) nNewWheelX, (float) nNewWheelY});
+			nWheelX = nSeenWheelX = nNewWheelX;
+			nWheelY = nSeenWheelY = nNewWheelY;
+		}
+		for (int i = 0; i < BUTTONS; i++) {
+			if (pNextButtonState[i] != pButtonState[i]) {
+				mQueue.record({now, INPUT_BUTTON, pNextButtonState[i], (int16_t) i, 0, 0});
+				apply(i, pNextButtonState[i]);
+			}
+		}
+	}
 
 	// button status (Static)
 	inline bool Mouse::isPressed(int button) { return pInstance->pStatePressed[button]; }
@@ -2,6 +2,24 @@
 //  Geometry2D.hpp
 //  PixFu
 //
+//  Drawing primitives originally from onelonecoder.com ´s Pixel Game Engine. Every primitive
+//  marks its bounding box dirty once before plotting, so the target drawable tracks the
+//  changed regions with a single rectangle per primitive. Filled primitives are decomposed
+//  in horizontal spans that are clipped once and written with the PixelOps kernels.
+//
+//  Sprites can be scaled, rotated and flipped (see SpriteBlitter), so many small sprites can be
+//  composited into a single surface and uploaded once instead of drawn one by one with GL.
+//
+//  Every primitive takes a blend mode, so translucent UI can be composited on the CPU into a
+//  single surface instead of stacking blended GL layers.
+//
+//  The target can also be an IndexedDrawable (indexed Surface mode): writes are then converted
+//  to palette indexes, see IndexedDrawable for how colors and blending map.
+//
+//  In deferred mode (setDeferred) primitives are recorded instead, and rasterized at the end
+//  of the frame in screen tiles on a job system (see CanvasRecorder). Tiles are drawn by
+//  clipped views of the canvas running the very same primitives, so output does not change.
+//
 //  Created by rodo on 11/02/2020.
 //  Copyright © 2020 rodo. All rights reserved.
 //
@@ -9,69 +27,687 @@
 #pragma once
 
 #include "Drawable.hpp"
+#include "FrameArena.hpp"
+#include "IndexedDrawable.hpp"
 #include "Font.hpp"
+#include "CanvasRecorder.hpp"
+#include "SpriteBlitter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 namespace Pix {
 
 class Canvas2D {
-	
+
 	Drawable *pTarget;
+	IndexedDrawable *pIndexed;		// the target, if indexed
+	PaletteLookup_t mLookup;		// color to index conversions
 	Font *pFont;
+	Drawable *pScratch = nullptr;	// offscreen for blended strings
+	CanvasRecorder *pRecorder = nullptr;	// command buffer in deferred mode
+
+	DirtyRect_t mClip;				// writes are clipped to this rect
+	bool bMark = true;				// whether primitives mark the target dirty
 
 public:
-	
+
 	Canvas2D(Drawable *target, Font *defaultFont = nullptr);
-	
-	void setPixel(int32_t x, int32_t y, Pixel p);
-	
+
+	~Canvas2D();
+
+	void setPixel(int32_t x, int32_t y, Pixel p, BlendMode_t blend = BLEND_NORMAL);
+
 	void clear(Pixel color = Pixel(0, 0, 0, 0));
-	
+
 	void blank();
-	
-	void drawString(int32_t x, int32_t y, std::string sText, Pix::Pixel col,
-					uint32_t scale = 1);
-	
+
+	void drawString(int32_t x, int32_t y, std::string_view sText, Pix::Pixel col,
+					uint32_t scale = 1, BlendMode_t blend = BLEND_NORMAL);
+
 	void
 	drawWireFrameModel(const std::vector<std::pair<float, float>> &vecModelCoordinates, float x,
-					   float y, float r, float s, std::vector<Pix::Pixel> col);
-	
+					   float y, float r, float s, std::vector<Pix::Pixel> col,
+					   BlendMode_t blend = BLEND_NORMAL);
+
 	void drawLine(int32_t x1, int32_t y1, int32_t x2, int32_t y2, Pixel p,
-				  uint32_t pattern = 0xFFFFFFFF);
-	
-	void drawCircle(int32_t x, int32_t y, int32_t radius, Pixel p, uint8_t mask = 0xff);
-	
-	void fillCircle(int32_t x, int32_t y, int32_t radius, Pixel p);
-	
-	void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, Pixel p);
-	
-	void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, Pixel p);
-	
+				  uint32_t pattern = 0xFFFFFFFF, BlendMode_t blend = BLEND_NORMAL);
+
+	void drawCircle(int32_t x, int32_t y, int32_t radius, Pixel p, uint8_t mask = 0xff,
+					BlendMode_t blend = BLEND_NORMAL);
+
+	void fillCircle(int32_t x, int32_t y, int32_t radius, Pixel p, BlendMode_t blend = BLEND_NORMAL);
+
+	void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, Pixel p, BlendMode_t blend = BLEND_NORMAL);
+
+	void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, Pixel p, BlendMode_t blend = BLEND_NORMAL);
+
 	void drawTriangle(int32_t x1, int32_t y1, int32_t x2, int32_t y2, int32_t x3, int32_t y3,
-					  Pixel p);
-	
+					  Pixel p, BlendMode_t blend = BLEND_NORMAL);
+
 	void fillTriangle(int32_t x1, int32_t y1, int32_t x2, int32_t y2, int32_t x3, int32_t y3,
-					  Pixel p);
-	
-	void drawSprite(int32_t x, int32_t y, Pix::Drawable *drawable, uint32_t sampleWidth=0);
+					  Pixel p, BlendMode_t blend = BLEND_NORMAL);
+
+	/**
+	 * Draws a drawable
+	 * @param x left
+	 * @param y top
+	 * @param drawable The sprite
+	 * @param sampleWidth if not 0, the sprite is resampled to this width (keeping aspect ratio)
+	 * @param blend how sprite pixels combine with the canvas
+	 */
+	void drawSprite(int32_t x, int32_t y, Pix::Drawable *drawable, uint32_t sampleWidth=0,
+					BlendMode_t blend = BLEND_NORMAL);
+
+	/**
+	 * Draws a scaled, rotated or flipped drawable
+	 * @param drawable The sprite
+	 * @param transform Placement, filtering and keying (see SpriteBlitter::place)
+	 * @param blend how sprite pixels combine with the canvas
+	 */
+	void drawSprite(Pix::Drawable *drawable, const SpriteTransform_t &transform, BlendMode_t blend = BLEND_NORMAL);
 
 	int width();
-	
+
 	int height();
-	
+
 	Font *font();
-		
+
+	/**
+	 * Enables or disables deferred mode. Deferred primitives are recorded and rasterized by
+	 * flush(), in screen tiles run on a job system. The target drawable flushes the
+	 * canvas when it is resolved, so this happens automatically when its texture is updated.
+	 * Sprites are read at flush time, so they must stay unchanged until then.
+	 * @param deferred whether to defer drawing
+	 * @param jobs job system to run the tiles on (ie. Fu::jobs()), null to run them on the caller
+	 */
+	void setDeferred(bool deferred, JobSystem *jobs = nullptr);
+
+	/** Whether the canvas is in deferred mode */
+	bool deferred();
+
+	/**
+	 * Rasterizes the recorded primitives, if any
+	 */
+	void flush();
+
+private:
+
+	// marks the bounding box of a primitive, returns it (x2,y2 exclusive)
+	DirtyRect_t markBox(int32_t x1, int32_t y1, int32_t x2, int32_t y2);
+
+	// clipped writes
+	void plot(int32_t x, int32_t y, Pixel p, BlendMode_t blend);
+
+	void span(int32_t x, int32_t y, int32_t len, Pixel p, BlendMode_t blend);
+
+	void spanCopy(int32_t x, int32_t y, const Pixel *src, int32_t len, BlendMode_t blend);
+
+	// rows of a primitive that fall in the clip rect
+	int32_t firstRow(int32_t y);
+
+	int32_t lastRow(int32_t y);
+
+	// draws a row of a transformed sprite, clipped
+	void spriteRow(Drawable *drawable, const SpriteWalk_t &walk, const SpriteTransform_t &transform, int32_t y,
+				   BlendMode_t blend);
+
+	// renders a string over a background on the scratch drawable
+	void renderString(int32_t y, int32_t w, int32_t h, uint32_t background, std::string_view sText,
+					  Pixel col, uint32_t scale);
+
+	// draws a recorded command
+	void replay(const CanvasCommand_t &cmd, CanvasRecorder *recorder);
+
 };
 
-inline void Canvas2D::setPixel(int32_t x, int32_t y, Pixel p) { pTarget->setPixel(x,y,p); }
+inline Canvas2D::Canvas2D(Drawable *target, Font *defaultFont)
+		: pTarget(target), pIndexed(dynamic_cast<IndexedDrawable *>(target)), pFont(defaultFont),
+		  mClip({0, 0, target->width, target->height}) {}
+
+inline Canvas2D::~Canvas2D() {
+	if (pRecorder != nullptr) {
+		pTarget->setResolver(nullptr);
+		delete pRecorder;
+	}
+	delete pScratch;
+}
+
+inline void Canvas2D::setPixel(int32_t x, int32_t y, Pixel p, BlendMode_t blend) {
+	markBox(x, y, x, y);
+	if (pRecorder != nullptr) pRecorder->recordPixel(x, y, p.n, blend);
+	else plot(x, y, p, blend);
+}
 
 inline int Canvas2D::width() { return pTarget->width; }
 
 inline int Canvas2D::height() { return pTarget->height; }
 
-inline void Canvas2D::clear(Pixel color) { pTarget->clear(color); }
+inline void Canvas2D::clear(Pixel color) {
+	if (pRecorder == nullptr) {
+		if (pIndexed != nullptr) pIndexed->fillIndexes(pIndexed->indexOf(color, mLookup));
+		else pTarget->clear(color);
+		return;
+	}
+	// everything recorded so far gets covered
+	pRecorder->reset();
+	pRecorder->record(CANVAS_FILLRECT, mClip, color.n, BLEND_NORMAL, {0, 0, pTarget->width, pTarget->height});
+	pTarget->markDirty();
+}
 
-inline void Canvas2D::blank() { pTarget->blank(0); }
+inline void Canvas2D::blank() {
+	if (pRecorder == nullptr && pIndexed == nullptr) pTarget->blank(0);
+	else clear(0);
+}
 
 inline Font *Canvas2D::font() { return pFont; }
 
+inline bool Canvas2D::deferred() { return pRecorder != nullptr; }
+
+inline void Canvas2D::setDeferred(bool deferred, JobSystem *jobs) {
+	if (deferred == (pRecorder != nullptr)) return;
+	if (deferred) {
+		pRecorder = new CanvasRecorder(jobs);
+		pTarget->setResolver([this] { flush(); });
+	} else {
+		flush();
+		pTarget->setResolver(nullptr);
+		delete pRecorder;
+		pRecorder = nullptr;
+	}
+}
+
+inline void Canvas2D::flush() {
+
+	if (pRecorder == nullptr || pRecorder->empty()) return;
+
+	pRecorder->execute(pTarget->width, pTarget->height,
+					   [this](const DirtyRect_t &tile, const std::vector<uint32_t> &commands,
+							  const std::vector<CanvasCommand_t> &buffer) {
+		Canvas2D view(pTarget, pFont);
+		view.mClip = tile;
+		view.bMark = false;
+		for (uint32_t i:commands) view.replay(buffer[i], pRecorder);
+	});
+
+	pRecorder->reset();
+}
+
+inline void Canvas2D::replay(const CanvasCommand_t &cmd, CanvasRecorder *recorder) {
+
+	const int32_t *c = cmd.c;
+	BlendMode_t blend = (BlendMode_t) cmd.blend;
+
+	switch (cmd.op) {
+		case CANVAS_PIXELS: {
+			const CanvasPoint_t *points = recorder->points() + c[0];
+			for (int32_t i = 0; i < c[1]; i++) plot(points[i].x, points[i].y, points[i].color, blend);
+			break;
+		}
+		case CANVAS_LINE:
+			drawLine(c[0], c[1], c[2], c[3], cmd.color, cmd.param, blend);
+			break;
+		case CANVAS_CIRCLE:
+			drawCircle(c[0], c[1], c[2], cmd.color, (uint8_t) cmd.param, blend);
+			break;
+		case CANVAS_FILLCIRCLE:
+			fillCircle(c[0], c[1], c[2], cmd.color, blend);
+			break;
+		case CANVAS_FILLRECT:
+			fillRect(c[0], c[1], c[2], c[3], cmd.color, blend);
+			break;
+		case CANVAS_FILLTRIANGLE:
+			fillTriangle(c[0], c[1], c[2], c[3], c[4], c[5], cmd.color, blend);
+			break;
+		case CANVAS_SPRITE:
+			drawSprite(c[0], c[1], cmd.sprite, cmd.param, blend);
+			break;
+		case CANVAS_TRANSFORMEDSPRITE:
+			drawSprite(cmd.sprite, recorder->transform(cmd.param), blend);
+			break;
+		case CANVAS_STRING: {
+			// only the pixels the font wrote
+			const CanvasString_t &str = recorder->string(cmd.param);
+			const uint32_t *pixels = recorder->stringPixels() + str.offset;
+			const uint8_t *coverage = recorder->stringCoverage() + str.offset;
+			int32_t i0 = std::max(0, mClip.x0 - c[0]), i1 = std::min(str.w, mClip.x1 - c[0]);
+			for (int32_t j = std::max(0, mClip.y0 - c[1]); j < std::min(str.h, mClip.y1 - c[1]); j++)
+				for (int32_t i = i0; i < i1; i++)
+					if (coverage[j * str.w + i]) plot(c[0] + i, c[1] + j, pixels[j * str.w + i], blend);
+			break;
+		}
+	}
+}
+
+inline DirtyRect_t Canvas2D::markBox(int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+	DirtyRect_t box = {std::min(x1, x2), std::min(y1, y2), std::max(x1, x2) + 1, std::max(y1, y2) + 1};
+	if (bMark) pTarget->markDirty(box.x0, box.y0, box.x1 - box.x0, box.y1 - box.y0);
+	return box;
+}
+
+inline void Canvas2D::plot(int32_t x, int32_t y, Pixel p, BlendMode_t blend) {
+	if (x < mClip.x0 || y < mClip.y0 || x >= mClip.x1 || y >= mClip.y1) return;
+	if (pIndexed != nullptr) {
+		pIndexed->plot(x, y, p.n, blend, mLookup);
+		return;
+	}
+	uint32_t &dst = reinterpret_cast<uint32_t *>(pTarget->getData())[y * pTarget->width + x];
+	dst = blend == BLEND_NORMAL ? p.n : PixelOps::blend(dst, p.n, blend);
+}
+
+inline void Canvas2D::span(int32_t x, int32_t y, int32_t len, Pixel p, BlendMode_t blend) {
+	if (y < mClip.y0 || y >= mClip.y1) return;
+	int32_t x1 = std::min(x + len, mClip.x1);
+	x = std::max(x, mClip.x0);
+	if (x >= x1) return;
+	if (pIndexed != nullptr) pIndexed->fillSpan(x, y, x1 - x, p.n, blend, mLookup);
+	else PixelOps::blendFill(reinterpret_cast<uint32_t *>(pTarget->getData()) + y * pTarget->width + x, p.n, x1 - x, blend);
+}
+
+inline void Canvas2D::spanCopy(int32_t x, int32_t y, const Pixel *src, int32_t len, BlendMode_t blend) {
+	if (y < mClip.y0 || y >= mClip.y1) return;
+	int32_t x1 = std::min(x + len, mClip.x1);
+	int32_t skip = x < mClip.x0 ? mClip.x0 - x : 0;
+	x += skip;
+	if (x >= x1) return;
+	if (pIndexed != nullptr) {
+		pIndexed->copySpan(x, y, reinterpret_cast<const uint32_t *>(src) + skip, x1 - x, blend, mLookup);
+		return;
+	}
+	PixelOps::blendCopy(reinterpret_cast<uint32_t *>(pTarget->getData()) + y * pTarget->width + x,
+						reinterpret_cast<const uint32_t *>(src) + skip, x1 - x, blend);
+}
+
+inline int32_t Canvas2D::firstRow(int32_t y) { return std::max(y, mClip.y0); }
+
+inline int32_t Canvas2D::lastRow(int32_t y) { return std::min(y, mClip.y1 - 1); }
+
+inline void Canvas2D::renderString(int32_t y, int32_t w, int32_t h, uint32_t background, std::string_view sText,
+								   Pixel col, uint32_t scale) {
+	uint32_t *data = reinterpret_cast<uint32_t *>(pScratch->getData());
+	for (int32_t j = y; j < y + h; j++)
+		PixelOps::fill(data + j * pScratch->width, background, w);
+	pFont->drawString(pScratch, 0, y, sText, col, scale);
+}
+
+inline void Canvas2D::drawString(int32_t x, int32_t y, std::string_view sText, Pix::Pixel col, uint32_t scale, BlendMode_t blend) {
+
+	if (pFont == nullptr) return;
+
+	int32_t columns = 0, lines = 1, column = 0;
+	for (char c:sText) {
+		if (c == '\n') {
+			lines++;
+			column = 0;
+		} else columns = std::max(columns, ++column);
+	}
+
+	if (columns == 0) return;
+
+	int32_t w = columns * pFont->INFO.charWidth * scale, h = lines * pFont->INFO.charHeight * scale;
+
+	DirtyRect_t box = markBox(x, y, x + w - 1, y + h - 1);
+
+	if (blend == BLEND_NORMAL && pRecorder == nullptr && pIndexed == nullptr) {
+		pFont->drawString(pTarget, x, y, sText, col, scale);
+		return;
+	}
+
+	// render on offscreen, deferred strings are rendered twice to know what the font wrote
+	int32_t rows = pRecorder != nullptr ? 2 * h : h;
+
+	if (pScratch == nullptr || pScratch->width < w || pScratch->height < rows) {
+		delete pScratch;
+		pScratch = new Drawable(std::max(w, pTarget->width), std::max(rows, pFont->INFO.charHeight * 4));
+	}
+
+	renderString(0, w, h, 0, sText, col, scale);
+
+	if (pRecorder != nullptr) {
+		renderString(h, w, h, 0xFFFFFFFF, sText, col, scale);
+		uint32_t slot = pRecorder->storeString(w, h, pScratch->getData(), pScratch->getData() + h * pScratch->width,
+											   pScratch->width);
+		pRecorder->record(CANVAS_STRING, box, col.n, blend, {x, y}, slot);
+		return;
+	}
+
+	// composite, transparent pixels leave the canvas untouched
+	for (int32_t j = 0; j < h; j++)
+		spanCopy(x, y + j, pScratch->getData() + j * pScratch->width, w, blend);
+}
+
+inline void Canvas2D::drawWireFrameModel(const std::vector<std::pair<float, float>> &vecModelCoordinates,
+										 float x, float y, float r, float s, std::vector<Pix::Pixel> col,
+										 BlendMode_t blend) {
+
+	size_t verts = vecModelCoordinates.size();
+	if (verts == 0 || col.empty()) return;
+
+	std::vector<std::pair<float, float>> vecTransformedCoordinates(verts);
+	float cr = cosf(r), sr = sinf(r);
+
+	// rotate, scale, translate
+	for (size_t i = 0; i < verts; i++) {
+		const std::pair<float, float> &v = vecModelCoordinates[i];
+		vecTransformedCoordinates[i].first = (v.first * cr - v.second * sr) * s + x;
+		vecTransformedCoordinates[i].second = (v.first * sr + v.second * cr) * s + y;
+	}
+
+	// closed polygon
+	for (size_t i = 0; i < verts; i++) {
+		size_t j = (i + 1) % verts;
+		drawLine((int32_t) vecTransformedCoordinates[i].first, (int32_t) vecTransformedCoordinates[i].second,
+				 (int32_t) vecTransformedCoordinates[j].first, (int32_t) vecTransformedCoordinates[j].second,
+				 col[i % col.size()], 0xFFFFFFFF, blend);
+	}
+}
+
+inline void Canvas2D::drawLine(int32_t x1, int32_t y1, int32_t x2, int32_t y2, Pixel p, uint32_t pattern,
+							   BlendMode_t blend) {
+
+	DirtyRect_t box = markBox(x1, y1, x2, y2);
+
+	if (pRecorder != nullptr) {
+		pRecorder->record(CANVAS_LINE, box, p.n, blend, {x1, y1, x2, y2}, pattern);
+		return;
+	}
+
+	int x, y, dx, dy, dx1, dy1, px, py, xe, ye;
+	dx = x2 - x1;
+	dy = y2 - y1;
+
+	auto rol = [&pattern]() {
+		pattern = (pattern << 1) | (pattern >> 31);
+		return pattern & 1;
+	};
+
+	// pattern state after k pixels
+	auto rolBy = [&pattern](int64_t k) {
+		k &= 31;
+		if (k > 0) pattern = (pattern << k) | (pattern >> (32 - k));
+	};
+
+	if (dx == 0) {
+		if (y2 < y1) std::swap(y1, y2);
+		rolBy(firstRow(y1) - y1);
+		for (y = firstRow(y1); y <= lastRow(y2); y++) if (rol()) plot(x1, y, p, blend);
+		return;
+	}
+
+	if (dy == 0) {
+		if (x2 < x1) std::swap(x1, x2);
+		if (pattern == 0xFFFFFFFF)
+			span(x1, y1, x2 - x1 + 1, p, blend);
+		else if (y1 >= mClip.y0 && y1 < mClip.y1) {
+			x = std::max(x1, mClip.x0);
+			rolBy(x - x1);
+			for (; x <= std::min(x2, mClip.x1 - 1); x++) if (rol()) plot(x, y1, p, blend);
+		}
+		return;
+	}
+
+	dx1 = std::abs(dx);
+	dy1 = std::abs(dy);
+	px = 2 * dy1 - dx1;
+	py = 2 * dx1 - dy1;
+
+	bool sameSign = (dx < 0 && dy < 0) || (dx > 0 && dy > 0);
+
+	if (dy1 <= dx1) {
+		if (dx >= 0) { x = x1; y = y1; xe = x2; }
+		else { x = x2; y = y2; xe = x1; }
+		// skip the steps before the clip rect, the error term has a closed form
+		int64_t k = std::max(0, mClip.x0 - x);
+		if (k > 0) {
+			if (k > xe - x) return;
+			int64_t n = (2 * dy1 * k + dx1) / (2 * (int64_t) dx1);
+			px = (int) (2 * dy1 * (k + 1) - dx1 - 2 * dx1 * n);
+			x += (int) k;
+			y += (int) (sameSign ? n : -n);
+			rolBy(k);
+		}
+		xe = std::min(xe, mClip.x1 - 1);
+		if (rol()) plot(x, y, p, blend);
+		while (x < xe) {
+			x++;
+			if (px < 0) px += 2 * dy1;
+			else {
+				y += sameSign ? 1 : -1;
+				px += 2 * (dy1 - dx1);
+			}
+			if (rol()) plot(x, y, p, blend);
+		}
+	} else {
+		if (dy >= 0) { x = x1; y = y1; ye = y2; }
+		else { x = x2; y = y2; ye = y1; }
+		int64_t k = std::max(0, mClip.y0 - y);
+		if (k > 0) {
+			if (k > ye - y) return;
+			int64_t n = (2 * dx1 * k + dy1 - 1) / (2 * (int64_t) dy1);
+			py = (int) (2 * dx1 * (k + 1) - dy1 - 2 * dy1 * n);
+			y += (int) k;
+			x += (int) (sameSign ? n : -n);
+			rolBy(k);
+		}
+		ye = std::min(ye, mClip.y1 - 1);
+		if (rol()) plot(x, y, p, blend);
+		while (y < ye) {
+			y++;
+			if (py <= 0) py += 2 * dx1;
+			else {
+				x += sameSign ? 1 : -1;
+				py += 2 * (dx1 - dy1);
+			}
+			if (rol()) plot(x, y, p, blend);
+		}
+	}
+}
+
+inline void Canvas2D::drawCircle(int32_t x, int32_t y, int32_t radius, Pixel p, uint8_t mask, BlendMode_t blend) {
+
+	if (radius <= 0) return;
+
+	DirtyRect_t box = markBox(x - radius, y - radius, x + radius, y + radius);
+
+	if (pRecorder != nullptr) {
+		pRecorder->record(CANVAS_CIRCLE, box, p.n, blend, {x, y, radius}, mask);
+		return;
+	}
+
+	int x0 = 0, y0 = radius, d = 3 - 2 * radius;
+
+	while (y0 >= x0) {
+		if (mask & 0x01) plot(x + x0, y - y0, p, blend);
+		if (mask & 0x02) plot(x + y0, y - x0, p, blend);
+		if (mask & 0x04) plot(x + y0, y + x0, p, blend);
+		if (mask & 0x08) plot(x + x0, y + y0, p, blend);
+		if (mask & 0x10) plot(x - x0, y + y0, p, blend);
+		if (mask & 0x20) plot(x - y0, y + x0, p, blend);
+		if (mask & 0x40) plot(x - y0, y - x0, p, blend);
+		if (mask & 0x80) plot(x - x0, y - y0, p, blend);
+		if (d < 0) d += 4 * x0++ + 6;
+		else d += 4 * (x0++ - y0--) + 10;
+	}
+}
+
+inline void Canvas2D::fillCircle(int32_t x, int32_t y, int32_t radius, Pixel p, BlendMode_t blend) {
+
+	if (radius <= 0) return;
+
+	DirtyRect_t box = markBox(x - radius, y - radius, x + radius, y + radius);
+
+	if (pRecorder != nullptr) {
+		pRecorder->record(CANVAS_FILLCIRCLE, box, p.n, blend, {x, y, radius});
+		return;
+	}
+
+	// half width of each row, so every row is drawn just once (matters when blending). On the
+	// stack, big circles in the frame arena.
+	int32_t local[256];
+	FrameVector<int32_t> arena;
+	int32_t *halfWidth = local;
+	if (radius >= 256) {
+		arena.resize(radius + 1);
+		halfWidth = arena.data();
+	}
+	std::fill(halfWidth, halfWidth + radius + 1, -1);
+
+	int x0 = 0, y0 = radius, d = 3 - 2 * radius;
+
+	while (y0 >= x0) {
+		halfWidth[y0] = std::max(halfWidth[y0], x0);
+		halfWidth[x0] = std::max(halfWidth[x0], y0);
+		if (d < 0) d += 4 * x0++ + 6;
+		else d += 4 * (x0++ - y0--) + 10;
+	}
+
+	for (int32_t row = firstRow(y - radius); row <= lastRow(y + radius); row++) {
+		int32_t hw = halfWidth[std::abs(row - y)];
+		if (hw >= 0) span(x - hw, row, 2 * hw + 1, p, blend);
+	}
+}
+
+inline void Canvas2D::drawRect(int32_t x, int32_t y, int32_t w, int32_t h, Pixel p, BlendMode_t blend) {
+	drawLine(x, y, x + w, y, p, 0xFFFFFFFF, blend);
+	drawLine(x + w, y, x + w, y + h, p, 0xFFFFFFFF, blend);
+	drawLine(x + w, y + h, x, y + h, p, 0xFFFFFFFF, blend);
+	drawLine(x, y + h, x, y, p, 0xFFFFFFFF, blend);
+}
+
+inline void Canvas2D::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, Pixel p, BlendMode_t blend) {
+
+	if (w <= 0 || h <= 0) return;
+
+	DirtyRect_t box = markBox(x, y, x + w - 1, y + h - 1);
+
+	if (pRecorder != nullptr) {
+		pRecorder->record(CANVAS_FILLRECT, box, p.n, blend, {x, y, w, h});
+		return;
+	}
+
+	int32_t x0 = std::max(x, mClip.x0), x1 = std::min(x + w, mClip.x1);
+	int32_t y0 = std::max(y, mClip.y0), y1 = std::min(y + h, mClip.y1);
+	if (x0 >= x1 || y0 >= y1) return;
+
+	if (pIndexed != nullptr) {
+		for (int32_t j = y0; j < y1; j++) span(x0, j, x1 - x0, p, blend);
+		return;
+	}
+
+	uint32_t *data = reinterpret_cast<uint32_t *>(pTarget->getData());
+
+	if (blend == BLEND_NORMAL)
+		PixelOps::fillRect(data, pTarget->width, x0, y0, x1 - x0, y1 - y0, p.n);
+	else
+		for (int32_t j = y0; j < y1; j++)
+			PixelOps::blendFill(data + j * pTarget->width + x0, p.n, x1 - x0, blend);
+}
+
+inline void Canvas2D::drawTriangle(int32_t x1, int32_t y1, int32_t x2, int32_t y2, int32_t x3, int32_t y3, Pixel p,
+								   BlendMode_t blend) {
+	drawLine(x1, y1, x2, y2, p, 0xFFFFFFFF, blend);
+	drawLine(x2, y2, x3, y3, p, 0xFFFFFFFF, blend);
+	drawLine(x3, y3, x1, y1, p, 0xFFFFFFFF, blend);
+}
+
+inline void Canvas2D::fillTriangle(int32_t x1, int32_t y1, int32_t x2, int32_t y2, int32_t x3, int32_t y3, Pixel p,
+								   BlendMode_t blend) {
+
+	// sort vertices by y
+	if (y2 < y1) { std::swap(y1, y2); std::swap(x1, x2); }
+	if (y3 < y1) { std::swap(y1, y3); std::swap(x1, x3); }
+	if (y3 < y2) { std::swap(y2, y3); std::swap(x2, x3); }
+
+	int32_t xmin = std::min(x1, std::min(x2, x3)), xmax = std::max(x1, std::max(x2, x3));
+
+	DirtyRect_t box = markBox(xmin, y1, xmax, y3);
+
+	if (pRecorder != nullptr) {
+		pRecorder->record(CANVAS_FILLTRIANGLE, box, p.n, blend, {x1, y1, x2, y2, x3, y3});
+		return;
+	}
+
+	if (y1 == y3) {
+		span(xmin, y1, xmax - xmin + 1, p, blend);
+		return;
+	}
+
+	// edge x at scanline y, long edge 1-3 against short edges 1-2 and 2-3
+	auto edge = [](int32_t xa, int32_t ya, int32_t xb, int32_t yb, int32_t y) {
+		return yb == ya ? xa : xa + (xb - xa) * (y - ya) / (yb - ya);
+	};
+
+	for (int32_t y = firstRow(y1); y <= lastRow(y3); y++) {
+		int32_t xl = edge(x1, y1, x3, y3, y);
+		int32_t xr = y < y2 ? edge(x1, y1, x2, y2, y) : edge(x2, y2, x3, y3, y);
+		if (xl > xr) std::swap(xl, xr);
+		span(xl, y, xr - xl + 1, p, blend);
+	}
+}
+
+inline void Canvas2D::drawSprite(int32_t x, int32_t y, Pix::Drawable *drawable, uint32_t sampleWidth, BlendMode_t blend) {
+
+	if (drawable == nullptr) return;
+
+	int32_t w = sampleWidth > 0 ? (int32_t) sampleWidth : drawable->width;
+	int32_t h = sampleWidth > 0 ? drawable->height * w / drawable->width : drawable->height;
+
+	if (w <= 0 || h <= 0) return;
+
+	DirtyRect_t box = markBox(x, y, x + w - 1, y + h - 1);
+
+	if (pRecorder != nullptr) {
+		pRecorder->record(CANVAS_SPRITE, box, 0, blend, {x, y}, sampleWidth, drawable);
+		return;
+	}
+
+	int32_t j0 = firstRow(y) - y, j1 = lastRow(y + h - 1) - y;
+
+	if (w == drawable->width) {
+		// 1:1, row copies
+		for (int32_t j = j0; j <= j1; j++)
+			spanCopy(x, y + j, drawable->getData() + j * drawable->width, w, blend);
+		return;
+	}
+
+	// resampled, with the affine blitter
+	SpriteTransform_t transform = {(float) x, (float) y, 0, (float) w / drawable->width, (float) h / drawable->height,
+								   0, 0, SPRITE_NEAREST, SPRITE_KEY_NONE, 0};
+	SpriteWalk_t walk;
+	if (!SpriteBlitter::prepare(drawable, transform, walk)) return;
+	for (int32_t j = j0; j <= j1; j++) spriteRow(drawable, walk, transform, y + j, blend);
+}
+
+inline void Canvas2D::drawSprite(Pix::Drawable *drawable, const SpriteTransform_t &transform, BlendMode_t blend) {
+
+	SpriteWalk_t walk;
+	if (!SpriteBlitter::prepare(drawable, transform, walk)) return;
+
+	DirtyRect_t box = markBox(walk.box.x0, walk.box.y0, walk.box.x1 - 1, walk.box.y1 - 1);
+
+	if (pRecorder != nullptr) {
+		pRecorder->record(CANVAS_TRANSFORMEDSPRITE, box, 0, blend, {}, pRecorder->storeTransform(transform), drawable);
+		return;
+	}
+
+	for (int32_t y = firstRow(walk.box.y0); y <= lastRow(walk.box.y1 - 1); y++)
+		spriteRow(drawable, walk, transform, y, blend);
+}
+
+inline void Canvas2D::spriteRow(Drawable *drawable, const SpriteWalk_t &walk, const SpriteTransform_t &transform,
+								int32_t y, BlendMode_t blend) {
+
+	if (pIndexed == nullptr) {
+		SpriteBlitter::drawRow(pTarget, drawable, walk, transform, y, mClip.x0, mClip.x1, blend);
+		return;
+	}
+
+	SpriteBlitter::sampleRow(drawable, walk, transform.filter, y, mClip.x0, mClip.x1,
+							 [&](int32_t x, uint32_t *pixels, int count) {
+		SpriteBlitter::clearKeyed(pixels, count, transform);
+		pIndexed->copySpan(x, y, pixels, count, blend, mLookup);
+	});
+}
+
 }
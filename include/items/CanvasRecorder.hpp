@@ -0,0 +1,381 @@
+//
+//  CanvasRecorder.hpp
+//  PixFu
+//
+//  Command buffer behind the deferred mode of Canvas2D. Primitives are recorded in a compact
+//  form while the frame is drawn; at flush time they are binned into screen tiles and the
+//  tiles are rasterized in parallel on a job system. Every tile replays its commands
+//  in recording order with writes clipped to the tile, so the output is the very same as
+//  drawing immediately.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "Drawable.hpp"
+#include "JobSystem.hpp"
+#include "SpriteBlitter.hpp"
+
+#include <cmath>
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+namespace Pix {
+
+	/** Recorded primitive types. Outlines (rects, triangles, wireframes) are recorded as lines */
+	typedef enum eCanvasOp {
+		CANVAS_PIXELS,
+		CANVAS_LINE,
+		CANVAS_CIRCLE,
+		CANVAS_FILLCIRCLE,
+		CANVAS_FILLRECT,
+		CANVAS_FILLTRIANGLE,
+		CANVAS_STRING,
+		CANVAS_SPRITE,
+		CANVAS_TRANSFORMEDSPRITE
+	} CanvasOp_t;
+
+	/** A recorded primitive */
+	typedef struct sCanvasCommand {
+		uint8_t op;                 // CanvasOp_t
+		uint8_t blend;              // BlendMode_t
+		int32_t c[6];               // coordinates, meaning depends on op (pixels: first point, count)
+		uint32_t color;
+		uint32_t param;             // line pattern, circle mask, sample width, string or transform slot
+		Drawable *sprite;           // sprite source
+		DirtyRect_t box;            // bounding box, x1,y1 exclusive
+	} CanvasCommand_t;
+
+	/** A recorded pixel */
+	typedef struct sCanvasPoint {
+		int32_t x, y;
+		uint32_t color;
+	} CanvasPoint_t;
+
+	/** A pre-rendered string: its pixels and which of them the font wrote */
+	typedef struct sCanvasString {
+		int32_t w, h;
+		size_t offset;              // into the pixel and coverage pools
+	} CanvasString_t;
+
+	class CanvasRecorder {
+
+		std::vector<CanvasCommand_t> vCommands;
+		std::vector<CanvasPoint_t> vPoints;
+		std::vector<CanvasString_t> vStrings;
+		std::vector<uint32_t> vStringPixels;
+		std::vector<uint8_t> vStringCoverage;
+		std::vector<SpriteTransform_t> vTransforms;
+
+		std::vector<std::vector<uint32_t>> vBins;       // command indexes per tile
+		std::vector<int> vActiveTiles;                  // tiles with commands this flush
+
+		JobSystem *pJobs;                               // runs the tiles, null = calling thread
+
+		// adds a command to the bins of the tiles in a rect
+		void bin(uint32_t index, int x0, int y0, int x1, int y1, int tilesX);
+
+		// adds a diagonal line only to the tiles it crosses
+		void binLine(uint32_t index, const CanvasCommand_t &cmd, int width, int height, int tilesX);
+
+		// adds a circle to the tiles it covers (or crosses, if an outline)
+		void binCircle(uint32_t index, const CanvasCommand_t &cmd, int tilesX);
+
+		// adds a filled triangle to the tiles it covers, row band by row band
+		void binTriangle(uint32_t index, const CanvasCommand_t &cmd, int height, int tilesX);
+
+		// runs fn(0..count-1) on the job system and the calling thread
+		void parallel(int count, const std::function<void(int)> &fn);
+
+	public:
+
+		/** Tile side in pixels */
+		static constexpr int TILESIZE = 64;
+
+		/**
+		 * Creates a recorder
+		 * @param jobs Job system to rasterize the tiles on, null to do it on the calling thread
+		 */
+		CanvasRecorder(JobSystem *jobs = nullptr);
+
+		/** Whether there are pending commands */
+		bool empty();
+
+		/**
+		 * Records a command
+		 * @param op The primitive
+		 * @param box Its bounding box (x1,y1 exclusive)
+		 * @param color Color
+		 * @param blend Blend mode
+		 * @param coords Primitive coordinates
+		 * @param param Extra parameter (see CanvasCommand_t)
+		 * @param sprite Sprite source, if any
+		 */
+		void record(CanvasOp_t op, const DirtyRect_t &box, uint32_t color, BlendMode_t blend,
+					std::initializer_list<int32_t> coords, uint32_t param = 0, Drawable *sprite = nullptr);
+
+		/**
+		 * Records a pixel. Consecutive pixels close to each other are recorded as a single
+		 * command, so curves plotted point by point stay cheap to record and to bin.
+		 * @param x coord
+		 * @param y coord
+		 * @param color Color
+		 * @param blend Blend mode
+		 */
+		void recordPixel(int32_t x, int32_t y, uint32_t color, BlendMode_t blend);
+
+		/** Recorded pixels */
+		const CanvasPoint_t *points();
+
+		/**
+		 * Stores a pre-rendered string. The string is rendered twice by the caller over two
+		 * different backgrounds, any pixel that differs from its background was written.
+		 * @param w width
+		 * @param h height
+		 * @param over0 rows rendered over 0x00000000
+		 * @param over1 rows rendered over 0xFFFFFFFF
+		 * @param stride row stride of both sources, in pixels
+		 * @return the string slot, to be recorded as param of a CANVAS_STRING
+		 */
+		uint32_t storeString(int32_t w, int32_t h, const Pixel *over0, const Pixel *over1, int32_t stride);
+
+		/** Gets a stored string */
+		const CanvasString_t &string(uint32_t slot);
+
+		/** Pixel and coverage pools of stored strings */
+		const uint32_t *stringPixels();
+
+		const uint8_t *stringCoverage();
+
+		/**
+		 * Stores a sprite transform
+		 * @return the transform slot, to be recorded as param of a CANVAS_TRANSFORMEDSPRITE
+		 */
+		uint32_t storeTransform(const SpriteTransform_t &transform);
+
+		/** Gets a stored transform */
+		const SpriteTransform_t &transform(uint32_t slot);
+
+		/**
+		 * Bins the commands into tiles of the target and calls fn on every non-empty tile, in parallel.
+		 * @param width target width
+		 * @param height target height
+		 * @param fn receives the tile rectangle and the recorded commands that touch it, in order
+		 */
+		void execute(int width, int height,
+					 const std::function<void(const DirtyRect_t &, const std::vector<uint32_t> &,
+											  const std::vector<CanvasCommand_t> &)> &fn);
+
+		/** Drops all recorded commands */
+		void reset();
+
+	};
+
+	inline CanvasRecorder::CanvasRecorder(JobSystem *jobs) : pJobs(jobs) {}
+
+	inline bool CanvasRecorder::empty() { return vCommands.empty(); }
+
+	inline void CanvasRecorder::record(CanvasOp_t op, const DirtyRect_t &box, uint32_t color, BlendMode_t blend,
+									   std::initializer_list<int32_t> coords, uint32_t param, Drawable *sprite) {
+		CanvasCommand_t cmd = {(uint8_t) op, (uint8_t) blend, {}, color, param, sprite, box};
+		std::copy(coords.begin(), coords.begin() + std::min((size_t) 6, coords.size()), cmd.c);
+		vCommands.push_back(cmd);
+	}
+
+	inline void CanvasRecorder::recordPixel(int32_t x, int32_t y, uint32_t color, BlendMode_t blend) {
+
+		vPoints.push_back({x, y, color});
+
+		if (!vCommands.empty()) {
+			CanvasCommand_t &last = vCommands.back();
+			DirtyRect_t box = last.box.merged({x, y, x + 1, y + 1});
+			if (last.op == CANVAS_PIXELS && last.blend == blend &&
+				box.x1 - box.x0 <= TILESIZE && box.y1 - box.y0 <= TILESIZE) {
+				last.box = box;
+				last.c[1]++;
+				return;
+			}
+		}
+
+		record(CANVAS_PIXELS, {x, y, x + 1, y + 1}, 0, blend, {(int32_t) vPoints.size() - 1, 1});
+	}
+
+	inline const CanvasPoint_t *CanvasRecorder::points() { return vPoints.data(); }
+
+	inline uint32_t CanvasRecorder::storeString(int32_t w, int32_t h, const Pixel *over0, const Pixel *over1, int32_t stride) {
+
+		size_t offset = vStringPixels.size();
+		vStringPixels.resize(offset + w * h);
+		vStringCoverage.resize(offset + w * h);
+
+		const uint32_t *src0 = reinterpret_cast<const uint32_t *>(over0);
+		const uint32_t *src1 = reinterpret_cast<const uint32_t *>(over1);
+
+		for (int32_t j = 0; j < h; j++) {
+			for (int32_t i = 0; i < w; i++) {
+				uint32_t a = src0[j * stride + i], b = src1[j * stride + i];
+				vStringCoverage[offset + j * w + i] = a != 0 || b != 0xFFFFFFFF;
+				vStringPixels[offset + j * w + i] = a != 0 ? a : b;
+			}
+		}
+
+		vStrings.push_back({w, h, offset});
+		return (uint32_t) vStrings.size() - 1;
+	}
+
+	inline const CanvasString_t &CanvasRecorder::string(uint32_t slot) { return vStrings[slot]; }
+
+	inline const uint32_t *CanvasRecorder::stringPixels() { return vStringPixels.data(); }
+
+	inline const uint8_t *CanvasRecorder::stringCoverage() { return vStringCoverage.data(); }
+
+	inline uint32_t CanvasRecorder::storeTransform(const SpriteTransform_t &transform) {
+		vTransforms.push_back(transform);
+		return (uint32_t) vTransforms.size() - 1;
+	}
+
+	inline const SpriteTransform_t &CanvasRecorder::transform(uint32_t slot) { return vTransforms[slot]; }
+
+	inline void CanvasRecorder::execute(int width, int height,
+										const std::function<void(const DirtyRect_t &, const std::vector<uint32_t> &,
+																 const std::vector<CanvasCommand_t> &)> &fn) {
+
+		int tilesX = (width + TILESIZE - 1) / TILESIZE, tilesY = (height + TILESIZE - 1) / TILESIZE;
+
+		vBins.resize(tilesX * tilesY);
+		for (std::vector<uint32_t> &bin:vBins) bin.clear();
+
+		for (uint32_t i = 0; i < vCommands.size(); i++) {
+			const CanvasCommand_t &cmd = vCommands[i];
+			if (cmd.op == CANVAS_LINE && cmd.c[0] != cmd.c[2] && cmd.c[1] != cmd.c[3])
+				binLine(i, cmd, width, height, tilesX);
+			else if (cmd.op == CANVAS_CIRCLE || cmd.op == CANVAS_FILLCIRCLE)
+				binCircle(i, cmd, tilesX);
+			else if (cmd.op == CANVAS_FILLTRIANGLE)
+				binTriangle(i, cmd, height, tilesX);
+			else
+				bin(i, cmd.box.x0, cmd.box.y0, cmd.box.x1, cmd.box.y1, tilesX);
+		}
+
+		vActiveTiles.clear();
+		for (int t = 0; t < tilesX * tilesY; t++)
+			if (!vBins[t].empty()) vActiveTiles.push_back(t);
+
+		parallel((int) vActiveTiles.size(), [&](int job) {
+			int t = vActiveTiles[job], tx = t % tilesX, ty = t / tilesX;
+			DirtyRect_t tile = {tx * TILESIZE, ty * TILESIZE,
+								std::min((tx + 1) * TILESIZE, width), std::min((ty + 1) * TILESIZE, height)};
+			fn(tile, vBins[t], vCommands);
+		});
+	}
+
+	inline void CanvasRecorder::bin(uint32_t index, int x0, int y0, int x1, int y1, int tilesX) {
+		int tilesY = (int) vBins.size() / tilesX;
+		x0 = std::max(x0, 0);
+		y0 = std::max(y0, 0);
+		x1 = std::min(x1, tilesX * TILESIZE);
+		y1 = std::min(y1, tilesY * TILESIZE);
+		if (x0 >= x1 || y0 >= y1) return;
+		for (int ty = y0 / TILESIZE; ty <= (y1 - 1) / TILESIZE; ty++)
+			for (int tx = x0 / TILESIZE; tx <= (x1 - 1) / TILESIZE; tx++)
+				vBins[ty * tilesX + tx].push_back(index);
+	}
+
+	inline void CanvasRecorder::binLine(uint32_t index, const CanvasCommand_t &cmd, int width, int height, int tilesX) {
+
+		// walk the major axis in tile bands, the line pixels stay within one pixel of the ideal line
+		bool xMajor = std::abs(cmd.c[2] - cmd.c[0]) >= std::abs(cmd.c[3] - cmd.c[1]);
+		int a0 = xMajor ? cmd.c[0] : cmd.c[1], b0 = xMajor ? cmd.c[1] : cmd.c[0];
+		int a1 = xMajor ? cmd.c[2] : cmd.c[3], b1 = xMajor ? cmd.c[3] : cmd.c[2];
+		if (a1 < a0) {
+			std::swap(a0, a1);
+			std::swap(b0, b1);
+		}
+
+		double slope = (double) (b1 - b0) / (a1 - a0);
+		int first = std::max(a0, 0), last = std::min(a1, (xMajor ? width : height) - 1);
+
+		for (int band = first - first % TILESIZE; band <= last; band += TILESIZE) {
+			int ba = std::max(band, first), bb = std::min(band + TILESIZE - 1, last);
+			double ea = b0 + (ba - a0) * slope, eb = b0 + (bb - a0) * slope;
+			int lo = (int) std::floor(std::min(ea, eb)) - 1, hi = (int) std::ceil(std::max(ea, eb)) + 2;
+			if (xMajor) bin(index, ba, lo, bb + 1, hi, tilesX);
+			else bin(index, lo, ba, hi, bb + 1, tilesX);
+		}
+	}
+
+	inline void CanvasRecorder::binCircle(uint32_t index, const CanvasCommand_t &cmd, int tilesX) {
+
+		int tilesY = (int) vBins.size() / tilesX;
+		int64_t cx = cmd.c[0], cy = cmd.c[1], r = cmd.c[2];
+		int64_t outer = (r + 1) * (r + 1), inner = r > 1 ? (r - 1) * (r - 1) : -1;
+
+		int tx0 = std::max(0, (int) (cx - r) / TILESIZE), tx1 = std::min(tilesX - 1, (int) (cx + r) / TILESIZE);
+		int ty0 = std::max(0, (int) (cy - r) / TILESIZE), ty1 = std::min(tilesY - 1, (int) (cy + r) / TILESIZE);
+
+		for (int ty = ty0; ty <= ty1; ty++) {
+			for (int tx = tx0; tx <= tx1; tx++) {
+				int64_t x0 = tx * TILESIZE, y0 = ty * TILESIZE, x1 = x0 + TILESIZE - 1, y1 = y0 + TILESIZE - 1;
+				// nearest and farthest tile points from the center
+				int64_t nx = std::max(x0 - cx, std::max((int64_t) 0, cx - x1)), ny = std::max(y0 - cy, std::max((int64_t) 0, cy - y1));
+				int64_t fx = std::max(std::abs(cx - x0), std::abs(cx - x1)), fy = std::max(std::abs(cy - y0), std::abs(cy - y1));
+				if (nx * nx + ny * ny > outer) continue;
+				if (cmd.op == CANVAS_CIRCLE && fx * fx + fy * fy < inner) continue;
+				vBins[ty * tilesX + tx].push_back(index);
+			}
+		}
+	}
+
+	inline void CanvasRecorder::binTriangle(uint32_t index, const CanvasCommand_t &cmd, int height, int tilesX) {
+
+		const int32_t *c = cmd.c;
+		int first = std::max(cmd.box.y0, 0), last = std::min(cmd.box.y1, height) - 1;
+
+		for (int band = first - first % TILESIZE; band <= last; band += TILESIZE) {
+			int ya = std::max(band, first), yb = std::min(band + TILESIZE - 1, last);
+			double xmin = 1e9, xmax = -1e9;
+			// x extent of every edge clipped to the band
+			for (int e = 0; e < 3; e++) {
+				double x0 = c[e * 2], y0 = c[e * 2 + 1], x1 = c[(e * 2 + 2) % 6], y1 = c[(e * 2 + 3) % 6];
+				if (y1 < y0) {
+					std::swap(x0, x1);
+					std::swap(y0, y1);
+				}
+				double ca = std::max(y0, (double) ya), cb = std::min(y1, (double) yb);
+				if (ca > cb) continue;
+				double xa = y1 == y0 ? x0 : x0 + (x1 - x0) * (ca - y0) / (y1 - y0);
+				double xb = y1 == y0 ? x1 : x0 + (x1 - x0) * (cb - y0) / (y1 - y0);
+				xmin = std::min(xmin, std::min(xa, xb));
+				xmax = std::max(xmax, std::max(xa, xb));
+			}
+			if (xmin <= xmax)
+				bin(index, (int) std::floor(xmin) - 1, ya, (int) std::ceil(xmax) + 2, yb + 1, tilesX);
+		}
+	}
+
+	inline void CanvasRecorder::reset() {
+		vCommands.clear();
+		vPoints.clear();
+		vStrings.clear();
+		vStringPixels.clear();
+		vStringCoverage.clear();
+		vTransforms.clear();
+	}
+
+	inline void CanvasRecorder::parallel(int count, const std::function<void(int)> &fn) {
+
+		if (pJobs == nullptr || count == 1) {
+			for (int i = 0; i < count; i++) fn(i);
+			return;
+		}
+
+		// a tile per job, they are few and uneven
+		pJobs->parallelFor(count, [&fn](int begin, int end) {
+			for (int i = begin; i < end; i++) fn(i);
+		}, 1);
+	}
+
+}
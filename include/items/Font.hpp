@@ -3,7 +3,9 @@
 //  A helper class to draw strings using a Font. Fonts are supplied as PNG files with a
 //  fixed grid.
 //
-//  Code to draw string originally from onelonecoder.com ´s Pixel Game Engine
+//  Code to draw string originally from onelonecoder.com ´s Pixel Game Engine. Glyphs are
+//  expanded once per scale (and color version) into a GlyphCache, so strings are drawn with
+//  span fills instead of sampling the font bitmap for every pixel.
 //
 //  Created by rodo on 17/01/2020.
 //  Copyright © 2020 rodo. All rights reserved.
@@ -11,6 +13,7 @@
 
 #pragma once
 #include "Drawable.hpp"
+#include "GlyphCache.hpp"
 #include <string_view>
 
 namespace Pix {
@@ -46,7 +49,15 @@ namespace Pix {
 	class Font {
 
 		Drawable *pFontSprite;
-		
+
+		GlyphCache mCache;
+
+		// whether a font bitmap pixel is part of a glyph
+		bool visible(int x, int y);
+
+		// expands a glyph at a scale from the font bitmap
+		void expand(int glyph, int version, uint32_t scale, Glyph_t &out);
+
 	public:
 
 		const FontInfo_t INFO;
@@ -60,8 +71,101 @@ namespace Pix {
 		
 		~Font();
 
+		/**
+		 * Draws a string. Monochrome fonts are drawn in the color, multicolor fonts use the
+		 * color version given by the color index (Colors::COLOR_1 is the first version).
+		 * @param target The drawable
+		 * @param x left
+		 * @param y top
+		 * @param text The text, may contain newlines
+		 * @param col Color or color index
+		 * @param scale Scale
+		 */
 		void
-		drawString(Drawable *target, int32_t x, int32_t y, const std::string &text, Pixel col,
+		drawString(Drawable *target, int32_t x, int32_t y, std::string_view text, Pixel col,
 				   uint32_t scale = 1);
+
+		/** Gets the glyph cache, ie. to tune its memory limit */
+		GlyphCache &cache();
 	};
+
+	inline GlyphCache &Font::cache() { return mCache; }
+
+	inline bool Font::visible(int x, int y) {
+		Pixel p = pFontSprite->getPixel(x, y);
+		// monochrome glyphs are lit pixels, multicolor ones any non-black opaque pixel
+		return INFO.multiColor ? p.a > 0 && (p.n & 0x00FFFFFF) != 0 : p.r > 0;
+	}
+
+	inline void Font::expand(int glyph, int version, uint32_t scale, Glyph_t &out) {
+
+		const int cw = INFO.charWidth, ch = INFO.charHeight;
+
+		// monochrome fonts are a grid, multicolor ones have each color version below the other
+		int cols = std::max(1, pFontSprite->width / cw);
+		int rowsPerVersion = std::max(1, pFontSprite->height / (ch * std::max(1, INFO.colorVersions)));
+		if (glyph / cols >= rowsPerVersion) return;
+
+		int ox = (glyph % cols) * cw, oy = (version * rowsPerVersion + glyph / cols) * ch;
+
+		for (int j = 0; j < ch; j++) {
+			for (int i = 0; i < cw;) {
+				while (i < cw && !visible(ox + i, oy + j)) i++;
+				int start = i;
+				while (i < cw && visible(ox + i, oy + j)) i++;
+				if (i == start) continue;
+
+				uint32_t offset = (uint32_t) out.pixels.size();
+				if (INFO.multiColor)
+					for (int k = start; k < i; k++)
+						out.pixels.insert(out.pixels.end(), scale, pFontSprite->getPixel(ox + k, oy + j).n);
+
+				for (uint32_t js = 0; js < scale; js++)
+					out.runs.push_back({(int32_t) (start * scale), (int32_t) (j * scale + js),
+										(int32_t) ((i - start) * scale), offset});
+			}
+		}
+	}
+
+	inline void Font::drawString(Drawable *target, int32_t x, int32_t y, std::string_view text, Pixel col,
+								 uint32_t scale) {
+
+		if (scale == 0 || pFontSprite == nullptr) return;
+
+		int version = INFO.multiColor && col.a > 0 && col.a <= INFO.colorVersions ? col.a - 1 : 0;
+		int32_t sx = 0, sy = 0;
+
+		for (char c:text) {
+
+			if (c == '\n') {
+				sx = 0;
+				sy += INFO.charHeight * scale;
+				continue;
+			}
+
+			int glyph = (uint8_t) c - INFO.firstChar;
+
+			if (glyph >= 0 && glyph < INFO.totalChars) {
+
+				uint64_t key = GlyphCache::key(glyph, scale, version);
+				const Glyph_t *cached = mCache.find(key);
+
+				if (cached == nullptr) {
+					Glyph_t expanded;
+					expand(glyph, version, scale, expanded);
+					cached = &mCache.insert(key, std::move(expanded));
+				}
+
+				if (cached->pixels.empty())
+					for (const GlyphRun_t &run:cached->runs)
+						target->fillSpan(x + sx + run.x, y + sy + run.y, run.len, col);
+				else
+					for (const GlyphRun_t &run:cached->runs)
+						target->copySpan(x + sx + run.x, y + sy + run.y,
+										 reinterpret_cast<const Pixel *>(cached->pixels.data() + run.offset), run.len);
+			}
+
+			sx += INFO.charWidth * scale;
+		}
+	}
 }
@@ -0,0 +1,162 @@
+//
+//  GlyphCache.hpp
+//  PixFu
+//
+//  Cache of pre-expanded glyphs used by Font::drawString. Every glyph is stored already
+//  scaled, as horizontal runs of visible pixels: monochrome glyphs are just the runs (the
+//  color is applied when filling them), multicolor glyphs also carry the run pixels so they
+//  are blitted with row copies. Least recently used glyphs are evicted past a memory limit.
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Pix {
+
+	/** A run of visible pixels of a glyph, relative to the glyph origin */
+	typedef struct sGlyphRun {
+		int32_t x, y, len;          // 32 bits: large scales overflow 16
+		uint32_t offset;            // first pixel in Glyph_t::pixels (multicolor only)
+	} GlyphRun_t;
+
+	/** An expanded glyph */
+	typedef struct sGlyph {
+		std::vector<GlyphRun_t> runs;
+		std::vector<uint32_t> pixels;   // empty for monochrome glyphs
+
+		inline size_t bytes() const {
+			return sizeof(sGlyph) + runs.size() * sizeof(GlyphRun_t) + pixels.size() * sizeof(uint32_t);
+		}
+	} Glyph_t;
+
+	class GlyphCache {
+
+		typedef std::list<std::pair<uint64_t, Glyph_t>> Entries_t;
+
+		Entries_t lEntries;                                             // most recent first
+		std::unordered_map<uint64_t, Entries_t::iterator> mIndex;
+
+		size_t nLimit;
+		size_t nBytes = 0;
+		uint32_t nHits = 0, nMisses = 0;
+
+		// evicts least recently used glyphs until under the limit (always keeps the newest)
+		void trim();
+
+	public:
+
+		/** Default memory limit, per font */
+		static constexpr size_t DEFAULTLIMIT = 512 * 1024;
+
+		GlyphCache(size_t limit = DEFAULTLIMIT);
+
+		/**
+		 * Builds a cache key
+		 * @param glyph glyph index in the font
+		 * @param scale Scale
+		 * @param version color version (multicolor fonts)
+		 */
+		static uint64_t key(uint32_t glyph, uint32_t scale, uint32_t version);
+
+		/**
+		 * Finds a glyph, marking it as recently used
+		 * @param key The key
+		 * @return the glyph or nullptr. Valid until the next insert.
+		 */
+		const Glyph_t *find(uint64_t key);
+
+		/**
+		 * Inserts a glyph
+		 * @param key The key
+		 * @param glyph The expanded glyph
+		 * @return The stored glyph. Valid until the next insert.
+		 */
+		const Glyph_t &insert(uint64_t key, Glyph_t &&glyph);
+
+		/** Sets the memory limit in bytes, evicting glyphs if needed */
+		void setLimit(size_t bytes);
+
+		/** Drops all glyphs */
+		void clear();
+
+		/** Memory used by the glyphs, in bytes */
+		size_t bytes() const;
+
+		/** Number of cached glyphs */
+		size_t size() const;
+
+		/** Lookups that found / did not find their glyph */
+		uint32_t hits() const;
+
+		uint32_t misses() const;
+
+	};
+
+	inline GlyphCache::GlyphCache(size_t limit) : nLimit(limit) {}
+
+	inline uint64_t GlyphCache::key(uint32_t glyph, uint32_t scale, uint32_t version) {
+		return (uint64_t) glyph | (uint64_t) version << 16 | (uint64_t) scale << 32;
+	}
+
+	inline const Glyph_t *GlyphCache::find(uint64_t key) {
+		auto it = mIndex.find(key);
+		if (it == mIndex.end()) {
+			nMisses++;
+			return nullptr;
+		}
+		nHits++;
+		if (it->second != lEntries.begin())
+			lEntries.splice(lEntries.begin(), lEntries, it->second);
+		return &it->second->second;
+	}
+
+	inline const Glyph_t &GlyphCache::insert(uint64_t key, Glyph_t &&glyph) {
+		auto it = mIndex.find(key);
+		if (it != mIndex.end()) {
+			nBytes -= it->second->second.bytes();
+			lEntries.erase(it->second);
+		}
+		lEntries.emplace_front(key, std::move(glyph));
+		mIndex[key] = lEntries.begin();
+		nBytes += lEntries.front().second.bytes();
+		trim();
+		return lEntries.front().second;
+	}
+
+	inline void GlyphCache::trim() {
+		while (nBytes > nLimit && lEntries.size() > 1) {
+			nBytes -= lEntries.back().second.bytes();
+			mIndex.erase(lEntries.back().first);
+			lEntries.pop_back();
+		}
+	}
+
+	inline void GlyphCache::setLimit(size_t bytes) {
+		nLimit = bytes;
+		trim();
+	}
+
+	inline void GlyphCache::clear() {
+		lEntries.clear();
+		mIndex.clear();
+		nBytes = 0;
+	}
+
+	inline size_t GlyphCache::bytes() const { return nBytes; }
+
+	inline size_t GlyphCache::size() const { return lEntries.size(); }
+
+	inline uint32_t GlyphCache::hits() const { return nHits; }
+
+	inline uint32_t GlyphCache::misses() const { return nMisses; }
+
+}
@@ -0,0 +1,394 @@
+//
+//  SpriteBlitter.hpp
+//  PixFu
+//
+//  CPU blitter for scaled, rotated and flipped sprites, used by Canvas2D::drawSprite. The
+//  destination is walked row by row: the span of every row that maps inside the sprite is
+//  solved exactly, then its pixels are sampled with 16.16 fixed-point UVs that advance by a
+//  constant step. Sampling goes in chunks (indexes first, then gathers), keying and blending
+//  then run on the chunk with the PixelOps kernels.
+//
+//  All the stepping is integer and starts at the sprite bounding box, so a row gives the very
+//  same pixels whatever part of it is clipped away (tiles in deferred mode).
+//
+//  Created by rodo on 18/10/2020.
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include "Drawable.hpp"
+#include "PixelOps.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+namespace Pix {
+
+	/** Sprite sampling */
+	typedef enum eSpriteFilter {
+		SPRITE_NEAREST,
+		SPRITE_BILINEAR
+	} SpriteFilter_t;
+
+	/** Sprite pixels that are not drawn */
+	typedef enum eSpriteKey {
+		SPRITE_KEY_NONE,
+		/** pixels whose RGB equals the key value */
+		SPRITE_KEY_CHROMA,
+		/** pixels whose alpha is below the key value */
+		SPRITE_KEY_ALPHA
+	} SpriteKey_t;
+
+	/** Placement of a sprite */
+	typedef struct sSpriteTransform {
+		float x, y;                 // destination of the pivot
+		float angle;                // radians, clockwise on screen
+		float scaleX, scaleY;       // negative values flip
+		float pivotX, pivotY;       // pivot in the sprite, 0..1 (0.5 = center)
+		SpriteFilter_t filter;
+		SpriteKey_t key;
+		uint32_t keyValue;          // key color (Pixel::n) or minimum alpha
+	} SpriteTransform_t;
+
+	/** Fixed-point walk of a transformed sprite, see SpriteBlitter::prepare */
+	typedef struct sSpriteWalk {
+		DirtyRect_t box;            // destination bounding box, x1,y1 exclusive
+		int64_t u, v;               // sprite coords at the center of the box top-left pixel, 16.16
+		int64_t du, dv;             // step per destination column
+		int64_t rowU, rowV;         // step per destination row
+	} SpriteWalk_t;
+
+	class SpriteBlitter {
+
+		// pixels sampled per chunk
+		static constexpr int CHUNK = 64;
+
+		// sprite range of one coordinate along a row: indexes i where 0 <= c + i * dc <= max
+		static bool solve(int64_t c, int64_t dc, int64_t max, int64_t &first, int64_t &last);
+
+		static void sampleNearest(uint32_t *out, int count, const uint32_t *src, int width, int32_t u, int32_t v,
+								  int32_t du, int32_t dv);
+
+		static void sampleBilinear(uint32_t *out, int count, const uint32_t *src, int width, int height,
+								   int32_t u, int32_t v, int32_t du, int32_t dv);
+
+		// writes a sampled chunk, skipping keyed pixels
+		static void write(uint32_t *dst, uint32_t *src, int count, const SpriteTransform_t &transform,
+						  BlendMode_t blend);
+
+	public:
+
+		/**
+		 * Builds a transform with the pivot at the sprite center and no keying
+		 * @param x destination x of the sprite center
+		 * @param y destination y of the sprite center
+		 * @param angle Rotation, radians
+		 * @param scale Scale
+		 * @param filter Sampling
+		 */
+		static SpriteTransform_t place(float x, float y, float angle = 0, float scale = 1,
+									   SpriteFilter_t filter = SPRITE_NEAREST);
+
+		/**
+		 * Computes the destination box and UV steps of a transformed sprite
+		 * @param sprite The sprite
+		 * @param transform Placement
+		 * @param walk Receives the walk
+		 * @return false if the sprite is empty or degenerate
+		 */
+		static bool prepare(Drawable *sprite, const SpriteTransform_t &transform, SpriteWalk_t &walk);
+
+		/**
+		 * Draws a destination row of a transformed sprite
+		 * @param target Target drawable
+		 * @param sprite The sprite
+		 * @param walk The walk from prepare()
+		 * @param transform Placement (filter and keying are used)
+		 * @param y Destination row, inside the walk box
+		 * @param x0 First column to draw (clip)
+		 * @param x1 Column after the last to draw (clip)
+		 * @param blend Blend mode
+		 */
+		static void drawRow(Drawable *target, Drawable *sprite, const SpriteWalk_t &walk,
+							const SpriteTransform_t &transform, int32_t y, int32_t x0, int32_t x1, BlendMode_t blend);
+
+		/**
+		 * Samples a destination row of a transformed sprite, for targets that are not RGBA
+		 * @param sprite The sprite
+		 * @param walk The walk from prepare()
+		 * @param filter Sampling
+		 * @param y Destination row
+		 * @param x0 First column (clip)
+		 * @param x1 Column after the last (clip)
+		 * @param emit called as emit(x, pixels, count) for every sampled chunk. Pixels can be modified.
+		 */
+		template<typename Emit>
+		static void sampleRow(Drawable *sprite, const SpriteWalk_t &walk, SpriteFilter_t filter, int32_t y,
+							  int32_t x0, int32_t x1, Emit emit);
+
+		/**
+		 * Makes keyed pixels transparent (0)
+		 * @param pixels Sampled pixels
+		 * @param count Number of pixels
+		 * @param transform Keying
+		 */
+		static void clearKeyed(uint32_t *pixels, int count, const SpriteTransform_t &transform);
+
+	};
+
+	inline SpriteTransform_t SpriteBlitter::place(float x, float y, float angle, float scale, SpriteFilter_t filter) {
+		return {x, y, angle, scale, scale, 0.5f, 0.5f, filter, SPRITE_KEY_NONE, 0};
+	}
+
+	inline bool SpriteBlitter::prepare(Drawable *sprite, const SpriteTransform_t &t, SpriteWalk_t &walk) {
+
+		if (sprite == nullptr || sprite->width <= 0 || sprite->height <= 0) return false;
+		if (std::fabs(t.scaleX) < 1e-6f || std::fabs(t.scaleY) < 1e-6f) return false;
+
+		// fixed-point stepping needs 16 bit texel coordinates
+		if (sprite->width > 32767 || sprite->height > 32767) return false;
+
+		float c = cosf(t.angle), s = sinf(t.angle);
+		float px = t.pivotX * sprite->width, py = t.pivotY * sprite->height;
+
+		// destination box from the transformed corners
+		float xmin = INFINITY, ymin = INFINITY, xmax = -INFINITY, ymax = -INFINITY;
+		for (int corner = 0; corner < 4; corner++) {
+			float sx = ((corner & 1) ? sprite->width - px : -px) * t.scaleX;
+			float sy = ((corner & 2) ? sprite->height - py : -py) * t.scaleY;
+			float dx = t.x + sx * c - sy * s, dy = t.y + sx * s + sy * c;
+			xmin = std::min(xmin, dx);
+			xmax = std::max(xmax, dx);
+			ymin = std::min(ymin, dy);
+			ymax = std::max(ymax, dy);
+		}
+
+		if (xmax - xmin > 1e6f || ymax - ymin > 1e6f) return false;
+
+		walk.box = {(int) std::floor(xmin), (int) std::floor(ymin), (int) std::ceil(xmax), (int) std::ceil(ymax)};
+
+		// inverse mapping at the center of the top-left pixel: u = R^-1 (d - pos) / scale + pivot
+		float dx = walk.box.x0 + 0.5f - t.x, dy = walk.box.y0 + 0.5f - t.y;
+		const double one = 65536.0;
+		walk.u = llround(((c * dx + s * dy) / t.scaleX + px) * one);
+		walk.v = llround(((c * dy - s * dx) / t.scaleY + py) * one);
+		walk.du = llround(c / t.scaleX * one);
+		walk.dv = llround(-s / t.scaleY * one);
+		walk.rowU = llround(s / t.scaleX * one);
+		walk.rowV = llround(c / t.scaleY * one);
+
+		return walk.box.x0 < walk.box.x1 && walk.box.y0 < walk.box.y1;
+	}
+
+	inline bool SpriteBlitter::solve(int64_t c, int64_t dc, int64_t max, int64_t &first, int64_t &last) {
+
+		auto floorDiv = [](int64_t a, int64_t b) { return a / b - ((a % b != 0) && ((a < 0) != (b < 0))); };
+		auto ceilDiv = [](int64_t a, int64_t b) { return a / b + ((a % b != 0) && ((a < 0) == (b < 0))); };
+
+		if (dc == 0) return c >= 0 && c <= max;
+
+		if (dc > 0) {
+			first = std::max(first, ceilDiv(-c, dc));
+			last = std::min(last, floorDiv(max - c, dc));
+		} else {
+			first = std::max(first, ceilDiv(max - c, dc));
+			last = std::min(last, floorDiv(-c, dc));
+		}
+
+		return first <= last;
+	}
+
+	template<typename Emit>
+	inline void SpriteBlitter::sampleRow(Drawable *sprite, const SpriteWalk_t &walk, SpriteFilter_t filter, int32_t y,
+										 int32_t x0, int32_t x1, Emit emit) {
+
+		x0 = std::max(x0, walk.box.x0);
+		x1 = std::min(x1, walk.box.x1);
+		if (x0 >= x1 || y < walk.box.y0 || y >= walk.box.y1) return;
+
+		// coords at the start of the row, then the columns that fall inside the sprite
+		int64_t u = walk.u + (y - walk.box.y0) * walk.rowU;
+		int64_t v = walk.v + (y - walk.box.y0) * walk.rowV;
+		int64_t first = x0 - walk.box.x0, last = x1 - 1 - walk.box.x0;
+
+		if (!solve(u, walk.du, ((int64_t) sprite->width << 16) - 1, first, last)) return;
+		if (!solve(v, walk.dv, ((int64_t) sprite->height << 16) - 1, first, last)) return;
+
+		// inside the sprite coords fit in 32 bits
+		int32_t su = (int32_t) (u + first * walk.du), sv = (int32_t) (v + first * walk.dv);
+		int32_t du = (int32_t) walk.du, dv = (int32_t) walk.dv;
+
+		const uint32_t *src = reinterpret_cast<const uint32_t *>(sprite->getData());
+		int32_t x = walk.box.x0 + (int32_t) first;
+		uint32_t buffer[CHUNK];
+
+		for (int64_t done = 0, count = last - first + 1; done < count; done += CHUNK) {
+			int n = (int) std::min((int64_t) CHUNK, count - done);
+			if (filter == SPRITE_BILINEAR)
+				sampleBilinear(buffer, n, src, sprite->width, sprite->height, su, sv, du, dv);
+			else
+				sampleNearest(buffer, n, src, sprite->width, su, sv, du, dv);
+			emit(x + (int32_t) done, buffer, n);
+			su += n * du;
+			sv += n * dv;
+		}
+	}
+
+	inline void SpriteBlitter::drawRow(Drawable *target, Drawable *sprite, const SpriteWalk_t &walk,
+									   const SpriteTransform_t &transform, int32_t y, int32_t x0, int32_t x1,
+									   BlendMode_t blend) {
+		uint32_t *row = reinterpret_cast<uint32_t *>(target->getData()) + y * target->width;
+		sampleRow(sprite, walk, transform.filter, y, x0, x1, [&](int32_t x, uint32_t *pixels, int count) {
+			write(row + x, pixels, count, transform, blend);
+		});
+	}
+
+	inline void SpriteBlitter::sampleNearest(uint32_t *out, int count, const uint32_t *src, int width,
+											 int32_t u, int32_t v, int32_t du, int32_t dv) {
+
+		int i = 0;
+
+#if defined(__AVX2__)
+		const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m256i stride = _mm256_set1_epi32(width);
+		__m256i uu = _mm256_add_epi32(_mm256_set1_epi32(u), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(du)));
+		__m256i vv = _mm256_add_epi32(_mm256_set1_epi32(v), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(dv)));
+		const __m256i stepU = _mm256_set1_epi32(8 * du), stepV = _mm256_set1_epi32(8 * dv);
+		for (; i + 8 <= count; i += 8) {
+			__m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srai_epi32(vv, 16), stride),
+											 _mm256_srai_epi32(uu, 16));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+								_mm256_i32gather_epi32(reinterpret_cast<const int *>(src), index, 4));
+			uu = _mm256_add_epi32(uu, stepU);
+			vv = _mm256_add_epi32(vv, stepV);
+		}
+#elif defined(__SSE2__)
+		// texel index as a 16 bit multiply-add: (u >> 16) * 1 + (v >> 16) * width
+		alignas(16) int32_t index[4];
+		const __m128i weights = _mm_set1_epi32(width << 16 | 1);
+		__m128i uu = _mm_add_epi32(_mm_set1_epi32(u), _mm_setr_epi32(0, du, 2 * du, 3 * du));
+		__m128i vv = _mm_add_epi32(_mm_set1_epi32(v), _mm_setr_epi32(0, dv, 2 * dv, 3 * dv));
+		const __m128i stepU = _mm_set1_epi32(4 * du), stepV = _mm_set1_epi32(4 * dv);
+		for (; i + 4 <= count; i += 4) {
+			__m128i texel = _mm_or_si128(_mm_srli_epi32(uu, 16), _mm_and_si128(vv, _mm_set1_epi32((int) 0xFFFF0000)));
+			_mm_store_si128(reinterpret_cast<__m128i *>(index), _mm_madd_epi16(texel, weights));
+			out[i] = src[index[0]];
+			out[i + 1] = src[index[1]];
+			out[i + 2] = src[index[2]];
+			out[i + 3] = src[index[3]];
+			uu = _mm_add_epi32(uu, stepU);
+			vv = _mm_add_epi32(vv, stepV);
+		}
+#endif
+
+		// tail (or everything without SIMD)
+		for (u += i * du, v += i * dv; i < count; i++, u += du, v += dv)
+			out[i] = src[(v >> 16) * width + (u >> 16)];
+	}
+
+	inline void SpriteBlitter::sampleBilinear(uint32_t *out, int count, const uint32_t *src, int width, int height,
+											  int32_t u, int32_t v, int32_t du, int32_t dv) {
+
+		// texel centers are at +0.5, neighbours clamp at the borders. 7 bit weights.
+		for (int i = 0; i < count; i++, u += du, v += dv) {
+
+			int32_t su = u - 32768, sv = v - 32768;
+			int x0 = su >> 16, y0 = sv >> 16;
+			int x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+			x0 = std::max(x0, 0);
+			y0 = std::max(y0, 0);
+			x1 = std::max(x1, 0);
+			y1 = std::max(y1, 0);
+			int fx = su < 0 ? 0 : (su >> 9) & 127, fy = sv < 0 ? 0 : (sv >> 9) & 127;
+
+			uint32_t p00 = src[y0 * width + x0], p10 = src[y0 * width + x1];
+			uint32_t p01 = src[y1 * width + x0], p11 = src[y1 * width + x1];
+
+#if defined(__SSE2__)
+			const __m128i zero = _mm_setzero_si128();
+			// 16 bit lanes: left column (top, bottom) and right column
+			__m128i l = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128((int) p00), _mm_cvtsi32_si128((int) p01)), zero);
+			__m128i r = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128((int) p10), _mm_cvtsi32_si128((int) p11)), zero);
+			__m128i h = _mm_add_epi16(l, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(r, l), _mm_set1_epi16((short) fx)), 7));
+			__m128i b = _mm_srli_si128(h, 8);
+			__m128i p = _mm_add_epi16(h, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(b, h), _mm_set1_epi16((short) fy)), 7));
+			out[i] = (uint32_t) _mm_cvtsi128_si32(_mm_packus_epi16(p, zero));
+#else
+			uint32_t pixel = 0;
+			for (int shift = 0; shift < 32; shift += 8) {
+				int c00 = (p00 >> shift) & 0xFF, c10 = (p10 >> shift) & 0xFF;
+				int c01 = (p01 >> shift) & 0xFF, c11 = (p11 >> shift) & 0xFF;
+				int top = c00 + (((c10 - c00) * fx) >> 7), bottom = c01 + (((c11 - c01) * fx) >> 7);
+				pixel |= (uint32_t) (top + (((bottom - top) * fy) >> 7)) << shift;
+			}
+			out[i] = pixel;
+#endif
+		}
+	}
+
+	inline void SpriteBlitter::write(uint32_t *dst, uint32_t *src, int count, const SpriteTransform_t &t,
+									 BlendMode_t blend) {
+
+		if (t.key == SPRITE_KEY_NONE) {
+			if (blend == BLEND_NORMAL) PixelOps::copy(dst, src, count);
+			else PixelOps::blendCopy(dst, src, count, blend);
+			return;
+		}
+
+		// blended: keyed pixels become transparent
+		if (blend != BLEND_NORMAL) {
+			clearKeyed(src, count, t);
+			PixelOps::blendCopy(dst, src, count, blend);
+			return;
+		}
+
+		// normal: keyed pixels keep the destination
+		bool chroma = t.key == SPRITE_KEY_CHROMA;
+		uint32_t key = chroma ? t.keyValue & 0xFFFFFF : t.keyValue;
+		int i = 0;
+
+#if defined(__SSE2__)
+		const __m128i rgb = _mm_set1_epi32(0xFFFFFF), k = _mm_set1_epi32((int) key);
+		for (; i + 4 <= count; i += 4) {
+			__m128i s = _mm_loadu_si128(reinterpret_cast<__m128i *>(src + i));
+			__m128i keyed = chroma ? _mm_cmpeq_epi32(_mm_and_si128(s, rgb), k)
+								   : _mm_cmplt_epi32(_mm_srli_epi32(s, 24), k);
+			__m128i *p = reinterpret_cast<__m128i *>(dst + i);
+			__m128i d = _mm_loadu_si128(p);
+			_mm_storeu_si128(p, _mm_or_si128(_mm_and_si128(keyed, d), _mm_andnot_si128(keyed, s)));
+		}
+#endif
+
+		for (; i < count; i++) {
+			bool keyed = chroma ? (src[i] & 0xFFFFFF) == key : (src[i] >> 24) < key;
+			if (!keyed) dst[i] = src[i];
+		}
+	}
+
+	inline void SpriteBlitter::clearKeyed(uint32_t *pixels, int count, const SpriteTransform_t &t) {
+
+		if (t.key == SPRITE_KEY_NONE) return;
+
+		bool chroma = t.key == SPRITE_KEY_CHROMA;
+		uint32_t key = chroma ? t.keyValue & 0xFFFFFF : t.keyValue;
+		int i = 0;
+
+#if defined(__SSE2__)
+		const __m128i rgb = _mm_set1_epi32(0xFFFFFF), k = _mm_set1_epi32((int) key);
+		for (; i + 4 <= count; i += 4) {
+			__m128i *p = reinterpret_cast<__m128i *>(pixels + i);
+			__m128i s = _mm_loadu_si128(p);
+			__m128i keyed = chroma ? _mm_cmpeq_epi32(_mm_and_si128(s, rgb), k)
+								   : _mm_cmplt_epi32(_mm_srli_epi32(s, 24), k);
+			_mm_storeu_si128(p, _mm_andnot_si128(keyed, s));
+		}
+#endif
+
+		for (; i < count; i++) {
+			bool keyed = chroma ? (pixels[i] & 0xFFFFFF) == key : (pixels[i] >> 24) < key;
+			if (keyed) pixels[i] = 0;
+		}
+	}
+
+}
@@ -4,26 +4,45 @@ cd ${SRCROOT}
 DEST=include
 
 if [[ -d $DEST ]]; then
-	rm -rf $DEST
-	mkdir $DEST $DEST/core $DEST/ext $DEST/input $DEST/support $DEST/items $DEST/glm
-	mkdir $DEST/ext/world $DEST/ext/sprites $DEST/arch $DEST/arch/apple
 
-	cp -v scripts/data/*.hpp $DEST/
+	if [[ ! -d modules/PixFu/src || ! -d modules/PixFu_Extensions/world ]]; then
+		echo "Module sources not found, run git submodule update --init"
+		exit 1
+	fi
+
+	# headers are gathered aside first, include/ is only replaced if nothing would be lost
+	NEW=$(mktemp -d)
+	trap "rm -rf $NEW" EXIT
+
+	mkdir $NEW/core $NEW/ext $NEW/input $NEW/support $NEW/items $NEW/glm
+	mkdir $NEW/ext/world $NEW/ext/sprites $NEW/arch $NEW/arch/apple $NEW/arch/linux
+
+	cp -v scripts/data/*.hpp $NEW/
 
-	cp -v modules/PixFu/src/arch/apple/*.hpp $DEST/arch/apple/
-	cp -v modules/PixFu/src/arch/apple/*.h $DEST/arch/apple/
-	cp -v modules/PixFu/src/core/headers/* $DEST/core/
-	cp -v modules/PixFu/src/input/headers/* $DEST/input/
-	cp -v modules/PixFu/src/support/headers/* $DEST/support/
-	cp -v modules/PixFu/src/items/headers/* $DEST/items/
-	cp -r modules/PixFu/src/thirdparty/glm/* $DEST/glm/
+	cp -v modules/PixFu/src/arch/apple/*.hpp $NEW/arch/apple/
+	cp -v modules/PixFu/src/arch/apple/*.h $NEW/arch/apple/
+	cp -v modules/PixFu/src/arch/linux/*.hpp $NEW/arch/linux/
+	cp -v modules/PixFu/src/core/headers/* $NEW/core/
+	cp -v modules/PixFu/src/input/headers/* $NEW/input/
+	cp -v modules/PixFu/src/support/headers/* $NEW/support/
+	cp -v modules/PixFu/src/items/headers/* $NEW/items/
+	cp -r modules/PixFu/src/thirdparty/glm/* $NEW/glm/
 
-	cp -v modules/PixFu_Extensions/world/* $DEST/ext/world/
-	cp -v modules/PixFu_Extensions/world/geom/* $DEST/ext/world/
-	cp -v modules/PixFu_Extensions/world/core/headers/* $DEST/ext/world/
-	cp -v modules/PixFu_Extensions/world/worlds/ballworld/headers/* $DEST/ext/world/
+	cp -v modules/PixFu_Extensions/world/* $NEW/ext/world/
+	cp -v modules/PixFu_Extensions/world/geom/* $NEW/ext/world/
+	cp -v modules/PixFu_Extensions/world/core/headers/* $NEW/ext/world/
+	cp -v modules/PixFu_Extensions/world/worlds/ballworld/headers/* $NEW/ext/world/
 
-	cp -v modules/PixFu_Extensions/sprites/headers/* $DEST/ext/sprites/
+	cp -v modules/PixFu_Extensions/sprites/headers/* $NEW/ext/sprites/
+
+	# headers changed or added in include/ but not landed in the modules would be lost
+	if [[ -z "$FORCE" ]] && ! diff -rq $NEW $DEST; then
+		echo "include/ differs from the modules (see above), land the changes there or set FORCE=1"
+		exit 1
+	fi
+
+	rm -rf $DEST
+	mv $NEW $DEST
 else
 	exit 1
 fi
@@ -65,12 +65,24 @@ class Demo3dWorld:public Pix::World {
 	
 	public:
 	
-		Demo3dWorld() : World(WORLDCONFIG) {
+		Demo3dWorld() : World(WORLDCONFIG) {}
 
-			// Add our terrain. Not neccessary to get a pointer to it, but in this
-			// case we want to access some properties from the terrain (the size)
+		bool init(Pix::Fu *engine) override {
 
-			Pix::Terrain *t = add(TERRAINCONFIG);
+			// Load our terrain and objects in the background: models and textures are decoded
+			// on all cores and uploaded a few every frame, so the engine keeps running and we
+			// can show a loading screen (see Demo3d::onUserUpdate)
+
+			// assets are uploaded in order, so the trees will be ready when the terrain is
+			preload(engine, "tree");
+
+			// once the terrain is in the world, we want to access some properties from it (the size)
+			preload(engine, TERRAINCONFIG, [this](Pix::Terrain *t) { plantTrees(t); });
+
+			return World::init(engine);
+		}
+
+		void plantTrees(Pix::Terrain *t) {
 
 			int w = t->xPixels() , h = t->zPixels();
 
@@ -145,7 +157,15 @@ class Demo3d : public Pix::Fu {
 	}
 	
 	bool onUserUpdate(float fElapsedTime) override {
-				
+
+		// loading screen while the world assets arrive
+		if (!assets()->done()) {
+			canvas()->blank();
+			canvas()->drawString(0,10,Pix::SFF("LOADING %d%%", (int) (assets()->progress() * 100)),
+								 Pix::Colors::COLOR_3, 3);
+			return true;
+		}
+
 		mWorld->canvas()->drawString(100,100,"RODOLFO LOPEZ PINTOR", Pix::Colors::PINK, 6);
 
 		// Select mode with ALT/CMD
@@ -169,7 +189,7 @@ class Demo3d : public Pix::Fu {
 		
 		canvas()->blank();	// fast clear (memset)
 
-		canvas()->drawString(0,10,Pix::SF("CAM x %f y %f z %f",
+		canvas()->drawString(0,10,Pix::SFF("CAM x %f y %f z %f",
 										  mWorld->camera()->getPosition().x,
 										  mWorld->camera()->getPosition().y,
 										  mWorld->camera()->getPosition().z),
@@ -227,12 +227,12 @@ class Demo3dBalls : public Pix::Fu {
 		
 		canvas()->blank();	// fast clear (memset)
 
-		canvas()->drawString(0,10,Pix::SF("CAM X %f Y %f Z %f",
+		canvas()->drawString(0,10,Pix::SFF("CAM X %f Y %f Z %f",
 										  mWorld->camera()->getPosition().x,
 										  mWorld->camera()->getPosition().y,
 										  mWorld->camera()->getPosition().z),
 							 Pix::Colors::COLOR_3, 3);
-		canvas()->drawString(0,40,Pix::SF("    p %f y %f r %f",
+		canvas()->drawString(0,40,Pix::SFF("    p %f y %f r %f",
 										  mWorld->camera()->getPitch(),
 										  mWorld->camera()->getYaw(),
 										  mWorld->camera()->getRoll()),
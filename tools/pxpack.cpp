@@ -0,0 +1,196 @@
+/**
+ *  pxpack.cpp
+ *  PixFu engine
+ *
+ *  @author Rodolfo Lopez Pintor
+ *  @copyright  © 2020 Nebular Streams. All rights reserved.
+ *
+ *  Asset packer. Writes every file under an assets folder to a single pack (see
+ *  AssetSource.hpp) that the engine maps at startup: FuPlatform::setPath mounts
+ *  <assets folder>.pxpk, so shipping it next to (or instead of) the folder is enough.
+ *
+ *  --lz4           compresses the entries that get smaller, but texture caches (.pxtc), that
+ *                  are mapped straight from the pack file. Needs PIXFU_LZ4 and liblz4, also in the engine.
+ *  --align n       entry alignment, a power of two (default 64)
+ *  --skip-sources  leaves out images that have a texture cache (run texcache first)
+ *
+ *  Build (from the repo root):
+ *
+ *    g++ -std=c++17 -O2 -Iinclude/core -Iinclude/support -Iinclude/arch/linux \
+ *        tools/pxpack.cpp <pixfu sources> -o pxpack
+ *    (add -DPIXFU_LZ4 ... -llz4 for --lz4)
+ *
+ *  Usage: pxpack [--lz4] [--align n] [--skip-sources] <assets folder> [output.pxpk]
+ *
+ */
+
+#include "AssetSource.hpp"
+#include "TextureCache.hpp"
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifdef PIXFU_LZ4
+#include <lz4hc.h>
+#endif
+
+using namespace Pix;
+
+static bool endsWith(const std::string &s, const std::string &suffix) {
+	return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// files under a folder, relative to the root
+static void scan(const std::string &root, const std::string &folder, std::vector<std::string> &files) {
+	DIR *dir = opendir((root + "/" + folder).c_str());
+	if (dir == nullptr) return;
+	while (dirent *entry = readdir(dir)) {
+		// hidden files (.DS_Store), temporaries, other packs
+		if (entry->d_name[0] == '.' || endsWith(entry->d_name, ".tmp")
+			|| endsWith(entry->d_name, AssetSource::EXTENSION))
+			continue;
+		std::string name = folder.empty() ? entry->d_name : folder + "/" + entry->d_name;
+		struct stat st;
+		if (stat((root + "/" + name).c_str(), &st) != 0) continue;
+		if (S_ISDIR(st.st_mode)) scan(root, name, files);
+		else if (S_ISREG(st.st_mode)) files.push_back(name);
+	}
+	closedir(dir);
+}
+
+static bool pad(FILE *file, uint32_t alignment) {
+	static const char zeros[4096] = {};
+	long position = ftell(file);
+	size_t padding = (alignment - position % alignment) % alignment;
+	return position >= 0 && fwrite(zeros, 1, padding, file) == padding;
+}
+
+int main(int argc, const char *argv[]) {
+
+	bool lz4 = false, skipSources = false;
+	uint32_t alignment = AssetSource::ALIGNMENT;
+	std::vector<std::string> paths;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--lz4") == 0) lz4 = true;
+		else if (strcmp(argv[i], "--skip-sources") == 0) skipSources = true;
+		else if (strcmp(argv[i], "--align") == 0 && i + 1 < argc) alignment = (uint32_t) atoi(argv[++i]);
+		else paths.emplace_back(argv[i]);
+	}
+
+	if (paths.empty() || alignment == 0 || alignment > 4096 || (alignment & (alignment - 1)) != 0) {
+		printf("usage: %s [--lz4] [--align n] [--skip-sources] <assets folder> [output%s]\n", argv[0],
+			   AssetSource::EXTENSION.c_str());
+		return 1;
+	}
+
+#ifndef PIXFU_LZ4
+	if (lz4) {
+		fprintf(stderr, "built without PIXFU_LZ4, --lz4 not available\n");
+		return 1;
+	}
+#endif
+
+	std::string root = paths[0];
+	while (root.size() > 1 && root.back() == '/') root.pop_back();
+	std::string output = paths.size() > 1 ? paths[1] : root + AssetSource::EXTENSION;
+
+	std::vector<std::string> files;
+	scan(root, "", files);
+
+	if (skipSources) {
+		std::set<std::string> all(files.begin(), files.end());
+		files.erase(std::remove_if(files.begin(), files.end(), [&all](const std::string &name) {
+			return all.count(name + TextureCache::EXTENSION) > 0;
+		}), files.end());
+	}
+
+	// the directory is binary searched
+	std::sort(files.begin(), files.end());
+
+	std::string names;
+	std::vector<AssetPackEntry_t> entries(files.size());
+	for (size_t i = 0; i < files.size(); i++) {
+		entries[i].name = (uint32_t) names.size();
+		entries[i].nameLength = (uint32_t) files[i].size();
+		names += files[i];
+	}
+
+	AssetPackHeader_t header = {{'P', 'X', 'P', 'K'}, AssetSource::VERSION, (uint32_t) files.size(), alignment,
+								sizeof(AssetPackHeader_t) + files.size() * sizeof(AssetPackEntry_t), names.size()};
+
+	// write to a temporary and rename, so a mounted pack is never seen half written
+	std::string temp = output + ".tmp";
+	FILE *file = fopen(temp.c_str(), "wb");
+	if (file == nullptr) {
+		fprintf(stderr, "cannot write %s\n", temp.c_str());
+		return 1;
+	}
+
+	// header and directory are written again at the end, with the data offsets
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+			  && fwrite(entries.data(), sizeof(AssetPackEntry_t), entries.size(), file) == entries.size()
+			  && fwrite(names.data(), 1, names.size(), file) == names.size();
+
+	uint64_t total = 0, stored = 0;
+	int compressed = 0;
+
+	for (size_t i = 0; ok && i < files.size(); i++) {
+
+		AssetData data = AssetSource::open(root + "/" + files[i]);
+		if (!data) {
+			fprintf(stderr, "  %s: cannot read\n", files[i].c_str());
+			ok = false;
+			break;
+		}
+
+		const uint8_t *bytes = data.data();
+		AssetPackEntry_t &entry = entries[i];
+		entry.size = entry.stored = data.size();
+
+#ifdef PIXFU_LZ4
+		std::vector<char> packed;
+		if (lz4 && data.size() > 0 && data.size() < (size_t) LZ4_MAX_INPUT_SIZE
+			&& !endsWith(files[i], TextureCache::EXTENSION)) {
+			packed.resize(LZ4_compressBound((int) data.size()));
+			int size = LZ4_compress_HC(reinterpret_cast<const char *>(bytes), packed.data(), (int) data.size(),
+									   (int) packed.size(), LZ4HC_CLEVEL_MAX);
+			if (size > 0 && (size_t) size < data.size()) {
+				bytes = reinterpret_cast<const uint8_t *>(packed.data());
+				entry.stored = size;
+				entry.flags |= ASSETPACK_LZ4;
+				compressed++;
+			}
+		}
+#endif
+
+		ok = pad(file, alignment);
+		entry.offset = (uint64_t) ftell(file);
+		ok = ok && fwrite(bytes, 1, entry.stored, file) == entry.stored;
+
+		total += entry.size;
+		stored += entry.stored;
+	}
+
+	ok = ok && fseek(file, sizeof(header), SEEK_SET) == 0
+		 && fwrite(entries.data(), sizeof(AssetPackEntry_t), entries.size(), file) == entries.size();
+
+	ok = fclose(file) == 0 && ok;
+	if (ok) ok = rename(temp.c_str(), output.c_str()) == 0;
+	if (!ok) {
+		fprintf(stderr, "cannot write %s\n", output.c_str());
+		remove(temp.c_str());
+		return 1;
+	}
+
+	printf("%s: %d assets, %llu bytes, %llu stored, %d compressed\n", output.c_str(), (int) files.size(),
+		   (unsigned long long) total, (unsigned long long) stored, compressed);
+	return 0;
+}
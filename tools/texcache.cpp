@@ -0,0 +1,49 @@
+/**
+ *  texcache.cpp
+ *  PixFu engine
+ *
+ *  @author Rodolfo Lopez Pintor
+ *  @copyright  © 2020 Nebular Streams. All rights reserved.
+ *
+ *  Offline texture cache converter. Decodes images and writes their TextureCache files
+ *  (source name + ".pxtc") next to them, so the first run of the game does not decode them.
+ *  Images with an up to date cache file are skipped.
+ *
+ *  Build (from the repo root, with the PixFu sources compiled in):
+ *
+ *    g++ -std=c++17 -O2 -Iinclude/core -Iinclude/support -Iinclude/arch/linux \
+ *        tools/texcache.cpp <pixfu sources> -o texcache
+ *
+ *  Usage: texcache [--mips] [--force] image.png ...
+ *
+ */
+
+#include "TextureCache.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace Pix;
+
+int main(int argc, const char *argv[]) {
+
+	bool mipmaps = false, force = false;
+	int converted = 0, skipped = 0, failed = 0;
+
+	for (int i = 1; i < argc; i++) {
+
+		if (strcmp(argv[i], "--mips") == 0) mipmaps = true;
+		else if (strcmp(argv[i], "--force") == 0) force = true;
+		else if (!force && TextureCache::isValid(argv[i], mipmaps)) skipped++;
+		else if (TextureCache::convert(argv[i], mipmaps)) {
+			printf("  %s\n", argv[i]);
+			converted++;
+		} else {
+			fprintf(stderr, "  %s: cannot convert\n", argv[i]);
+			failed++;
+		}
+	}
+
+	printf("%d converted, %d up to date, %d failed\n", converted, skipped, failed);
+	return failed ? 1 : 0;
+}